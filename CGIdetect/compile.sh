@@ -0,0 +1 @@
+g++ -g -O3 -std=c++17 -pthread main.cpp cpg_detector.cpp fasta_file.cpp -oCGIdetect
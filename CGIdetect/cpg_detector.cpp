@@ -0,0 +1,294 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       multithreaded CpG island detection
+ *
+ *************************************************/
+
+#include "cpg_detector.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// per base class bits
+const uint8_t base_c   = 1;
+const uint8_t base_g   = 2;
+const uint8_t base_cpg = 4;     // this C is followed by a G
+
+struct Counts
+{
+    Counts() : c(0), g(0), cpg(0) {}
+    unsigned long c, g, cpg;
+};
+
+// run of marked bases, half open
+struct Run
+{
+    size_t begin, end;
+};
+
+// classify [begin, end) of seq into cls.  seq must be readable at end, the
+// terminating NUL of std::string is enough.
+void classify(const char * seq, size_t begin, size_t end, uint8_t * cls)
+{
+    size_t i = begin;
+
+#ifdef __SSE2__
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i c     = _mm_set1_epi8('c');
+    const __m128i g     = _mm_set1_epi8('g');
+    const __m128i bit_c = _mm_set1_epi8(base_c);
+    const __m128i bit_g = _mm_set1_epi8(base_g);
+    const __m128i bit_p = _mm_set1_epi8(base_cpg);
+
+    for (; i + 16 <= end; i += 16)
+    {
+        __m128i here = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(seq + i)), lower);
+        __m128i next = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(seq + i + 1)), lower);
+        __m128i is_c = _mm_cmpeq_epi8(here, c);
+        __m128i is_g = _mm_cmpeq_epi8(here, g);
+        __m128i cpg  = _mm_and_si128(is_c, _mm_cmpeq_epi8(next, g));
+
+        __m128i bits = _mm_or_si128(_mm_and_si128(is_c, bit_c),
+                       _mm_or_si128(_mm_and_si128(is_g, bit_g), _mm_and_si128(cpg, bit_p)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(cls + i), bits);
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        char here = seq[i] | 0x20;
+        char next = seq[i + 1] | 0x20;
+
+        cls[i] = (here == 'c' ? base_c : 0) | (here == 'g' ? base_g : 0) |
+                 (here == 'c' && next == 'g' ? base_cpg : 0);
+    }
+}
+
+// count each class over cls[begin, end)
+Counts count_classes(const uint8_t * cls, size_t begin, size_t end)
+{
+    Counts counts;
+    size_t i = begin;
+
+#ifdef __SSE2__
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i bit_c = _mm_set1_epi8(base_c);
+    const __m128i bit_g = _mm_set1_epi8(base_g);
+    const __m128i bit_p = _mm_set1_epi8(base_cpg);
+
+    while (i + 16 <= end)
+    {
+        // byte lanes count up to 255 before they have to be flushed
+        __m128i acc_c = zero, acc_g = zero, acc_p = zero;
+        size_t  blocks = std::min<size_t>((end - i) / 16, 255);
+
+        for (size_t b = 0; b < blocks; b++, i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cls + i));
+            acc_c = _mm_sub_epi8(acc_c, _mm_cmpeq_epi8(_mm_and_si128(v, bit_c), bit_c));
+            acc_g = _mm_sub_epi8(acc_g, _mm_cmpeq_epi8(_mm_and_si128(v, bit_g), bit_g));
+            acc_p = _mm_sub_epi8(acc_p, _mm_cmpeq_epi8(_mm_and_si128(v, bit_p), bit_p));
+        }
+
+        __m128i sum_c = _mm_sad_epu8(acc_c, zero);
+        __m128i sum_g = _mm_sad_epu8(acc_g, zero);
+        __m128i sum_p = _mm_sad_epu8(acc_p, zero);
+        counts.c   += _mm_cvtsi128_si32(sum_c) + _mm_cvtsi128_si32(_mm_srli_si128(sum_c, 8));
+        counts.g   += _mm_cvtsi128_si32(sum_g) + _mm_cvtsi128_si32(_mm_srli_si128(sum_g, 8));
+        counts.cpg += _mm_cvtsi128_si32(sum_p) + _mm_cvtsi128_si32(_mm_srli_si128(sum_p, 8));
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        counts.c   += cls[i] & base_c ? 1 : 0;
+        counts.g   += cls[i] & base_g ? 1 : 0;
+        counts.cpg += cls[i] & base_cpg ? 1 : 0;
+    }
+    return counts;
+}
+
+// run fn(0 .. num_tasks - 1) on up to threads threads
+template <typename F>
+void parallel_for(size_t num_tasks, unsigned threads, F fn)
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+
+    auto worker = [&]()
+    {
+        size_t task;
+        while ((task = next++) < num_tasks)
+            fn(task);
+    };
+
+    threads = std::max(1u, std::min<unsigned>(threads, num_tasks));
+    for (unsigned t = 1; t < threads; t++)
+        pool.push_back(std::thread(worker));
+    worker();
+    for (size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+}
+
+void add_marked(std::vector<Run> & runs, size_t begin, size_t end)
+{
+    if (!runs.empty() && runs.back().end >= begin)
+        runs.back().end = std::max(runs.back().end, end);
+    else
+        runs.push_back(Run{ begin, end });
+}
+
+} // namespace
+
+CpGDetector::CpGDetector(const CpGParameters & parameters, unsigned threads, size_t chunk_size)
+    : parameters_(parameters), threads_(threads), chunk_size_(chunk_size)
+{
+    if (parameters_.shift == 0)
+        parameters_.shift = 1;
+    // chunks hold whole shifts so every chunk sees the same window grid
+    chunk_size_ = std::max<size_t>(chunk_size_ / parameters_.shift, 1) * parameters_.shift;
+}
+
+std::vector<std::vector<CpGIsland> > CpGDetector::detect(const std::vector<FastaRecord> & records) const
+{
+    struct Chunk
+    {
+        size_t record;
+        size_t begin, end;          // window starts / bases covered
+        std::vector<Run> runs;
+    };
+
+    const unsigned window = parameters_.window;
+    const unsigned shift  = parameters_.shift;
+    const size_t   centre = window / 2;
+
+    std::vector<std::vector<uint8_t> > classes(records.size());
+    std::vector<Chunk> chunks;
+
+    for (size_t r = 0; r < records.size(); r++)
+    {
+        classes[r].resize(records[r].sequence.size());
+        for (size_t begin = 0; begin < records[r].sequence.size(); begin += chunk_size_)
+        {
+            Chunk chunk;
+            chunk.record = r;
+            chunk.begin  = begin;
+            chunk.end    = std::min(begin + chunk_size_, records[r].sequence.size());
+            chunks.push_back(chunk);
+        }
+    }
+
+    // windows read past the end of their chunk, so classify everything first
+    parallel_for(chunks.size(), threads_, [&](size_t k)
+    {
+        const Chunk & chunk = chunks[k];
+        classify(records[chunk.record].sequence.c_str(), chunk.begin, chunk.end, &classes[chunk.record][0]);
+    });
+
+    parallel_for(chunks.size(), threads_, [&](size_t k)
+    {
+        Chunk &         chunk = chunks[k];
+        const uint8_t * cls   = &classes[chunk.record][0];
+        size_t          n     = classes[chunk.record].size();
+
+        if (n < window)
+            return;
+
+        size_t last_start = std::min(chunk.end, n - window + 1);
+        Counts counts;
+
+        for (size_t i = chunk.begin; i < last_start; i += shift)
+        {
+            if (i == chunk.begin)
+            {
+                Counts bases = count_classes(cls, i, i + window);
+                counts.c   = bases.c;
+                counts.g   = bases.g;
+                counts.cpg = count_classes(cls, i, i + window - 1).cpg;
+            }
+            else if (shift == 1)
+            {
+                // slide one base: drop the base leaving, add the base entering
+                uint8_t out  = cls[i - 1];
+                uint8_t in   = cls[i + window - 1];
+                uint8_t in_p = cls[i + window - 2];
+
+                counts.c   = counts.c + (in & base_c) - (out & base_c);
+                counts.g   = counts.g + ((in & base_g) >> 1) - ((out & base_g) >> 1);
+                counts.cpg = counts.cpg + ((in_p & base_cpg) >> 2) - ((out & base_cpg) >> 2);
+            }
+            else
+            {
+                Counts out  = count_classes(cls, i - shift, i);
+                Counts in   = count_classes(cls, i + window - shift, i + window);
+                Counts in_p = count_classes(cls, i + window - 1 - shift, i + window - 1);
+
+                counts.c   = counts.c + in.c - out.c;
+                counts.g   = counts.g + in.g - out.g;
+                counts.cpg = counts.cpg + in_p.cpg - out.cpg;
+            }
+
+            double expected   = (double)counts.c * counts.g / window;
+            double obs_exp    = expected > 0.0 ? counts.cpg / expected : 0.0;
+            double percent_cg = (counts.c + counts.g) * 100.0 / window;
+
+            if (obs_exp > parameters_.min_obs_exp && percent_cg > parameters_.min_percent_cg)
+                add_marked(chunk.runs, i + centre, i + centre + shift);
+        }
+    });
+
+    // stitch runs across chunk boundaries and score the islands
+    std::vector<std::vector<CpGIsland> > islands(records.size());
+    std::vector<Run> runs;
+
+    for (size_t k = 0; k < chunks.size(); k++)
+    {
+        for (size_t j = 0; j < chunks[k].runs.size(); j++)
+            add_marked(runs, chunks[k].runs[j].begin, chunks[k].runs[j].end);
+
+        if (k + 1 < chunks.size() && chunks[k + 1].record == chunks[k].record)
+            continue;
+
+        const uint8_t * cls = classes[chunks[k].record].empty() ? 0 : &classes[chunks[k].record][0];
+        size_t          n   = classes[chunks[k].record].size();
+
+        for (size_t j = 0; j < runs.size(); j++)
+        {
+            size_t begin = runs[j].begin;
+            size_t end   = std::min(runs[j].end, n);
+
+            if (end <= begin || end - begin < parameters_.min_length)
+                continue;
+
+            Counts    bases  = count_classes(cls, begin, end);
+            size_t    length = end - begin;
+            CpGIsland island;
+
+            island.start      = begin + 1;
+            island.end        = end;
+            island.sum_cg     = bases.c + bases.g;
+            island.percent_cg = island.sum_cg * 100.0 / length;
+            island.obs_exp    = bases.c && bases.g
+                              ? count_classes(cls, begin, end - 1).cpg * (double)length / ((double)bases.c * bases.g)
+                              : 0.0;
+            islands[chunks[k].record].push_back(island);
+        }
+        runs.clear();
+    }
+
+    return islands;
+}
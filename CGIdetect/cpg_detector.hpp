@@ -0,0 +1,64 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       CpG island detection with the EMBOSS newcpgreport rules: a window
+ *       slides along the sequence, every window with a high enough
+ *       observed/expected CpG ratio and C+G percentage marks its centre
+ *       base(s), and runs of marked bases at least min_length long are
+ *       islands.
+ *
+ *       Chromosomes are cut into chunks that are scanned on a pool of
+ *       threads; runs that touch a chunk boundary are stitched afterwards.
+ *
+ *************************************************/
+
+#ifndef CPG_DETECTOR_HPP
+#define CPG_DETECTOR_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "fasta_file.hpp"
+
+struct CpGParameters
+{
+    CpGParameters()
+        : window(100), shift(1), min_length(200), min_obs_exp(0.6), min_percent_cg(50.0)
+    {
+    }
+
+    unsigned window;
+    unsigned shift;
+    unsigned min_length;
+    double   min_obs_exp;
+    double   min_percent_cg;
+};
+
+struct CpGIsland
+{
+    size_t        start;        // 1-based, inclusive
+    size_t        end;          // 1-based, inclusive
+    unsigned long sum_cg;       // number of C and G bases in the island
+    double        obs_exp;
+    double        percent_cg;
+};
+
+class CpGDetector
+{
+public:
+    CpGDetector(const CpGParameters & parameters, unsigned threads, size_t chunk_size);
+
+    // islands of every record, in record order
+    std::vector<std::vector<CpGIsland> > detect(const std::vector<FastaRecord> & records) const;
+
+private:
+    CpGParameters parameters_;
+    unsigned      threads_;
+    size_t        chunk_size_;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       load the records of a (multi) FASTA file through mmap
+ *
+ *************************************************/
+
+#include "fasta_file.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool load_fasta(const std::string & path, std::vector<FastaRecord> & records)
+{
+    struct stat st;
+    int fd;
+
+    if ((fd = open(path.c_str(), O_RDONLY)) < 0)
+        return false;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    void * map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    const char * p   = static_cast<const char *>(map);
+    const char * end = p + st.st_size;
+    FastaRecord * record = 0;
+
+    while (p < end)
+    {
+        const char * eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+
+        if (*p == '>')
+        {
+            const char * name = p + 1;
+            const char * name_end = name;
+            while (name_end < eol && *name_end != ' ' && *name_end != '\t' && *name_end != '\r')
+                name_end++;
+
+            records.push_back(FastaRecord());
+            record = &records.back();
+            record->seqid.assign(name, name_end);
+            // chromosome scale records, reserve up to the next header
+            const char * next = static_cast<const char *>(memchr(eol, '>', end - eol));
+            record->sequence.reserve((next ? next : end) - eol);
+        }
+        else if (record)
+        {
+            const char * line_end = eol;
+            if (line_end > p && line_end[-1] == '\r')
+                line_end--;
+            record->sequence.append(p, line_end);
+        }
+        p = eol + 1;
+    }
+
+    munmap(map, st.st_size);
+    return true;
+}
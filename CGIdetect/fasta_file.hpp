@@ -0,0 +1,28 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       load the records of a (multi) FASTA file through mmap
+ *
+ *************************************************/
+
+#ifndef FASTA_FILE_HPP
+#define FASTA_FILE_HPP
+
+#include <string>
+#include <vector>
+
+struct FastaRecord
+{
+    std::string seqid;      // first word of the header line
+    std::string sequence;   // line breaks removed, case kept
+};
+
+// appends every record of path to records, returns false if the file
+// can't be read
+bool load_fasta(const std::string & path, std::vector<FastaRecord> & records);
+
+#endif
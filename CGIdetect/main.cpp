@@ -0,0 +1,100 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       find CpG islands in FASTA files and write them straight out as GFF3,
+ *       replacing the newcpgreport + CGItoGFF3 round trip.  Defaults match
+ *       the parameters TAIR10/reports.sh passes to newcpgreport.
+ *
+ *************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "cpg_detector.hpp"
+#include "fasta_file.hpp"
+
+void usage(const char * name)
+{
+    std::cout << "Usage: " << name << " [options] <fasta file>... > islands.gff3" << std::endl
+              << "   -w <window>      window size (100)" << std::endl
+              << "   -s <shift>       window shift (1)" << std::endl
+              << "   -l <minlen>      minimum island length (200)" << std::endl
+              << "   -o <minoe>       minimum observed/expected CpG (0.6)" << std::endl
+              << "   -p <minpc>       minimum C+G percentage (50)" << std::endl
+              << "   -t <threads>     worker threads (all cores)" << std::endl
+              << "   -c <chunk>       bases per work chunk (4000000)" << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    CpGParameters parameters;
+    unsigned threads = std::thread::hardware_concurrency();
+    size_t chunk_size = 4000000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:s:l:o:p:t:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w': parameters.window         = strtoul(optarg, 0, 10); break;
+        case 's': parameters.shift          = strtoul(optarg, 0, 10); break;
+        case 'l': parameters.min_length     = strtoul(optarg, 0, 10); break;
+        case 'o': parameters.min_obs_exp    = strtod(optarg, 0);      break;
+        case 'p': parameters.min_percent_cg = strtod(optarg, 0);      break;
+        case 't': threads                   = strtoul(optarg, 0, 10); break;
+        case 'c': chunk_size                = strtoul(optarg, 0, 10); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind == argc || parameters.window < 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<FastaRecord> records;
+    for (int i = optind; i < argc; i++)
+    {
+        if (!load_fasta(argv[i], records))
+        {
+            std::cerr << "Failed to read FASTA file " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    CpGDetector detector(parameters, threads ? threads : 1, chunk_size);
+    std::vector<std::vector<CpGIsland> > islands = detector.detect(records);
+
+    static char buffer[1 << 20];
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+    printf("##gff-version 3\n");
+    for (size_t r = 0; r < records.size(); r++)
+        printf("##sequence-region %s 1 %zu\n", records[r].seqid.c_str(), records[r].sequence.size());
+
+    unsigned long island_num = 0;
+    for (size_t r = 0; r < records.size(); r++)
+    {
+        for (size_t i = 0; i < islands[r].size(); i++)
+        {
+            const CpGIsland & island = islands[r][i];
+            printf("%s\t.\tCpGI\t%zu\t%zu\t.\t.\t.\tID=CpGI_%lu;sumcg=%lu;ObsExp=%.2f;PercentCG=%.2f\n",
+                   records[r].seqid.c_str(), island.start, island.end, ++island_num,
+                   island.sum_cg, island.obs_exp, island.percent_cg);
+        }
+    }
+
+    return 0;
+}
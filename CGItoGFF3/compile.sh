@@ -1 +1 @@
-g++ -g main.cpp -L/usr/lib -lboost_regex -oCGItoGFF3
+g++ -g -O2 -std=c++17 -pthread main.cpp cpgreport_file.cpp -oCGItoGFF3
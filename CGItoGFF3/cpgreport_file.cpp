@@ -0,0 +1,178 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       scan an EMBOSS newcpgreport file in place through mmap
+ *
+ *************************************************/
+
+#include "cpgreport_file.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+const char * skip_blanks(const char * p, const char * end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+const char * skip_word(const char * p, const char * end)
+{
+    while (p < end && *p != ' ' && *p != '\t')
+        p++;
+    return p;
+}
+
+// true if [p, end) starts with prefix, p is moved past it
+bool consume(const char *& p, const char * end, const char * prefix)
+{
+    size_t length = strlen(prefix);
+
+    if ((size_t)(end - p) < length || memcmp(p, prefix, length) != 0)
+        return false;
+    p += length;
+    return true;
+}
+
+unsigned long read_number(const char *& p, const char * end)
+{
+    unsigned long value = 0;
+
+    while (p < end && *p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+    return value;
+}
+
+} // namespace
+
+CpGReportFile::CpGReportFile() : data_(0), size_(0), mapped_(false)
+{
+}
+
+CpGReportFile::~CpGReportFile()
+{
+    if (mapped_)
+        munmap(const_cast<char *>(data_), size_);
+    else
+        free(const_cast<char *>(data_));
+}
+
+bool CpGReportFile::open(const std::string & path)
+{
+    if (path == "-")
+    {
+        // a pipe can't be mapped, slurp it instead
+        size_t capacity = 1 << 20;
+        char * buffer = static_cast<char *>(malloc(capacity));
+        ssize_t n;
+
+        while ((n = read(0, buffer + size_, capacity - size_)) > 0)
+        {
+            size_ += n;
+            if (size_ == capacity)
+                buffer = static_cast<char *>(realloc(buffer, capacity *= 2));
+        }
+        data_ = buffer;
+        if (n < 0)
+            return false;
+    }
+    else
+    {
+        struct stat st;
+        int fd;
+
+        if ((fd = ::open(path.c_str(), O_RDONLY)) < 0)
+            return false;
+        if (fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        if (st.st_size > 0)
+        {
+            void * map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED)
+            {
+                ::close(fd);
+                return false;
+            }
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            data_   = static_cast<const char *>(map);
+            size_   = st.st_size;
+            mapped_ = true;
+        }
+        ::close(fd);
+    }
+
+    scan();
+    return true;
+}
+
+// only the ID line and the FT feature table matter:
+//
+//   ID   Chr1  30427671 BP.
+//   FT   CpG island       12651..12895
+//   FT                    /Sum C+G=118
+//   FT                    /Percent CG=48.16
+//   FT                    /ObsExp=0.95
+void CpGReportFile::scan()
+{
+    const char *     p   = data_;
+    const char *     end = data_ + size_;
+    ReportSequence * sequence = 0;
+    ReportIsland *   island = 0;
+
+    while (p < end)
+    {
+        const char * eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+        const char * line_end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+
+        if (consume(p, line_end, "ID "))
+        {
+            const char * name = skip_blanks(p, line_end);
+            const char * name_end = skip_word(name, line_end);
+            const char * length = skip_blanks(name_end, line_end);
+
+            sequences_.push_back(ReportSequence());
+            sequence = &sequences_.back();
+            sequence->seqid.assign(name, name_end);
+            sequence->length = read_number(length, line_end);
+            island = 0;
+        }
+        else if (sequence && consume(p, line_end, "FT "))
+        {
+            p = skip_blanks(p, line_end);
+
+            if (consume(p, line_end, "CpG island"))
+            {
+                p = skip_blanks(p, line_end);
+                sequence->islands.push_back(ReportIsland());
+                island = &sequence->islands.back();
+                island->start = read_number(p, line_end);
+                consume(p, line_end, "..");
+                island->end = read_number(p, line_end);
+            }
+            else if (island && consume(p, line_end, "/Sum C+G="))
+                island->sum_cg = read_number(p, line_end);
+            else if (island && consume(p, line_end, "/ObsExp="))
+                island->obs_exp = ReportText{ p, (size_t)(line_end - p) };
+            else if (island && consume(p, line_end, "/Percent CG="))
+                island->percent_cg = ReportText{ p, (size_t)(line_end - p) };
+        }
+        p = eol + 1;
+    }
+}
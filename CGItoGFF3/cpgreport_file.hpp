@@ -0,0 +1,68 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       scan an EMBOSS newcpgreport file in place through mmap
+ *
+ *************************************************/
+
+#ifndef CPGREPORT_FILE_HPP
+#define CPGREPORT_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// a value as written in the report, pointing into the mapped file
+struct ReportText
+{
+    const char * text;
+    size_t       length;
+};
+
+struct ReportIsland
+{
+    unsigned long start;
+    unsigned long end;
+    unsigned long sum_cg;
+    ReportText    obs_exp;
+    ReportText    percent_cg;
+};
+
+struct ReportSequence
+{
+    std::string               seqid;
+    unsigned long             length;
+    std::vector<ReportIsland> islands;
+};
+
+class CpGReportFile
+{
+public:
+    CpGReportFile();
+    ~CpGReportFile();
+
+    // map path, or read all of standard input for "-".  Returns false if
+    // the input can't be read
+    bool open(const std::string & path);
+
+    // one entry per ID record, ReportText values stay valid while the
+    // file is open
+    const std::vector<ReportSequence> & sequences() const { return sequences_; }
+
+private:
+    CpGReportFile(const CpGReportFile &);
+    CpGReportFile & operator=(const CpGReportFile &);
+
+    void scan();
+
+    const char *                data_;
+    size_t                      size_;
+    bool                        mapped_;
+    std::vector<ReportSequence> sequences_;
+};
+
+#endif
@@ -3,10 +3,11 @@
 REPORTS_DIR=/home/brock/bionformatics/arabidopsis/TAIR10/reports
 IMAGES_DIR=./
 REPORTS_EXT=cpgreport
+CHARTS=../island_overlap_tss/island_charts
+GT_STYLE=${GT_STYLE:-/usr/local/share/genometools/gtdata/sketch/default.style}
 
-cat $REPORTS_DIR/*.$REPORTS_EXT | ./CGItoGFF3 > $REPORTS_DIR/islands.gff3
+./CGItoGFF3 $REPORTS_DIR/*.$REPORTS_EXT > $REPORTS_DIR/islands.gff3
 
-for name in Chr1 Chr2 Chr3 Chr4 Chr5 mitochondria chloroplast
-do
-    gt sketch -force -width 2400 -seqid $name $name-islands.png $REPORTS_DIR/islands.gff3
-done
+# every sequence in one pass, on all cores; tiles left unchanged since the
+# last run are reused from $IMAGES_DIR/chart_tiles
+$CHARTS -w 2400 -s $GT_STYLE -x -islands $REPORTS_DIR/islands.gff3 $IMAGES_DIR
@@ -5,105 +5,234 @@
  *       Released to public domain without restriction
  *
  *    @section DESCRIPTION
- *       convert CPGISLE format to GFF3
+ *       convert CPGISLE format to GFF3, optionally writing the cpgi.list
+ *       island table read by CpGIOverlap_stream in the same pass.  Report
+ *       files are scanned and formatted concurrently, islands are numbered
+ *       in the order the files are given.
  *       TODO: insert into current GFF3 document
  *
  *************************************************/
 
-#include <boost/tokenizer.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
 
+#include "cpgreport_file.hpp"
 
-typedef enum { ID_FIELD, FT_FIELD, UNKNOWN_FIELD } field_t;
+namespace
+{
+
+// run fn(0 .. num_tasks - 1) on up to threads threads
+template <typename F>
+void parallel_for(size_t num_tasks, unsigned threads, F fn)
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+
+    auto worker = [&]()
+    {
+        size_t task;
+        while ((task = next++) < num_tasks)
+            fn(task);
+    };
+
+    threads = std::max(1u, std::min<unsigned>(threads, num_tasks));
+    for (unsigned t = 1; t < threads; t++)
+        pool.push_back(std::thread(worker));
+    worker();
+    for (size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+}
+
+void append_number(std::string & out, unsigned long value)
+{
+    char digits[24];
+    char * p = digits + sizeof(digits);
+
+    do
+        *--p = '0' + value % 10;
+    while (value /= 10);
+    out.append(p, digits + sizeof(digits) - p);
+}
+
+void append_text(std::string & out, const ReportText & text)
+{
+    out.append(text.text, text.length);
+}
+
+struct Output
+{
+    std::string gff3;
+    std::string cpgi_list;
+};
+
+// format every island of one report, the first one gets ID CpGI_<island_num + 1>
+void format_report(const CpGReportFile & report, unsigned long island_num,
+                   bool write_list, Output & out)
+{
+    const std::vector<ReportSequence> & sequences = report.sequences();
+
+    for (size_t s = 0; s < sequences.size(); s++)
+    {
+        const ReportSequence & sequence = sequences[s];
+        int chromosome = 0;
+
+        // the island table only knows numbered chromosomes
+        bool listed = write_list && sscanf(sequence.seqid.c_str(), "Chr%d", &chromosome) == 1;
+
+        out.gff3.reserve(out.gff3.size() + sequence.islands.size() * 96);
+        for (size_t i = 0; i < sequence.islands.size(); i++)
+        {
+            const ReportIsland & island = sequence.islands[i];
+
+            island_num++;
+
+            out.gff3 += sequence.seqid;
+            out.gff3 += "\t.\tCpGI\t";
+            append_number(out.gff3, island.start);
+            out.gff3 += '\t';
+            append_number(out.gff3, island.end);
+            out.gff3 += "\t.\t.\t.\tID=CpGI_";
+            append_number(out.gff3, island_num);
+            out.gff3 += ";sumcg=";
+            append_number(out.gff3, island.sum_cg);
+            if (island.obs_exp.length)
+            {
+                out.gff3 += ";ObsExp=";
+                append_text(out.gff3, island.obs_exp);
+            }
+            if (island.percent_cg.length)
+            {
+                out.gff3 += ";PercentCG=";
+                append_text(out.gff3, island.percent_cg);
+            }
+            out.gff3 += '\n';
+
+            if (listed)
+            {
+                out.cpgi_list += "CpGI_";
+                append_number(out.cpgi_list, island_num);
+                out.cpgi_list += '\t';
+                append_number(out.cpgi_list, chromosome);
+                out.cpgi_list += '\t';
+                append_number(out.cpgi_list, island.start);
+                out.cpgi_list += '\t';
+                append_number(out.cpgi_list, island.end);
+                out.cpgi_list += '\n';
+            }
+        }
+    }
+}
+
+} // namespace
+
+void usage(const char * name)
+{
+    std::cout << "Usage: " << name << " [options] [cpgreport file]... > islands.gff3" << std::endl
+              << "   reads standard input when no report file is given" << std::endl
+              << "   -l <cpgi list>   also write the island table for CpGIOverlap_stream" << std::endl
+              << "   -t <threads>     worker threads (all cores)" << std::endl;
+}
 
 int main(int argc, char ** argv)
 {
-    std::string seqid;
-    std::string line;
-    std::string start_base, end_base;
+    unsigned threads = std::thread::hardware_concurrency();
+    const char * cpgi_list_path = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l': cpgi_list_path = optarg;                  break;
+        case 't': threads        = strtoul(optarg, 0, 10); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<std::string> paths(argv + optind, argv + argc);
+    if (paths.empty())
+        paths.push_back("-");
 
-    std::cout << "##gff-version 3" << std::endl;
+    // scan every report at once, the island numbering needs all the counts
+    std::vector<CpGReportFile> reports(paths.size());
+    std::vector<char> opened(paths.size());
+
+    parallel_for(paths.size(), threads ? threads : 1, [&](size_t k)
+    {
+        opened[k] = reports[k].open(paths[k]);
+    });
+
+    for (size_t k = 0; k < paths.size(); k++)
+    {
+        if (!opened[k])
+        {
+            std::cerr << "Failed to read cpgreport file " << paths[k] << std::endl;
+            return 1;
+        }
+    }
 
-    bool waiting_for_sum = false;
+    std::vector<unsigned long> first_island(paths.size() + 1, 0);
+    for (size_t k = 0; k < reports.size(); k++)
+    {
+        unsigned long count = 0;
+        for (size_t s = 0; s < reports[k].sequences().size(); s++)
+            count += reports[k].sequences()[s].islands.size();
+        first_island[k + 1] = first_island[k] + count;
+    }
 
-    while (std::cin)
+    std::vector<Output> outputs(reports.size());
+    parallel_for(reports.size(), threads ? threads : 1, [&](size_t k)
     {
-        field_t field = UNKNOWN_FIELD;
-        int col = 1;
+        format_report(reports[k], first_island[k], cpgi_list_path != 0, outputs[k]);
+    });
 
-        bool has_cpg_coords  = false;
-        bool cpg_coords_found = false;
-        bool sum_found = false;
+    std::string header = "##gff-version 3\n";
+    for (size_t k = 0; k < reports.size(); k++)
+    {
+        for (size_t s = 0; s < reports[k].sequences().size(); s++)
+        {
+            const ReportSequence & sequence = reports[k].sequences()[s];
+            header += "##sequence-region " + sequence.seqid + " 1 ";
+            append_number(header, sequence.length);
+            header += '\n';
+        }
+    }
 
-        size_t dot_loc;
-        std::getline(std::cin, line);
-        boost::tokenizer<> tok(line);
-        boost::tokenizer<>::iterator cur = tok.begin();
- 
-   
+    fwrite(header.data(), 1, header.size(), stdout);
+    for (size_t k = 0; k < outputs.size(); k++)
+        fwrite(outputs[k].gff3.data(), 1, outputs[k].gff3.size(), stdout);
+    if (fflush(stdout) != 0)
+    {
+        std::cerr << "Failed to write GFF3 output" << std::endl;
+        return 1;
+    }
 
-        if (tok.begin() != tok.end())
+    if (cpgi_list_path)
+    {
+        FILE * list = fopen(cpgi_list_path, "w");
+        if (!list)
         {
-           if (cur->compare("ID") == 0)
-              field = ID_FIELD;
-           else if (cur->compare("FT") == 0)
-              field = FT_FIELD;
-           else
-              continue; // bad field
+            std::cerr << "Failed to create island table " << cpgi_list_path << std::endl;
+            return 1;
         }
-        else
-          continue;
- 
-        cur++;
-
-        for (; cur!= tok.end(); cur++)
-        { 
-            col++;
-            switch(field)
-            {
-            case FT_FIELD:
-                if (col == 2 && !cur->compare("CpG"))
-                {
-                   has_cpg_coords = true;
-                   break;
-                }
-                if (col == 2 && !cur->compare("Sum"))
-                {
-                   sum_found = true;
-                }
-                if (col == 4 && has_cpg_coords)
-                {
-                   start_base = *cur;
-                }
-                if (col == 5 && has_cpg_coords)
-                {
-                   end_base = *cur;
-                   cpg_coords_found = true;
-                   waiting_for_sum  = true;
-                }
-                if (col == 5 && waiting_for_sum && sum_found)
-                {
-                   std::cout << "sumcg=" << *cur << std::endl;
-                   waiting_for_sum = false;
-                }
-                break;
-            case ID_FIELD:
-                if (col == 2)
-                   seqid = *cur;
-                break;
-            }
+        for (size_t k = 0; k < outputs.size(); k++)
+            fwrite(outputs[k].cpgi_list.data(), 1, outputs[k].cpgi_list.size(), list);
+        if (fclose(list) != 0)
+        {
+            std::cerr << "Failed to write island table " << cpgi_list_path << std::endl;
+            return 1;
         }
-       if (cpg_coords_found)
-           std::cout << seqid << "\t"
-                     << "."   << "\t" 
-                     << "CpGI" << "\t"
-                     << start_base << "\t" 
-                     << end_base <<"\t"
-                     << "."      << "\t"
-                     << "."      << "\t"
-                     << "."      << "\t";
-                     //wait for annotations until sumcg known
     }
-   return 0;
+
+    return 0;
 }
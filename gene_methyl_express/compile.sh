@@ -1 +1,2 @@
-g++ -g main.cpp -L/usr/lib -lboost_regex -ogene_methyl_express
+g++ -g -O2 -std=c++17 -pthread main.cpp island_join.cpp mapped_file.cpp pair_stats.cpp -ogene_methyl_express
+g++ -g -O2 -std=c++17 -pthread correlate.cpp pair_stats.cpp mapped_file.cpp -ocorrelate
@@ -0,0 +1,80 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       correlation statistics for many pairs files, one row per file, so
+ *       every sample / condition comparison is scored in one run
+ *
+ *************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+#include "pair_stats.hpp"
+
+void usage(const char * name)
+{
+    std::cout << "Usage: " << name
+              << " [-B <bootstrap resamples>] [-P <permutations>] [-c <confidence>] [-j <threads>] [-s <seed>]"
+              << " <pairs file> ..." << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    StatsOptions options;
+    int opt, failed = 0;
+
+    while ((opt = getopt(argc, argv, "B:P:c:j:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'B':
+            options.bootstrap = strtoul(optarg, 0, 10);
+            break;
+        case 'P':
+            options.permutations = strtoul(optarg, 0, 10);
+            break;
+        case 'c':
+            options.confidence = strtod(optarg, 0);
+            break;
+        case 'j':
+            options.threads = strtoul(optarg, 0, 10);
+            break;
+        case 's':
+            options.seed = strtoul(optarg, 0, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+
+    if (argc - optind < 1)
+    {
+        usage(argv[0]);
+        return 0;
+    }
+
+    // comparisons run one after another, each spread over the threads
+    PairStats::write_header(stdout);
+    for (int i = optind; i < argc; i++)
+    {
+        PairStats stats;
+
+        if (!stats.load(argv[i]))
+        {
+            std::cerr << "Error opening pairs file " << argv[i] << std::endl;
+            failed = 1;
+            continue;
+        }
+        PairStats::write(stdout, argv[i], stats.run(options));
+        fflush(stdout);
+    }
+
+    return failed;
+}
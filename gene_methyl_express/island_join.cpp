@@ -0,0 +1,353 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       hash join / external sort-merge join of genes against island scores
+ *
+ *************************************************/
+
+#include "island_join.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+namespace
+{
+
+const size_t io_buffer_size = 1 << 20;
+
+inline bool is_separator(char c)
+{
+    return c == ',' || c == ' ' || c == '\t';
+}
+
+// split [line, eol) on ", \t" dropping empty tokens, the same way the
+// boost::char_separator used to.  Returns number of fields found.
+size_t split_fields(const char * line, const char * eol, std::string_view * fields, size_t max_fields)
+{
+    size_t n = 0;
+
+    while (line < eol && n < max_fields)
+    {
+        while (line < eol && is_separator(*line))
+            line++;
+        if (line == eol)
+            break;
+
+        const char * token = line;
+        while (line < eol && !is_separator(*line))
+            line++;
+        fields[n++] = std::string_view(token, line - token);
+    }
+    return n;
+}
+
+// calls f(begin, end) for every line of a mapped file
+template <typename F>
+void for_each_line(const MappedFile & file, F f)
+{
+    const char * p   = file.data();
+    const char * end = p + file.size();
+
+    while (p < end)
+    {
+        const char * eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+        f(p, eol);
+        p = eol + 1;
+    }
+}
+
+// gene rows: expression level in column 1, island name in column 3
+inline bool parse_gene(const char * line, const char * eol, std::string_view & island, std::string_view & expression)
+{
+    std::string_view fields[3];
+
+    if (split_fields(line, eol, fields, 3) != 3)
+        return false;
+    expression = fields[0];
+    island     = fields[2];
+    return true;
+}
+
+// island rows: island name in column 1, methylation score in column 2
+inline bool parse_island(const char * line, const char * eol, std::string_view & island, std::string_view & score)
+{
+    std::string_view fields[2];
+
+    if (split_fields(line, eol, fields, 2) != 2)
+        return false;
+    island = fields[0];
+    score  = fields[1];
+    return true;
+}
+
+inline void write_pair(FILE * out, PairStats * stats, std::string_view score, std::string_view expression)
+{
+    fwrite(score.data(), 1, score.size(), out);
+    fputc('\t', out);
+    fwrite(expression.data(), 1, expression.size(), out);
+    fputc('\n', out);
+
+    // the fields point into the mapped files, from_chars stays inside them
+    if (stats)
+    {
+        double x, y;
+
+        if (std::from_chars(score.data(), score.data() + score.size(), x).ec == std::errc() &&
+            std::from_chars(expression.data(), expression.data() + expression.size(), y).ec == std::errc())
+            stats->add(x, y);
+    }
+}
+
+struct RunRecord
+{
+    std::string   key;
+    std::string   value;
+    unsigned long seq;      // row number in the input, keeps the sort stable
+
+    bool operator<(const RunRecord & other) const
+    {
+        int c = key.compare(other.key);
+        return c < 0 || (c == 0 && seq < other.seq);
+    }
+};
+
+// sorted runs spilled to unlinked temporary files, then merged back in
+// (key, seq) order through a heap over the run heads
+class RunMerger
+{
+public:
+    RunMerger(const JoinOptions & options) : options_(options), line_(0), line_capacity_(0) {}
+
+    ~RunMerger()
+    {
+        for (size_t i = 0; i < runs_.size(); i++)
+            fclose(runs_[i]);
+        free(line_);
+    }
+
+    bool add_run(std::vector<RunRecord> & records)
+    {
+        std::string path = options_.temp_dir + "/island_join.XXXXXX";
+        std::vector<char> templ(path.begin(), path.end());
+        templ.push_back('\0');
+
+        int fd = mkstemp(&templ[0]);
+        if (fd < 0)
+            return false;
+        unlink(&templ[0]);  // goes away by itself once closed
+
+        FILE * run = fdopen(fd, "w+");
+        setvbuf(run, 0, _IOFBF, io_buffer_size);
+
+        std::sort(records.begin(), records.end());
+        for (size_t i = 0; i < records.size(); i++)
+            fprintf(run, "%s\t%s\t%lu\n", records[i].key.c_str(), records[i].value.c_str(), records[i].seq);
+        records.clear();
+
+        if (fflush(run) != 0)
+        {
+            fclose(run);
+            return false;
+        }
+        rewind(run);
+        runs_.push_back(run);
+        return true;
+    }
+
+    void start()
+    {
+        heads_.resize(runs_.size());
+        for (size_t i = 0; i < runs_.size(); i++)
+            if (read_record(runs_[i], heads_[i]))
+                heap_.push(Head(&heads_[i], i));
+    }
+
+    bool next(RunRecord & record)
+    {
+        if (heap_.empty())
+            return false;
+
+        size_t run = heap_.top().run;
+        heap_.pop();
+        record = heads_[run];
+        if (read_record(runs_[run], heads_[run]))
+            heap_.push(Head(&heads_[run], run));
+        return true;
+    }
+
+private:
+    struct Head
+    {
+        Head(const RunRecord * r, size_t i) : record(r), run(i) {}
+        const RunRecord * record;
+        size_t            run;
+
+        // priority_queue is a max heap
+        bool operator<(const Head & other) const { return *other.record < *record; }
+    };
+
+    bool read_record(FILE * run, RunRecord & record)
+    {
+        ssize_t length = getline(&line_, &line_capacity_, run);
+        if (length <= 0)
+            return false;
+
+        char * key_end   = static_cast<char *>(memchr(line_, '\t', length));
+        char * value_end = key_end ? static_cast<char *>(memchr(key_end + 1, '\t', line_ + length - key_end - 1)) : 0;
+        if (!value_end)
+            return false;
+
+        record.key.assign(line_, key_end - line_);
+        record.value.assign(key_end + 1, value_end - key_end - 1);
+        record.seq = strtoul(value_end + 1, 0, 10);
+        return true;
+    }
+
+    const JoinOptions &           options_;
+    std::vector<FILE *>           runs_;
+    std::vector<RunRecord>        heads_;
+    std::priority_queue<Head>     heap_;
+    char *                        line_;
+    size_t                        line_capacity_;
+};
+
+// cut one side of the join into sorted runs no bigger than the memory limit
+template <typename Parse>
+bool spill_runs(const MappedFile & file, Parse parse, const JoinOptions & options, RunMerger & merger)
+{
+    std::vector<RunRecord> records;
+    size_t run_bytes = 0;
+    unsigned long seq = 0;
+    bool ok = true;
+
+    for_each_line(file, [&](const char * line, const char * eol)
+    {
+        std::string_view key, value;
+
+        if (!ok || !parse(line, eol, key, value))
+            return;
+
+        RunRecord record;
+        record.key.assign(key.data(), key.size());
+        record.value.assign(value.data(), value.size());
+        record.seq = seq++;
+        run_bytes += sizeof(RunRecord) + key.size() + value.size();
+        records.push_back(record);
+
+        if (run_bytes >= options.memory_limit)
+        {
+            ok = merger.add_run(records);
+            run_bytes = 0;
+        }
+    });
+
+    if (ok && !records.empty())
+        ok = merger.add_run(records);
+    return ok;
+}
+
+} // namespace
+
+IslandJoin::IslandJoin(const MappedFile & genes, const MappedFile & islands, const JoinOptions & options)
+    : genes_(genes), islands_(islands), options_(options)
+{
+}
+
+size_t IslandJoin::hash_table_bytes() const
+{
+    const size_t bytes_per_entry = 2 * sizeof(std::string_view) + 4 * sizeof(void *);
+    size_t rows = std::count(islands_.data(), islands_.data() + islands_.size(), '\n') + 1;
+
+    return rows * bytes_per_entry;
+}
+
+long IslandJoin::run(FILE * out, PairStats * stats)
+{
+    if (hash_table_bytes() <= options_.memory_limit)
+        return hash_join(out, stats);
+    return sort_merge_join(out, stats);
+}
+
+long IslandJoin::hash_join(FILE * out, PairStats * stats)
+{
+    // keys and values point straight into the mapped island file
+    std::unordered_map<std::string_view, std::string_view> scores;
+    long pairs = 0;
+
+    scores.reserve(islands_.size() / 16);
+
+    for_each_line(islands_, [&](const char * line, const char * eol)
+    {
+        std::string_view island, score;
+
+        // emplace keeps the first score when an island is listed twice
+        if (parse_island(line, eol, island, score))
+            scores.emplace(island, score);
+    });
+
+    for_each_line(genes_, [&](const char * line, const char * eol)
+    {
+        std::string_view island, expression;
+
+        if (!parse_gene(line, eol, island, expression))
+            return;
+
+        auto found = scores.find(island);
+        if (found == scores.end())
+            return;
+
+        write_pair(out, stats, found->second, expression);
+        pairs++;
+    });
+
+    return pairs;
+}
+
+long IslandJoin::sort_merge_join(FILE * out, PairStats * stats)
+{
+    RunMerger islands(options_), genes(options_);
+    RunRecord island, gene;
+    long pairs = 0;
+
+    if (!spill_runs(islands_, parse_island, options_, islands) ||
+        !spill_runs(genes_, parse_gene, options_, genes))
+        return -1;
+
+    islands.start();
+    genes.start();
+
+    bool has_island = islands.next(island);
+    bool has_gene   = genes.next(gene);
+
+    while (has_gene && has_island)
+    {
+        // island stays on the first (lowest seq) row of its name, the same
+        // row the hash join would keep
+        while (has_island && island.key < gene.key)
+            has_island = islands.next(island);
+        if (!has_island)
+            break;
+
+        if (island.key == gene.key)
+        {
+            write_pair(out, stats, island.value, gene.value);
+            pairs++;
+        }
+        has_gene = genes.next(gene);
+    }
+
+    return pairs;
+}
@@ -0,0 +1,56 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       join gene rows (expression, gene, island) against island rows
+ *       (island, methylation score) and write "score\texpression" pairs.
+ *
+ *       When the island table fits in the memory limit it is hashed and the
+ *       genes are probed in file order.  Otherwise both sides are cut into
+ *       sorted runs on disk, k-way merged and merge joined; pairs then come
+ *       out ordered by island name instead of gene file order.
+ *
+ *************************************************/
+
+#ifndef ISLAND_JOIN_HPP
+#define ISLAND_JOIN_HPP
+
+#include <cstdio>
+#include <string>
+
+#include "mapped_file.hpp"
+#include "pair_stats.hpp"
+
+struct JoinOptions
+{
+    JoinOptions() : memory_limit(1024UL * 1024 * 1024), temp_dir("/tmp") {}
+
+    size_t      memory_limit;   // bytes the island hash table may use
+    std::string temp_dir;       // where sorted runs are spilled
+};
+
+class IslandJoin
+{
+public:
+    IslandJoin(const MappedFile & genes, const MappedFile & islands, const JoinOptions & options);
+
+    // rough size of the island hash table, used to pick the join
+    size_t hash_table_bytes() const;
+
+    // picks hash or sort-merge join, returns number of pairs written or -1.
+    // Pairs are also added to stats when given
+    long run(FILE * out, PairStats * stats = 0);
+
+    long hash_join(FILE * out, PairStats * stats = 0);
+    long sort_merge_join(FILE * out, PairStats * stats = 0);
+
+private:
+    const MappedFile & genes_;
+    const MappedFile & islands_;
+    JoinOptions        options_;
+};
+
+#endif
@@ -1,126 +1,125 @@
-/*      
- *    @file 
+/*
+ *    @file
  *    @author Brock Anderson <brock.wright.anderson@gmail.com>
  *    @section LICENSE
  *       Released to public domain without restriction
  *
  *    @section DESCRIPTION
- *       convert CPGISLE format to GFF3
- *       TODO: insert into current GFF3 document
+ *       pair the methylation score of the island at each gene's TSS with
+ *       the gene's expression level
  *
  *************************************************/
 
-#include <boost/tokenizer.hpp>
-#include <fstream>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <unistd.h>
 
-std::string locate_island_score(std::ifstream * island_stream, std::string name)
-{
- 
-    // this is really inneficient and needs to be fixed  
- 
-    island_stream->seekg(0, std::ios::beg);
-    while (*island_stream)
-    {
-        std::string cpgi_name;
-        std::string line;
-   
-        std::getline(*island_stream, line);
-        boost::char_separator<char> sep(", \t", "", boost::drop_empty_tokens);
-        boost::tokenizer<boost::char_separator<char> > tok(line, sep);
-        boost::tokenizer<boost::char_separator<char> >::iterator cur = tok.begin();
-
-        std::string value;
-
-        // don't process empty line
-        if (cur == tok.end())
-           continue;
-
-        value = *cur;
-
-        // see if the island matched
-        if (value != name)
-            continue;
-
-        cur++; // go to next field
-        
-        if (cur == tok.end())
-           continue;
-
-        return *cur;  
+#include "island_join.hpp"
+#include "mapped_file.hpp"
+#include "pair_stats.hpp"
 
-    }
-    
-    return "NA";
+void usage(const char * name)
+{
+    std::cout << "Usage: " << name
+              << " [-m <memory MB>] [-T <temp dir>] [-S <stats file>] <gene file> <island file> [pairs file]" << std::endl
+              << "   -S also writes the correlation of the pairs, tuned with" << std::endl
+              << "   -B <bootstrap resamples> -P <permutations> -c <confidence> -j <threads> -s <seed>" << std::endl;
 }
 
-
 int main(int argc, char ** argv)
 {
+    JoinOptions options;
+    StatsOptions stats_options;
+    const char * stats_path = 0;
+    int opt;
+
+    if (getenv("TMPDIR"))
+        options.temp_dir = getenv("TMPDIR");
 
-    if (argc < 3)
+    while ((opt = getopt(argc, argv, "m:T:S:B:P:c:j:s:")) != -1)
     {
-       std::cout << "Usage: " << argv[0] << " <gene file> <island file>" << std::endl;
-       return 0;
+        switch (opt)
+        {
+        case 'm':
+            options.memory_limit = strtoul(optarg, 0, 10) * 1024 * 1024;
+            break;
+        case 'T':
+            options.temp_dir = optarg;
+            break;
+        case 'S':
+            stats_path = optarg;
+            break;
+        case 'B':
+            stats_options.bootstrap = strtoul(optarg, 0, 10);
+            break;
+        case 'P':
+            stats_options.permutations = strtoul(optarg, 0, 10);
+            break;
+        case 'c':
+            stats_options.confidence = strtod(optarg, 0);
+            break;
+        case 'j':
+            stats_options.threads = strtoul(optarg, 0, 10);
+            break;
+        case 's':
+            stats_options.seed = strtoul(optarg, 0, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
     }
 
-    std::ifstream gene_file(argv[1]);
+    if (argc - optind < 2)
+    {
+        usage(argv[0]);
+        return 0;
+    }
 
-    if (!gene_file.is_open())
+    MappedFile gene_file;
+    if (!gene_file.open(argv[optind]))
     {
         std::cout << "Error opening gene file" << std::endl;
         return 0;
-    } 
-
-    std::ifstream island_file(argv[2]);
+    }
 
-    if (!island_file.is_open())
+    MappedFile island_file;
+    if (!island_file.open(argv[optind + 1]))
     {
         std::cout << "Error opening island file" << std::endl;
         return 0;
-    } 
+    }
 
-    while (gene_file)
+    FILE * out = stdout;
+    if (argc - optind > 2 && !(out = fopen(argv[optind + 2], "w")))
     {
-        int col = 0;
-        bool methylation_found  = false;
-        std::string island_name;     
-        std::string expression_level;
-        std::string line;
-        std::string  methylation_score;
-
-
-        std::getline(gene_file, line);
-        boost::char_separator<char> sep(", \t", "", boost::drop_empty_tokens);
-        boost::tokenizer<boost::char_separator<char> > tok(line, sep);
-        boost::tokenizer<boost::char_separator<char> >::iterator cur = tok.begin();
-
-        for (; cur!= tok.end(); cur++)
-        { 
-            col++;
-            
-            // first column is expression level
-            if (col == 1)
-            {
-                expression_level = *cur;
-            }
+        std::cout << "Error opening pairs file" << std::endl;
+        return 0;
+    }
+    setvbuf(out, 0, _IOFBF, 1 << 20);
 
-            // we y want to find the CpGI
-            if (col == 3)
-            {
-                island_name = *cur;
-//                std::cout << island_name << std::endl;
-                methylation_score = locate_island_score(&island_file, island_name);
-                if (methylation_score != "NA")
-                    methylation_found = true;
-                break;
-            }
-        }
+    FILE * stats_out = 0;
+    if (stats_path && !(stats_out = fopen(stats_path, "w")))
+    {
+        std::cout << "Error opening stats file" << std::endl;
+        return 0;
+    }
 
-       if (methylation_found)
-           std::cout << methylation_score << "\t"
-                     << expression_level  <<  std::endl;
+    PairStats stats;
+    IslandJoin join(gene_file, island_file, options);
+    if (join.run(out, stats_out ? &stats : 0) < 0)
+        std::cerr << "Failed to spill sorted runs to " << options.temp_dir << std::endl;
+    else if (stats_out)
+    {
+        PairStats::write_header(stats_out);
+        PairStats::write(stats_out, argv[optind + 1], stats.run(stats_options));
     }
-   return 0;
+
+    if (stats_out)
+        fclose(stats_out);
+    if (out != stdout)
+        fclose(out);
+    return 0;
 }
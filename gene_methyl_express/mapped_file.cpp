@@ -0,0 +1,70 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       read only memory mapped input file
+ *
+ *************************************************/
+
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : fd_(-1), data_(0), size_(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string & path)
+{
+    struct stat st;
+
+    close();
+
+    if ((fd_ = ::open(path.c_str(), O_RDONLY)) < 0)
+        return false;
+
+    if (fstat(fd_, &st) != 0)
+    {
+        close();
+        return false;
+    }
+
+    size_ = st.st_size;
+
+    // mmap refuses empty files, an empty map is still a valid input
+    if (size_ == 0)
+        return true;
+
+    void * map = mmap(0, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (map == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    madvise(map, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(map);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data_)
+        munmap(const_cast<char *>(data_), size_);
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_   = -1;
+    data_ = 0;
+    size_ = 0;
+}
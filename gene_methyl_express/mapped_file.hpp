@@ -0,0 +1,41 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       read only memory mapped input file
+ *
+ *************************************************/
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // returns false if the file can't be opened or mapped
+    bool open(const std::string & path);
+    void close();
+
+    bool is_open() const { return fd_ >= 0; }
+    const char * data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile & operator=(const MappedFile &);
+
+    int          fd_;
+    const char * data_;
+    size_t       size_;
+};
+
+#endif
@@ -0,0 +1,442 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       correlation, bootstrap and permutation kernels over (score, expression)
+ *       pairs
+ *
+ *************************************************/
+
+#include "pair_stats.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+namespace
+{
+
+typedef double vector4 __attribute__ ((vector_size (4 * sizeof(double))));
+
+const unsigned long block_size = 1024;      // resamples drawn from one seed
+const double        not_a_number = std::numeric_limits<double>::quiet_NaN();
+
+// by reference, vectors wider than SSE change the ABI when passed by value
+inline void load4(vector4 & v, const double * p)
+{
+    memcpy(&v, p, sizeof(v));
+}
+
+inline double sum4(const vector4 & v)
+{
+    return (v[0] + v[1]) + (v[2] + v[3]);
+}
+
+// xoshiro256** seeded through splitmix64, one generator per block of resamples
+class Random
+{
+public:
+    Random(unsigned long seed, unsigned long stream)
+    {
+        uint64_t x = seed ^ (stream * 0x9e3779b97f4a7c15ULL);
+
+        for (int i = 0; i < 4; i++)
+        {
+            uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            s_[i] = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next()
+    {
+        uint64_t result = rotl(s_[1] * 5, 7) * 9;
+        uint64_t t = s_[1] << 17;
+
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    // unbiased integer in [0, n), Lemire's multiply and reject
+    uint32_t below(uint32_t n)
+    {
+        uint64_t m = (next() >> 32) * n;
+
+        if ((uint32_t)m < n)
+        {
+            uint32_t threshold = -n % n;
+            while ((uint32_t)m < threshold)
+                m = (next() >> 32) * n;
+        }
+        return m >> 32;
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    uint64_t s_[4];
+};
+
+struct Moments
+{
+    double w, x, y, xx, yy, xy;
+};
+
+// weighted first and second moments, four lanes at a time
+Moments weighted_moments(const double * w, const double * x, const double * y, size_t n)
+{
+    vector4 sw = {0}, sx = {0}, sy = {0}, sxx = {0}, syy = {0}, sxy = {0};
+    Moments m;
+    size_t  i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        vector4 vw, vx, vy, wx, wy;
+
+        load4(vw, w + i);
+        load4(vx, x + i);
+        load4(vy, y + i);
+        wx = vw * vx;
+        wy = vw * vy;
+
+        sw  += vw;
+        sx  += wx;
+        sy  += wy;
+        sxx += wx * vx;
+        syy += wy * vy;
+        sxy += wx * vy;
+    }
+
+    m.w = sum4(sw); m.x = sum4(sx); m.y = sum4(sy);
+    m.xx = sum4(sxx); m.yy = sum4(syy); m.xy = sum4(sxy);
+    for (; i < n; i++)
+    {
+        m.w  += w[i];
+        m.x  += w[i] * x[i];
+        m.y  += w[i] * y[i];
+        m.xx += w[i] * x[i] * x[i];
+        m.yy += w[i] * y[i] * y[i];
+        m.xy += w[i] * x[i] * y[i];
+    }
+    return m;
+}
+
+double dot(const double * x, const double * y, size_t n)
+{
+    vector4 s = {0};
+    double  sum;
+    size_t  i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        vector4 vx, vy;
+
+        load4(vx, x + i);
+        load4(vy, y + i);
+        s += vx * vy;
+    }
+    for (sum = sum4(s); i < n; i++)
+        sum += x[i] * y[i];
+    return sum;
+}
+
+double moments_correlation(const Moments & m)
+{
+    double xy = m.xy - m.x * m.y / m.w;
+    double xx = m.xx - m.x * m.x / m.w;
+    double yy = m.yy - m.y * m.y / m.w;
+
+    if (!(xx > 0.0 && yy > 0.0))
+        return not_a_number;
+    return xy / std::sqrt(xx * yy);
+}
+
+// one variable sorted once, tied values grouped, so ranks of any resample
+// are a single pass over the groups
+struct RankOrder
+{
+    std::vector<uint32_t> order;        // indices by value
+    std::vector<uint32_t> group_end;    // one past the last tie of order[k]
+
+    explicit RankOrder(const std::vector<double> & v) : order(v.size()), group_end(v.size())
+    {
+        for (size_t i = 0; i < v.size(); i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return v[a] < v[b]; });
+
+        for (size_t k = 0; k < v.size(); )
+        {
+            size_t end = k + 1;
+
+            while (end < v.size() && v[order[end]] == v[order[k]])
+                end++;
+            std::fill(group_end.begin() + k, group_end.begin() + end, end);
+            k = end;
+        }
+    }
+
+    // mid-ranks of the sample holding w[i] copies of value i, ties share the
+    // mean of their positions.  Entries with no copies get a rank too, it is
+    // weighted out later
+    void ranks(const double * w, double * ranks) const
+    {
+        double below = 0.0;
+
+        for (size_t k = 0; k < order.size(); )
+        {
+            size_t end = group_end[k], j;
+            double tied = 0.0, rank;
+
+            for (j = k; j < end; j++)
+                tied += w[order[j]];
+            rank = below + (tied + 1.0) / 2.0;
+            for (j = k; j < end; j++)
+                ranks[order[j]] = rank;
+            below += tied;
+            k = end;
+        }
+    }
+};
+
+struct Scratch
+{
+    explicit Scratch(size_t n) : counts(n), x_ranks(n), y_ranks(n), y(n), y_ranks_shuffled(n) {}
+
+    std::vector<double> counts;
+    std::vector<double> x_ranks;
+    std::vector<double> y_ranks;
+    std::vector<double> y;
+    std::vector<double> y_ranks_shuffled;
+};
+
+// hand out blocks to the threads, each thread keeps its own scratch space
+template <typename F>
+void for_each_block(unsigned long num_blocks, unsigned threads, size_t n, F f)
+{
+    std::atomic<unsigned long> next(0);
+    std::vector<std::thread>   workers;
+
+    auto work = [&]()
+    {
+        Scratch       scratch(n);
+        unsigned long block;
+
+        while ((block = next++) < num_blocks)
+            f(block, scratch);
+    };
+
+    threads = std::max(1U, std::min<unsigned>(threads, num_blocks));
+    for (unsigned t = 1; t < threads; t++)
+        workers.emplace_back(work);
+    work();
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+}
+
+// percentile interval of the finite resampled statistics
+void percentile_interval(std::vector<double> & values, double confidence, Correlation & c)
+{
+    values.erase(std::remove_if(values.begin(), values.end(), [](double v) { return !std::isfinite(v); }),
+                 values.end());
+    if (values.empty())
+        return;
+    std::sort(values.begin(), values.end());
+
+    auto quantile = [&](double q)
+    {
+        double h = q * (values.size() - 1);
+        size_t i = (size_t)h;
+
+        return i + 1 < values.size() ? values[i] + (h - i) * (values[i + 1] - values[i]) : values[i];
+    };
+
+    c.low  = quantile((1.0 - confidence) / 2.0);
+    c.high = quantile(1.0 - (1.0 - confidence) / 2.0);
+}
+
+} // namespace
+
+StatsOptions::StatsOptions()
+    : bootstrap(10000), permutations(10000), confidence(0.95),
+      threads(std::max(1U, std::thread::hardware_concurrency())), seed(1)
+{
+}
+
+bool PairStats::load(const std::string & path)
+{
+    MappedFile  file;
+    const char * p, * end;
+
+    if (!file.open(path))
+        return false;
+
+    for (p = file.data(), end = p + file.size(); p < end; )
+    {
+        const char * eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        double       score, expression;
+
+        if (!eol)
+            eol = end;
+
+        // lines that aren't two numbers, headers and the like, are skipped
+        auto parsed = std::from_chars(p, eol, score);
+        if (parsed.ec == std::errc())
+        {
+            const char * q = parsed.ptr;
+
+            while (q < eol && (*q == '\t' || *q == ' ' || *q == ','))
+                q++;
+            if (q > parsed.ptr && std::from_chars(q, eol, expression).ec == std::errc())
+                add(score, expression);
+        }
+        p = eol + 1;
+    }
+    return true;
+}
+
+PairStatsResult PairStats::run(const StatsOptions & options) const
+{
+    PairStatsResult result;
+    size_t          n = scores_.size(), i;
+
+    result.n = n;
+    result.pearson.value  = result.pearson.low  = result.pearson.high  = result.pearson.p_value  = not_a_number;
+    result.spearman.value = result.spearman.low = result.spearman.high = result.spearman.p_value = not_a_number;
+    if (n < 3)
+        return result;
+
+    // centered values keep the sums of squares well conditioned
+    std::vector<double> x(scores_), y(expressions_), ones(n, 1.0);
+    double x_mean = 0.0, y_mean = 0.0;
+
+    for (i = 0; i < n; i++)
+    {
+        x_mean += x[i];
+        y_mean += y[i];
+    }
+    x_mean /= n;
+    y_mean /= n;
+    for (i = 0; i < n; i++)
+    {
+        x[i] -= x_mean;
+        y[i] -= y_mean;
+    }
+
+    RankOrder           x_order(x), y_order(y);
+    std::vector<double> x_ranks(n), y_ranks(n);
+
+    // ranks centered on (n + 1) / 2 for the same reason
+    x_order.ranks(&ones[0], &x_ranks[0]);
+    y_order.ranks(&ones[0], &y_ranks[0]);
+    for (i = 0; i < n; i++)
+    {
+        x_ranks[i] -= (n + 1) / 2.0;
+        y_ranks[i] -= (n + 1) / 2.0;
+    }
+
+    result.pearson.value  = moments_correlation(weighted_moments(&ones[0], &x[0], &y[0], n));
+    result.spearman.value = moments_correlation(weighted_moments(&ones[0], &x_ranks[0], &y_ranks[0], n));
+
+    if (options.bootstrap)
+    {
+        std::vector<double> pearson(options.bootstrap), spearman(options.bootstrap);
+        unsigned long       num_blocks = (options.bootstrap + block_size - 1) / block_size;
+
+        // a resample is a vector of counts, how often each pair was drawn
+        for_each_block(num_blocks, options.threads, n, [&](unsigned long block, Scratch & s)
+        {
+            Random        random(options.seed, 2 * block);
+            unsigned long r, last = std::min(options.bootstrap, (block + 1) * block_size);
+
+            for (r = block * block_size; r < last; r++)
+            {
+                std::fill(s.counts.begin(), s.counts.end(), 0.0);
+                for (size_t k = 0; k < n; k++)
+                    s.counts[random.below(n)] += 1.0;
+
+                pearson[r] = moments_correlation(weighted_moments(&s.counts[0], &x[0], &y[0], n));
+
+                x_order.ranks(&s.counts[0], &s.x_ranks[0]);
+                y_order.ranks(&s.counts[0], &s.y_ranks[0]);
+                spearman[r] = moments_correlation(weighted_moments(&s.counts[0], &s.x_ranks[0], &s.y_ranks[0], n));
+            }
+        });
+
+        percentile_interval(pearson, options.confidence, result.pearson);
+        percentile_interval(spearman, options.confidence, result.spearman);
+    }
+
+    if (options.permutations && std::isfinite(result.pearson.value) && std::isfinite(result.spearman.value))
+    {
+        unsigned long              num_blocks = (options.permutations + block_size - 1) / block_size;
+        std::vector<unsigned long> pearson_hits(num_blocks), spearman_hits(num_blocks);
+        unsigned long              pearson_total = 0, spearman_total = 0;
+
+        // shuffling y leaves every moment but sum(x * y) alone, so only the
+        // cross products are recomputed.  The slack absorbs rounding so ties
+        // with the observed statistic count as at least as extreme
+        double pearson_bound  = std::fabs(dot(&x[0], &y[0], n)) * (1.0 - 1e-12);
+        double spearman_bound = std::fabs(dot(&x_ranks[0], &y_ranks[0], n)) * (1.0 - 1e-12);
+
+        for_each_block(num_blocks, options.threads, n, [&](unsigned long block, Scratch & s)
+        {
+            Random        random(options.seed, 2 * block + 1);
+            unsigned long r, last = std::min(options.permutations, (block + 1) * block_size);
+
+            // every block starts from the same order
+            std::copy(y.begin(), y.end(), s.y.begin());
+            std::copy(y_ranks.begin(), y_ranks.end(), s.y_ranks_shuffled.begin());
+
+            for (r = block * block_size; r < last; r++)
+            {
+                for (size_t k = n - 1; k > 0; k--)
+                {
+                    size_t j = random.below(k + 1);
+
+                    std::swap(s.y[k], s.y[j]);
+                    std::swap(s.y_ranks_shuffled[k], s.y_ranks_shuffled[j]);
+                }
+                pearson_hits[block]  += std::fabs(dot(&x[0], &s.y[0], n)) >= pearson_bound;
+                spearman_hits[block] += std::fabs(dot(&x_ranks[0], &s.y_ranks_shuffled[0], n)) >= spearman_bound;
+            }
+        });
+
+        for (i = 0; i < num_blocks; i++)
+        {
+            pearson_total  += pearson_hits[i];
+            spearman_total += spearman_hits[i];
+        }
+        result.pearson.p_value  = (pearson_total + 1.0) / (options.permutations + 1.0);
+        result.spearman.p_value = (spearman_total + 1.0) / (options.permutations + 1.0);
+    }
+
+    return result;
+}
+
+void PairStats::write_header(FILE * out)
+{
+    fprintf(out, "comparison\tn\tpearson\tpearson_low\tpearson_high\tpearson_p"
+                 "\tspearman\tspearman_low\tspearman_high\tspearman_p\n");
+}
+
+void PairStats::write(FILE * out, const std::string & name, const PairStatsResult & result)
+{
+    fprintf(out, "%s\t%zu\t%g\t%g\t%g\t%g\t%g\t%g\t%g\t%g\n", name.c_str(), result.n,
+            result.pearson.value, result.pearson.low, result.pearson.high, result.pearson.p_value,
+            result.spearman.value, result.spearman.low, result.spearman.high, result.spearman.p_value);
+}
@@ -0,0 +1,75 @@
+/*
+ *    @file
+ *    @author Brock Anderson <brock.wright.anderson@gmail.com>
+ *    @section LICENSE
+ *       Released to public domain without restriction
+ *
+ *    @section DESCRIPTION
+ *       Pearson and Spearman correlation of (score, expression) pairs with
+ *       percentile bootstrap confidence intervals and two sided permutation
+ *       p-values.  Resamples are cut into fixed blocks, each seeded from the
+ *       block number, so the results don't depend on the thread count.
+ *
+ *************************************************/
+
+#ifndef PAIR_STATS_HPP
+#define PAIR_STATS_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct StatsOptions
+{
+    StatsOptions();
+
+    unsigned long bootstrap;        // resamples for the confidence intervals
+    unsigned long permutations;     // shuffles for the p-values
+    double        confidence;       // confidence level of the intervals
+    unsigned      threads;
+    unsigned long seed;
+};
+
+struct Correlation
+{
+    double value;
+    double low;                     // bootstrap interval, NaN without resamples
+    double high;
+    double p_value;                 // NaN without permutations
+};
+
+struct PairStatsResult
+{
+    size_t      n;
+    Correlation pearson;
+    Correlation spearman;
+};
+
+class PairStats
+{
+public:
+    PairStats() {}
+
+    void add(double score, double expression)
+    {
+        scores_.push_back(score);
+        expressions_.push_back(expression);
+    }
+
+    // reads "score\texpression" lines as written by gene_methyl_express,
+    // returns false if the file can't be read
+    bool load(const std::string & path);
+
+    size_t size() const { return scores_.size(); }
+
+    PairStatsResult run(const StatsOptions & options) const;
+
+    static void write_header(FILE * out);
+    static void write(FILE * out, const std::string & name, const PairStatsResult & result);
+
+private:
+    std::vector<double> scores_;
+    std::vector<double> expressions_;
+};
+
+#endif
@@ -18,8 +18,13 @@
 struct CpGIOverlap_stream {
     const GtNodeStream parent_instance;
     GtNodeStream * in_stream;
-    FILE * cpgi_file;
+    cpgi_index * islands;
 
+    // per stream query buffers, so streams don't share any state
+    const cpgi_t ** hits;
+    unsigned long   hits_capacity;
+    GtStr *         overlap_names;
+    unsigned long   num_scored;
 };
 
 static const char * feature_type_gene = "gene";
@@ -30,82 +35,29 @@ const GtNodeStreamClass * CpGIOverlap_stream_class(void);
 #define CpGIOverlap_stream_cast(GS) gt_node_stream_cast(CpGIOverlap_stream_class(), GS);
 
 
-static inline int in_range(unsigned long n, unsigned long s, unsigned long e)
-{
-    return (n >= s && n <= e) ? 1 : 0;
-}
-
-// not thread safe
+// returns a comma separated list of every island containing the TSS, or NULL
+// if there is none.  The string is owned by the stream.
 const char * CpGIOverlap_stream_find_gene_overlap( CpGIOverlap_stream * context,
                                                    unsigned long        TSS,
                                                    int                  chromosome
                                                  )
 {
-    static char found_island_name[255];
-    unsigned long island_start = 0;
-    unsigned long island_end   = 0;
-    int           island_chromosome = 0;
-    char          buf;
-    int           err;
-
-    int passed_TSS = false;
-    
-    // file positioning
-    long int file_start_search_pos;
-    file_start_search_pos = ftell(context->cpgi_file);
+    unsigned long num_hits, i;
 
-    // to find the associated CpGI, we check for valid islands moving forward in file until we get beyond the TSS.  If
-    // none is found, we move backwards in the file until we get beyond the TSS and then declare an overlap not found
+    num_hits = cpgi_index_overlap(context->islands, chromosome, TSS, TSS,
+                                  &context->hits, &context->hits_capacity);
+    if (num_hits == 0)
+        return (const char *)0;
 
-    while (island_chromosome < chromosome || (island_chromosome == chromosome && island_end <= TSS))
+    gt_str_reset(context->overlap_names);
+    for (i = 0; i < num_hits; i++)
     {
-        if (4 != fscanf(context->cpgi_file, "%s %d %lu %lu", found_island_name, &island_chromosome, &island_start, &island_end) )
-            break; // reached EOF
-        if (island_chromosome != chromosome)
-            continue; // keep scanning forward until we get to our chromosome
-        if (in_range(TSS, island_start, island_end))
-            return found_island_name;
+        if (i)
+            gt_str_append_char(context->overlap_names, ',');
+        gt_str_append_cstr(context->overlap_names, context->hits[i]->name);
     }
 
-    // if we didn't find an overlapping cpgi moving forward, rewind back to where we were and search file backwards
-    fseek(context->cpgi_file, file_start_search_pos + 1, SEEK_SET);
-    
-
-    // fake this info so we can search 
-    island_chromosome = chromosome;
-    island_start = TSS + 1;
-    island_end   = TSS + 1;
- 
-    while ( island_chromosome > chromosome || (island_chromosome == chromosome && island_start >= TSS))
-    {
-        // we have to search backwards from the current position for a newline marker
-        while (! ( err = fseek(context->cpgi_file, -2, SEEK_CUR)))
-        {
-           fread(&buf, 1, 1, context->cpgi_file);
-           if (buf == '\n') // look for newline
-               break;
-        }
-       
-        // if error we were at beginning of file and it's time to return without finding anything
-        if (err)
-            return (const char *)0;
-
-        file_start_search_pos = ftell(context->cpgi_file);
-
-        // now fscanf, check for a match, if no match rewind to the beginning of the search line
-        if (4 != fscanf(context->cpgi_file, "%s %d %lu %lu", found_island_name, &island_chromosome, &island_start, &island_end) )
-            break; // something went wrong
-
-        if (chromosome == island_chromosome && in_range(TSS, island_start, island_end))
-        {
-             printf("Found special");
-             return found_island_name;
-        }
-
-        fseek(context->cpgi_file, file_start_search_pos, SEEK_SET);
-    }
-
-    return (const char *)0;
+    return gt_str_get(context->overlap_names);
 }
 
 static int CpGIOverlap_stream_next(GtNodeStream * ns,
@@ -129,10 +81,10 @@ static int CpGIOverlap_stream_next(GtNodeStream * ns,
     context = CpGIOverlap_stream_cast(ns);
 
     // find the genes, determine expression level
-     if(!gt_node_stream_next(context->in_stream,
-                            &cur_node,
-                            err
-                           ) && cur_node != NULL
+     if(!(err_num = gt_node_stream_next(context->in_stream,
+                                        &cur_node,
+                                        err
+                                       )) && cur_node != NULL
        )
      {
          *gn = cur_node;
@@ -149,7 +101,7 @@ static int CpGIOverlap_stream_next(GtNodeStream * ns,
               {
                   iter = gt_feature_node_iterator_new(cur_node);
                   if (iter == NULL)
-                      return;
+                      return 0;
                   while ((next_node = gt_feature_node_iterator_next(iter)) && !gt_feature_node_has_type(next_node, feature_type_gene));
                   gt_feature_node_iterator_delete(iter);
                   if (NULL == (cur_node = next_node))
@@ -164,7 +116,7 @@ static int CpGIOverlap_stream_next(GtNodeStream * ns,
               gene_name = gt_feature_node_get_attribute(cur_node, "Name");
 
               if (gene_name == NULL)
-                  return;
+                  return 0;
 
               if ( 1 != sscanf(gt_str_get(gt_genome_node_get_seqid(cur_node)), "Chr%d", &chr_num))
                   return 0;
@@ -177,6 +129,7 @@ static int CpGIOverlap_stream_next(GtNodeStream * ns,
 
               // save the score into the node
               gt_feature_node_set_attribute(cur_node, "cpgi_at_tss", overlap_name);
+              context->num_scored++;
               
               return 0;
 
@@ -191,7 +144,10 @@ static void CpGIOverlap_stream_free(GtNodeStream * ns)
     CpGIOverlap_stream * score_stream;
     
     score_stream = CpGIOverlap_stream_cast(ns);
-    fclose(score_stream->cpgi_file);
+    cpgi_index_delete(score_stream->islands);
+    gt_node_stream_delete(score_stream->in_stream);
+    free(score_stream->hits);
+    gt_str_delete(score_stream->overlap_names);
     return;
 }
 
@@ -210,21 +166,41 @@ const GtNodeStreamClass * CpGIOverlap_stream_class(void)
     return c;
 }
 
-GtNodeStream * CpGIOverlap_stream_new(GtNodeStream * in_stream, const char * cpgi_db)
+GtNodeStream * CpGIOverlap_stream_new_with_index(GtNodeStream * in_stream, cpgi_index * islands)
 {
     GtNodeStream * ns = gt_node_stream_create(CpGIOverlap_stream_class(), 
                                               true); // must be sorted
     CpGIOverlap_stream * context = CpGIOverlap_stream_cast(ns);
-    gt_assert(in_stream);
+    gt_assert(in_stream && islands);
     context->in_stream = gt_node_stream_ref(in_stream);
+    context->islands = cpgi_index_ref(islands);
+    context->num_scored = 0;
+    context->hits = NULL;
+    context->hits_capacity = 0;
+    context->overlap_names = gt_str_new();
 
-    if ((context->cpgi_file = fopen(cpgi_db, "r")) == NULL)
+    return ns;
+}
+
+GtNodeStream * CpGIOverlap_stream_new(GtNodeStream * in_stream, const char * cpgi_db)
+{
+    GtNodeStream * ns;
+    cpgi_index *   islands;
+
+    // the whole island list is loaded up front, so it doesn't need to be sorted
+    if ((islands = cpgi_index_load(cpgi_db)) == NULL)
     {
-       gt_node_stream_delete(ns);
        fprintf(stderr, "Failed to open CpG Island db file %s\n", cpgi_db);
        return NULL;
     }
 
+    ns = CpGIOverlap_stream_new_with_index(in_stream, islands);
+    cpgi_index_delete(islands);
     return ns;
- 
+}
+
+unsigned long CpGIOverlap_stream_num_scored(GtNodeStream * ns)
+{
+    CpGIOverlap_stream * context = CpGIOverlap_stream_cast(ns);
+    return context->num_scored;
 }
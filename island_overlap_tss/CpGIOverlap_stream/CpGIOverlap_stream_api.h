@@ -9,8 +9,16 @@
 #ifndef  CPGI_OVERLAP_STREAM_API_H
 #define  CPGI_OVERLAP_STREAM_API_H
 
+#include "../cpgi_index/cpgi_index.h"
+
 typedef struct CpGIOverlap_stream CpGIOverlap_stream;
 
-GtNodeStream* CpGI_overlap_stream_new(GtNodeStream * in_stream, const char * cpgi_db);
+GtNodeStream* CpGIOverlap_stream_new(GtNodeStream * in_stream, const char * cpgi_db);
+
+// check against an already loaded island list, the stream takes its own reference
+GtNodeStream* CpGIOverlap_stream_new_with_index(GtNodeStream * in_stream, cpgi_index * islands);
+
+// number of genes found with an island at their TSS so far
+unsigned long CpGIOverlap_stream_num_scored(GtNodeStream * ns);
 
 #endif
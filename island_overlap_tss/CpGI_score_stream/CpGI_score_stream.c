@@ -12,193 +12,70 @@
 #include <genometools.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include "CpGI_score_stream.h"
+#include "CpGI_score_stream_api.h"
+#include "../track_index/track_index.h"
+#include "../track_score_stream/track_score_stream_api.h"
 
 
-typedef struct
+// score is sum(entries in island range) / (num_cg)
+static const track_score_spec_t CpGI_score_spec =
 {
-    unsigned long start;
-    unsigned long end;
-} island_t;
-
-struct CpGI_score_stream {
-    const GtNodeStream parent_instance;
-    GtNodeStream * in_stream;
-    FILE * methylome_file;
-  
-    // we store these in case we fscanf'd an entry too far
-    unsigned long previous_methylome_position;
-    float         previous_methylome_fraction;
-    int           previous_methylome_chromosome;
+    "CpGI", TRACK_REDUCE_SUM, TRACK_NORMALIZE_ATTRIBUTE, "sumcg", NULL
 };
 
-static const char * feature_type_CpGI = "CpGI";
-
-
-const GtNodeStreamClass * CpGI_score_stream_class(void);
-
-#define CpGI_score_stream_cast(GS) gt_node_stream_cast(CpGI_score_stream_class(), GS);
-
-static float CpGI_score_stream_score_island(CpGI_score_stream * context,
-                                            int island_chromosome_num,
-                                            unsigned long num_cg,
-                                            unsigned long island_start,
-                                            unsigned long island_end
-                                         )
-{
-    // iterate through the methylome db to find all entries
-    // score is sum(entries in island range) / (num_cg)
-    //
-    // assume both streams are sorted
-
-    unsigned long position = 0;
-    int chromosome_num = island_chromosome_num;
-    float methylation;
-    float score = 0.0f;
-
-    if (num_cg == 0)
-        return 0.0f;
-
-    // first see if the previous data matches this CpGI
-    if (context->previous_methylome_chromosome == island_chromosome_num &&
-        island_start <= context->previous_methylome_position &&
-        island_end   >= context->previous_methylome_position
-       )
-          score += context->previous_methylome_fraction; 
-
-    while ((position < island_end && chromosome_num == island_chromosome_num) || chromosome_num < island_chromosome_num)
-    {
-       if (3 != fscanf(context->methylome_file, "%d %lu %f", &chromosome_num, &position, &methylation))
-           break;
-       if (position >= island_start && position <= island_end && island_chromosome_num == chromosome_num)
-           score += methylation;
-    }
-
-    context->previous_methylome_position = position;
-    context->previous_methylome_fraction = methylation;
-    context->previous_methylome_chromosome = chromosome_num;
-
-    score = score / (float)(num_cg);
-
-    return score;
-}
-
-static int CpGI_score_stream_next(GtNodeStream * ns,
-                                   GtGenomeNode ** gn,
-                                   GtError * err)
+// or with read counts, methylated reads / reads over the island's
+// cytosines, so deeply covered sites count for more
+static const track_score_spec_t CpGI_score_weighted_spec =
 {
-    GtGenomeNode * cur_node;
-    int err_num = 0;
-    *gn = NULL;
-    CpGI_score_stream * score_stream;
-    unsigned long island_start;
-    unsigned long island_end;
-    float island_score;
-    int chromosome_num;
-    GtStr * seqID_gtstr;
-    char *  seqID_str;
-    char *  num_cg_str;
-    unsigned long num_cg = 0;
-
-    score_stream = CpGI_score_stream_cast(ns);
-
-    // find the CpGI's, process methylome score
-     if(!gt_node_stream_next(score_stream->in_stream,
-                            &cur_node,
-                            err
-                           ) && cur_node != NULL
-       )
-     {
-         *gn = cur_node;
-
-         // try casting as a feature node so we can test type
-         if(!gt_genome_node_try_cast(gt_feature_node_class(), cur_node))
-         {
-               return 0;
-         }
-         else // we found a feature node
-         {
-              if(!gt_feature_node_has_type(cur_node, feature_type_CpGI))
-                  return 0;
-
-              #if DEBUG_SCORE
-              printf("found CpGI\n");
-              #endif 
- 
-              island_start = gt_genome_node_get_start(cur_node);
-              island_end   = gt_genome_node_get_end(cur_node);
-
-              seqID_gtstr = gt_genome_node_get_seqid(cur_node);
-              seqID_str   = gt_str_get(seqID_gtstr);
-              sscanf(seqID_str, "Chr%d", &chromosome_num);
-
-              num_cg_str = gt_feature_node_get_attribute(cur_node, "sumcg");
-              if (!num_cg_str)
-                 return 0;
-              
-              sscanf(num_cg_str, "%d", &num_cg);             
-
-              // now figure out the score
-              island_score = CpGI_score_stream_score_island(score_stream ,
-                                                            chromosome_num,
-                                                            num_cg,
-                                                            island_start,
-                                                            island_end);
-//              gt_str_delete(seqID_gtstr);
-
-              // save the score into the node
-              gt_feature_node_set_score(cur_node, island_score);
-              
-              return 0;
-
-         }
-     }
+    "CpGI", TRACK_REDUCE_WEIGHTED, TRACK_NORMALIZE_NONE, NULL, NULL
+};
 
-    return err_num;
-}
 
-static void CpGI_score_stream_free(GtNodeStream * ns)
+GtNodeStream * CpGI_score_stream_new_with_index(GtNodeStream * in_stream, track_index * methylome)
 {
-    CpGI_score_stream * score_stream;
-    
-    score_stream = CpGI_score_stream_cast(ns);
-    fclose(score_stream->methylome_file);
-    return;
+    return track_score_stream_new_with_index(in_stream, methylome,
+                                             track_index_has_counts(methylome) ? &CpGI_score_weighted_spec
+                                                                               : &CpGI_score_spec);
 }
 
-const GtNodeStreamClass * CpGI_score_stream_class(void)
+GtNodeStream * CpGI_score_stream_new(GtNodeStream * in_stream, const char * methylome_db)
 {
-    static const GtNodeStreamClass * c = NULL;
+    GtNodeStream * ns;
+    track_index *  methylome;
 
-    if (!c)
-    {	
-        c = gt_node_stream_class_new( sizeof(CpGI_score_stream),
-                                      CpGI_score_stream_free,
-                                      CpGI_score_stream_next
-                                    );
+    // text or packed (see methylome_pack) methylome
+    if ((methylome = track_index_load(methylome_db)) == NULL)
+    {
+       fprintf(stderr, "Failed to open methylome db file %s\n", methylome_db);
+       return NULL;
     }
-    
-    return c;
+
+    ns = CpGI_score_stream_new_with_index(in_stream, methylome);
+    track_index_delete(methylome);
+    return ns;
 }
 
-GtNodeStream * CpGI_score_stream_new(GtNodeStream * in_stream, const char * methylome_db)
+GtNodeStream * CpGI_score_stream_new_counts(GtNodeStream * in_stream,
+                                            const char *   count_report,
+                                            unsigned int   min_depth,
+                                            int            num_threads
+                                           )
 {
-    GtNodeStream * ns = gt_node_stream_create(CpGI_score_stream_class(), 
-                                              true); // must be sorted
-    CpGI_score_stream * score_stream = CpGI_score_stream_cast(ns);
-    gt_assert(in_stream);
-    score_stream->in_stream = gt_node_stream_ref(in_stream);
-    score_stream->previous_methylome_position = 0;
-    score_stream->previous_methylome_fraction = 0.0f;
-    score_stream->previous_methylome_chromosome = 0;
+    GtNodeStream * ns;
+    track_index *  methylome;
 
-    if ((score_stream->methylome_file = fopen(methylome_db, "r")) == NULL)
+    if ((methylome = track_index_load_counts(count_report, min_depth, num_threads)) == NULL)
     {
-       gt_node_stream_delete(ns);
-       fprintf(stderr, "Failed to open methylome db file %s\n", methylome_db);
+       fprintf(stderr, "Failed to open cytosine report %s\n", count_report);
        return NULL;
     }
 
+    ns = CpGI_score_stream_new_with_index(in_stream, methylome);
+    track_index_delete(methylome);
     return ns;
- 
+}
+
+unsigned long CpGI_score_stream_num_scored(GtNodeStream * ns)
+{
+    return track_score_stream_num_scored(ns);
 }
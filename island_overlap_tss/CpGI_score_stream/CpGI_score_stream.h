@@ -1,9 +0,0 @@
-
-#ifndef CPGI_OVERLAP_STREAM_H
-#define CPGI_OVERLAP_STREAM_H
-
-#include "CpGI_score_stream_api.h"
-
-const GtNodeStreamClass * CpGI_score_stream_class(void);
-
-#endif
@@ -1,16 +1,30 @@
 /* 
  * @author brock a<brock.wright.anderson@gmail.cm>
  *
- *   
- *
+ *   Island scoring specs of track_score_stream
  *
  */
 
-#ifndef  CPGI_OVERLAP_STREAM_API_H
-#define  CPGI_OVERLAP_STREAM_API_H
+#ifndef  CPGI_SCORE_STREAM_API_H
+#define  CPGI_SCORE_STREAM_API_H
 
-typedef struct CpGI_score_stream CpGI_score_stream;
+#include "../track_index/track_index.h"
 
 GtNodeStream* CpGI_score_stream_new(GtNodeStream * in_stream, const char * methylome_db);
 
+// score against a Bismark coverage file or cytosine report, by methylated
+// over covering reads at the cytosines with at least min_depth reads
+GtNodeStream* CpGI_score_stream_new_counts(GtNodeStream * in_stream,
+                                           const char *   count_report,
+                                           unsigned int   min_depth,
+                                           int            num_threads
+                                          );
+
+// score against an already loaded methylome, the stream takes its own
+// reference.  Methylomes loaded from read counts are scored as above
+GtNodeStream* CpGI_score_stream_new_with_index(GtNodeStream * in_stream, track_index * methylome);
+
+// number of islands scored so far
+unsigned long CpGI_score_stream_num_scored(GtNodeStream * ns);
+
 #endif
@@ -0,0 +1,296 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*  run any combination of the scoring streams in one pipeline, so the
+*  annotation is parsed and written only once
+*
+*************************************************/
+#include "genometools.h"
+#include "CpGI_score_stream/CpGI_score_stream_api.h"
+#include "island_nuc_score_stream/island_nuc_score_stream_api.h"
+#include "CpGIOverlap_stream/CpGIOverlap_stream_api.h"
+#include "island_sweep_stream/island_sweep_stream_api.h"
+#include "gene_expression_score_stream/gene_expression_score_stream_api.h"
+#include "seqid_parallel_stream/seqid_parallel_stream_api.h"
+#include "stats_stream/stats_stream_api.h"
+#include "gff3_lite_in_stream/gff3_lite_in_stream_api.h"
+#include "gff3_fast_out_stream/gff3_fast_out_stream_api.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_STAGES 5
+
+// every db is loaded once and shared by all the stream chains
+typedef struct
+{
+    track_index *      methylome;
+    track_index *      nucleosomes;
+    cpgi_index *       islands;
+    cpgi_index *       sweep_islands;
+    unsigned long      upstream;        // promoter window of the sweep join
+    unsigned long      downstream;
+    expression_table * rnaseq;
+} annotate_dbs_t;
+
+void usage(const char * name)
+{
+   printf("Usage: %s [--stats] [--fast] [--fast-out] [-j <threads>] [-m <methylome db> [-D <min depth>]] [-n <nucleosome db>]\n"
+          "       [-c <cpgi fileName>] [-p <cpgi fileName> [-u <upstream>] [-d <downstream>]] [-r <RNA-seq db>] <in fileName> <out fileName>\n", name);
+   printf("   stages run in the order methylome, nucleosome, cpgi overlap, cpgi sweep join, expression\n");
+   printf("   -p adds the islands in each gene's promoter and body and the nearest island up and\n");
+   printf("   downstream, the promoter runs from -u (1000) bases before to -d (500) after the TSS\n");
+   printf("   -D reads the methylome as a Bismark coverage file or cytosine report and scores islands\n");
+   printf("   by methylated over covering reads, leaving out cytosines with fewer than min depth reads,\n");
+   printf("   only the CG rows of a CX report count\n");
+   printf("   with -j each sequence is scored on its own thread, output order is kept\n");
+   printf("   --fast reads only the gene and CpGI rows the stages need, on -j threads\n");
+   printf("   --stats reports per stage counters as JSON on stderr\n");
+   printf("   --fast-out writes through a buffered writer, scores in full precision\n");
+}
+
+// chain the requested stages on top of in, see seqid_parallel_build_func
+static int annotate_build_stages(GtNodeStream *  in,
+                                 GtNodeStream ** stages,
+                                 int             max_stages,
+                                 void *          data
+                                )
+{
+    annotate_dbs_t * dbs = data;
+    int              num_stages = 0;
+
+    gt_assert(max_stages >= MAX_STAGES);
+
+    // each stage pulls from the one before it, timed when --stats is on
+    if (dbs->methylome)
+    {
+        stages[num_stages] = stats_stream_new(CpGI_score_stream_new_with_index(in, dbs->methylome),
+                                              "CpGI_score", CpGI_score_stream_num_scored);
+        in = stages[num_stages++];
+    }
+    if (dbs->nucleosomes)
+    {
+        stages[num_stages] = stats_stream_new(island_nuc_score_stream_new_with_index(in, dbs->nucleosomes),
+                                              "island_nuc_score", island_nuc_score_stream_num_scored);
+        in = stages[num_stages++];
+    }
+    if (dbs->islands)
+    {
+        stages[num_stages] = stats_stream_new(CpGIOverlap_stream_new_with_index(in, dbs->islands),
+                                              "CpGIOverlap", CpGIOverlap_stream_num_scored);
+        in = stages[num_stages++];
+    }
+    if (dbs->sweep_islands)
+    {
+        stages[num_stages] = stats_stream_new(island_sweep_stream_new_with_index(in, dbs->sweep_islands,
+                                                                                 dbs->upstream, dbs->downstream),
+                                              "island_sweep", island_sweep_stream_num_scored);
+        in = stages[num_stages++];
+    }
+    if (dbs->rnaseq)
+    {
+        stages[num_stages] = stats_stream_new(gene_expression_score_stream_new_with_table(in, dbs->rnaseq),
+                                              "gene_expression_score", gene_expression_score_stream_num_scored);
+        in = stages[num_stages++];
+    }
+
+    return num_stages;
+}
+
+static void annotate_delete_dbs(annotate_dbs_t * dbs)
+{
+    track_index_delete(dbs->methylome);
+    track_index_delete(dbs->nucleosomes);
+    cpgi_index_delete(dbs->islands);
+    cpgi_index_delete(dbs->sweep_islands);
+    expression_table_delete(dbs->rnaseq);
+}
+
+
+int main(int argc, char ** argv)
+{
+    GtNodeStream *  in, * out, * last;
+    GtNodeStream *  stages[MAX_STAGES];
+    int             num_stages = 0;
+    GtFile *        out_file = NULL;
+    GtError *       err;
+    annotate_dbs_t  dbs = { NULL, NULL, NULL, NULL, 1000, 500, NULL };
+    const char *    methylome_db = NULL, * nucleosome_db = NULL;
+    const char *    cpgi_db = NULL, * sweep_db = NULL, * rnaseq_db = NULL;
+    int             num_threads = 1;
+    int             counts = 0;
+    unsigned int    min_depth = 1;
+    int             fast;
+    int             fast_out;
+    const char *    fast_types[3];
+    int             num_fast_types = 0;
+    int             opt, i, failed = 0;
+
+    // strip --stats, --fast and --fast-out before getopt sees them
+    stream_stats_parse_flag(&argc, argv);
+    fast = gff3_lite_in_stream_parse_flag(&argc, argv);
+    fast_out = gff3_fast_out_stream_parse_flag(&argc, argv);
+
+    while ((opt = getopt(argc, argv, "j:m:D:n:c:p:u:d:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': num_threads    = atoi(optarg); break;
+        case 'm': methylome_db   = optarg; break;
+        case 'D': counts = 1; min_depth = strtoul(optarg, NULL, 10); break;
+        case 'n': nucleosome_db  = optarg; break;
+        case 'c': cpgi_db        = optarg; break;
+        case 'p': sweep_db       = optarg; break;
+        case 'u': dbs.upstream   = strtoul(optarg, NULL, 10); break;
+        case 'd': dbs.downstream = strtoul(optarg, NULL, 10); break;
+        case 'r': rnaseq_db      = optarg; break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 2 || num_threads < 1
+        || !(methylome_db || nucleosome_db || cpgi_db || sweep_db || rnaseq_db))
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+
+    // text or packed (see methylome_pack) methylome, or read counts
+    if (methylome_db && counts)
+    {
+        if (!(dbs.methylome = track_index_load_counts(methylome_db, min_depth, sysconf(_SC_NPROCESSORS_ONLN))))
+        {
+            fprintf(stderr, "Failed to open cytosine report %s\n", methylome_db);
+            failed = 1;
+        }
+    }
+    else if (methylome_db && !(dbs.methylome = track_index_load(methylome_db)))
+    {
+        fprintf(stderr, "Failed to open methylome db file %s\n", methylome_db);
+        failed = 1;
+    }
+    if (nucleosome_db && !failed && !(dbs.nucleosomes = track_index_load(nucleosome_db)))
+    {
+        fprintf(stderr, "Failed to open nucleosome db file %s\n", nucleosome_db);
+        failed = 1;
+    }
+    if (cpgi_db && !failed && !(dbs.islands = cpgi_index_load(cpgi_db)))
+    {
+        fprintf(stderr, "Failed to open CpG Island db file %s\n", cpgi_db);
+        failed = 1;
+    }
+    if (sweep_db && !failed)
+    {
+        // both island stages usually read the same list
+        if (cpgi_db && !strcmp(cpgi_db, sweep_db))
+            dbs.sweep_islands = cpgi_index_ref(dbs.islands);
+        else if (!(dbs.sweep_islands = cpgi_index_load(sweep_db)))
+        {
+            fprintf(stderr, "Failed to open CpG Island db file %s\n", sweep_db);
+            failed = 1;
+        }
+    }
+    if (rnaseq_db && !failed && !(dbs.rnaseq = expression_table_load(rnaseq_db)))
+    {
+        fprintf(stderr, "Failed to open RNA seq db file %s\n", rnaseq_db);
+        failed = 1;
+    }
+    if (failed)
+    {
+        annotate_delete_dbs(&dbs);
+        exit(1);
+    }
+
+    // initilaize genometools
+    gt_lib_init();
+    err = gt_error_new();
+
+    if (fast)
+    {
+        // the scoring stages look at islands, the others at genes
+        if (methylome_db || nucleosome_db)
+            fast_types[num_fast_types++] = "CpGI";
+        if (cpgi_db || sweep_db || rnaseq_db)
+            fast_types[num_fast_types++] = "gene";
+        fast_types[num_fast_types] = NULL;
+        in = gff3_lite_in_stream_new(argv[optind], fast_types, num_threads);
+    }
+    else
+        in = gt_gff3_in_stream_new_sorted(argv[optind]);
+
+    if (!in)
+    {
+        fprintf(stderr, "Failed to open input stream with arg %s\n", argv[optind]);
+        exit(1);
+    }
+
+    if (!fast)
+        gt_gff3_in_stream_show_progress_bar(in);
+    in = stats_stream_new(in, "gff3_in", NULL);
+
+    if (!fast_out && !(out_file = gt_file_new(argv[optind + 1], "w+", err)))
+    {
+        gt_node_stream_delete(in);
+        fprintf(stderr, "Failed to create output file %s\n", argv[optind + 1]);
+        exit(1);
+    }
+
+    // in parallel every sequence gets a chain of its own from the same
+    // builder, otherwise the one chain reads straight from the input
+    if (num_threads > 1)
+    {
+        stages[num_stages] = stats_stream_new(seqid_parallel_stream_new(in, num_threads, annotate_build_stages, &dbs),
+                                              "seqid_parallel", NULL);
+        last = stages[num_stages++];
+    }
+    else
+    {
+        num_stages = annotate_build_stages(in, stages, MAX_STAGES, &dbs);
+        last = stages[num_stages - 1];
+    }
+
+    out = fast_out ? gff3_fast_out_stream_new(last, argv[optind + 1], 1)
+                   : gt_gff3_out_stream_new(last, out_file);
+    if (!out)
+    {
+        fprintf(stderr, "Failed to create output stream\n");
+        failed = 1;
+    }
+    out = stats_stream_new(out, "gff3_out", NULL);
+
+    if (failed)
+    {
+        for (i = num_stages - 1; i >= 0; i--)
+            gt_node_stream_delete(stages[i]);
+        gt_file_delete(out_file);
+        gt_node_stream_delete(in);
+        annotate_delete_dbs(&dbs);
+        exit(1);
+    }
+
+    if (gt_node_stream_pull(out, err))
+    {
+        fprintf(stderr, "Failed to pull through out stream: %s\n", gt_error_get(err));
+    }
+
+    // close genome tools
+    gt_node_stream_delete(out);
+    for (i = num_stages - 1; i >= 0; i--)
+        gt_node_stream_delete(stages[i]);
+    gt_file_delete(out_file);
+    gt_node_stream_delete(in);
+    annotate_delete_dbs(&dbs);
+    gt_error_delete(err);
+    gt_lib_clean();
+
+    // the stages report their scored counts as they are deleted
+    if (stream_stats_enabled())
+        stream_stats_write_json(stderr);
+    return 0;
+}
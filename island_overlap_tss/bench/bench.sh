@@ -0,0 +1,89 @@
+#!/bin/bash
+#
+# time every stream program over a generated workload, reporting wall
+# time, throughput and peak RSS.  Run through "make bench", which builds
+# the programs first; the workload is regenerated only when the settings
+# change.
+#
+#   BENCH_DIR          where the workload lives (bench/data)
+#   BENCH_SEED         generator seed (1)
+#   BENCH_GENES        genes in the annotation (33000)
+#   BENCH_ISLANDS      CpG islands in the annotation (10000)
+#   BENCH_METHYLOME    methylome records (10000000)
+#   BENCH_NUCLEOSOMES  nucleosome records (10000000)
+#   BENCH_THREADS      threads for the parallel annotate run (all cores)
+
+BENCH_DIR=${BENCH_DIR:-bench/data}
+BENCH_SEED=${BENCH_SEED:-1}
+BENCH_GENES=${BENCH_GENES:-33000}
+BENCH_ISLANDS=${BENCH_ISLANDS:-10000}
+BENCH_METHYLOME=${BENCH_METHYLOME:-10000000}
+BENCH_NUCLEOSOMES=${BENCH_NUCLEOSOMES:-10000000}
+BENCH_THREADS=${BENCH_THREADS:-$(getconf _NPROCESSORS_ONLN)}
+
+params="-s $BENCH_SEED -g $BENCH_GENES -i $BENCH_ISLANDS -m $BENCH_METHYLOME -n $BENCH_NUCLEOSOMES"
+
+mkdir -p $BENCH_DIR || exit 1
+if [ "$(cat $BENCH_DIR/params 2>/dev/null)" != "$params" ]
+then
+    echo "generating workload: $params"
+    rm -f $BENCH_DIR/params
+    ./bench_generate $params $BENCH_DIR || exit 1
+    ./methylome_pack $BENCH_DIR/methylome.txt $BENCH_DIR/methylome.db || exit 1
+    echo "$params" > $BENCH_DIR/params
+fi
+
+annotation=$BENCH_DIR/annotation.gff3
+features=$(grep -vc '^#' $annotation)
+out=$BENCH_DIR/out.gff3
+
+# bench <name> <input files...> -- <command...>
+bench()
+{
+    local name=$1 bytes=0 count=0 result seconds rss status
+    shift
+    # only runs over the annotation have a feature rate
+    [ "$1" = "$annotation" ] && count=$features
+    while [ "$1" != "--" ]
+    do
+        bytes=$((bytes + $(stat -c %s $1)))
+        shift
+    done
+    shift
+
+    result=$(./bench_run "$@" 2>&1 >/dev/null | tail -n 1)
+    read seconds rss status <<< "$result"
+    if [ "$status" != "0" ]
+    then
+        printf "%-24s failed (%s)\n" $name "$result"
+        return
+    fi
+
+    awk -v name=$name -v s=$seconds -v rss=$rss -v features=$count -v bytes=$bytes 'BEGIN {
+        if (s <= 0) s = 0.001
+        rate = features ? sprintf("%14.0f", features / s) : sprintf("%14s", "-")
+        printf "%-24s %9.3f %s %10.1f %10.1f\n", name, s, rate, bytes / s / 1048576, rss / 1024
+    }'
+}
+
+printf "%-24s %9s %14s %10s %10s\n" program seconds features/s MB/s "peak MB"
+bench island_overlap_tss $annotation $BENCH_DIR/cpgi.list -- \
+      ./island_overlap_tss $annotation $out $BENCH_DIR/cpgi.list
+bench island_score $annotation $BENCH_DIR/methylome.txt -- \
+      ./island_score $annotation $out $BENCH_DIR/methylome.txt
+bench island_score_packed $annotation $BENCH_DIR/methylome.db -- \
+      ./island_score $annotation $out $BENCH_DIR/methylome.db
+bench nuc_score $annotation $BENCH_DIR/nucleosomes.txt -- \
+      ./nuc_score $annotation $out $BENCH_DIR/nucleosomes.txt
+bench expression_score $annotation $BENCH_DIR/rnaseq.txt -- \
+      ./expression_score $annotation $out $BENCH_DIR/rnaseq.txt
+bench methylome_pack $BENCH_DIR/methylome.txt -- \
+      ./methylome_pack $BENCH_DIR/methylome.txt $BENCH_DIR/methylome.repack.db
+bench annotate $annotation $BENCH_DIR/methylome.db $BENCH_DIR/nucleosomes.txt $BENCH_DIR/cpgi.list $BENCH_DIR/rnaseq.txt -- \
+      ./annotate -m $BENCH_DIR/methylome.db -n $BENCH_DIR/nucleosomes.txt -c $BENCH_DIR/cpgi.list -r $BENCH_DIR/rnaseq.txt $annotation $out
+bench annotate_j$BENCH_THREADS $annotation $BENCH_DIR/methylome.db $BENCH_DIR/nucleosomes.txt $BENCH_DIR/cpgi.list $BENCH_DIR/rnaseq.txt -- \
+      ./annotate -j $BENCH_THREADS -m $BENCH_DIR/methylome.db -n $BENCH_DIR/nucleosomes.txt -c $BENCH_DIR/cpgi.list -r $BENCH_DIR/rnaseq.txt $annotation $out
+bench annotate_fj$BENCH_THREADS $annotation $BENCH_DIR/methylome.db $BENCH_DIR/nucleosomes.txt $BENCH_DIR/cpgi.list $BENCH_DIR/rnaseq.txt -- \
+      ./annotate --fast -j $BENCH_THREADS -m $BENCH_DIR/methylome.db -n $BENCH_DIR/nucleosomes.txt -c $BENCH_DIR/cpgi.list -r $BENCH_DIR/rnaseq.txt $annotation $out
+
+rm -f $out $BENCH_DIR/methylome.repack.db
@@ -0,0 +1,302 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Generate a seeded, TAIR10 sized synthetic workload for the stream
+*   programs: a sorted GFF3 of genes and CpG islands, the matching
+*   cpgi.list, methylome and nucleosome tracks and an rna-seq table
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define NUM_CHROMOSOMES 5
+
+// TAIR10 nuclear chromosome lengths
+static const unsigned long chromosome_length[NUM_CHROMOSOMES] = {
+    30427671, 19698289, 23459830, 18585056, 26975502
+};
+
+typedef struct
+{
+    unsigned long start;
+    unsigned long end;
+    char          strand;
+    int           is_island;
+    unsigned long number;       // gene number within chromosome, or global island number
+    unsigned long sum_cg;
+} feature_t;
+
+static uint64_t rng_state;
+
+// xorshift64*, plenty for synthetic data and the same on every platform
+static uint64_t bench_random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+static unsigned long bench_random_range(unsigned long lo, unsigned long hi)
+{
+    return lo + (unsigned long)(bench_random() % (hi - lo + 1));
+}
+
+static double bench_random_unit(void)
+{
+    return (bench_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int feature_compare(const void * a, const void * b)
+{
+    const feature_t * x = (const feature_t *)a;
+    const feature_t * y = (const feature_t *)b;
+
+    if (x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+    if (x->is_island != y->is_island)
+        return x->is_island ? 1 : -1;
+    return x->end < y->end ? -1 : x->end > y->end;
+}
+
+static FILE * bench_open(const char * dir, const char * name)
+{
+    char   path[4096];
+    FILE * file;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if ((file = fopen(path, "w")) == NULL)
+    {
+        fprintf(stderr, "Failed to create %s\n", path);
+        exit(1);
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    return file;
+}
+
+static char * append_number(char * p, unsigned long value)
+{
+    char   digits[24];
+    char * d = digits + sizeof(digits);
+
+    do
+        *--d = '0' + value % 10;
+    while (value /= 10);
+    memcpy(p, d, digits + sizeof(digits) - d);
+    return p + (digits + sizeof(digits) - d);
+}
+
+// fixed point with three decimals, printf is the bottleneck at 10^9 rows
+static char * append_fraction(char * p, double value)
+{
+    unsigned long thousandths = (unsigned long)(value * 1000.0 + 0.5);
+
+    p = append_number(p, thousandths / 1000);
+    *p++ = '.';
+    *p++ = '0' + thousandths / 100 % 10;
+    *p++ = '0' + thousandths / 10 % 10;
+    *p++ = '0' + thousandths % 10;
+    return p;
+}
+
+// "chromosome position value" rows spread over the genome in proportion to
+// chromosome length, one row at a random offset in each of count equal
+// strides so positions ascend without piling up at the chromosome end
+static void bench_write_track(FILE * file, unsigned long num_records, int nucleosomes)
+{
+    unsigned long genome_length = 0;
+    unsigned long written = 0;
+    char          line[64];
+    int           c;
+
+    for (c = 0; c < NUM_CHROMOSOMES; c++)
+        genome_length += chromosome_length[c];
+
+    for (c = 0; c < NUM_CHROMOSOMES; c++)
+    {
+        unsigned long count = c == NUM_CHROMOSOMES - 1
+                            ? num_records - written
+                            : (unsigned long)((double)num_records * chromosome_length[c] / genome_length);
+        // 32.32 fixed point so dense tracks (several rows per base) work too
+        uint64_t      stride = count ? ((uint64_t)chromosome_length[c] << 32) / count : 0;
+        unsigned long i;
+
+        for (i = 0; i < count; i++)
+        {
+            unsigned long base = 1 + (unsigned long)((i * stride + bench_random() % (stride + 1)) >> 32);
+            double        value;
+            char *        p = line;
+
+            if (nucleosomes)
+                value = (double)(bench_random() % 40);
+            else
+            {
+                // methylation is mostly all or nothing
+                double u = bench_random_unit();
+                value = u < 0.45 ? u * 0.1 : u < 0.9 ? 1.0 - (u - 0.45) * 0.1 : bench_random_unit();
+            }
+
+            p = append_number(p, c + 1);
+            *p++ = '\t';
+            p = append_number(p, base);
+            *p++ = '\t';
+            p = append_fraction(p, value);
+            *p++ = '\n';
+            fwrite(line, 1, p - line, file);
+        }
+        written += count;
+    }
+}
+
+void usage(const char * name)
+{
+   printf("Usage: %s [-s seed] [-g genes] [-i islands] [-m methylome records] [-n nucleosome records] <out dir>\n", name);
+   printf("   writes annotation.gff3 cpgi.list methylome.txt nucleosomes.txt rnaseq.txt\n");
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned long seed = 1;
+    unsigned long num_genes = 33000, num_islands = 10000;
+    unsigned long num_methylome = 10000000, num_nucleosomes = 10000000;
+    unsigned long genome_length = 0, island_number = 0;
+    FILE *        gff3_file, * cpgi_file, * rnaseq_file, * track_file;
+    int           opt, c;
+
+    while ((opt = getopt(argc, argv, "s:g:i:m:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's': seed            = strtoul(optarg, NULL, 10); break;
+        case 'g': num_genes       = strtoul(optarg, NULL, 10); break;
+        case 'i': num_islands     = strtoul(optarg, NULL, 10); break;
+        case 'm': num_methylome   = strtoul(optarg, NULL, 10); break;
+        case 'n': num_nucleosomes = strtoul(optarg, NULL, 10); break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 1)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+
+    // splitmix the seed so small seeds still give a well mixed state
+    rng_state = seed + 0x9E3779B97F4A7C15ULL;
+    rng_state = (rng_state ^ (rng_state >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    rng_state = (rng_state ^ (rng_state >> 27)) * 0x94D049BB133111EBULL;
+    rng_state ^= rng_state >> 31;
+    if (!rng_state)
+        rng_state = 1;
+
+    gff3_file   = bench_open(argv[optind], "annotation.gff3");
+    cpgi_file   = bench_open(argv[optind], "cpgi.list");
+    rnaseq_file = bench_open(argv[optind], "rnaseq.txt");
+
+    fprintf(gff3_file, "##gff-version 3\n");
+    for (c = 0; c < NUM_CHROMOSOMES; c++)
+    {
+        fprintf(gff3_file, "##sequence-region Chr%d 1 %lu\n", c + 1, chromosome_length[c]);
+        genome_length += chromosome_length[c];
+    }
+
+    for (c = 0; c < NUM_CHROMOSOMES; c++)
+    {
+        unsigned long genes = (unsigned long)((double)num_genes * chromosome_length[c] / genome_length);
+        unsigned long islands = (unsigned long)((double)num_islands * chromosome_length[c] / genome_length);
+        unsigned long slot = genes ? chromosome_length[c] / genes : chromosome_length[c];
+        unsigned long num_features = 0, i;
+        feature_t *   features = malloc((genes + islands + 1) * sizeof(feature_t));
+
+        // genes sit one per slot, like the evenly spread TAIR10 loci
+        for (i = 0; i < genes; i++)
+        {
+            feature_t * gene = &features[num_features++];
+            unsigned long length = bench_random_range(300, slot > 1000 ? slot / 2 : 500);
+
+            gene->start     = i * slot + 1 + bench_random() % (slot / 2 + 1);
+            gene->end       = gene->start + length - 1;
+            if (gene->end > chromosome_length[c])
+                gene->end = chromosome_length[c];
+            gene->strand    = bench_random() & 1 ? '+' : '-';
+            gene->is_island = 0;
+            gene->number    = i + 1;
+        }
+
+        // about half the islands cover a TSS so the overlap stage finds hits
+        for (i = 0; i < islands; i++)
+        {
+            feature_t *   island = &features[num_features++];
+            unsigned long length = bench_random_range(200, 1500);
+
+            if (genes && bench_random() & 1)
+            {
+                const feature_t * gene = &features[bench_random() % genes];
+                unsigned long     tss  = gene->strand == '+' ? gene->start : gene->end;
+                unsigned long     lead = bench_random() % length;
+
+                island->start = tss > lead ? tss - lead : 1;
+            }
+            else
+                island->start = bench_random_range(1, chromosome_length[c] - length);
+            island->end       = island->start + length - 1;
+            if (island->end > chromosome_length[c])
+                island->end = chromosome_length[c];
+            island->strand    = '.';
+            island->is_island = 1;
+            island->sum_cg    = length / 2 + bench_random() % (length / 4 + 1);
+        }
+
+        qsort(features, num_features, sizeof(feature_t), feature_compare);
+
+        for (i = 0; i < num_features; i++)
+        {
+            feature_t * f = &features[i];
+
+            if (f->is_island)
+            {
+                f->number = ++island_number;
+                fprintf(gff3_file, "Chr%d\t.\tCpGI\t%lu\t%lu\t.\t.\t.\tID=CpGI_%lu;sumcg=%lu;ObsExp=%.2f;PercentCG=%.2f\n",
+                        c + 1, f->start, f->end, f->number, f->sum_cg,
+                        0.6 + bench_random_unit(), 100.0 * f->sum_cg / (f->end - f->start + 1));
+                fprintf(cpgi_file, "CpGI_%lu\t%d\t%lu\t%lu\n", f->number, c + 1, f->start, f->end);
+            }
+            else
+            {
+                fprintf(gff3_file, "Chr%d\tbench\tgene\t%lu\t%lu\t.\t%c\t.\tID=AT%dG%04lu0;Name=AT%dG%04lu0\n",
+                        c + 1, f->start, f->end, f->strand, c + 1, f->number, c + 1, f->number);
+
+                // most genes are expressed, some have extra isoform rows to sum
+                if (bench_random() % 10)
+                    fprintf(rnaseq_file, "AT%dG%04lu0\tbench\t%.1f\n", c + 1, f->number, bench_random_unit() * 200.0);
+                if (bench_random() % 10 == 0)
+                    fprintf(rnaseq_file, "AT%dG%04lu0\tbench\t%.1f\n", c + 1, f->number, bench_random_unit() * 50.0);
+            }
+        }
+        free(features);
+    }
+
+    fclose(gff3_file);
+    fclose(cpgi_file);
+    fclose(rnaseq_file);
+
+    track_file = bench_open(argv[optind], "methylome.txt");
+    bench_write_track(track_file, num_methylome, 0);
+    fclose(track_file);
+
+    track_file = bench_open(argv[optind], "nucleosomes.txt");
+    bench_write_track(track_file, num_nucleosomes, 1);
+    fclose(track_file);
+
+    return 0;
+}
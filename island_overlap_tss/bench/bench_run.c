@@ -0,0 +1,58 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Run a command and print its wall time and peak resident set size,
+*   used by bench.sh since /usr/bin/time isn't always installed
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+void usage(const char * name)
+{
+   printf("Usage: %s <command> [args]...\n", name);
+   printf("   prints \"<seconds> <peak rss KB> <exit status>\" to stderr\n");
+}
+
+int main(int argc, char ** argv)
+{
+    struct timespec begin, end;
+    struct rusage   usage_info;
+    pid_t           pid;
+    int             status;
+
+    if (argc < 2)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    if ((pid = fork()) == 0)
+    {
+        execvp(argv[1], argv + 1);
+        fprintf(stderr, "Failed to run %s\n", argv[1]);
+        _exit(127);
+    }
+    if (pid < 0 || wait4(pid, &status, 0, &usage_info) < 0)
+    {
+        fprintf(stderr, "Failed to wait for %s\n", argv[1]);
+        exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // ru_maxrss is in KB on linux
+    fprintf(stderr, "%.3f %ld %d\n",
+            (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9,
+            usage_info.ru_maxrss,
+            WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+    return 0;
+}
@@ -0,0 +1,587 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Sketch every sequence of a feature index on worker threads as a column
+*   of cached tiles and paste the tiles together with cairo
+*
+*
+*************************************************/
+#include <genometools.h>
+#include <cairo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "chart_renderer.h"
+
+#define CHART_CACHE_INDEX   "tiles.index"
+#define CHART_MAX_HEIGHT    32767           // largest cairo image surface
+#define CHART_FNV_OFFSET    0xcbf29ce484222325ULL
+#define CHART_FNV_PRIME     0x100000001b3ULL
+
+typedef struct
+{
+    char *        seqid;
+    unsigned long start;
+    unsigned long end;
+    unsigned int  width;
+    uint64_t      digest;           // features in the range and the style
+    int           valid;            // the cached PNG matches the digest
+} chart_tile_t;
+
+// one sequence's chart.  A job is only touched by the worker drawing it
+// until all workers are joined.
+typedef struct
+{
+    const char *   seqid;
+    GtRange        range;
+    chart_tile_t * tiles;
+    unsigned long  num_tiles;
+    unsigned long  num_drawn;
+    GtError *      err;
+    int            had_err;
+} chart_job_t;
+
+typedef struct
+{
+    GtFeatureIndex *        index;
+    const chart_options_t * options;
+    const char *            out_dir;
+    const char *            suffix;
+    uint64_t                style_digest;
+    chart_tile_t *          cached;     // the cache index, sorted by key
+    unsigned long           num_cached;
+    chart_job_t *           jobs;
+    unsigned long           num_jobs;
+    unsigned long           next_job;
+    pthread_mutex_t         lock;
+} chart_context_t;
+
+static char * chart_path_new(const char * format, ...)
+{
+    va_list args;
+    char *  path;
+    int     length;
+
+    va_start(args, format);
+    length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    path = malloc(length + 1);
+    va_start(args, format);
+    vsnprintf(path, length + 1, format, args);
+    va_end(args);
+    return path;
+}
+
+static char * chart_tile_path_new(const char * cache_dir, const chart_tile_t * tile)
+{
+    return chart_path_new("%s/%s_%lu-%lu_%u.png", cache_dir, tile->seqid, tile->start, tile->end, tile->width);
+}
+
+static int chart_tile_compare(const void * a, const void * b)
+{
+    const chart_tile_t * x = (const chart_tile_t *)a;
+    const chart_tile_t * y = (const chart_tile_t *)b;
+    int                  c = strcmp(x->seqid, y->seqid);
+
+    if (c)
+        return c;
+    if (x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+    if (x->end != y->end)
+        return x->end < y->end ? -1 : 1;
+    if (x->width != y->width)
+        return x->width < y->width ? -1 : 1;
+    return 0;
+}
+
+// longest sequence first, so the pool doesn't end waiting on one big chart
+static int chart_job_compare(const void * a, const void * b)
+{
+    unsigned long x = gt_range_length(&((const chart_job_t *)a)->range);
+    unsigned long y = gt_range_length(&((const chart_job_t *)b)->range);
+
+    return x > y ? -1 : x < y;
+}
+
+static uint64_t chart_hash_bytes(uint64_t hash, const void * bytes, size_t length)
+{
+    const unsigned char * p = bytes;
+
+    while (length--)
+    {
+        hash ^= *p++;
+        hash *= CHART_FNV_PRIME;
+    }
+    return hash;
+}
+
+// the terminating NUL keeps "ab" "c" apart from "a" "bc"
+static uint64_t chart_hash_string(uint64_t hash, const char * s)
+{
+    return chart_hash_bytes(hash, s, strlen(s) + 1);
+}
+
+static void chart_hash_attribute(const char * key, const char * value, void * data)
+{
+    uint64_t * hash = data;
+
+    *hash = chart_hash_string(chart_hash_string(*hash, key), value);
+}
+
+// everything a sketch of the feature and its children can show
+static uint64_t chart_hash_feature(GtFeatureNode * top)
+{
+    GtFeatureNodeIterator * iter = gt_feature_node_iterator_new(top);
+    GtFeatureNode *         fn;
+    uint64_t                hash = CHART_FNV_OFFSET;
+
+    while ((fn = gt_feature_node_iterator_next(iter)))
+    {
+        GtRange  range  = gt_genome_node_get_range((GtGenomeNode *)fn);
+        GtStrand strand = gt_feature_node_get_strand(fn);
+
+        hash = chart_hash_string(hash, gt_feature_node_get_type(fn));
+        hash = chart_hash_bytes(hash, &range, sizeof(range));
+        hash = chart_hash_bytes(hash, &strand, sizeof(strand));
+        if (gt_feature_node_score_is_defined(fn))
+        {
+            float score = gt_feature_node_get_score(fn);
+            hash = chart_hash_bytes(hash, &score, sizeof(score));
+        }
+        gt_feature_node_foreach_attribute(fn, chart_hash_attribute, &hash);
+    }
+    gt_feature_node_iterator_delete(iter);
+    return hash;
+}
+
+// the features come back in index order, they are summed so that order
+// doesn't matter
+static int chart_tile_digest(GtFeatureIndex * index, chart_tile_t * tile, uint64_t style_digest, GtError * err)
+{
+    GtArray *     features = gt_array_new(sizeof(GtFeatureNode *));
+    GtRange       range = { tile->start, tile->end };
+    uint64_t      sum = 0;
+    unsigned long i, num_features;
+    int           had_err;
+
+    had_err = gt_feature_index_get_features_for_range(index, features, tile->seqid, &range, err);
+    num_features = gt_array_size(features);
+    for (i = 0; !had_err && i < num_features; i++)
+        sum += chart_hash_feature(*(GtFeatureNode **)gt_array_get(features, i));
+    gt_array_delete(features);
+
+    tile->digest = chart_hash_bytes(chart_hash_bytes(style_digest, &num_features, sizeof(num_features)),
+                                    &sum, sizeof(sum));
+    return had_err;
+}
+
+// a changed style redraws every tile
+static uint64_t chart_style_digest(const char * style_file)
+{
+    uint64_t      hash = CHART_FNV_OFFSET;
+    unsigned char buffer[65536];
+    size_t        n;
+    FILE *        f;
+
+    if (!style_file || !(f = fopen(style_file, "rb")))
+        return hash;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        hash = chart_hash_bytes(hash, buffer, n);
+    fclose(f);
+    return hash;
+}
+
+// the cache index has a line "seqid start end width digest" per tile,
+// a missing index is an empty cache
+static void chart_cache_load(chart_context_t * context)
+{
+    char *        path = chart_path_new("%s/%s", context->options->cache_dir, CHART_CACHE_INDEX);
+    FILE *        f = fopen(path, "r");
+    unsigned long capacity = 0;
+    char          seqid[1024];
+    chart_tile_t  tile;
+
+    free(path);
+    if (!f)
+        return;
+
+    memset(&tile, 0, sizeof(tile));
+    while (5 == fscanf(f, "%1023s %lu %lu %u %" SCNx64, seqid, &tile.start, &tile.end, &tile.width, &tile.digest))
+    {
+        if (context->num_cached == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            context->cached = realloc(context->cached, capacity * sizeof(chart_tile_t));
+        }
+        tile.seqid = strdup(seqid);
+        context->cached[context->num_cached++] = tile;
+    }
+    fclose(f);
+
+    qsort(context->cached, context->num_cached, sizeof(chart_tile_t), chart_tile_compare);
+}
+
+static int chart_cache_hit(const chart_context_t * context, const chart_tile_t * tile, const char * tile_path)
+{
+    const chart_tile_t * cached = context->num_cached ? bsearch(tile, context->cached, context->num_cached,
+                                                                sizeof(chart_tile_t), chart_tile_compare) : NULL;
+
+    return cached && cached->digest == tile->digest && access(tile_path, R_OK) == 0;
+}
+
+// the index is replaced in one rename, so an interrupted run leaves the
+// old one.  Tiles that are no longer part of any chart are removed.
+static int chart_cache_save(chart_context_t * context, GtError * err)
+{
+    char *        path = chart_path_new("%s/%s", context->options->cache_dir, CHART_CACHE_INDEX);
+    char *        tmp_path = chart_path_new("%s.tmp", path);
+    FILE *        f = fopen(tmp_path, "w");
+    unsigned long j, t;
+    int           had_err = 0;
+
+    if (!f)
+    {
+        gt_error_set(err, "Failed to create tile cache index %s", tmp_path);
+        had_err = -1;
+    }
+
+    for (j = 0; !had_err && j < context->num_jobs; j++)
+        for (t = 0; t < context->jobs[j].num_tiles; t++)
+        {
+            const chart_tile_t * tile = &context->jobs[j].tiles[t];
+
+            if (tile->valid)
+                fprintf(f, "%s\t%lu\t%lu\t%u\t%016" PRIx64 "\n",
+                        tile->seqid, tile->start, tile->end, tile->width, tile->digest);
+        }
+
+    if (!had_err && fclose(f))
+    {
+        gt_error_set(err, "Failed to write tile cache index %s", tmp_path);
+        had_err = -1;
+    }
+    if (!had_err && rename(tmp_path, path))
+    {
+        gt_error_set(err, "Failed to replace tile cache index %s", path);
+        had_err = -1;
+    }
+
+    for (t = 0; !had_err && t < context->num_cached; t++)
+    {
+        const chart_tile_t * tile = &context->cached[t];
+        int                  current = 0;
+
+        for (j = 0; j < context->num_jobs && !current; j++)
+            current = context->jobs[j].num_tiles &&
+                      bsearch(tile, context->jobs[j].tiles, context->jobs[j].num_tiles,
+                              sizeof(chart_tile_t), chart_tile_compare) != NULL;
+        if (!current)
+        {
+            char * tile_path = chart_tile_path_new(context->options->cache_dir, tile);
+            unlink(tile_path);
+            free(tile_path);
+        }
+    }
+
+    free(tmp_path);
+    free(path);
+    return had_err;
+}
+
+static int chart_tile_draw(GtFeatureIndex *     index,
+                           GtStyle *            style,
+                           const chart_tile_t * tile,
+                           const char *         tile_path,
+                           GtError *            err
+                          )
+{
+    GtRange     range = { tile->start, tile->end };
+    GtDiagram * diagram = NULL;
+    GtLayout *  layout = NULL;
+    GtCanvas *  canvas = NULL;
+    GtUword     height;
+    int         had_err = 0;
+
+    if (!(diagram = gt_diagram_new(index, tile->seqid, &range, style, err)))
+        had_err = -1;
+    if (!had_err && !(layout = gt_layout_new(diagram, tile->width, style, err)))
+        had_err = -1;
+    if (!had_err)
+        had_err = gt_layout_get_height(layout, &height, err);
+    if (!had_err && !(canvas = gt_canvas_cairo_file_new(style, GT_GRAPHICS_PNG, tile->width, height, NULL, err)))
+        had_err = -1;
+    if (!had_err)
+        had_err = gt_layout_sketch(layout, canvas, err);
+    if (!had_err)
+        had_err = gt_canvas_cairo_file_to_file((GtCanvasCairoFile *)canvas, tile_path, err);
+
+    gt_canvas_delete(canvas);
+    gt_layout_delete(layout);
+    gt_diagram_delete(diagram);
+    return had_err;
+}
+
+// stack the tiles top to bottom on a white background
+static int chart_paste_tiles(char ** tile_paths, unsigned long num_tiles, unsigned int width,
+                             const char * chart_path, GtError * err)
+{
+    cairo_surface_t ** surfaces = calloc(num_tiles, sizeof(cairo_surface_t *));
+    cairo_surface_t *  chart = NULL;
+    cairo_t *          cr;
+    unsigned long      t;
+    long               height = 0, y = 0;
+    int                had_err = 0;
+
+    for (t = 0; !had_err && t < num_tiles; t++)
+    {
+        surfaces[t] = cairo_image_surface_create_from_png(tile_paths[t]);
+        if (cairo_surface_status(surfaces[t]) != CAIRO_STATUS_SUCCESS)
+        {
+            gt_error_set(err, "Failed to read tile %s", tile_paths[t]);
+            had_err = -1;
+        }
+        else
+            height += cairo_image_surface_get_height(surfaces[t]);
+    }
+    if (!had_err && height > CHART_MAX_HEIGHT)
+    {
+        gt_error_set(err, "Chart %s would be %ld pixels high, use larger tiles", chart_path, height);
+        had_err = -1;
+    }
+
+    if (!had_err)
+    {
+        chart = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height ? height : 1);
+        cr = cairo_create(chart);
+        cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+        cairo_paint(cr);
+        for (t = 0; t < num_tiles; t++)
+        {
+            cairo_set_source_surface(cr, surfaces[t], 0, y);
+            cairo_paint(cr);
+            y += cairo_image_surface_get_height(surfaces[t]);
+        }
+        cairo_destroy(cr);
+
+        if (cairo_surface_write_to_png(chart, chart_path) != CAIRO_STATUS_SUCCESS)
+        {
+            gt_error_set(err, "Failed to write chart %s", chart_path);
+            had_err = -1;
+        }
+        cairo_surface_destroy(chart);
+    }
+
+    for (t = 0; t < num_tiles; t++)
+        if (surfaces[t])
+            cairo_surface_destroy(surfaces[t]);
+    free(surfaces);
+    return had_err;
+}
+
+static void chart_renderer_draw_job(chart_context_t * context, GtStyle * style, chart_job_t * job)
+{
+    char **       tile_paths = calloc(job->num_tiles, sizeof(char *));
+    char *        chart_path;
+    unsigned long t;
+
+    for (t = 0; !job->had_err && t < job->num_tiles; t++)
+    {
+        chart_tile_t * tile = &job->tiles[t];
+
+        tile_paths[t] = chart_tile_path_new(context->options->cache_dir, tile);
+        job->had_err = chart_tile_digest(context->index, tile, context->style_digest, job->err);
+
+        if (!job->had_err && !chart_cache_hit(context, tile, tile_paths[t]))
+        {
+            job->had_err = chart_tile_draw(context->index, style, tile, tile_paths[t], job->err);
+            job->num_drawn++;
+        }
+        tile->valid = !job->had_err;
+    }
+
+    if (!job->had_err)
+    {
+        chart_path = chart_path_new("%s/%s%s.png", context->out_dir, job->seqid, context->suffix);
+        job->had_err = chart_paste_tiles(tile_paths, job->num_tiles, context->options->width, chart_path, job->err);
+        free(chart_path);
+    }
+
+    for (t = 0; t < job->num_tiles; t++)
+        free(tile_paths[t]);
+    free(tile_paths);
+}
+
+static void * chart_renderer_worker(void * data)
+{
+    chart_context_t * context = data;
+    GtError *         err = gt_error_new();
+    GtStyle *         style;
+
+    // a style holds a Lua state, which can't be shared between threads
+    if ((style = gt_style_new(err)) && context->options->style_file &&
+        gt_style_load_file(style, context->options->style_file, err))
+    {
+        gt_style_delete(style);
+        style = NULL;
+    }
+
+    for (;;)
+    {
+        chart_job_t * job;
+
+        pthread_mutex_lock(&context->lock);
+        job = context->next_job < context->num_jobs ? &context->jobs[context->next_job++] : NULL;
+        pthread_mutex_unlock(&context->lock);
+        if (!job)
+            break;
+
+        if (!style)
+        {
+            gt_error_set(job->err, "%s", gt_error_get(err));
+            job->had_err = -1;
+            continue;
+        }
+        chart_renderer_draw_job(context, style, job);
+    }
+
+    gt_style_delete(style);
+    gt_error_delete(err);
+    return NULL;
+}
+
+// cut the sequence into tiles starting at multiples of tile_bases, so the
+// keys stay put when features elsewhere change
+static int chart_job_init(chart_job_t * job, GtFeatureIndex * index, const char * seqid,
+                          const chart_options_t * options, GtError * err)
+{
+    unsigned long first, last, k;
+
+    memset(job, 0, sizeof(chart_job_t));
+    job->seqid = seqid;
+    job->err   = gt_error_new();
+    if (gt_feature_index_get_range_for_seqid(index, &job->range, seqid, err))
+        return -1;
+
+    if (options->tile_bases == 0)
+    {
+        first = last = 0;
+    }
+    else
+    {
+        first = (job->range.start - 1) / options->tile_bases;
+        last  = (job->range.end - 1) / options->tile_bases;
+    }
+
+    job->num_tiles = last - first + 1;
+    job->tiles     = calloc(job->num_tiles, sizeof(chart_tile_t));
+    for (k = first; k <= last; k++)
+    {
+        chart_tile_t * tile = &job->tiles[k - first];
+
+        tile->seqid = (char *)seqid;
+        tile->width = options->width;
+        tile->start = options->tile_bases && k * options->tile_bases + 1 > job->range.start ?
+                      k * options->tile_bases + 1 : job->range.start;
+        tile->end   = options->tile_bases && (k + 1) * options->tile_bases < job->range.end ?
+                      (k + 1) * options->tile_bases : job->range.end;
+    }
+    return 0;
+}
+
+int chart_renderer_run(GtFeatureIndex *        index,
+                       const chart_options_t * options,
+                       const char *            out_dir,
+                       const char *            suffix,
+                       unsigned long *         tiles_drawn,
+                       unsigned long *         tiles_total,
+                       GtError *               err
+                      )
+{
+    chart_context_t context;
+    GtStrArray *    seqids;
+    pthread_t *     threads;
+    unsigned long   j;
+    int             num_threads = options->num_threads, t, had_err = 0;
+
+    *tiles_drawn = *tiles_total = 0;
+    if (mkdir(options->cache_dir, 0755) && errno != EEXIST)
+    {
+        gt_error_set(err, "Failed to create tile cache directory %s", options->cache_dir);
+        return -1;
+    }
+    if (!(seqids = gt_feature_index_get_seqids(index, err)))
+        return -1;
+
+    memset(&context, 0, sizeof(context));
+    context.index        = index;
+    context.options      = options;
+    context.out_dir      = out_dir;
+    context.suffix       = suffix;
+    context.style_digest = chart_style_digest(options->style_file);
+    context.num_jobs     = gt_str_array_size(seqids);
+    context.jobs         = calloc(context.num_jobs ? context.num_jobs : 1, sizeof(chart_job_t));
+    pthread_mutex_init(&context.lock, NULL);
+    chart_cache_load(&context);
+
+    for (j = 0; !had_err && j < context.num_jobs; j++)
+        had_err = chart_job_init(&context.jobs[j], index, gt_str_array_get(seqids, j), options, err);
+
+    if (!had_err)
+    {
+        qsort(context.jobs, context.num_jobs, sizeof(chart_job_t), chart_job_compare);
+
+        if (num_threads < 1)
+            num_threads = 1;
+        if ((unsigned long)num_threads > context.num_jobs)
+            num_threads = context.num_jobs ? context.num_jobs : 1;
+
+        // this thread works too
+        threads = malloc(num_threads * sizeof(pthread_t));
+        for (t = 1; t < num_threads; t++)
+            pthread_create(&threads[t], NULL, chart_renderer_worker, &context);
+        chart_renderer_worker(&context);
+        for (t = 1; t < num_threads; t++)
+            pthread_join(threads[t], NULL);
+        free(threads);
+
+        for (j = 0; j < context.num_jobs; j++)
+        {
+            *tiles_drawn += context.jobs[j].num_drawn;
+            *tiles_total += context.jobs[j].num_tiles;
+            if (context.jobs[j].had_err && !had_err)
+            {
+                gt_error_set(err, "%s: %s", context.jobs[j].seqid, gt_error_get(context.jobs[j].err));
+                had_err = -1;
+            }
+        }
+
+        // tiles drawn before a failure are still good for the next run
+        if (chart_cache_save(&context, had_err ? NULL : err) && !had_err)
+            had_err = -1;
+    }
+
+    for (j = 0; j < context.num_jobs; j++)
+    {
+        free(context.jobs[j].tiles);
+        gt_error_delete(context.jobs[j].err);
+    }
+    free(context.jobs);
+    for (j = 0; j < context.num_cached; j++)
+        free(context.cached[j].seqid);
+    free(context.cached);
+    pthread_mutex_destroy(&context.lock);
+    gt_str_array_delete(seqids);
+
+    return had_err;
+}
@@ -0,0 +1,45 @@
+/*
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Draw an annotation chart of every sequence in a feature index, the
+ *   sequences on a pool of threads.  A chart is a column of tiles, each a
+ *   sketch of tile_bases of the sequence at the chart width, stacked top
+ *   to bottom.
+ *
+ *   Tiles are kept as PNGs in a cache directory, keyed by seqid, range and
+ *   width, together with a digest of the features they show and the style.
+ *   When the charts are drawn again only tiles whose digest changed are
+ *   sketched, the rest are pasted from the cache.
+ *
+ *   The nodes of a sequence are only touched by the thread drawing it and
+ *   every thread loads its own style, so genometools state isn't shared.
+ *
+ */
+
+#ifndef  CHART_RENDERER_H
+#define  CHART_RENDERER_H
+
+#include <genometools.h>
+
+typedef struct
+{
+    unsigned int  width;            // pixels
+    unsigned long tile_bases;       // 0 draws each sequence as one tile
+    const char *  style_file;       // NULL for the built in defaults
+    const char *  cache_dir;
+    int           num_threads;
+} chart_options_t;
+
+// write out_dir/<seqid><suffix>.png for every sequence of index.
+// tiles_drawn and tiles_total receive how many tiles were sketched and how
+// many the charts hold.  Returns 0 on success, -1 with err set otherwise.
+int chart_renderer_run(GtFeatureIndex *        index,
+                       const chart_options_t * options,
+                       const char *            out_dir,
+                       const char *            suffix,
+                       unsigned long *         tiles_drawn,
+                       unsigned long *         tiles_total,
+                       GtError *               err
+                      );
+
+#endif
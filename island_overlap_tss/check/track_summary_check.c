@@ -0,0 +1,107 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Check track_file_summarize against track_file_sum: over random windows
+*   read from the records, every bin must count exactly the records in the
+*   range track_summary prints for it
+*
+*************************************************/
+#include "../track_file/track_file.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CHECK_CHROMOSOME 2
+#define CHECK_LAST       200000
+#define CHECK_WINDOWS    20000
+
+static uint64_t rng_state = 1;
+
+// xorshift64*, as bench_generate
+static uint64_t check_random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned long check_uniform(unsigned long low, unsigned long high)
+{
+    return low + check_random() % (high - low + 1);
+}
+
+int main(void)
+{
+    char                   text_path[] = "/tmp/track_summary_checkXXXXXX";
+    char                   track_path[sizeof(text_path) + 4];
+    track_file_summary_t * bins;
+    track_file *           file;
+    FILE *                 text;
+    unsigned long          position, checked = 0;
+    int                    fd, w, b, failed = 0;
+
+    if ((fd = mkstemp(text_path)) < 0 || (text = fdopen(fd, "w")) == NULL)
+    {
+        fprintf(stderr, "Failed to create %s\n", text_path);
+        exit(1);
+    }
+    snprintf(track_path, sizeof(track_path), "%s.trk", text_path);
+
+    // CpG like spacing, runs of neighbours and long gaps
+    for (position = check_uniform(1, 50); position <= CHECK_LAST; position += check_uniform(1, 40))
+        fprintf(text, "%d\t%lu\t%g\n", CHECK_CHROMOSOME, position, (double)check_uniform(0, 1000) / 1000);
+    fclose(text);
+
+    if (track_file_build(text_path, track_path) || (file = track_file_open(track_path)) == NULL)
+    {
+        fprintf(stderr, "Failed to build indexed track %s\n", track_path);
+        unlink(text_path);
+        unlink(track_path);
+        exit(1);
+    }
+
+    bins = malloc(5000 * sizeof(track_file_summary_t));
+    for (w = 0; w < CHECK_WINDOWS && !failed; w++)
+    {
+        unsigned long start  = check_uniform(1, CHECK_LAST);
+        unsigned long length = check_uniform(1, 6000);
+        int           num_bins = (int)check_uniform(1, 5000);
+
+        // the zoom levels are counted where their bins start, not exact
+        if (track_file_summarize(file, CHECK_CHROMOSOME, start, start + length - 1, num_bins, bins))
+            continue;
+
+        for (b = 0; b < num_bins; b++)
+        {
+            unsigned long bin_start = start + b * length / num_bins;
+            unsigned long bin_end   = start + (b + 1) * length / num_bins - 1;
+            unsigned long expected  = 0;
+
+            if (bin_end + 1 > bin_start)
+                track_file_sum(file, CHECK_CHROMOSOME, bin_start, bin_end, &expected);
+            if (bins[b].coverage != expected)
+            {
+                fprintf(stderr, "%lu-%lu in %d bins: bin %d (%lu-%lu) has %lu records, not %lu\n",
+                        start, start + length - 1, num_bins, b, bin_start, bin_end, bins[b].coverage, expected);
+                failed = 1;
+                break;
+            }
+        }
+        checked++;
+    }
+
+    free(bins);
+    track_file_close(file);
+    unlink(text_path);
+    unlink(track_path);
+
+    if (!failed)
+        printf("track_summary_check: %lu windows read from the records match\n", checked);
+    return failed;
+}
@@ -0,0 +1,475 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Inflate gzip / BGZF input on a background thread into a pipe
+*
+*
+*************************************************/
+#define _GNU_SOURCE             // F_SETPIPE_SZ
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "compressed_input.h"
+#include "../stream_stats/stream_stats.h"
+
+#define INPUT_CHUNK        (1 << 18)
+#define PIPE_SIZE          (1 << 20)
+#define BGZF_MAX_BLOCK     65536
+#define BGZF_BATCH         64       // blocks inflated together, up to 4MB of text
+#define BGZF_MAX_THREADS   4
+
+typedef struct
+{
+    unsigned char * data;       // the whole block, header to ISIZE
+    size_t          length;
+    unsigned char * text;
+    size_t          text_length;
+    int             failed;
+} bgzf_block_t;
+
+typedef struct
+{
+    bgzf_block_t blocks[BGZF_BATCH];
+    int          num_blocks;
+    pthread_t    threads[BGZF_MAX_THREADS];
+    int          num_threads;
+} bgzf_batch_t;
+
+typedef struct
+{
+    bgzf_batch_t * batch;
+    int            first;
+    int            step;
+} bgzf_work_t;
+
+struct compressed_input {
+    FILE *             file;
+    int                compressed;
+    int                bgzf;
+    int                source_fd;
+    int                pipe_write;
+    pthread_t          thread;
+    int                num_threads;     // BGZF inflate threads
+    int                failed;          // only read after the thread is joined
+    char *             path;
+    unsigned long long disk_bytes;
+    unsigned long long text_bytes;      // inflated so far, read after the join
+};
+
+static uint16_t read_le16(const unsigned char * p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t read_le32(const unsigned char * p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// read exactly length bytes, returns the number read (short only at EOF)
+static size_t read_full(int fd, unsigned char * buffer, size_t length)
+{
+    size_t  done = 0;
+    ssize_t n;
+
+    while (done < length)
+    {
+        n = read(fd, buffer + done, length - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+// returns -1 once the reader has gone away
+static int write_full(int fd, const unsigned char * buffer, size_t length)
+{
+    ssize_t n;
+
+    while (length)
+    {
+        n = write(fd, buffer, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        buffer += n;
+        length -= n;
+    }
+    return 0;
+}
+
+// the BC subfield of the gzip extra field holds the block size - 1
+static int bgzf_block_size(const unsigned char * header, size_t extra_length)
+{
+    const unsigned char * extra = header + 12;
+    size_t                i = 0;
+
+    while (i + 4 <= extra_length)
+    {
+        uint16_t field_length = read_le16(extra + i + 2);
+
+        if (extra[i] == 'B' && extra[i + 1] == 'C' && field_length == 2 && i + 6 <= extra_length)
+            return read_le16(extra + i + 4) + 1;
+        i += 4 + field_length;
+    }
+    return -1;
+}
+
+// BGZF's own header always puts BC first, which is all that fits in length
+static int is_bgzf_header(const unsigned char * header, size_t length)
+{
+    size_t extra_length;
+
+    if (length < 18 || header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || !(header[3] & 4))
+        return 0;
+    extra_length = read_le16(header + 10);
+    if (extra_length > length - 12)
+        extra_length = length - 12;
+    return bgzf_block_size(header, extra_length) > 0;
+}
+
+static void bgzf_inflate_block(bgzf_block_t * block)
+{
+    z_stream       zs;
+    size_t         header_length = 12 + read_le16(block->data + 10);
+    uint32_t       crc, text_length;
+
+    block->failed = 1;
+    if (block->length < header_length + 8)
+        return;
+
+    crc         = read_le32(block->data + block->length - 8);
+    text_length = read_le32(block->data + block->length - 4);
+    if (text_length > BGZF_MAX_BLOCK)
+        return;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+        return;
+    zs.next_in   = block->data + header_length;
+    zs.avail_in  = block->length - header_length - 8;
+    zs.next_out  = block->text;
+    zs.avail_out = BGZF_MAX_BLOCK;
+
+    if (inflate(&zs, Z_FINISH) == Z_STREAM_END && zs.total_out == text_length
+        && crc32(crc32(0L, Z_NULL, 0), block->text, text_length) == crc)
+    {
+        block->text_length = text_length;
+        block->failed      = 0;
+    }
+    inflateEnd(&zs);
+}
+
+static void * bgzf_worker(void * arg)
+{
+    bgzf_work_t * work = arg;
+    int           i;
+
+    for (i = work->first; i < work->batch->num_blocks; i += work->step)
+        bgzf_inflate_block(&work->batch->blocks[i]);
+    free(work);
+    return NULL;
+}
+
+// read up to BGZF_BATCH blocks, returns -1 on a malformed block
+static int bgzf_read_batch(int fd, bgzf_batch_t * batch)
+{
+    batch->num_blocks = 0;
+
+    while (batch->num_blocks < BGZF_BATCH)
+    {
+        bgzf_block_t * block = &batch->blocks[batch->num_blocks];
+        size_t         got = read_full(fd, block->data, 12);
+        size_t         extra_length;
+        int            block_size;
+
+        if (got == 0)
+            break;
+        if (got < 12 || block->data[0] != 0x1f || block->data[1] != 0x8b || !(block->data[3] & 4))
+            return -1;
+
+        extra_length = read_le16(block->data + 10);
+        if (12 + extra_length > BGZF_MAX_BLOCK
+            || read_full(fd, block->data + 12, extra_length) < extra_length
+            || (block_size = bgzf_block_size(block->data, extra_length)) < (int)(12 + extra_length + 8)
+            || read_full(fd, block->data + 12 + extra_length, block_size - 12 - extra_length)
+               < (size_t)(block_size - 12 - extra_length))
+            return -1;
+
+        block->length = block_size;
+        batch->num_blocks++;
+    }
+    return 0;
+}
+
+static void bgzf_start_batch(bgzf_batch_t * batch, int num_threads)
+{
+    int t;
+
+    batch->num_threads = num_threads < batch->num_blocks ? num_threads : batch->num_blocks;
+    for (t = 0; t < batch->num_threads; t++)
+    {
+        bgzf_work_t * work = malloc(sizeof(bgzf_work_t));
+
+        work->batch = batch;
+        work->first = t;
+        work->step  = batch->num_threads;
+        pthread_create(&batch->threads[t], NULL, bgzf_worker, work);
+    }
+}
+
+static void bgzf_finish_batch(bgzf_batch_t * batch)
+{
+    int t;
+
+    for (t = 0; t < batch->num_threads; t++)
+        pthread_join(batch->threads[t], NULL);
+    batch->num_threads = 0;
+}
+
+// inflate batch n + 1 while batch n is written out, so the writer blocking
+// on a slow reader doesn't stall decompression
+static void * bgzf_thread(void * arg)
+{
+    compressed_input * input = arg;
+    bgzf_batch_t *     batches = calloc(2, sizeof(bgzf_batch_t));
+    bgzf_batch_t *     current = &batches[0], * next = &batches[1];
+    int                i, b, reader_gone = 0;
+
+    for (b = 0; b < 2; b++)
+        for (i = 0; i < BGZF_BATCH; i++)
+        {
+            batches[b].blocks[i].data = malloc(BGZF_MAX_BLOCK);
+            batches[b].blocks[i].text = malloc(BGZF_MAX_BLOCK);
+        }
+
+    if (bgzf_read_batch(input->source_fd, current))
+        input->failed = 1;
+    bgzf_start_batch(current, input->num_threads);
+
+    while (current->num_blocks)
+    {
+        bgzf_batch_t * swap;
+
+        bgzf_finish_batch(current);
+
+        if (!input->failed && bgzf_read_batch(input->source_fd, next))
+            input->failed = 1;
+        if (input->failed)
+            next->num_blocks = 0;
+        bgzf_start_batch(next, input->num_threads);
+
+        for (i = 0; i < current->num_blocks && !reader_gone && !input->failed; i++)
+        {
+            if (current->blocks[i].failed)
+                input->failed = 1;
+            else if (write_full(input->pipe_write, current->blocks[i].text, current->blocks[i].text_length))
+                reader_gone = 1;
+            else
+                input->text_bytes += current->blocks[i].text_length;
+        }
+
+        if (reader_gone)
+        {
+            bgzf_finish_batch(next);
+            break;
+        }
+
+        swap = current;
+        current = next;
+        next = swap;
+    }
+
+    close(input->pipe_write);
+
+    for (b = 0; b < 2; b++)
+        for (i = 0; i < BGZF_BATCH; i++)
+        {
+            free(batches[b].blocks[i].data);
+            free(batches[b].blocks[i].text);
+        }
+    free(batches);
+    return NULL;
+}
+
+// plain gzip can only be inflated serially, concatenated members included
+static void * gzip_thread(void * arg)
+{
+    compressed_input * input = arg;
+    unsigned char *    in  = malloc(INPUT_CHUNK);
+    unsigned char *    out = malloc(INPUT_CHUNK);
+    z_stream           zs;
+    ssize_t            n;
+    int                ret, reader_gone = 0;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+        input->failed = 1;
+
+    while (!input->failed)
+    {
+        if (zs.avail_in == 0)
+        {
+            n = read(input->source_fd, in, INPUT_CHUNK);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                input->failed = 1;
+            if (n <= 0)
+                break;
+            zs.next_in  = in;
+            zs.avail_in = n;
+        }
+
+        zs.next_out  = out;
+        zs.avail_out = INPUT_CHUNK;
+        ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        {
+            input->failed = 1;
+            break;
+        }
+        if (write_full(input->pipe_write, out, INPUT_CHUNK - zs.avail_out))
+        {
+            reader_gone = 1;
+            break;
+        }
+        input->text_bytes += INPUT_CHUNK - zs.avail_out;
+        if (ret == Z_STREAM_END)
+            inflateReset(&zs);
+    }
+
+    // a member that was started but never finished means truncation
+    if (zs.total_in && !reader_gone)
+        input->failed = 1;
+
+    inflateEnd(&zs);
+    close(input->pipe_write);
+    free(in);
+    free(out);
+    return NULL;
+}
+
+static void * compressed_input_thread(void * arg)
+{
+    compressed_input * input = arg;
+    sigset_t           signals;
+
+    // a reader closing early must show up as EPIPE, not kill the process
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    return input->bgzf ? bgzf_thread(arg) : gzip_thread(arg);
+}
+
+compressed_input * compressed_input_open(const char * path)
+{
+    compressed_input * input;
+    unsigned char      header[18];
+    size_t             header_length;
+    int                fd, fds[2];
+    long               cores;
+    struct stat        file_info;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+
+    input = calloc(1, sizeof(compressed_input));
+    if (fstat(fd, &file_info) == 0)
+        input->disk_bytes = file_info.st_size;
+    header_length = read_full(fd, header, sizeof(header));
+
+    if (header_length < 2 || header[0] != 0x1f || header[1] != 0x8b)
+    {
+        close(fd);
+        if ((input->file = fopen(path, "r")) == NULL)
+        {
+            free(input);
+            return NULL;
+        }
+        input->path = strdup(path);
+        return input;
+    }
+
+    if (lseek(fd, 0, SEEK_SET) != 0 || pipe(fds) != 0)
+    {
+        close(fd);
+        free(input);
+        return NULL;
+    }
+
+#ifdef F_SETPIPE_SZ
+    // a deeper pipe lets the inflater run further ahead of the parser
+    fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+#endif
+
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+    input->compressed  = 1;
+    input->bgzf        = is_bgzf_header(header, header_length);
+    input->source_fd   = fd;
+    input->pipe_write  = fds[1];
+    input->num_threads = cores < 1 ? 1 : cores > BGZF_MAX_THREADS ? BGZF_MAX_THREADS : (int)cores;
+    input->file        = fdopen(fds[0], "r");
+    setvbuf(input->file, NULL, _IOFBF, 1 << 16);
+
+    if (pthread_create(&input->thread, NULL, compressed_input_thread, input))
+    {
+        fclose(input->file);
+        close(fds[1]);
+        close(fd);
+        free(input);
+        return NULL;
+    }
+
+    input->path = strdup(path);
+    return input;
+}
+
+FILE * compressed_input_file(compressed_input * input)
+{
+    return input->file;
+}
+
+int compressed_input_close(compressed_input * input)
+{
+    int failed;
+
+    if (!input)
+        return 0;
+
+    // a plain file's text is the file itself, as far as it was read
+    if (!input->compressed)
+        input->text_bytes = ftell(input->file);
+
+    // closing the read end first lets a writer blocked on a full pipe finish
+    fclose(input->file);
+    if (input->compressed)
+    {
+        pthread_join(input->thread, NULL);
+        close(input->source_fd);
+    }
+
+    stream_stats_file_read(input->path, input->disk_bytes, input->text_bytes);
+
+    failed = input->failed;
+    free(input->path);
+    free(input);
+    return failed;
+}
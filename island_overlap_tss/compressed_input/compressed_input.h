@@ -0,0 +1,29 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Read a text db that may be gzip or BGZF compressed.  Plain files are
+ *   read as they are; compressed ones are inflated on a background thread
+ *   that feeds the reader through a pipe, so parsing overlaps decompression
+ *   and no uncompressed copy ever lands on disk.  BGZF blocks are inflated
+ *   a batch at a time on several threads.
+ *
+ */
+
+#ifndef  COMPRESSED_INPUT_H
+#define  COMPRESSED_INPUT_H
+
+#include <stdio.h>
+
+typedef struct compressed_input compressed_input;
+
+// returns NULL if the file can't be read
+compressed_input * compressed_input_open(const char * path);
+
+// stream of the uncompressed text, owned by input
+FILE * compressed_input_file(compressed_input * input);
+
+// returns non-zero if the compressed data was corrupt or truncated, in
+// which case the text read is incomplete
+int compressed_input_close(compressed_input * input);
+
+#endif
@@ -0,0 +1,334 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Load cpgi.list once into a per-chromosome implicit augmented interval
+*   tree (islands sorted by start, the tree is laid over the array indices)
+*
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpgi_index.h"
+#include "../record_reader/record_reader.h"
+#include "../stream_stats/stream_stats.h"
+
+typedef struct
+{
+    int           chromosome;
+    unsigned long offset;       // first island of this chromosome
+    unsigned long count;
+    int           root_level;
+} chromosome_t;
+
+struct cpgi_index {
+    cpgi_t *       islands;
+    unsigned long  num_islands;
+    char *         names;       // all island names, NUL separated
+    chromosome_t * chromosomes;
+    int            num_chromosomes;
+    int            reference_count;
+};
+
+static int cpgi_compare(const void * a, const void * b)
+{
+    const cpgi_t * x = (const cpgi_t *)a;
+    const cpgi_t * y = (const cpgi_t *)b;
+
+    if (x->chromosome != y->chromosome)
+        return x->chromosome < y->chromosome ? -1 : 1;
+    if (x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+    return 0;
+}
+
+static int cpgi_ptr_compare(const void * a, const void * b)
+{
+    const cpgi_t * x = *(const cpgi_t * const *)a;
+    const cpgi_t * y = *(const cpgi_t * const *)b;
+
+    if (x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+    return 0;
+}
+
+// fill in max_end for each internal node of the implicit tree.  Leaves sit at
+// even indices, a node at level k has index with the lowest k bits set.
+// Returns the level of the root.
+static int cpgi_index_build_tree(cpgi_t * a, unsigned long n)
+{
+    unsigned long i, last_i = 0;
+    unsigned long last = 0;
+    int k;
+
+    if (n == 0)
+        return -1;
+
+    for (i = 0; i < n; i += 2)
+    {
+        last_i = i;
+        last = a[i].max_end = a[i].end;
+    }
+
+    for (k = 1; (1UL << k) <= n; ++k)
+    {
+        unsigned long x = 1UL << (k - 1);
+        unsigned long i0 = (x << 1) - 1;
+        unsigned long step = x << 2;
+
+        for (i = i0; i < n; i += step)
+        {
+            unsigned long el = a[i - x].max_end;
+            unsigned long er = (i + x < n) ? a[i + x].max_end : last;
+            unsigned long e  = a[i].end;
+
+            e = e > el ? e : el;
+            e = e > er ? e : er;
+            a[i].max_end = e;
+        }
+
+        // the rightmost node of this level may have no right child in range
+        last_i = ((last_i >> k) & 1) ? last_i - x : last_i + x;
+        if (last_i < n && a[last_i].max_end > last)
+            last = a[last_i].max_end;
+    }
+
+    return k - 1;
+}
+
+static const chromosome_t * cpgi_index_find_chromosome(const cpgi_index * index, int chromosome)
+{
+    int lo = 0, hi = index->num_chromosomes;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (index->chromosomes[mid].chromosome < chromosome)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < index->num_chromosomes && index->chromosomes[lo].chromosome == chromosome)
+        return &index->chromosomes[lo];
+    return NULL;
+}
+
+cpgi_index * cpgi_index_load(const char * cpgi_db)
+{
+    record_reader *    reader;
+    record_view_t      record;
+    cpgi_index *       index;
+    int                chromosome;
+    unsigned long      start, end;
+    unsigned long      capacity = 1024;
+    size_t             names_length = 0, names_capacity = 16384;
+    size_t *           name_offsets;
+    unsigned long      i;
+    uint64_t           load_start = stream_stats_now();
+
+    // gzip / BGZF text is inflated on the fly
+    if ((reader = record_reader_open(cpgi_db)) == NULL)
+        return NULL;
+
+    index = calloc(1, sizeof(cpgi_index));
+    index->reference_count = 1;
+    index->islands = malloc(capacity * sizeof(cpgi_t));
+    index->names = malloc(names_capacity);
+    name_offsets = malloc(capacity * sizeof(size_t));
+
+    // "name chromosome start end"
+    while (record_reader_next(reader, &record))
+    {
+        size_t name_length = record.lengths[0] + 1;
+
+        if (record.num_fields < 4 ||
+            record_parse_int(record.fields[1], record.lengths[1], &chromosome) ||
+            record_parse_ulong(record.fields[2], record.lengths[2], &start) ||
+            record_parse_ulong(record.fields[3], record.lengths[3], &end))
+        {
+            record_reader_reject(reader);
+            continue;
+        }
+
+        if (index->num_islands == capacity)
+        {
+            capacity *= 2;
+            index->islands = realloc(index->islands, capacity * sizeof(cpgi_t));
+            name_offsets = realloc(name_offsets, capacity * sizeof(size_t));
+        }
+        while (names_length + name_length > names_capacity)
+        {
+            names_capacity *= 2;
+            index->names = realloc(index->names, names_capacity);
+        }
+
+        memcpy(index->names + names_length, record.fields[0], record.lengths[0]);
+        index->names[names_length + record.lengths[0]] = '\0';
+        name_offsets[index->num_islands] = names_length;
+        names_length += name_length;
+
+        index->islands[index->num_islands].chromosome = chromosome;
+        index->islands[index->num_islands].start = start < end ? start : end;
+        index->islands[index->num_islands].end   = start < end ? end : start;
+        index->num_islands++;
+    }
+    if (record_reader_close(reader))
+    {
+        free(name_offsets);
+        cpgi_index_delete(index);
+        return NULL;
+    }
+
+    // the name pool is final now, so it is safe to hand out pointers into it
+    for (i = 0; i < index->num_islands; i++)
+        index->islands[i].name = index->names + name_offsets[i];
+    free(name_offsets);
+
+    qsort(index->islands, index->num_islands, sizeof(cpgi_t), cpgi_compare);
+
+    // split into chromosomes and lay a tree over each run
+    for (i = 0; i < index->num_islands; )
+    {
+        unsigned long first = i;
+        chromosome_t * c;
+
+        while (i < index->num_islands && index->islands[i].chromosome == index->islands[first].chromosome)
+            i++;
+
+        index->chromosomes = realloc(index->chromosomes, (index->num_chromosomes + 1) * sizeof(chromosome_t));
+        c = &index->chromosomes[index->num_chromosomes++];
+        c->chromosome = index->islands[first].chromosome;
+        c->offset     = first;
+        c->count      = i - first;
+        c->root_level = cpgi_index_build_tree(index->islands + first, c->count);
+    }
+
+    stream_stats_file_parsed(cpgi_db, index->num_islands, (stream_stats_now() - load_start) / 1e9);
+    return index;
+}
+
+cpgi_index * cpgi_index_ref(cpgi_index * index)
+{
+    index->reference_count++;
+    return index;
+}
+
+void cpgi_index_delete(cpgi_index * index)
+{
+    if (!index || --index->reference_count > 0)
+        return;
+    free(index->islands);
+    free(index->names);
+    free(index->chromosomes);
+    free(index);
+}
+
+unsigned long cpgi_index_size(const cpgi_index * index)
+{
+    return index->num_islands;
+}
+
+const cpgi_t * cpgi_index_chromosome(const cpgi_index * index,
+                                     int                 chromosome,
+                                     unsigned long *     count
+                                    )
+{
+    const chromosome_t * c = cpgi_index_find_chromosome(index, chromosome);
+
+    *count = c ? c->count : 0;
+    return c ? index->islands + c->offset : NULL;
+}
+
+static void cpgi_index_add_hit(const cpgi_t *     island,
+                               const cpgi_t ***    hits,
+                               unsigned long *     hits_capacity,
+                               unsigned long       num_hits
+                              )
+{
+    if (num_hits == *hits_capacity)
+    {
+        *hits_capacity = *hits_capacity ? *hits_capacity * 2 : 8;
+        *hits = realloc(*hits, *hits_capacity * sizeof(cpgi_t *));
+    }
+    (*hits)[num_hits] = island;
+}
+
+unsigned long cpgi_index_overlap(const cpgi_index * index,
+                                 int                 chromosome,
+                                 unsigned long       start,
+                                 unsigned long       end,
+                                 const cpgi_t ***    hits,
+                                 unsigned long *     hits_capacity
+                                )
+{
+    struct { unsigned long x; int k; int left_done; } stack[64], z;
+    const chromosome_t * c;
+    const cpgi_t *       r;
+    unsigned long        n, num_hits = 0;
+    int                  t = 0;
+
+    if (!(c = cpgi_index_find_chromosome(index, chromosome)) || c->count == 0)
+        return 0;
+
+    r = index->islands + c->offset;
+    n = c->count;
+
+    stack[t].k = c->root_level;
+    stack[t].x = (1UL << c->root_level) - 1;
+    stack[t++].left_done = 0;
+
+    while (t)
+    {
+        z = stack[--t];
+
+        if (z.k <= 3)
+        {
+            // small subtree, a linear scan is cheaper than descending
+            unsigned long i;
+            unsigned long i0 = z.x >> z.k << z.k;
+            unsigned long i1 = i0 + (1UL << (z.k + 1)) - 1;
+
+            if (i1 >= n)
+                i1 = n;
+            for (i = i0; i < i1 && r[i].start <= end; ++i)
+                if (start <= r[i].end)
+                    cpgi_index_add_hit(&r[i], hits, hits_capacity, num_hits++);
+        }
+        else if (!z.left_done)
+        {
+            // revisit this node once the left subtree is done
+            unsigned long y = z.x - (1UL << (z.k - 1));
+
+            stack[t].k = z.k;
+            stack[t].x = z.x;
+            stack[t++].left_done = 1;
+
+            // y can be past the end of the array, its subtree may still hold nodes
+            if (y >= n || r[y].max_end >= start)
+            {
+                stack[t].k = z.k - 1;
+                stack[t].x = y;
+                stack[t++].left_done = 0;
+            }
+        }
+        else if (z.x < n && r[z.x].start <= end)
+        {
+            if (start <= r[z.x].end)
+                cpgi_index_add_hit(&r[z.x], hits, hits_capacity, num_hits++);
+
+            stack[t].k = z.k - 1;
+            stack[t].x = z.x + (1UL << (z.k - 1));
+            stack[t++].left_done = 0;
+        }
+    }
+
+    if (num_hits > 1)
+        qsort(*hits, num_hits, sizeof(cpgi_t *), cpgi_ptr_compare);
+
+    return num_hits;
+}
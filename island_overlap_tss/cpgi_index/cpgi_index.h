@@ -0,0 +1,56 @@
+/*
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   In-memory CpG island interval index built from a cpgi.list table
+ *   (name chromosome start end).  Islands are grouped by chromosome and
+ *   stored as an implicit augmented interval tree, so a point or range
+ *   query costs O(log n + hits) regardless of the order of the input file.
+ *   The index is read only once loaded and may be shared between threads,
+ *   take a reference for each user.
+ *
+ */
+
+#ifndef  CPGI_INDEX_H
+#define  CPGI_INDEX_H
+
+typedef struct
+{
+    const char *  name;
+    int           chromosome;
+    unsigned long start;        // 1-based, inclusive
+    unsigned long end;          // 1-based, inclusive
+    unsigned long max_end;      // largest end in this node's subtree
+} cpgi_t;
+
+typedef struct cpgi_index cpgi_index;
+
+// load the whole island table, plain or gzip / BGZF compressed.  Returns
+// NULL if file can't be read or is corrupt
+cpgi_index * cpgi_index_load(const char * cpgi_db);
+
+cpgi_index * cpgi_index_ref(cpgi_index * index);
+
+// drops a reference, the index is freed with the last one
+void cpgi_index_delete(cpgi_index * index);
+
+unsigned long cpgi_index_size(const cpgi_index * index);
+
+// find every island on chromosome that overlaps [start, end] (inclusive).
+// hits is a caller owned buffer grown with realloc as required, so the
+// query is reentrant; results are ordered by island start.  Returns the
+// number of hits.
+unsigned long cpgi_index_overlap(const cpgi_index * index,
+                                 int                 chromosome,
+                                 unsigned long       start,
+                                 unsigned long       end,
+                                 const cpgi_t ***    hits,
+                                 unsigned long *     hits_capacity
+                                );
+
+// islands of one chromosome ordered by start, NULL if chromosome is unknown
+const cpgi_t * cpgi_index_chromosome(const cpgi_index * index,
+                                     int                 chromosome,
+                                     unsigned long *     count
+                                    );
+
+#endif
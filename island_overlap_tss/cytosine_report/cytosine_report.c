@@ -0,0 +1,294 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Parse Bismark coverage files and cytosine reports in parallel chunks,
+*   one block of text read ahead while the last one is parsed
+*
+*
+*************************************************/
+#define _GNU_SOURCE             // memrchr
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include "cytosine_report.h"
+#include "../compressed_input/compressed_input.h"
+#include "../record_reader/record_reader.h"
+#include "../stream_stats/stream_stats.h"
+
+#define CYTOSINE_REPORT_BLOCK        (32 << 20)  // bytes of text read at once
+#define CYTOSINE_REPORT_MIN_CHUNK    (1 << 20)   // smallest piece given a thread
+#define CYTOSINE_REPORT_MAX_THREADS  16
+#define CYTOSINE_REPORT_MAX_FIELDS   7
+
+// whole lines [begin, end), only touched by its worker until joined
+typedef struct
+{
+    const char *       begin;
+    const char *       end;
+    unsigned int       min_depth;
+
+    cytosine_count_t * counts;
+    size_t             num_counts;
+    size_t             capacity;
+    unsigned long      num_malformed;
+} report_chunk_t;
+
+// a count or position field, -1 unless it is digits that fit 32 bits
+static int report_parse_uint(const char * p, const char * end, uint32_t * value)
+{
+    unsigned long n;
+
+    if (record_parse_ulong(p, end - p, &n) || n > UINT32_MAX || *p == '+')
+        return -1;
+    *value = (uint32_t)n;
+    return 0;
+}
+
+// 1 for a counted cytosine, 0 for a row to skip and -1 if it is malformed
+static int report_parse_line(const char * p, const char * line_end, cytosine_count_t * count)
+{
+    const char * fields[CYTOSINE_REPORT_MAX_FIELDS + 1];
+    const char * tab;
+    uint32_t     chromosome, unmethylated;
+    int          num_fields = 0;
+
+    // field i is [fields[i], fields[i + 1] - 1)
+    fields[num_fields++] = p;
+    while (num_fields < CYTOSINE_REPORT_MAX_FIELDS && (tab = memchr(p, '\t', line_end - p)) != NULL)
+        fields[num_fields++] = p = tab + 1;
+    if (num_fields == CYTOSINE_REPORT_MAX_FIELDS)
+    {
+        // the trinucleotide column is not needed
+        if ((tab = memchr(p, '\t', line_end - p)) != NULL)
+            line_end = tab;
+    }
+    fields[num_fields] = line_end + 1;
+
+    // Chr1, chr1 and 1 are the same, organelles and scaffolds are dropped
+    p = fields[0];
+    if (fields[1] - 1 - p > 3 && !strncasecmp(p, "chr", 3))
+        p += 3;
+    if (report_parse_uint(p, fields[1] - 1, &chromosome) || chromosome > INT32_MAX)
+        return num_fields >= 6 ? 0 : -1;
+    count->chromosome = (int)chromosome;
+
+    if (report_parse_uint(fields[1], fields[2] - 1, &count->position))
+        return -1;
+
+    // coverage files have six columns, reports seven
+    if (num_fields == 6)
+    {
+        if (report_parse_uint(fields[4], fields[5] - 1, &count->methylated) ||
+            report_parse_uint(fields[5], fields[6] - 1, &unmethylated))
+            return -1;
+    }
+    else if (num_fields == 7)
+    {
+        if (report_parse_uint(fields[3], fields[4] - 1, &count->methylated) ||
+            report_parse_uint(fields[4], fields[5] - 1, &unmethylated))
+            return -1;
+
+        // the islands are CpG, a CX report's CHG and CHH rows measure something else
+        if (fields[6] - 1 - fields[5] != 2 || memcmp(fields[5], "CG", 2))
+            return 0;
+    }
+    else
+        return -1;
+
+    if ((uint64_t)count->methylated + unmethylated > UINT32_MAX)
+        return -1;
+    count->coverage = count->methylated + unmethylated;
+    return 1;
+}
+
+static void report_parse_chunk(report_chunk_t * chunk)
+{
+    const char * p = chunk->begin;
+
+    chunk->num_counts    = 0;
+    chunk->num_malformed = 0;
+
+    while (p < chunk->end)
+    {
+        const char *     line_end = memchr(p, '\n', chunk->end - p);
+        const char *     next_line;
+        cytosine_count_t count;
+        int              status;
+
+        if (!line_end)
+            line_end = chunk->end;
+        next_line = line_end + (line_end < chunk->end);
+        if (line_end > p && line_end[-1] == '\r')
+            line_end--;
+
+        if (line_end == p)
+        {
+            p = next_line;
+            continue;
+        }
+
+        if ((status = report_parse_line(p, line_end, &count)) < 0)
+            chunk->num_malformed++;
+        else if (status && count.coverage >= chunk->min_depth)
+        {
+            if (chunk->num_counts == chunk->capacity)
+            {
+                chunk->capacity = chunk->capacity ? 2 * chunk->capacity : 1 << 16;
+                chunk->counts   = realloc(chunk->counts, chunk->capacity * sizeof(cytosine_count_t));
+            }
+            chunk->counts[chunk->num_counts++] = count;
+        }
+        p = next_line;
+    }
+}
+
+static void * report_worker(void * arg)
+{
+    report_parse_chunk(arg);
+    return NULL;
+}
+
+// cut [text, text + length) at newlines into up to num_threads chunks and
+// start parsing them, returns the number started
+static int report_start_chunks(report_chunk_t * chunks,
+                               pthread_t *      threads,
+                               int              num_threads,
+                               const char *     text,
+                               size_t           length
+                              )
+{
+    size_t chunk_size = length / num_threads + 1;
+    size_t offset = 0;
+    int    n = 0;
+
+    if (chunk_size < CYTOSINE_REPORT_MIN_CHUNK)
+        chunk_size = CYTOSINE_REPORT_MIN_CHUNK;
+
+    while (offset < length)
+    {
+        size_t       end = offset + chunk_size;
+        const char * newline;
+
+        if (end >= length || n == num_threads - 1)
+            end = length;
+        else if ((newline = memchr(text + end, '\n', length - end)) != NULL)
+            end = newline + 1 - text;
+        else
+            end = length;
+
+        chunks[n].begin = text + offset;
+        chunks[n].end   = text + end;
+        pthread_create(&threads[n], NULL, report_worker, &chunks[n]);
+        n++;
+        offset = end;
+    }
+
+    return n;
+}
+
+cytosine_count_t * cytosine_report_read(const char * path,
+                                        unsigned int min_depth,
+                                        int          num_threads,
+                                        size_t *     num_counts
+                                       )
+{
+    compressed_input * input;
+    FILE *             file;
+    report_chunk_t     chunks[CYTOSINE_REPORT_MAX_THREADS];
+    pthread_t          threads[CYTOSINE_REPORT_MAX_THREADS];
+    char *             blocks[2];
+    cytosine_count_t * counts;
+    size_t             capacity, length, parsed, carry, n;
+    unsigned long      num_malformed = 0;
+    int                current = 0, eof, num_chunks, i, failed;
+    uint64_t           load_start = stream_stats_now();
+
+    if ((input = compressed_input_open(path)) == NULL)
+        return NULL;
+    file = compressed_input_file(input);
+
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > CYTOSINE_REPORT_MAX_THREADS)
+        num_threads = CYTOSINE_REPORT_MAX_THREADS;
+    memset(chunks, 0, sizeof(chunks));
+    for (i = 0; i < num_threads; i++)
+        chunks[i].min_depth = min_depth ? min_depth : 1;
+
+    capacity  = 1 << 16;
+    counts    = malloc(capacity * sizeof(cytosine_count_t));
+    blocks[0] = malloc(CYTOSINE_REPORT_BLOCK);
+    blocks[1] = malloc(CYTOSINE_REPORT_BLOCK);
+    *num_counts = 0;
+
+    length = fread(blocks[current], 1, CYTOSINE_REPORT_BLOCK, file);
+    eof    = length < CYTOSINE_REPORT_BLOCK;
+
+    for (;;)
+    {
+        const char * newline;
+        size_t       text_length;
+
+        // whole lines only, until the last block
+        parsed = text_length = length;
+        if (!eof)
+        {
+            if ((newline = memrchr(blocks[current], '\n', length)) != NULL)
+                parsed = text_length = newline + 1 - blocks[current];
+            else
+            {
+                num_malformed++;    // a line longer than a block is garbage
+                text_length = 0;
+            }
+        }
+
+        num_chunks = report_start_chunks(chunks, threads, num_threads, blocks[current], text_length);
+
+        // the partial line starts the next block, read while the workers run
+        carry = length - parsed;
+        memcpy(blocks[!current], blocks[current] + parsed, carry);
+        n = eof ? 0 : fread(blocks[!current] + carry, 1, CYTOSINE_REPORT_BLOCK - carry, file);
+
+        for (i = 0; i < num_chunks; i++)
+        {
+            pthread_join(threads[i], NULL);
+            if (*num_counts + chunks[i].num_counts > capacity)
+            {
+                capacity = 2 * (*num_counts + chunks[i].num_counts);
+                counts   = realloc(counts, capacity * sizeof(cytosine_count_t));
+            }
+            memcpy(counts + *num_counts, chunks[i].counts, chunks[i].num_counts * sizeof(cytosine_count_t));
+            *num_counts   += chunks[i].num_counts;
+            num_malformed += chunks[i].num_malformed;
+        }
+
+        if (eof)
+            break;
+        current = !current;
+        length  = carry + n;
+        eof     = length < CYTOSINE_REPORT_BLOCK;
+    }
+
+    failed = ferror(file) != 0;
+    for (i = 0; i < num_threads; i++)
+        free(chunks[i].counts);
+    free(blocks[0]);
+    free(blocks[1]);
+    if (compressed_input_close(input) || failed)
+    {
+        free(counts);
+        return NULL;
+    }
+
+    if (num_malformed)
+        fprintf(stderr, "%s: skipped %lu malformed rows\n", path, num_malformed);
+
+    stream_stats_file_parsed(path, *num_counts, (stream_stats_now() - load_start) / 1e9);
+    return counts;
+}
@@ -0,0 +1,40 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Read Bismark per cytosine read counts, either coverage files
+ *   (chr start end percent methylated unmethylated) or CpG / CX reports
+ *   (chr position strand methylated unmethylated context trinucleotide),
+ *   told apart line by line by the number of columns.  The text is read a
+ *   large block at a time and each block is cut into chunks parsed on
+ *   worker threads while the next block is read.  Plain and gzip / BGZF
+ *   compressed files are read.
+ *
+ */
+
+#ifndef  CYTOSINE_REPORT_H
+#define  CYTOSINE_REPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    int      chromosome;    // Chr<n>, chr<n> or <n>
+    uint32_t position;
+    uint32_t methylated;    // reads
+    uint32_t coverage;      // methylated and unmethylated reads
+} cytosine_count_t;
+
+// the cytosines covered by at least min_depth reads (1 if 0) in file
+// order, *num_counts receives how many.  Only the CG rows of a report are
+// kept, so a CX report reads as a CpG one, coverage files have no context
+// and are taken whole.  Rows of chromosomes that aren't numbered are
+// dropped, malformed rows are dropped with a warning on stderr.  Returns NULL if the file can't be read or is corrupt, release
+// with free()
+cytosine_count_t * cytosine_report_read(const char * path,
+                                        unsigned int min_depth,
+                                        int          num_threads,
+                                        size_t *     num_counts
+                                       );
+
+#endif
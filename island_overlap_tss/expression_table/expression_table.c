@@ -0,0 +1,210 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Load an rna-seq db once into a linear probing hash table keyed by
+*   interned gene ID, summing the rows of each gene as they are read
+*
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "expression_table.h"
+#include "../record_reader/record_reader.h"
+#include "../stream_stats/stream_stats.h"
+
+typedef struct
+{
+    uint32_t hash;
+    uint32_t name_offset;       // into names, 0 marks an empty slot
+    double   expression;
+} expression_slot_t;
+
+struct expression_table {
+    expression_slot_t * slots;
+    unsigned long       capacity;   // always a power of two
+    unsigned long       num_genes;
+    char *              names;
+    size_t              names_length;
+    size_t              names_capacity;
+    int                 reference_count;
+};
+
+// FNV-1a, the gene IDs are short so anything fancier doesn't pay off
+static uint32_t expression_table_hash(const char * key, size_t length)
+{
+    uint32_t h = 2166136261u;
+
+    while (length--)
+    {
+        h ^= (unsigned char)*key++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// gene_name is length bytes, not necessarily NUL terminated
+static expression_slot_t * expression_table_probe(const expression_table * table,
+                                                  const char *             gene_name,
+                                                  size_t                   length,
+                                                  uint32_t                 hash
+                                                 )
+{
+    unsigned long mask = table->capacity - 1;
+    unsigned long i = hash & mask;
+
+    while (table->slots[i].name_offset)
+    {
+        const char * name = table->names + table->slots[i].name_offset;
+
+        if (table->slots[i].hash == hash && !strncmp(name, gene_name, length) && name[length] == '\0')
+            break;
+        i = (i + 1) & mask;
+    }
+    return &table->slots[i];
+}
+
+static void expression_table_grow(expression_table * table)
+{
+    expression_slot_t * old_slots = table->slots;
+    unsigned long       old_capacity = table->capacity;
+    unsigned long       i;
+
+    table->capacity *= 2;
+    table->slots = calloc(table->capacity, sizeof(expression_slot_t));
+
+    for (i = 0; i < old_capacity; i++)
+    {
+        unsigned long j;
+
+        if (!old_slots[i].name_offset)
+            continue;
+        j = old_slots[i].hash & (table->capacity - 1);
+        while (table->slots[j].name_offset)
+            j = (j + 1) & (table->capacity - 1);
+        table->slots[j] = old_slots[i];
+    }
+    free(old_slots);
+}
+
+static uint32_t expression_table_intern(expression_table * table, const char * gene_name, size_t length)
+{
+    uint32_t offset;
+
+    while (table->names_length + length + 1 > table->names_capacity)
+    {
+        table->names_capacity *= 2;
+        table->names = realloc(table->names, table->names_capacity);
+    }
+    offset = (uint32_t)table->names_length;
+    memcpy(table->names + offset, gene_name, length);
+    table->names[offset + length] = '\0';
+    table->names_length += length + 1;
+    return offset;
+}
+
+expression_table * expression_table_load(const char * rnaseq_db)
+{
+    record_reader *    reader;
+    record_view_t      record;
+    expression_table * table;
+    float              found_expression;
+    unsigned long long num_rows = 0;
+    uint64_t           load_start = stream_stats_now();
+
+    // gzip / BGZF text is inflated on the fly
+    if ((reader = record_reader_open(rnaseq_db)) == NULL)
+        return NULL;
+
+    table = calloc(1, sizeof(expression_table));
+    table->reference_count = 1;
+    table->capacity = 1024;
+    table->slots = calloc(table->capacity, sizeof(expression_slot_t));
+    table->names_capacity = 16384;
+    table->names = malloc(table->names_capacity);
+    table->names[0] = '\0';     // offset 0 is reserved for empty slots
+    table->names_length = 1;
+
+    // "gene ignored level", the gene ID is hashed where it lies in the text
+    while (record_reader_next(reader, &record))
+    {
+        const char *        found_name = record.fields[0];
+        size_t              length = record.lengths[0];
+        uint32_t            hash;
+        expression_slot_t * slot;
+
+        if (record.num_fields < 3 ||
+            record_parse_float(record.fields[2], record.lengths[2], &found_expression))
+        {
+            record_reader_reject(reader);
+            continue;
+        }
+        hash = expression_table_hash(found_name, length);
+        slot = expression_table_probe(table, found_name, length, hash);
+
+        if (!slot->name_offset)
+        {
+            // keep the load factor under 1/2 so probe runs stay short
+            if (2 * (table->num_genes + 1) > table->capacity)
+            {
+                expression_table_grow(table);
+                slot = expression_table_probe(table, found_name, length, hash);
+            }
+            slot->hash = hash;
+            slot->name_offset = expression_table_intern(table, found_name, length);
+            slot->expression = 0.0;
+            table->num_genes++;
+        }
+        slot->expression += found_expression;
+        num_rows++;
+    }
+    if (record_reader_close(reader))
+    {
+        expression_table_delete(table);
+        return NULL;
+    }
+
+    stream_stats_file_parsed(rnaseq_db, num_rows, (stream_stats_now() - load_start) / 1e9);
+    return table;
+}
+
+expression_table * expression_table_ref(expression_table * table)
+{
+    table->reference_count++;
+    return table;
+}
+
+void expression_table_delete(expression_table * table)
+{
+    if (!table || --table->reference_count > 0)
+        return;
+    free(table->slots);
+    free(table->names);
+    free(table);
+}
+
+unsigned long expression_table_size(const expression_table * table)
+{
+    return table->num_genes;
+}
+
+int expression_table_lookup(const expression_table * table,
+                            const char *             gene_name,
+                            float *                  expression
+                           )
+{
+    const expression_slot_t * slot;
+    size_t                    length = strlen(gene_name);
+
+    slot = expression_table_probe(table, gene_name, length, expression_table_hash(gene_name, length));
+    if (!slot->name_offset)
+        return 0;
+
+    *expression = (float)slot->expression;
+    return 1;
+}
@@ -0,0 +1,35 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   RNA-seq expression table loaded once from "<gene> <ignored> <level>"
+ *   rows.  Gene IDs are interned into one string pool and indexed by an
+ *   open addressing hash table holding the per-gene sum of all its rows.
+ *   Lookups don't modify the table, so one copy may be shared between
+ *   threads; take a reference for each user.
+ *
+ */
+
+#ifndef  EXPRESSION_TABLE_H
+#define  EXPRESSION_TABLE_H
+
+typedef struct expression_table expression_table;
+
+// read the whole rna-seq db, plain or gzip / BGZF compressed.  Returns
+// NULL if file can't be read or is corrupt
+expression_table * expression_table_load(const char * rnaseq_db);
+
+expression_table * expression_table_ref(expression_table * table);
+
+// drops a reference, the table is freed with the last one
+void expression_table_delete(expression_table * table);
+
+unsigned long expression_table_size(const expression_table * table);
+
+// sum of every row for gene_name, returns 0 and leaves *expression alone
+// if the gene is not in the table
+int expression_table_lookup(const expression_table * table,
+                            const char *             gene_name,
+                            float *                  expression
+                           );
+
+#endif
@@ -0,0 +1,601 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Memory bounded external sort of text dbs on (chromosome, position): runs
+*   radix sorted in parallel, then a k-way merge of the run files
+*
+*
+*************************************************/
+#include "external_sort.h"
+#include "../compressed_input/compressed_input.h"
+#include "../stream_stats/stream_stats.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define EXTERNAL_SORT_MAX_CHUNK     (1UL << 30)     // line offsets in a run are 32 bit
+#define EXTERNAL_SORT_MAX_FAN_IN    256
+#define EXTERNAL_SORT_MIN_BUFFER    (64UL << 10)
+#define EXTERNAL_SORT_MAX_BUFFER    (8UL << 20)
+#define EXTERNAL_SORT_CHECK_BUFFER  (4UL << 20)
+#define EXTERNAL_SORT_RADIX_BITS    16
+
+// a line of a run, the key packs the chromosome above the position so one
+// unsigned compare orders both
+typedef struct
+{
+    uint64_t key;
+    uint32_t offset;
+    uint32_t length;
+} sort_entry_t;
+
+typedef struct
+{
+    char *          text;           // whole lines, each ending in '\n'
+    size_t          length;
+    size_t          capacity;
+    size_t          max_records;
+    sort_entry_t *  entries;
+    sort_entry_t *  scratch;
+    unsigned long   first_line;
+    char *          run_path;
+    int             chromosome_column;
+    int             position_column;
+
+    // set by the worker
+    int             had_err;        // 1 for a line without a key, -1 for I/O
+    unsigned long   bad_line;
+    size_t          num_records;
+
+    pthread_t       thread;
+    int             busy;
+} sort_slot_t;
+
+typedef struct
+{
+    FILE *        file;
+    uint64_t      key;
+    uint32_t      length;
+    char *        line;
+    size_t        line_capacity;
+    unsigned long run;
+} run_reader_t;
+
+
+// decimal digits only, negative allowed for the chromosome
+static int external_sort_parse_number(const char * p, const char * end, int64_t min, int64_t max, int64_t * value)
+{
+    int      negative = 0;
+    uint64_t v = 0;
+
+    if (p < end && *p == '-')
+    {
+        negative = 1;
+        p++;
+    }
+    if (p == end)
+        return 0;
+    for (; p < end; p++)
+    {
+        if (*p < '0' || *p > '9' || v > UINT32_MAX)
+            return 0;
+        v = v * 10 + (*p - '0');
+    }
+    if (v > UINT32_MAX + 1ULL)
+        return 0;
+    *value = negative ? -(int64_t)v : (int64_t)v;
+    return *value >= min && *value <= max;
+}
+
+// returns 1 with the key of the line [line, end), 0 for a blank line and -1
+// if either column is missing or not a number
+static int external_sort_parse_key(const char * line,
+                                   const char * end,
+                                   int          chromosome_column,
+                                   int          position_column,
+                                   uint64_t *   key
+                                  )
+{
+    const char * p = line;
+    int          column = 0, have_chromosome = 0, have_position = 0;
+    int64_t      chromosome = 0, position = 0;
+
+    while (p < end && (!have_chromosome || !have_position))
+    {
+        const char * field;
+
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
+        if (p == end)
+            break;
+        field = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+            p++;
+        column++;
+
+        if (column == chromosome_column &&
+            !(have_chromosome = external_sort_parse_number(field, p, INT32_MIN, INT32_MAX, &chromosome)))
+            return -1;
+        if (column == position_column &&
+            !(have_position = external_sort_parse_number(field, p, 0, UINT32_MAX, &position)))
+            return -1;
+    }
+
+    if (column == 0)
+        return 0;
+    if (!have_chromosome || !have_position)
+        return -1;
+
+    // flipping the sign bit makes signed chromosomes order as unsigned
+    *key = ((uint64_t)((uint32_t)(int32_t)chromosome ^ 0x80000000u) << 32) | (uint64_t)position;
+    return 1;
+}
+
+// LSD radix sort, stable, so lines with one key keep their order.  Digits
+// every entry shares, like the high chromosome bits, cost a count only.
+static sort_entry_t * external_sort_radix(sort_entry_t * entries, sort_entry_t * scratch, size_t n)
+{
+    size_t * counts = malloc(sizeof(size_t) << EXTERNAL_SORT_RADIX_BITS);
+    size_t   mask   = (1UL << EXTERNAL_SORT_RADIX_BITS) - 1;
+    size_t   i, sum, count;
+    int      shift;
+
+    for (shift = 0; shift < 64; shift += EXTERNAL_SORT_RADIX_BITS)
+    {
+        sort_entry_t * swap;
+
+        memset(counts, 0, sizeof(size_t) << EXTERNAL_SORT_RADIX_BITS);
+        for (i = 0; i < n; i++)
+            counts[(entries[i].key >> shift) & mask]++;
+        if (counts[(entries[0].key >> shift) & mask] == n)
+            continue;
+
+        for (i = 0, sum = 0; i <= mask; i++)
+        {
+            count     = counts[i];
+            counts[i] = sum;
+            sum      += count;
+        }
+        for (i = 0; i < n; i++)
+            scratch[counts[(entries[i].key >> shift) & mask]++] = entries[i];
+
+        swap    = entries;
+        entries = scratch;
+        scratch = swap;
+    }
+
+    free(counts);
+    return entries;
+}
+
+static int external_sort_write_record(FILE * file, uint64_t key, const char * line, uint32_t length)
+{
+    return fwrite(&key, sizeof(key), 1, file) != 1 ||
+           fwrite(&length, sizeof(length), 1, file) != 1 ||
+           fwrite(line, 1, length, file) != length;
+}
+
+static void * external_sort_run_worker(void * data)
+{
+    sort_slot_t *  slot = data;
+    const char *   p    = slot->text, * end = slot->text + slot->length;
+    unsigned long  line = slot->first_line;
+    sort_entry_t * sorted;
+    FILE *         run;
+    size_t         n = 0, i;
+
+    while (p < end)
+    {
+        const char * eol = memchr(p, '\n', end - p);
+        int          status = external_sort_parse_key(p, eol, slot->chromosome_column, slot->position_column,
+                                                      &slot->entries[n].key);
+
+        if (status < 0)
+        {
+            slot->had_err  = 1;
+            slot->bad_line = line;
+            return NULL;
+        }
+        if (status)
+        {
+            slot->entries[n].offset = p - slot->text;
+            slot->entries[n].length = eol - p + 1;
+            n++;
+        }
+        p = eol + 1;
+        line++;
+    }
+    slot->num_records = n;
+
+    sorted = n ? external_sort_radix(slot->entries, slot->scratch, n) : slot->entries;
+
+    if ((run = fopen(slot->run_path, "wb")) == NULL)
+    {
+        slot->had_err = -1;
+        return NULL;
+    }
+    setvbuf(run, NULL, _IOFBF, EXTERNAL_SORT_MAX_BUFFER);
+    for (i = 0; i < n && !slot->had_err; i++)
+        if (external_sort_write_record(run, sorted[i].key, slot->text + sorted[i].offset, sorted[i].length))
+            slot->had_err = -1;
+    if (fclose(run))
+        slot->had_err = -1;
+
+    return NULL;
+}
+
+static int run_reader_next(run_reader_t * reader)
+{
+    if (fread(&reader->key, sizeof(reader->key), 1, reader->file) != 1)
+        return ferror(reader->file) ? -1 : 0;
+    if (fread(&reader->length, sizeof(reader->length), 1, reader->file) != 1)
+        return -1;
+    if (reader->length > reader->line_capacity)
+    {
+        reader->line_capacity = reader->length;
+        reader->line = realloc(reader->line, reader->line_capacity);
+    }
+    return fread(reader->line, 1, reader->length, reader->file) == reader->length ? 1 : -1;
+}
+
+static int run_reader_less(const run_reader_t * a, const run_reader_t * b)
+{
+    return a->key < b->key || (a->key == b->key && a->run < b->run);
+}
+
+static void external_sort_sift_down(run_reader_t ** heap, size_t n, size_t i)
+{
+    for (;;)
+    {
+        size_t         smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        run_reader_t * swap;
+
+        if (left < n && run_reader_less(heap[left], heap[smallest]))
+            smallest = left;
+        if (right < n && run_reader_less(heap[right], heap[smallest]))
+            smallest = right;
+        if (smallest == i)
+            return;
+        swap           = heap[i];
+        heap[i]        = heap[smallest];
+        heap[smallest] = swap;
+        i              = smallest;
+    }
+}
+
+// merge count runs into out_path, as text for the final pass or as another
+// run.  Each file gets a buffer of buffer_size so reads are long and
+// sequential however many runs are open.
+static int external_sort_merge(char ** run_paths, size_t count, const char * out_path, int text, size_t buffer_size)
+{
+    run_reader_t *  readers = calloc(count, sizeof(run_reader_t));
+    run_reader_t ** heap    = malloc(count * sizeof(run_reader_t *));
+    FILE *          out;
+    size_t          i, n = 0;
+    int             had_err = 0, status;
+
+    if ((out = fopen(out_path, "wb")) == NULL)
+    {
+        fprintf(stderr, "external_sort: can't write %s\n", out_path);
+        free(readers);
+        free(heap);
+        return -1;
+    }
+    setvbuf(out, NULL, _IOFBF, buffer_size);
+
+    for (i = 0; i < count && !had_err; i++)
+    {
+        readers[i].run = i;
+        if ((readers[i].file = fopen(run_paths[i], "rb")) == NULL)
+        {
+            had_err = -1;
+            break;
+        }
+        setvbuf(readers[i].file, NULL, _IOFBF, buffer_size);
+        if ((status = run_reader_next(&readers[i])) < 0)
+            had_err = -1;
+        else if (status)
+            heap[n++] = &readers[i];
+    }
+
+    for (i = n / 2; i-- > 0; )
+        external_sort_sift_down(heap, n, i);
+
+    while (n && !had_err)
+    {
+        run_reader_t * top = heap[0];
+
+        if (text ? fwrite(top->line, 1, top->length, out) != top->length
+                 : external_sort_write_record(out, top->key, top->line, top->length))
+            had_err = -1;
+
+        if ((status = run_reader_next(top)) < 0)
+            had_err = -1;
+        else if (!status)
+            heap[0] = heap[--n];
+        external_sort_sift_down(heap, n, 0);
+    }
+
+    if (fclose(out))
+        had_err = -1;
+    for (i = 0; i < count; i++)
+    {
+        if (readers[i].file)
+            fclose(readers[i].file);
+        free(readers[i].line);
+    }
+    free(readers);
+    free(heap);
+
+    if (had_err)
+        fprintf(stderr, "external_sort: I/O error merging into %s\n", out_path);
+    return had_err;
+}
+
+static char * external_sort_run_path(const char * temp_dir, unsigned long run)
+{
+    char * path = malloc(strlen(temp_dir) + 64);
+    sprintf(path, "%s/track_sort.%ld.%lu.run", temp_dir, (long)getpid(), run);
+    return path;
+}
+
+// hand the full lines at the front of text to slot, returns how many bytes
+// it took.  The cut leaves room for the slot's entries within its budget.
+static size_t external_sort_cut(const char * text, size_t length, size_t max_records, unsigned long * num_lines)
+{
+    const char * p = text, * end = text + length, * eol;
+
+    *num_lines = 0;
+    while (*num_lines < max_records && (eol = memchr(p, '\n', end - p)) != NULL)
+    {
+        p = eol + 1;
+        (*num_lines)++;
+    }
+    return p - text;
+}
+
+int external_sort_file(const char * in_path, const char * out_path, const external_sort_options_t * options)
+{
+    compressed_input * input;
+    FILE *             in;
+    sort_slot_t *      slots;
+    char *             carry, * temp_dir, ** run_paths = NULL;
+    size_t             slot_budget, carry_length = 0, fan_in, buffer_size, i;
+    unsigned long      num_runs = 0, run_capacity = 0, next_run = 0, line = 1;
+    unsigned long long num_records = 0;
+    int                num_threads = options->num_threads > 0 ? options->num_threads : 1;
+    int                eof = 0, had_err = 0;
+    uint64_t           sort_start = stream_stats_now();
+
+    if ((input = compressed_input_open(in_path)) == NULL)
+    {
+        fprintf(stderr, "external_sort: can't read %s\n", in_path);
+        return -1;
+    }
+    in = compressed_input_file(input);
+
+    if (options->temp_dir)
+        temp_dir = strdup(options->temp_dir);
+    else
+    {
+        const char * slash = strrchr(out_path, '/');
+
+        temp_dir = slash ? strndup(out_path, slash - out_path + (slash == out_path)) : strdup(".");
+    }
+
+    // every slot and the carried partial line share the memory limit, half
+    // of a slot's share holds text and the other half its entries
+    slot_budget = options->memory_limit / (num_threads + 1);
+    slots = calloc(num_threads, sizeof(sort_slot_t));
+    for (i = 0; i < (size_t)num_threads; i++)
+    {
+        slots[i].capacity          = slot_budget / 2 < EXTERNAL_SORT_MAX_CHUNK ? slot_budget / 2 : EXTERNAL_SORT_MAX_CHUNK;
+        slots[i].max_records       = slot_budget / 2 / (2 * sizeof(sort_entry_t));
+        slots[i].text              = malloc(slots[i].capacity + 1);
+        slots[i].entries           = malloc(slots[i].max_records * sizeof(sort_entry_t));
+        slots[i].scratch           = malloc(slots[i].max_records * sizeof(sort_entry_t));
+        slots[i].chromosome_column = options->chromosome_column;
+        slots[i].position_column   = options->position_column;
+    }
+    carry = malloc(slots[0].capacity + 1);
+
+    while (!had_err)
+    {
+        sort_slot_t * slot = &slots[next_run % num_threads];
+        unsigned long num_lines;
+        size_t        taken;
+
+        if (slot->busy)
+        {
+            pthread_join(slot->thread, NULL);
+            slot->busy = 0;
+            num_records += slot->num_records;
+            if ((had_err = slot->had_err))
+                break;
+        }
+
+        memcpy(slot->text, carry, carry_length);
+        slot->length = carry_length;
+        if (!eof)
+        {
+            slot->length += fread(slot->text + slot->length, 1, slot->capacity - slot->length, in);
+            eof = slot->length < slot->capacity;
+        }
+        if (slot->length == 0)
+            break;
+        if (eof && slot->text[slot->length - 1] != '\n')
+            slot->text[slot->length++] = '\n';
+
+        taken = external_sort_cut(slot->text, slot->length, slot->max_records, &num_lines);
+        if (taken == 0)
+        {
+            fprintf(stderr, "external_sort: line %lu of %s is longer than the sort buffer\n", line, in_path);
+            had_err = 1;
+            break;
+        }
+        carry_length = slot->length - taken;
+        memcpy(carry, slot->text + taken, carry_length);
+        slot->length = taken;
+
+        if (num_runs == run_capacity)
+        {
+            run_capacity = run_capacity ? run_capacity * 2 : 64;
+            run_paths = realloc(run_paths, run_capacity * sizeof(char *));
+        }
+        slot->run_path   = run_paths[num_runs++] = external_sort_run_path(temp_dir, next_run++);
+        slot->first_line = line;
+        slot->had_err    = 0;
+        line += num_lines;
+
+        slot->busy = 1;
+        pthread_create(&slot->thread, NULL, external_sort_run_worker, slot);
+    }
+
+    for (i = 0; i < (size_t)num_threads; i++)
+    {
+        if (slots[i].busy)
+        {
+            pthread_join(slots[i].thread, NULL);
+            num_records += slots[i].num_records;
+            if (!had_err)
+                had_err = slots[i].had_err;
+        }
+        if (slots[i].had_err > 0)
+            fprintf(stderr, "external_sort: line %lu of %s has no chromosome and position\n",
+                    slots[i].bad_line, in_path);
+        else if (slots[i].had_err < 0)
+            fprintf(stderr, "external_sort: can't write run %s\n", slots[i].run_path);
+        free(slots[i].text);
+        free(slots[i].entries);
+        free(slots[i].scratch);
+    }
+    free(slots);
+    free(carry);
+
+    if (compressed_input_close(input) && !had_err)
+    {
+        fprintf(stderr, "external_sort: %s is corrupt or truncated\n", in_path);
+        had_err = -1;
+    }
+    if (!had_err)
+        stream_stats_file_parsed(in_path, num_records, (stream_stats_now() - sort_start) / 1e9);
+
+    // the run buffers are free now, split the limit among the merge inputs
+    fan_in = options->memory_limit / EXTERNAL_SORT_MIN_BUFFER - 1;
+    if (fan_in > EXTERNAL_SORT_MAX_FAN_IN)
+        fan_in = EXTERNAL_SORT_MAX_FAN_IN;
+    if (fan_in < 2)
+        fan_in = 2;
+    buffer_size = options->memory_limit / (fan_in + 1);
+    if (buffer_size > EXTERNAL_SORT_MAX_BUFFER)
+        buffer_size = EXTERNAL_SORT_MAX_BUFFER;
+
+    // too many runs to open at once are merged a group at a time into
+    // longer runs first
+    while (!had_err && num_runs > fan_in)
+    {
+        unsigned long merged = 0;
+
+        for (i = 0; i < num_runs && !had_err; i += fan_in)
+        {
+            size_t count = num_runs - i < fan_in ? num_runs - i : fan_in;
+            char * path  = external_sort_run_path(temp_dir, next_run++);
+            size_t j;
+
+            had_err = external_sort_merge(run_paths + i, count, path, 0, buffer_size);
+            for (j = i; j < i + count; j++)
+            {
+                unlink(run_paths[j]);
+                free(run_paths[j]);
+            }
+            run_paths[merged++] = path;
+        }
+        // groups not reached after an error still have their runs
+        for (; i < num_runs; i++)
+            run_paths[merged++] = run_paths[i];
+        num_runs = merged;
+    }
+
+    if (!had_err)
+        had_err = external_sort_merge(run_paths, num_runs, out_path, 1, buffer_size);
+
+    for (i = 0; i < num_runs; i++)
+    {
+        unlink(run_paths[i]);
+        free(run_paths[i]);
+    }
+    free(run_paths);
+    free(temp_dir);
+    return had_err;
+}
+
+int external_sort_check(const char *    path,
+                        int             chromosome_column,
+                        int             position_column,
+                        unsigned long * bad_line
+                       )
+{
+    compressed_input * input;
+    FILE *             file;
+    char *             buffer;
+    size_t             length = 0, n;
+    uint64_t           key, last = 0;
+    unsigned long      line = 0;
+    int                have_last = 0, result = 1;
+
+    if ((input = compressed_input_open(path)) == NULL)
+        return -1;
+    file   = compressed_input_file(input);
+    buffer = malloc(EXTERNAL_SORT_CHECK_BUFFER + 1);
+
+    do
+    {
+        const char * p, * end, * eol;
+
+        n       = fread(buffer + length, 1, EXTERNAL_SORT_CHECK_BUFFER - length, file);
+        length += n;
+        if (n == 0 && length && buffer[length - 1] != '\n')
+            buffer[length++] = '\n';
+
+        for (p = buffer, end = buffer + length; (eol = memchr(p, '\n', end - p)) != NULL; p = eol + 1)
+        {
+            int status = external_sort_parse_key(p, eol, chromosome_column, position_column, &key);
+
+            line++;
+            if (status < 0 || (status && have_last && key < last))
+            {
+                result    = status < 0 ? -1 : 0;
+                *bad_line = line;
+                break;
+            }
+            if (status)
+            {
+                last      = key;
+                have_last = 1;
+            }
+        }
+        if (result != 1)
+            break;
+
+        length = end - p;
+        if (length == EXTERNAL_SORT_CHECK_BUFFER)
+        {
+            result    = -1;
+            *bad_line = line + 1;
+            break;
+        }
+        memmove(buffer, p, length);
+    } while (n);
+
+    free(buffer);
+    if (compressed_input_close(input))
+        result = -1;
+    return result;
+}
@@ -0,0 +1,43 @@
+/*
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Sort a whitespace separated text db by numeric chromosome and then
+ *   position, in bounded memory.  The input is cut into runs that fit the
+ *   memory limit, each run is radix sorted on its own thread and written to
+ *   a temporary file, then the runs are merged with large sequential reads
+ *   and writes.  Records with the same key keep their input order.
+ *
+ *   Works for every db the loaders read: methylome and nucleosome tracks
+ *   (chromosome in column 1, position in 2) and island lists (2 and 3).
+ *
+ */
+
+#ifndef  EXTERNAL_SORT_H
+#define  EXTERNAL_SORT_H
+
+#include <stddef.h>
+
+typedef struct
+{
+    int          chromosome_column;     // 1 based
+    int          position_column;       // 1 based
+    size_t       memory_limit;          // bytes, for run buffers and merge buffers together
+    int          num_threads;
+    const char * temp_dir;              // NULL for the directory of the output
+} external_sort_options_t;
+
+// sort in_path (which may be gzip or BGZF compressed) into out_path as
+// plain text.  Blank lines are dropped.  Returns 0 on success, non-zero
+// with a message on stderr if a line has no numeric key or on I/O errors.
+int external_sort_file(const char * in_path, const char * out_path, const external_sort_options_t * options);
+
+// stream through path checking it is sorted, without holding more than a
+// buffer of it.  Returns 1 if sorted, 0 if not with the first line out of
+// order in bad_line, -1 if the file can't be read or a line has no key.
+int external_sort_check(const char *    path,
+                        int             chromosome_column,
+                        int             position_column,
+                        unsigned long * bad_line
+                       );
+
+#endif
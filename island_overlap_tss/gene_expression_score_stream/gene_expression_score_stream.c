@@ -18,8 +18,8 @@
 struct gene_expression_score_stream {
     const GtNodeStream parent_instance;
     GtNodeStream * in_stream;
-    FILE * rnaseq_file;
-
+    expression_table * rnaseq;
+    unsigned long num_scored;
 };
 
 static const char * feature_type_gene = "gene";
@@ -33,19 +33,10 @@ static float gene_expression_score_stream_score_gene( gene_expression_score_stre
                                                      const char * gene_name
                                                     )
 {
-    char found_name[255];
-    char trash_buffer[255];
-    float found_expression;
     float score = 0.0f;
 
-    // this is slow but we rewind the rna-seq each time because it's out of sequence
-    rewind(context->rnaseq_file);
-
-    while (3 == fscanf(context->rnaseq_file, "%s %s %f", found_name, trash_buffer, &found_expression) )
-    {
-        if (strcmp(found_name, gene_name) == 0)
-            score += found_expression;
-    }
+    // rows were summed per gene when the rna-seq db was loaded
+    expression_table_lookup(context->rnaseq, gene_name, &score);
     return score;
 }
 
@@ -66,10 +57,10 @@ static int gene_expression_score_stream_next(GtNodeStream * ns,
     context = gene_expression_score_stream_cast(ns);
 
     // find the genes, determine expression level
-     if(!gt_node_stream_next(context->in_stream,
-                            &cur_node,
-                            err
-                           ) && cur_node != NULL
+     if(!(err_num = gt_node_stream_next(context->in_stream,
+                                        &cur_node,
+                                        err
+                                       )) && cur_node != NULL
        )
      {
          *gn = cur_node;
@@ -86,7 +77,7 @@ static int gene_expression_score_stream_next(GtNodeStream * ns,
               {
                   iter = gt_feature_node_iterator_new(cur_node);
                   if (iter == NULL)
-                      return;
+                      return 0;
                   while ((next_node = gt_feature_node_iterator_next(iter)) && !gt_feature_node_has_type(next_node, feature_type_gene));
                   gt_feature_node_iterator_delete(iter);
                   if (NULL == (cur_node = next_node))
@@ -101,13 +92,14 @@ static int gene_expression_score_stream_next(GtNodeStream * ns,
               gene_name = gt_feature_node_get_attribute(cur_node, "Name");
 
               if (gene_name == NULL)
-                  return;
+                  return 0;
 
               // now figure out the score
               gene_expression_score = gene_expression_score_stream_score_gene(context, gene_name);
 
               // save the score into the node
               gt_feature_node_set_score(cur_node, gene_expression_score);
+              context->num_scored++;
               
               return 0;
 
@@ -122,7 +114,8 @@ static void gene_expression_score_stream_free(GtNodeStream * ns)
     gene_expression_score_stream * score_stream;
     
     score_stream = gene_expression_score_stream_cast(ns);
-    fclose(score_stream->rnaseq_file);
+    expression_table_delete(score_stream->rnaseq);
+    gt_node_stream_delete(score_stream->in_stream);
     return;
 }
 
@@ -141,21 +134,38 @@ const GtNodeStreamClass * gene_expression_score_stream_class(void)
     return c;
 }
 
-GtNodeStream * gene_expression_score_stream_new(GtNodeStream * in_stream, const char * rnaseq_db)
+GtNodeStream * gene_expression_score_stream_new_with_table(GtNodeStream * in_stream, expression_table * rnaseq)
 {
     GtNodeStream * ns = gt_node_stream_create(gene_expression_score_stream_class(), 
                                               true); // must be sorted
     gene_expression_score_stream * context = gene_expression_score_stream_cast(ns);
-    gt_assert(in_stream);
+    gt_assert(in_stream && rnaseq);
     context->in_stream = gt_node_stream_ref(in_stream);
+    context->rnaseq = expression_table_ref(rnaseq);
+    context->num_scored = 0;
+
+    return ns;
+}
+
+GtNodeStream * gene_expression_score_stream_new(GtNodeStream * in_stream, const char * rnaseq_db)
+{
+    GtNodeStream *     ns;
+    expression_table * rnaseq;
 
-    if ((context->rnaseq_file = fopen(rnaseq_db, "r")) == NULL)
+    // the rna-seq db is out of sequence with the genes, so read it all once
+    if ((rnaseq = expression_table_load(rnaseq_db)) == NULL)
     {
-       gt_node_stream_delete(ns);
        fprintf(stderr, "Failed to open RNA seq db file %s\n", rnaseq_db);
        return NULL;
     }
 
+    ns = gene_expression_score_stream_new_with_table(in_stream, rnaseq);
+    expression_table_delete(rnaseq);
     return ns;
- 
+}
+
+unsigned long gene_expression_score_stream_num_scored(GtNodeStream * ns)
+{
+    gene_expression_score_stream * context = gene_expression_score_stream_cast(ns);
+    return context->num_scored;
 }
@@ -9,8 +9,16 @@
 #ifndef  GENE_EXPRESSION_SCORE_STREAM_API_H
 #define  GENE_EXPRESSION_SCORE_STREAM_API_H
 
+#include "../expression_table/expression_table.h"
+
 typedef struct gene_expression_score_stream gene_expression_score_stream;
 
-GtNodeStream* gene_expression_score_stream_new(GtNodeStream * in_stream, const char * methylome_db);
+GtNodeStream* gene_expression_score_stream_new(GtNodeStream * in_stream, const char * rnaseq_db);
+
+// score against an already loaded rna-seq table, the stream takes its own reference
+GtNodeStream* gene_expression_score_stream_new_with_table(GtNodeStream * in_stream, expression_table * rnaseq);
+
+// number of genes scored so far
+unsigned long gene_expression_score_stream_num_scored(GtNodeStream * ns);
 
 #endif
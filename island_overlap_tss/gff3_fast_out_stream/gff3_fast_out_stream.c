@@ -0,0 +1,591 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Write the nodes of a stream as GFF3 through one large buffer, formatting
+*   numbers by hand
+*
+*
+*************************************************/
+#include <genometools.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gff3_fast_out_stream.h"
+#include "../typed_attribute/typed_attribute.h"
+
+#define GFF3_FAST_OUT_BUFFER      (4UL << 20)
+#define GFF3_FAST_OUT_FASTA_WIDTH 60
+
+// a node of the tree being written, in the order it is written
+typedef struct
+{
+    GtFeatureNode * node;
+    const char *    id;             // the ID attribute, NULL if it has none
+    long            made_up_id;     // offset in ids of one made up for it, -1 if none
+    int             has_children;
+} gff3_fast_out_node_t;
+
+typedef struct
+{
+    unsigned long child;
+    unsigned long parent;
+} gff3_fast_out_link_t;
+
+typedef struct
+{
+    const char *  type;
+    unsigned long count;
+} gff3_fast_out_type_t;
+
+struct gff3_fast_out_stream {
+    const GtNodeStream parent_instance;
+    GtNodeStream * in_stream;
+    char *         path;
+    int            fd;
+    int            write_errno;
+    char *         buffer;
+    size_t         length;
+    int            wrote_header;
+    int            wrote_fasta;
+
+    // the tree being written, reused from tree to tree
+    gff3_fast_out_node_t * nodes;
+    unsigned long          num_nodes;
+    unsigned long          node_capacity;
+    gff3_fast_out_link_t * links;
+    unsigned long          num_links;
+    unsigned long          link_capacity;
+    GtHashmap *            seen;        // node to its index + 1
+    char *                 ids;
+    size_t                 ids_length;
+    size_t                 ids_capacity;
+    gff3_fast_out_type_t * types;       // made up ID counters
+    unsigned long          num_types;
+    int                    first_attribute;
+};
+
+
+#define gff3_fast_out_stream_cast(GS) gt_node_stream_cast(gff3_fast_out_stream_class(), GS);
+
+
+static void gff3_fast_out_stream_flush(gff3_fast_out_stream * context, const char * data, size_t length)
+{
+    ssize_t n;
+
+    while (length && !context->write_errno)
+    {
+        n = write(context->fd, data, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            context->write_errno = errno;
+        else
+        {
+            data   += n;
+            length -= n;
+        }
+    }
+}
+
+static void gff3_fast_out_stream_append(gff3_fast_out_stream * context, const char * data, size_t length)
+{
+    if (context->length + length > GFF3_FAST_OUT_BUFFER)
+    {
+        gff3_fast_out_stream_flush(context, context->buffer, context->length);
+        context->length = 0;
+
+        // a sequence longer than the buffer goes straight out
+        if (length > GFF3_FAST_OUT_BUFFER)
+        {
+            gff3_fast_out_stream_flush(context, data, length);
+            return;
+        }
+    }
+    memcpy(context->buffer + context->length, data, length);
+    context->length += length;
+}
+
+static void gff3_fast_out_stream_append_cstr(gff3_fast_out_stream * context, const char * text)
+{
+    gff3_fast_out_stream_append(context, text, strlen(text));
+}
+
+static void gff3_fast_out_stream_append_char(gff3_fast_out_stream * context, char c)
+{
+    if (context->length == GFF3_FAST_OUT_BUFFER)
+    {
+        gff3_fast_out_stream_flush(context, context->buffer, context->length);
+        context->length = 0;
+    }
+    context->buffer[context->length++] = c;
+}
+
+// text as a column 9 value, with the characters gt escapes percent encoded
+static void gff3_fast_out_stream_append_escaped(gff3_fast_out_stream * context, const char * text)
+{
+    size_t run;
+
+    for (;;)
+    {
+        run = strcspn(text, ";=&,\t");
+        gff3_fast_out_stream_append(context, text, run);
+        text += run;
+        if (!*text)
+            return;
+
+        switch (*text++)
+        {
+            case ';':  gff3_fast_out_stream_append(context, "%3B", 3); break;
+            case '=':  gff3_fast_out_stream_append(context, "%3D", 3); break;
+            case '&':  gff3_fast_out_stream_append(context, "%26", 3); break;
+            case ',':  gff3_fast_out_stream_append(context, "%2C", 3); break;
+            case '\t': gff3_fast_out_stream_append(context, "%09", 3); break;
+        }
+    }
+}
+
+static void gff3_fast_out_stream_append_ulong(gff3_fast_out_stream * context, unsigned long value)
+{
+    char digits[24];
+    int  i = sizeof(digits);
+
+    do
+    {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    gff3_fast_out_stream_append(context, digits + i, sizeof(digits) - i);
+}
+
+static void gff3_fast_out_stream_append_float(gff3_fast_out_stream * context, float value)
+{
+    char text[TYPED_ATTRIBUTE_FLOAT_MAX];
+    gff3_fast_out_stream_append(context, text, typed_attribute_format_float(text, value));
+}
+
+// ID to write for nodes[index], NULL if it has none
+static const char * gff3_fast_out_stream_id(gff3_fast_out_stream * context, unsigned long index)
+{
+    if (context->nodes[index].id)
+        return context->nodes[index].id;
+    if (context->nodes[index].made_up_id >= 0)
+        return context->ids + context->nodes[index].made_up_id;
+    return NULL;
+}
+
+// a parent without an ID gets <type><n>, numbered per type like gt does
+static void gff3_fast_out_stream_make_id(gff3_fast_out_stream * context, unsigned long index)
+{
+    const char *  type = gt_feature_node_get_type(context->nodes[index].node);
+    unsigned long t;
+    size_t        needed;
+
+    for (t = 0; t < context->num_types && strcmp(context->types[t].type, type); t++)
+        ;
+    if (t == context->num_types)
+    {
+        context->types = realloc(context->types, (context->num_types + 1) * sizeof(gff3_fast_out_type_t));
+        context->types[t].type  = type;
+        context->types[t].count = 0;
+        context->num_types++;
+    }
+
+    needed = strlen(type) + 24;
+    if (context->ids_length + needed > context->ids_capacity)
+    {
+        context->ids_capacity = 2 * (context->ids_length + needed);
+        context->ids = realloc(context->ids, context->ids_capacity);
+    }
+    context->nodes[index].made_up_id = context->ids_length;
+    context->ids_length += sprintf(context->ids + context->ids_length, "%s%lu", type, ++context->types[t].count) + 1;
+}
+
+static void gff3_fast_out_stream_collect(gff3_fast_out_stream * context, GtFeatureNode * fn, long parent)
+{
+    GtFeatureNodeIterator * iter;
+    GtFeatureNode *         child;
+    void *                  seen = gt_hashmap_get(context->seen, fn);
+    unsigned long           index;
+
+    if (seen)
+        index = (unsigned long)seen - 1;
+    else
+    {
+        if (context->num_nodes == context->node_capacity)
+        {
+            context->node_capacity = context->node_capacity ? context->node_capacity * 2 : 64;
+            context->nodes = realloc(context->nodes, context->node_capacity * sizeof(gff3_fast_out_node_t));
+        }
+        index = context->num_nodes++;
+        context->nodes[index].node         = fn;
+        context->nodes[index].id           = gt_feature_node_get_attribute(fn, "ID");
+        context->nodes[index].made_up_id   = -1;
+        context->nodes[index].has_children = 0;
+        gt_hashmap_add(context->seen, fn, (void *)(index + 1));
+    }
+
+    if (parent >= 0)
+    {
+        if (context->num_links == context->link_capacity)
+        {
+            context->link_capacity = context->link_capacity ? context->link_capacity * 2 : 64;
+            context->links = realloc(context->links, context->link_capacity * sizeof(gff3_fast_out_link_t));
+        }
+        context->links[context->num_links].child  = index;
+        context->links[context->num_links].parent = parent;
+        context->num_links++;
+        context->nodes[parent].has_children = 1;
+    }
+
+    // a node with several parents brings its children along the first time
+    if (seen)
+        return;
+
+    iter = gt_feature_node_iterator_new_direct(fn);
+    while ((child = gt_feature_node_iterator_next(iter)))
+        gff3_fast_out_stream_collect(context, child, index);
+    gt_feature_node_iterator_delete(iter);
+}
+
+static int gff3_fast_out_link_compare(const void * a, const void * b)
+{
+    const gff3_fast_out_link_t * la = a, * lb = b;
+
+    // parents in the order they were written
+    if (la->child != lb->child)
+        return la->child < lb->child ? -1 : 1;
+    return (la->parent > lb->parent) - (la->parent < lb->parent);
+}
+
+static void gff3_fast_out_stream_separator(gff3_fast_out_stream * context)
+{
+    if (!context->first_attribute)
+        gff3_fast_out_stream_append_char(context, ';');
+    context->first_attribute = 0;
+}
+
+static void gff3_fast_out_stream_attribute(const char * name, const char * value, void * data)
+{
+    gff3_fast_out_stream * context = data;
+
+    // written first, from the tree
+    if (!strcmp(name, "ID") || !strcmp(name, "Parent"))
+        return;
+
+    gff3_fast_out_stream_separator(context);
+    gff3_fast_out_stream_append_cstr(context, name);
+    gff3_fast_out_stream_append_char(context, '=');
+    gff3_fast_out_stream_append_escaped(context, value);
+}
+
+static void gff3_fast_out_stream_write_feature(gff3_fast_out_stream * context,
+                                               unsigned long          index,
+                                               unsigned long *        next_link
+                                              )
+{
+    GtFeatureNode *           fn = context->nodes[index].node;
+    const char *              id = gff3_fast_out_stream_id(context, index);
+    const char *              source = gt_feature_node_get_source(fn);
+    const typed_attribute_t * typed;
+    unsigned int              num_typed, i;
+    int                       first_parent = 1;
+
+    gff3_fast_out_stream_append_cstr(context, gt_str_get(gt_genome_node_get_seqid((GtGenomeNode *)fn)));
+    gff3_fast_out_stream_append_char(context, '\t');
+    gff3_fast_out_stream_append_cstr(context, source ? source : ".");
+    gff3_fast_out_stream_append_char(context, '\t');
+    gff3_fast_out_stream_append_cstr(context, gt_feature_node_get_type(fn));
+    gff3_fast_out_stream_append_char(context, '\t');
+    gff3_fast_out_stream_append_ulong(context, gt_genome_node_get_start((GtGenomeNode *)fn));
+    gff3_fast_out_stream_append_char(context, '\t');
+    gff3_fast_out_stream_append_ulong(context, gt_genome_node_get_end((GtGenomeNode *)fn));
+    gff3_fast_out_stream_append_char(context, '\t');
+    if (gt_feature_node_score_is_defined(fn))
+        gff3_fast_out_stream_append_float(context, gt_feature_node_get_score(fn));
+    else
+        gff3_fast_out_stream_append_char(context, '.');
+    gff3_fast_out_stream_append_char(context, '\t');
+    gff3_fast_out_stream_append_char(context, GT_STRAND_CHARS[gt_feature_node_get_strand(fn)]);
+    gff3_fast_out_stream_append_char(context, '\t');
+    gff3_fast_out_stream_append_char(context, GT_PHASE_CHARS[gt_feature_node_get_phase(fn)]);
+    gff3_fast_out_stream_append_char(context, '\t');
+
+    context->first_attribute = 1;
+    if (id)
+    {
+        gff3_fast_out_stream_separator(context);
+        gff3_fast_out_stream_append(context, "ID=", 3);
+        gff3_fast_out_stream_append_escaped(context, id);
+    }
+
+    // links are sorted by child, and nodes are written in index order
+    for (; *next_link < context->num_links && context->links[*next_link].child == index; (*next_link)++)
+    {
+        const char * parent_id = gff3_fast_out_stream_id(context, context->links[*next_link].parent);
+
+        if (first_parent)
+        {
+            gff3_fast_out_stream_separator(context);
+            gff3_fast_out_stream_append(context, "Parent=", 7);
+            first_parent = 0;
+        }
+        else
+            gff3_fast_out_stream_append_char(context, ',');
+        gff3_fast_out_stream_append_escaped(context, parent_id);
+    }
+
+    gt_feature_node_foreach_attribute(fn, gff3_fast_out_stream_attribute, context);
+
+    num_typed = typed_attribute_list(fn, &typed);
+    for (i = 0; i < num_typed; i++)
+    {
+        size_t       name_length;
+        const char * name = typed_attribute_name(typed[i].key, &name_length);
+
+        gff3_fast_out_stream_separator(context);
+        gff3_fast_out_stream_append(context, name, name_length);
+        gff3_fast_out_stream_append_char(context, '=');
+        gff3_fast_out_stream_append_float(context, typed[i].value);
+    }
+
+    if (context->first_attribute)
+        gff3_fast_out_stream_append_char(context, '.');
+    gff3_fast_out_stream_append_char(context, '\n');
+}
+
+static void gff3_fast_out_stream_write_tree(gff3_fast_out_stream * context, GtFeatureNode * root)
+{
+    GtFeatureNodeIterator * iter;
+    GtFeatureNode *         child;
+    unsigned long           i, next_link = 0;
+
+    context->num_nodes  = 0;
+    context->num_links  = 0;
+    context->ids_length = 0;
+    gt_hashmap_reset(context->seen);
+
+    // a pseudo node only holds the parts of a multi feature together
+    if (gt_feature_node_is_pseudo(root))
+    {
+        iter = gt_feature_node_iterator_new_direct(root);
+        while ((child = gt_feature_node_iterator_next(iter)))
+            gff3_fast_out_stream_collect(context, child, -1);
+        gt_feature_node_iterator_delete(iter);
+    }
+    else
+        gff3_fast_out_stream_collect(context, root, -1);
+
+    for (i = 0; i < context->num_nodes; i++)
+        if (context->nodes[i].has_children && !context->nodes[i].id)
+            gff3_fast_out_stream_make_id(context, i);
+
+    qsort(context->links, context->num_links, sizeof(gff3_fast_out_link_t), gff3_fast_out_link_compare);
+
+    for (i = 0; i < context->num_nodes; i++)
+        gff3_fast_out_stream_write_feature(context, i, &next_link);
+
+    if (context->num_nodes && (context->num_links || context->nodes[0].id))
+        gff3_fast_out_stream_append(context, "###\n", 4);
+}
+
+static void gff3_fast_out_stream_write_sequence(gff3_fast_out_stream * context, GtSequenceNode * sn)
+{
+    const char *  sequence = gt_sequence_node_get_sequence(sn);
+    unsigned long length   = gt_sequence_node_get_sequence_length(sn), i;
+
+    if (!context->wrote_fasta)
+    {
+        gff3_fast_out_stream_append(context, "##FASTA\n", 8);
+        context->wrote_fasta = 1;
+    }
+    gff3_fast_out_stream_append_char(context, '>');
+    gff3_fast_out_stream_append_cstr(context, gt_sequence_node_get_description(sn));
+    gff3_fast_out_stream_append_char(context, '\n');
+    for (i = 0; i < length; i += GFF3_FAST_OUT_FASTA_WIDTH)
+    {
+        gff3_fast_out_stream_append(context, sequence + i,
+                                    length - i < GFF3_FAST_OUT_FASTA_WIDTH ? length - i : GFF3_FAST_OUT_FASTA_WIDTH);
+        gff3_fast_out_stream_append_char(context, '\n');
+    }
+}
+
+static void gff3_fast_out_stream_write_node(gff3_fast_out_stream * context, GtGenomeNode * gn)
+{
+    void * node;
+
+    if (!context->wrote_header)
+    {
+        gff3_fast_out_stream_append(context, "##gff-version 3\n", 16);
+        context->wrote_header = 1;
+    }
+
+    if ((node = gt_genome_node_try_cast(gt_feature_node_class(), gn)))
+        gff3_fast_out_stream_write_tree(context, node);
+    else if ((node = gt_genome_node_try_cast(gt_region_node_class(), gn)))
+    {
+        gff3_fast_out_stream_append(context, "##sequence-region   ", 20);
+        gff3_fast_out_stream_append_cstr(context, gt_str_get(gt_genome_node_get_seqid(gn)));
+        gff3_fast_out_stream_append_char(context, ' ');
+        gff3_fast_out_stream_append_ulong(context, gt_genome_node_get_start(gn));
+        gff3_fast_out_stream_append_char(context, ' ');
+        gff3_fast_out_stream_append_ulong(context, gt_genome_node_get_end(gn));
+        gff3_fast_out_stream_append_char(context, '\n');
+    }
+    else if ((node = gt_genome_node_try_cast(gt_comment_node_class(), gn)))
+    {
+        gff3_fast_out_stream_append_char(context, '#');
+        gff3_fast_out_stream_append_cstr(context, gt_comment_node_get_comment(node));
+        gff3_fast_out_stream_append_char(context, '\n');
+    }
+    else if ((node = gt_genome_node_try_cast(gt_meta_node_class(), gn)))
+    {
+        const char * data = gt_meta_node_get_data(node);
+
+        gff3_fast_out_stream_append(context, "##", 2);
+        gff3_fast_out_stream_append_cstr(context, gt_meta_node_get_directive(node));
+        if (data)
+        {
+            gff3_fast_out_stream_append_char(context, ' ');
+            gff3_fast_out_stream_append_cstr(context, data);
+        }
+        gff3_fast_out_stream_append_char(context, '\n');
+    }
+    else if ((node = gt_genome_node_try_cast(gt_sequence_node_class(), gn)))
+        gff3_fast_out_stream_write_sequence(context, node);
+}
+
+static int gff3_fast_out_stream_next(GtNodeStream *  ns,
+                                     GtGenomeNode ** gn,
+                                     GtError *       err
+                                    )
+{
+    gff3_fast_out_stream * context;
+    int                    had_err;
+
+    context = gff3_fast_out_stream_cast(ns);
+
+    if ((had_err = gt_node_stream_next(context->in_stream, gn, err)))
+        return had_err;
+
+    if (*gn)
+        gff3_fast_out_stream_write_node(context, *gn);
+    else
+    {
+        // the input is done, so is the file
+        gff3_fast_out_stream_flush(context, context->buffer, context->length);
+        context->length = 0;
+    }
+
+    if (context->write_errno)
+    {
+        // nobody takes the node on a failed next
+        if (*gn)
+        {
+            gt_genome_node_delete(*gn);
+            *gn = NULL;
+        }
+        gt_error_set(err, "can't write %s: %s", context->path, strerror(context->write_errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void gff3_fast_out_stream_free(GtNodeStream * ns)
+{
+    gff3_fast_out_stream * context = gff3_fast_out_stream_cast(ns);
+
+    gff3_fast_out_stream_flush(context, context->buffer, context->length);
+    if (context->write_errno)
+        fprintf(stderr, "gff3_fast_out_stream: can't write %s: %s\n", context->path, strerror(context->write_errno));
+    if (context->fd != STDOUT_FILENO)
+        close(context->fd);
+    gt_node_stream_delete(context->in_stream);
+    gt_hashmap_delete(context->seen);
+    free(context->path);
+    free(context->buffer);
+    free(context->nodes);
+    free(context->links);
+    free(context->ids);
+    free(context->types);
+}
+
+const GtNodeStreamClass * gff3_fast_out_stream_class(void)
+{
+    static const GtNodeStreamClass * c = NULL;
+
+    if (!c)
+    {
+        c = gt_node_stream_class_new( sizeof(gff3_fast_out_stream),
+                                      gff3_fast_out_stream_free,
+                                      gff3_fast_out_stream_next
+                                    );
+    }
+
+    return c;
+}
+
+GtNodeStream * gff3_fast_out_stream_new(GtNodeStream * in_stream, const char * path, int typed)
+{
+    GtNodeStream *         ns;
+    gff3_fast_out_stream * context;
+    int                    fd;
+
+    gt_assert(in_stream && path);
+    if (!strcmp(path, "-"))
+        fd = STDOUT_FILENO;
+    else if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+        return NULL;
+
+    // nodes are only written here, so the numbers can stay floats until now
+    if (typed)
+        typed_attribute_enable();
+
+    ns = gt_node_stream_create(gff3_fast_out_stream_class(), gt_node_stream_is_sorted(in_stream));
+    context = gff3_fast_out_stream_cast(ns);
+    context->in_stream     = gt_node_stream_ref(in_stream);
+    context->path          = strdup(path);
+    context->fd            = fd;
+    context->write_errno   = 0;
+    context->buffer        = malloc(GFF3_FAST_OUT_BUFFER);
+    context->length        = 0;
+    context->wrote_header  = 0;
+    context->wrote_fasta   = 0;
+    context->nodes         = NULL;
+    context->num_nodes     = 0;
+    context->node_capacity = 0;
+    context->links         = NULL;
+    context->num_links     = 0;
+    context->link_capacity = 0;
+    context->seen          = gt_hashmap_new(GT_HASH_DIRECT, NULL, NULL);
+    context->ids           = NULL;
+    context->ids_length    = 0;
+    context->ids_capacity  = 0;
+    context->types         = NULL;
+    context->num_types     = 0;
+
+    return ns;
+}
+
+int gff3_fast_out_stream_parse_flag(int * argc, char ** argv)
+{
+    int i, j, found = 0;
+
+    for (i = j = 1; i < *argc; i++)
+    {
+        if (!strcmp(argv[i], "--fast-out"))
+            found = 1;
+        else
+            argv[j++] = argv[i];
+    }
+    *argc = j;
+    argv[j] = NULL;
+
+    return found;
+}
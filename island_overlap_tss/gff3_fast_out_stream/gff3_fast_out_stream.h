@@ -0,0 +1,9 @@
+
+#ifndef GFF3_FAST_OUT_STREAM_H
+#define GFF3_FAST_OUT_STREAM_H
+
+#include "gff3_fast_out_stream_api.h"
+
+const GtNodeStreamClass * gff3_fast_out_stream_class(void);
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   GFF3 writer for large scored annotations.  Lines are formatted by hand
+ *   into one large buffer that goes out in a single write once full, the
+ *   score column and typed attributes (see typed_attribute) in the fewest
+ *   digits that read back as the same float.
+ *
+ *   The layout is that of gt gff3 -retainids: IDs are kept as in the input,
+ *   and made up only for parents without one, Parent lists the parents of
+ *   every node, ### follows each tree with children or an ID, and sequences
+ *   go after ##FASTA.
+ *
+ */
+
+#ifndef  GFF3_FAST_OUT_STREAM_API_H
+#define  GFF3_FAST_OUT_STREAM_API_H
+
+typedef struct gff3_fast_out_stream gff3_fast_out_stream;
+
+// write every node of in_stream to path ("-" for stdout) and pass it on.
+// With typed, scores set through typed_attribute stay floats on the nodes
+// until they are written.  Returns NULL if path can't be created.
+GtNodeStream* gff3_fast_out_stream_new(GtNodeStream * in_stream, const char * path, int typed);
+
+// removes a --fast-out argument from argv, returns 1 if it was there
+int gff3_fast_out_stream_parse_flag(int * argc, char ** argv);
+
+#endif
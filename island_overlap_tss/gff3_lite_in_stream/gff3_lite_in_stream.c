@@ -0,0 +1,728 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Scan a mapped GFF3 file a batch of chunks at a time on worker threads,
+*   keeping only rows of the requested types, and build a node per row as
+*   the stream is pulled
+*
+*
+*************************************************/
+#include <genometools.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gff3_lite_in_stream.h"
+#include "../compressed_input/compressed_input.h"
+
+#define GFF3_LITE_CHUNK        (4 << 20)    // bytes of text per worker
+#define GFF3_LITE_MAX_THREADS  16
+#define GFF3_LITE_REGION       -1           // type of a ##sequence-region record
+
+// one kept row, pointing into the text
+typedef struct
+{
+    const char *  seqid;
+    const char *  source;
+    const char *  attributes;
+    unsigned long start;
+    unsigned long end;
+    unsigned long line;         // within the chunk
+    float         score;
+    unsigned int  seqid_length;
+    unsigned int  source_length;
+    unsigned int  attributes_length;
+    int           type;         // into types, or GFF3_LITE_REGION
+    char          strand;
+    char          phase;
+    char          has_score;
+} gff3_lite_record_t;
+
+// whole lines [begin, end), only touched by its worker until joined
+typedef struct
+{
+    const char *         begin;
+    const char *         end;
+    const char * const * types;
+    int                  num_types;
+
+    gff3_lite_record_t * records;
+    unsigned long        num_records;
+    unsigned long        records_capacity;
+    unsigned long        num_lines;
+    const char *         error;         // first malformed line, if any
+    unsigned long        error_line;
+    int                  fasta;         // the annotation ended in this chunk
+} gff3_lite_chunk_t;
+
+typedef struct
+{
+    gff3_lite_chunk_t chunks[GFF3_LITE_MAX_THREADS];
+    int               num_chunks;
+    pthread_t         threads[GFF3_LITE_MAX_THREADS];
+    int               running;
+} gff3_lite_batch_t;
+
+struct gff3_lite_in_stream {
+    const GtNodeStream parent_instance;
+    char *              path;
+    char **             types;
+    int                 num_types;
+    int                 num_threads;
+
+    const char *        text;
+    size_t              text_length;
+    int                 mapped;         // else text was malloced
+    size_t              next_offset;    // start of the next chunk to scan
+
+    // the current batch is handed out while the next one is scanned
+    gff3_lite_batch_t * batches;
+    gff3_lite_batch_t * current;
+    gff3_lite_batch_t * next;
+    int                 chunk_index;
+    unsigned long       record_index;
+    unsigned long       line_base;      // lines before the current chunk
+    int                 finished;
+
+    // nodes of one seqid share its string
+    GtStr *             seqid;
+    GtStr *             source;
+    const char *        last_seqid;
+    unsigned int        last_seqid_length;
+    unsigned long       last_start;
+    char *              attribute_buffer;
+    size_t              attribute_capacity;
+};
+
+
+const GtNodeStreamClass * gff3_lite_in_stream_class(void);
+
+#define gff3_lite_in_stream_cast(GS) gt_node_stream_cast(gff3_lite_in_stream_class(), GS);
+
+// next field up to a tab, returns NULL if the line ends first
+static const char * gff3_lite_field(const char * p, const char * line_end, const char ** field_end)
+{
+    const char * tab = memchr(p, '\t', line_end - p);
+
+    *field_end = tab;
+    return tab ? tab + 1 : NULL;
+}
+
+static int gff3_lite_parse_position(const char * p, const char * field_end, unsigned long * value)
+{
+    unsigned long v = 0;
+
+    if (p == field_end)
+        return -1;
+    for (; p < field_end; p++)
+    {
+        if (*p < '0' || *p > '9')
+            return -1;
+        v = v * 10 + (*p - '0');
+    }
+    *value = v;
+    return 0;
+}
+
+static int gff3_lite_type_index(const gff3_lite_chunk_t * chunk, const char * type, size_t length)
+{
+    int i;
+
+    for (i = 0; i < chunk->num_types; i++)
+        if (!strncmp(chunk->types[i], type, length) && chunk->types[i][length] == '\0')
+            return i;
+    return -2;
+}
+
+static gff3_lite_record_t * gff3_lite_add_record(gff3_lite_chunk_t * chunk)
+{
+    if (chunk->num_records == chunk->records_capacity)
+    {
+        chunk->records_capacity = chunk->records_capacity ? chunk->records_capacity * 2 : 4096;
+        chunk->records = realloc(chunk->records, chunk->records_capacity * sizeof(gff3_lite_record_t));
+    }
+    return &chunk->records[chunk->num_records++];
+}
+
+// ##sequence-region seqid start end
+static void gff3_lite_parse_region(gff3_lite_chunk_t * chunk, const char * p, const char * line_end)
+{
+    gff3_lite_record_t record;
+    char               numbers[64];
+    const char *       seqid_end;
+    size_t             length;
+
+    p += strlen("##sequence-region");
+    while (p < line_end && (*p == ' ' || *p == '\t'))
+        p++;
+    for (seqid_end = p; seqid_end < line_end && *seqid_end != ' ' && *seqid_end != '\t'; seqid_end++)
+        ;
+
+    length = line_end - seqid_end < (long)sizeof(numbers) ? (size_t)(line_end - seqid_end) : sizeof(numbers) - 1;
+    memcpy(numbers, seqid_end, length);
+    numbers[length] = '\0';
+
+    memset(&record, 0, sizeof(record));
+    if (seqid_end == p || 2 != sscanf(numbers, "%lu %lu", &record.start, &record.end))
+        return;     // a pragma we can't use is only a comment
+
+    record.seqid        = p;
+    record.seqid_length = seqid_end - p;
+    record.type         = GFF3_LITE_REGION;
+    record.line         = chunk->num_lines - 1;
+    *gff3_lite_add_record(chunk) = record;
+}
+
+static void gff3_lite_parse_chunk(gff3_lite_chunk_t * chunk)
+{
+    const char * p = chunk->begin;
+
+    chunk->num_records = 0;
+    chunk->num_lines   = 0;
+    chunk->error       = NULL;
+    chunk->fasta       = 0;
+
+    while (p < chunk->end)
+    {
+        const char *       line_end = memchr(p, '\n', chunk->end - p);
+        const char *       next_line;
+        const char *       field_end;
+        const char *       seqid, * source, * type;
+        const char *       q;
+        gff3_lite_record_t record;
+        char               score_text[32];
+        int                type_index, i;
+
+        if (!line_end)
+            line_end = chunk->end;
+        next_line = line_end + (line_end < chunk->end);
+        if (line_end > p && line_end[-1] == '\r')
+            line_end--;
+        chunk->num_lines++;
+
+        if (line_end == p)
+        {
+            p = next_line;
+            continue;
+        }
+        if (*p == '#' || *p == '>')
+        {
+            // sequences may follow the annotation, nothing after them is read
+            if (*p == '>' || (line_end - p >= 7 && !strncmp(p, "##FASTA", 7)))
+            {
+                chunk->fasta = 1;
+                return;
+            }
+            if (line_end - p > 17 && !strncmp(p, "##sequence-region", 17))
+                gff3_lite_parse_region(chunk, p, line_end);
+            p = next_line;
+            continue;
+        }
+
+        // only the first three columns are looked at for rows that are dropped
+        seqid = p;
+        if (!(source = gff3_lite_field(seqid, line_end, &field_end)) ||
+            !(type = gff3_lite_field(source, line_end, &field_end)) ||
+            !(q = gff3_lite_field(type, line_end, &field_end)))
+        {
+            chunk->error = "expected 9 tab separated columns";
+            chunk->error_line = chunk->num_lines - 1;
+            return;
+        }
+
+        if ((type_index = gff3_lite_type_index(chunk, type, field_end - type)) < 0)
+        {
+            p = next_line;
+            continue;
+        }
+
+        memset(&record, 0, sizeof(record));
+        record.seqid         = seqid;
+        record.seqid_length  = source - 1 - seqid;
+        record.source        = source;
+        record.source_length = type - 1 - source;
+        record.type          = type_index;
+        record.line          = chunk->num_lines - 1;
+        chunk->error_line    = record.line;
+
+        // start, end, score, strand, phase
+        for (i = 0; i < 5; i++)
+        {
+            const char * field = q;
+
+            if (!(q = gff3_lite_field(field, line_end, &field_end)))
+            {
+                chunk->error = "expected 9 tab separated columns";
+                return;
+            }
+            switch (i)
+            {
+            case 0:
+            case 1:
+                if (gff3_lite_parse_position(field, field_end, i ? &record.end : &record.start))
+                {
+                    chunk->error = "start and end must be positive integers";
+                    return;
+                }
+                break;
+            case 2:
+                if (field_end - field == 1 && *field == '.')
+                    break;
+                if ((size_t)(field_end - field) >= sizeof(score_text))
+                {
+                    chunk->error = "score is not a number";
+                    return;
+                }
+                memcpy(score_text, field, field_end - field);
+                score_text[field_end - field] = '\0';
+                if (1 != sscanf(score_text, "%f", &record.score))
+                {
+                    chunk->error = "score is not a number";
+                    return;
+                }
+                record.has_score = 1;
+                break;
+            case 3:
+                if (field_end - field != 1 || !strchr("+-.?", *field))
+                {
+                    chunk->error = "strand must be one of + - . ?";
+                    return;
+                }
+                record.strand = *field;
+                break;
+            case 4:
+                if (field_end - field != 1 || !strchr("012.", *field))
+                {
+                    chunk->error = "phase must be one of 0 1 2 .";
+                    return;
+                }
+                record.phase = *field;
+                break;
+            }
+        }
+
+        if (record.start == 0 || record.start > record.end)
+        {
+            chunk->error = "start must be at least 1 and no larger than end";
+            return;
+        }
+
+        // the attributes are split up only if the node is pulled
+        record.attributes        = q;
+        record.attributes_length = line_end - q;
+        *gff3_lite_add_record(chunk) = record;
+
+        p = next_line;
+    }
+}
+
+static void * gff3_lite_worker(void * arg)
+{
+    gff3_lite_parse_chunk(arg);
+    return NULL;
+}
+
+// cut the next chunks off the text and start scanning them
+static void gff3_lite_start_batch(gff3_lite_in_stream * context, gff3_lite_batch_t * batch)
+{
+    int i;
+
+    batch->num_chunks = 0;
+    for (i = 0; i < context->num_threads && context->next_offset < context->text_length; i++)
+    {
+        gff3_lite_chunk_t * chunk = &batch->chunks[batch->num_chunks++];
+        size_t              end = context->next_offset + GFF3_LITE_CHUNK;
+        const char *        newline;
+
+        if (end >= context->text_length)
+            end = context->text_length;
+        else if ((newline = memchr(context->text + end, '\n', context->text_length - end)) != NULL)
+            end = newline + 1 - context->text;
+        else
+            end = context->text_length;
+
+        chunk->begin     = context->text + context->next_offset;
+        chunk->end       = context->text + end;
+        chunk->types     = (const char * const *)context->types;
+        chunk->num_types = context->num_types;
+        context->next_offset = end;
+    }
+
+    for (i = 0; i < batch->num_chunks; i++)
+        pthread_create(&batch->threads[i], NULL, gff3_lite_worker, &batch->chunks[i]);
+    batch->running = 1;
+}
+
+static void gff3_lite_finish_batch(gff3_lite_batch_t * batch)
+{
+    int i;
+
+    if (!batch->running)
+        return;
+    for (i = 0; i < batch->num_chunks; i++)
+        pthread_join(batch->threads[i], NULL);
+    batch->running = 0;
+}
+
+// reuses the last string while consecutive rows share a value
+static GtStr * gff3_lite_intern(GtStr ** cached, const char * value, unsigned int length)
+{
+    if (*cached && gt_str_length(*cached) == length && !memcmp(gt_str_get(*cached), value, length))
+        return *cached;
+
+    gt_str_delete(*cached);
+    *cached = gt_str_new();
+    gt_str_append_cstr_nt(*cached, value, length);
+    return *cached;
+}
+
+static int gff3_lite_hex(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// decodes the %XX escapes of an attribute value in place, like gt's
+// reader, a % without two hex digits is kept as it is
+static void gff3_lite_unescape(char * value)
+{
+    char * out;
+    int    high, low;
+
+    if (!(value = strchr(value, '%')))
+        return;
+
+    for (out = value; *value; value++)
+    {
+        if (*value == '%' && (high = gff3_lite_hex(value[1])) >= 0 && (low = gff3_lite_hex(value[2])) >= 0)
+        {
+            *out++ = (char)(high << 4 | low);
+            value += 2;
+        }
+        else
+            *out++ = *value;
+    }
+    *out = '\0';
+}
+
+static void gff3_lite_set_attributes(gff3_lite_in_stream * context,
+                                     GtFeatureNode *       fn,
+                                     const gff3_lite_record_t * record
+                                    )
+{
+    char * p, * next, * value;
+
+    if (record->attributes_length == 1 && record->attributes[0] == '.')
+        return;
+
+    if (record->attributes_length + 1 > context->attribute_capacity)
+    {
+        context->attribute_capacity = record->attributes_length + 1;
+        context->attribute_buffer = realloc(context->attribute_buffer, context->attribute_capacity);
+    }
+    memcpy(context->attribute_buffer, record->attributes, record->attributes_length);
+    context->attribute_buffer[record->attributes_length] = '\0';
+
+    for (p = context->attribute_buffer; p; p = next)
+    {
+        if ((next = strchr(p, ';')) != NULL)
+            *next++ = '\0';
+        if (!(value = strchr(p, '=')) || value == p)
+            continue;
+        *value++ = '\0';
+
+        // every node is top level here, the parent was not read
+        if (!strcmp(p, "Parent") || !strcmp(p, "Derives_from"))
+            continue;
+        gff3_lite_unescape(value);
+
+        // gt takes no empty value, "Note=" or one that decoded to nothing
+        if (!*value)
+            continue;
+        gt_feature_node_set_attribute(fn, p, value);
+    }
+}
+
+static int gff3_lite_make_node(gff3_lite_in_stream *      context,
+                               const gff3_lite_record_t * record,
+                               GtGenomeNode **            gn,
+                               GtError *                  err
+                              )
+{
+    GtStr *         seqid;
+    GtFeatureNode * fn;
+    int             order = 0;
+
+    seqid = gff3_lite_intern(&context->seqid, record->seqid, record->seqid_length);
+
+    if (record->type == GFF3_LITE_REGION)
+    {
+        *gn = gt_region_node_new(seqid, record->start, record->end);
+        return 0;
+    }
+
+    // the streams downstream count on the same order gt_gff3_in_stream_new_sorted checks
+    if (context->last_seqid)
+    {
+        unsigned int length = record->seqid_length < context->last_seqid_length ?
+                              record->seqid_length : context->last_seqid_length;
+
+        if (!(order = memcmp(context->last_seqid, record->seqid, length)))
+            order = context->last_seqid_length < record->seqid_length ? -1 :
+                    context->last_seqid_length > record->seqid_length;
+    }
+    if (order > 0 || (order == 0 && context->last_seqid && context->last_start > record->start))
+    {
+        gt_error_set(err, "%s: line %lu: the file is not sorted (seqid \"%s\", start %lu)",
+                     context->path, context->line_base + record->line + 1, gt_str_get(seqid), record->start);
+        return -1;
+    }
+    context->last_seqid        = record->seqid;
+    context->last_seqid_length = record->seqid_length;
+    context->last_start        = record->start;
+
+    *gn = gt_feature_node_new(seqid, context->types[record->type], record->start, record->end,
+                              gt_strand_get(record->strand));
+    fn = gt_feature_node_cast(*gn);
+
+    gt_feature_node_set_source(fn, gff3_lite_intern(&context->source, record->source, record->source_length));
+    if (record->has_score)
+        gt_feature_node_set_score(fn, record->score);
+    if (record->phase != '.')
+        gt_feature_node_set_phase(fn, gt_phase_get(record->phase));
+    gff3_lite_set_attributes(context, fn, record);
+
+    return 0;
+}
+
+static int gff3_lite_in_stream_next(GtNodeStream * ns,
+                                    GtGenomeNode ** gn,
+                                    GtError * err)
+{
+    gff3_lite_in_stream * context;
+
+    context = gff3_lite_in_stream_cast(ns);
+    *gn = NULL;
+
+    while (!context->finished)
+    {
+        if (context->chunk_index < context->current->num_chunks)
+        {
+            gff3_lite_chunk_t * chunk = &context->current->chunks[context->chunk_index];
+            gff3_lite_batch_t * swap;
+
+            if (context->record_index < chunk->num_records)
+                return gff3_lite_make_node(context, &chunk->records[context->record_index++], gn, err);
+
+            if (chunk->error)
+            {
+                gt_error_set(err, "%s: line %lu: %s", context->path,
+                             context->line_base + chunk->error_line + 1, chunk->error);
+                context->finished = 1;
+                return -1;
+            }
+            if (chunk->fasta)
+            {
+                context->finished = 1;
+                break;
+            }
+
+            context->line_base += chunk->num_lines;
+            context->record_index = 0;
+            if (++context->chunk_index < context->current->num_chunks)
+                continue;
+
+            // move on to the batch scanned in the background, and start the one after
+            gff3_lite_finish_batch(context->next);
+            swap = context->current;
+            context->current = context->next;
+            context->next = swap;
+            context->chunk_index = 0;
+            gff3_lite_start_batch(context, context->next);
+        }
+
+        if (context->current->num_chunks == 0)
+            context->finished = 1;
+    }
+
+    return 0;
+}
+
+static void gff3_lite_in_stream_free(GtNodeStream * ns)
+{
+    gff3_lite_in_stream * context;
+    int                   b, i;
+
+    context = gff3_lite_in_stream_cast(ns);
+
+    // the workers may still be scanning when the stream is dropped early
+    gff3_lite_finish_batch(context->next);
+    for (b = 0; b < 2; b++)
+        for (i = 0; i < GFF3_LITE_MAX_THREADS; i++)
+            free(context->batches[b].chunks[i].records);
+    free(context->batches);
+
+    if (context->mapped)
+        munmap((void *)context->text, context->text_length);
+    else
+        free((void *)context->text);
+
+    for (i = 0; i < context->num_types; i++)
+        free(context->types[i]);
+    free(context->types);
+    free(context->path);
+    free(context->attribute_buffer);
+    gt_str_delete(context->seqid);
+    gt_str_delete(context->source);
+    return;
+}
+
+const GtNodeStreamClass * gff3_lite_in_stream_class(void)
+{
+    static const GtNodeStreamClass * c = NULL;
+
+    if (!c)
+    {
+        c = gt_node_stream_class_new( sizeof(gff3_lite_in_stream),
+                                      gff3_lite_in_stream_free,
+                                      gff3_lite_in_stream_next
+                                    );
+    }
+
+    return c;
+}
+
+// map the file, or inflate it into memory if it is gzip compressed
+static int gff3_lite_load_text(const char * path, const char ** text_out, size_t * length_out, int * mapped)
+{
+    compressed_input * input;
+    FILE *             file;
+    unsigned char      magic[2];
+    struct stat        file_info;
+    char *             text = NULL;
+    size_t             length = 0, capacity = 0, n;
+    int                fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+
+    if (fstat(fd, &file_info) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (file_info.st_size > 0 &&
+        (file_info.st_size < 2 || read(fd, magic, 2) != 2 || magic[0] != 0x1f || magic[1] != 0x8b))
+    {
+        text = mmap(NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (text == MAP_FAILED)
+            return -1;
+        madvise(text, file_info.st_size, MADV_SEQUENTIAL);
+
+        *text_out   = text;
+        *length_out = file_info.st_size;
+        *mapped     = 1;
+        return 0;
+    }
+    close(fd);
+
+    if ((input = compressed_input_open(path)) == NULL)
+        return -1;
+    file = compressed_input_file(input);
+    do
+    {
+        if (length == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1 << 24;
+            text = realloc(text, capacity);
+        }
+        n = fread(text + length, 1, capacity - length, file);
+        length += n;
+    } while (n);
+
+    if (compressed_input_close(input))
+    {
+        free(text);
+        return -1;
+    }
+
+    *text_out   = text;
+    *length_out = length;
+    *mapped     = 0;
+    return 0;
+}
+
+GtNodeStream * gff3_lite_in_stream_new(const char *         path,
+                                       const char * const * types,
+                                       int                  num_threads
+                                      )
+{
+    GtNodeStream *        ns;
+    gff3_lite_in_stream * context;
+    const char *          text;
+    size_t                text_length;
+    int                   mapped, i;
+
+    gt_assert(path && types);
+
+    if (gff3_lite_load_text(path, &text, &text_length, &mapped))
+        return NULL;
+
+    ns = gt_node_stream_create(gff3_lite_in_stream_class(),
+                               true); // sorted, checked as the nodes are made
+    context = gff3_lite_in_stream_cast(ns);
+    context->text        = text;
+    context->text_length = text_length;
+    context->mapped      = mapped;
+    context->path        = strdup(path);
+    for (context->num_types = 0; types[context->num_types]; context->num_types++)
+        ;
+    context->types = malloc((context->num_types + 1) * sizeof(char *));
+    for (i = 0; i < context->num_types; i++)
+        context->types[i] = strdup(types[i]);
+    context->types[i] = NULL;
+
+    context->num_threads = num_threads < 1 ? 1 : num_threads > GFF3_LITE_MAX_THREADS ?
+                           GFF3_LITE_MAX_THREADS : num_threads;
+    context->batches = calloc(2, sizeof(gff3_lite_batch_t));
+    context->current = &context->batches[0];
+    context->next    = &context->batches[1];
+
+    gff3_lite_start_batch(context, context->current);
+    gff3_lite_finish_batch(context->current);
+    gff3_lite_start_batch(context, context->next);
+
+    return ns;
+}
+
+int gff3_lite_in_stream_parse_flag(int * argc, char ** argv)
+{
+    int i, j, found = 0;
+
+    for (i = j = 1; i < *argc; i++)
+    {
+        if (!strcmp(argv[i], "--fast"))
+            found = 1;
+        else
+            argv[j++] = argv[i];
+    }
+    *argc = j;
+    argv[j] = NULL;
+
+    return found;
+}
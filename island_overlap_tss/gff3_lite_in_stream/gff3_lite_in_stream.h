@@ -0,0 +1,9 @@
+
+#ifndef GFF3_LITE_IN_STREAM_H
+#define GFF3_LITE_IN_STREAM_H
+
+#include "gff3_lite_in_stream_api.h"
+
+const GtNodeStreamClass * gff3_lite_in_stream_class(void);
+
+#endif
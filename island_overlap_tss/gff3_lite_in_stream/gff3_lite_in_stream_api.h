@@ -0,0 +1,32 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Fast reader for a sorted GFF3 annotation that only builds the feature
+ *   types a pipeline looks at.  The file is cut into chunks that are
+ *   scanned on several threads; rows of any other type are dropped on the
+ *   type column before anything is allocated, and the attributes of the
+ *   rows kept are only split up when the node is handed out.
+ *
+ *   Every row kept becomes a top level feature node, so Parent and
+ *   Derives_from are not carried over; the output only holds the types
+ *   asked for.  ##sequence-region lines become region nodes.  gzip
+ *   compressed input is inflated into memory first.
+ *
+ */
+
+#ifndef  GFF3_LITE_IN_STREAM_API_H
+#define  GFF3_LITE_IN_STREAM_API_H
+
+typedef struct gff3_lite_in_stream gff3_lite_in_stream;
+
+// types is a NULL terminated list of the feature types to keep.  Returns
+// NULL if the file can't be read.
+GtNodeStream* gff3_lite_in_stream_new(const char *         path,
+                                      const char * const * types,
+                                      int                  num_threads
+                                     );
+
+// removes a --fast argument from argv, returns 1 if it was there
+int gff3_lite_in_stream_parse_flag(int * argc, char ** argv);
+
+#endif
@@ -0,0 +1,115 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*  draw a chart of every sequence in an annotation, parsed once, with the
+*  sequences on several threads and unchanged tiles taken from a cache
+*
+*************************************************/
+#include "genometools.h"
+#include "chart_renderer/chart_renderer.h"
+#include "stats_stream/stats_stream_api.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+void usage(const char * name)
+{
+   printf("Usage: %s [--stats] [-j <threads>] [-w <width>] [-t <tile bases>] [-s <style file>] [-c <cache dir>]\n"
+          "       [-x <suffix>] <in fileName> <out dir>\n", name);
+   printf("   writes <out dir>/<seqid><suffix>.png for every sequence, by default\n");
+   printf("   2400 pixels wide in tiles of 1000000 bases stacked top to bottom\n");
+   printf("   -t 0 draws each sequence as a single tile, like gt sketch\n");
+   printf("   tiles are cached in <out dir>/chart_tiles unless -c is given, only\n");
+   printf("   tiles whose features or style changed are drawn again\n");
+}
+
+int main(int argc, char ** argv)
+{
+    GtNodeStream *   in, * feature_stream;
+    GtFeatureIndex * index;
+    GtError *        err;
+    chart_options_t  options;
+    const char *     suffix = "";
+    char *           cache_dir = NULL;
+    unsigned long    tiles_drawn, tiles_total;
+    int              opt, had_err;
+
+    // --stats reports per stage counters as JSON on stderr
+    stream_stats_parse_flag(&argc, argv);
+
+    options.width       = 2400;
+    options.tile_bases  = 1000000;
+    options.style_file  = NULL;
+    options.cache_dir   = NULL;
+    options.num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((opt = getopt(argc, argv, "j:w:t:s:c:x:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': options.num_threads = atoi(optarg); break;
+        case 'w': options.width       = strtoul(optarg, NULL, 10); break;
+        case 't': options.tile_bases  = strtoul(optarg, NULL, 10); break;
+        case 's': options.style_file  = optarg; break;
+        case 'c': options.cache_dir   = optarg; break;
+        case 'x': suffix              = optarg; break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 2 || options.num_threads < 1 || options.width == 0)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+
+    if (!options.cache_dir)
+    {
+        cache_dir = malloc(strlen(argv[optind + 1]) + sizeof("/chart_tiles"));
+        sprintf(cache_dir, "%s/chart_tiles", argv[optind + 1]);
+        options.cache_dir = cache_dir;
+    }
+
+    // initilaize genometools
+    gt_lib_init();
+    err = gt_error_new();
+
+    in = gt_gff3_in_stream_new_sorted(argv[optind]);
+    if (!in)
+    {
+        fprintf(stderr, "Failed to open input stream with arg %s\n", argv[optind]);
+        exit(1);
+    }
+    in = stats_stream_new(in, "gff3_in", NULL);
+
+    // the whole annotation goes into one index shared by the render threads
+    index = gt_feature_index_memory_new();
+    feature_stream = gt_feature_stream_new(in, index);
+
+    had_err = gt_node_stream_pull(feature_stream, err);
+    gt_node_stream_delete(feature_stream);
+    gt_node_stream_delete(in);
+
+    if (!had_err)
+        had_err = chart_renderer_run(index, &options, argv[optind + 1], suffix, &tiles_drawn, &tiles_total, err);
+
+    if (had_err)
+        fprintf(stderr, "Failed to draw charts: %s\n", gt_error_get(err));
+    else
+        printf("%lu of %lu tiles drawn, the rest from %s\n", tiles_drawn, tiles_total, options.cache_dir);
+
+    gt_feature_index_delete(index);
+    gt_error_delete(err);
+    free(cache_dir);
+    gt_lib_clean();
+
+    if (stream_stats_enabled())
+        stream_stats_write_json(stderr);
+    return had_err ? 1 : 0;
+}
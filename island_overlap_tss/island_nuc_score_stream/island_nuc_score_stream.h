@@ -1,9 +0,0 @@
-
-#ifndef ISLAND_NUC_SCORE_STREAM_H
-#define ISLAND_NUC_SCORE_STREAM_H
-
-#include "island_nuc_score_stream_api.h"
-
-const GtNodeStreamClass * island_nuc_score_stream_class(void);
-
-#endif
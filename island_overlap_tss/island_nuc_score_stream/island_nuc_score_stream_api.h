@@ -1,16 +1,21 @@
 /* 
  * @author brock a<brock.wright.anderson@gmail.cm>
  *
- *   
- *
+ *   Island scoring specs of track_score_stream
  *
  */
 
 #ifndef  ISLAND_NUC_SCORE_STREAM_API_H
 #define  ISLAND_NUC_SCORE_STREAM_API_H
 
-typedef struct island_nuc_score_stream island_nuc_score_stream;
+#include "../track_index/track_index.h"
+
+GtNodeStream* island_nuc_score_stream_new(GtNodeStream * in_stream, const char * nucleosome_db);
+
+// score against an already loaded nucleosome track, the stream takes its own reference
+GtNodeStream* island_nuc_score_stream_new_with_index(GtNodeStream * in_stream, track_index * nucleosomes);
 
-GtNodeStream* island_nuc_score_stream_new(GtNodeStream * in_stream, const char * methylome_db);
+// number of islands scored so far
+unsigned long island_nuc_score_stream_num_scored(GtNodeStream * ns);
 
 #endif
@@ -10,12 +10,21 @@
 *************************************************/
 #include "genometools.h"	
 #include "CpGIOverlap_stream/CpGIOverlap_stream_api.h"
+#include "stats_stream/stats_stream_api.h"
+#include "gff3_lite_in_stream/gff3_lite_in_stream_api.h"
+#include "gff3_fast_out_stream/gff3_fast_out_stream_api.h"
 #include <stdio.h>
+#include <unistd.h>
 
 
+// the only rows the stream looks at, see --fast
+static const char * fast_types[] = { "gene", NULL };
+
 void usage(const char * name)
 {
-   printf("Usage: %s <in fileName> <out fileName> <cpgi fileName> \n", name);
+   printf("Usage: %s [--stats] [--fast] [--fast-out] <in fileName> <out fileName> <cpgi fileName> \n", name);
+   printf("   --fast reads only the genes of the annotation, on several threads\n");
+   printf("   --fast-out writes through a buffered writer, scores in full precision\n");
 }
 
 static inline int in_range(unsigned long num, unsigned long min, unsigned long max)
@@ -26,8 +35,14 @@ static inline int in_range(unsigned long num, unsigned long min, unsigned long m
 int main(int argc, char ** argv)
 {
     GtNodeStream * in, * overlap, * out;
-    GtFile * out_file;
+    GtFile * out_file = NULL;
     GtError * err;
+    int fast, fast_out;
+
+    // --stats reports per stage counters as JSON on stderr
+    stream_stats_parse_flag(&argc, argv);
+    fast = gff3_lite_in_stream_parse_flag(&argc, argv);
+    fast_out = gff3_fast_out_stream_parse_flag(&argc, argv);
 
     if (argc != 4)
     {
@@ -39,15 +54,22 @@ int main(int argc, char ** argv)
     gt_lib_init();
     err = gt_error_new();
 
-    if (!(in = gt_gff3_in_stream_new_sorted(argv[1])))
+    if (fast)
+        in = gff3_lite_in_stream_new(argv[1], fast_types, sysconf(_SC_NPROCESSORS_ONLN));
+    else
+        in = gt_gff3_in_stream_new_sorted(argv[1]);
+
+    if (!in)
     {
         fprintf(stderr, "Failed to open input stream with arg %s\n", argv[1]);
         exit(1);
     }
 
-    gt_gff3_in_stream_show_progress_bar(in);
+    if (!fast)
+        gt_gff3_in_stream_show_progress_bar(in);
+    in = stats_stream_new(in, "gff3_in", NULL);
 
-    if (!(out_file = gt_file_new(argv[2], "w+", err)))
+    if (!fast_out && !(out_file = gt_file_new(argv[2], "w+", err)))
     {
         gt_node_stream_delete(in);
         fprintf(stderr, "Failed to create output file %s\n", argv[2]);
@@ -62,9 +84,11 @@ int main(int argc, char ** argv)
         fprintf(stderr, "Failed to create CpGI overlap stream\n");
         exit(1);
     }
-    out = gt_gff3_out_stream_new(in, out_file);
-    
-    if (!(out = gt_gff3_out_stream_new(overlap, out_file)))
+    overlap = stats_stream_new(overlap, "CpGIOverlap", CpGIOverlap_stream_num_scored);
+
+    out = fast_out ? gff3_fast_out_stream_new(overlap, argv[2], 1)
+                   : gt_gff3_out_stream_new(overlap, out_file);
+    if (!out)
     {
         gt_node_stream_delete(overlap);
         gt_file_delete(out_file);
@@ -72,6 +96,7 @@ int main(int argc, char ** argv)
         fprintf(stderr, "Failed to create output stream\n");
         exit(1);
     }
+    out = stats_stream_new(out, "gff3_out", NULL);
 
     if (gt_node_stream_pull(out, err))
     {
@@ -85,5 +110,9 @@ int main(int argc, char ** argv)
     gt_node_stream_delete(in);
     gt_error_delete(err);
     gt_lib_clean();
+
+    // the stages report their scored counts as they are deleted
+    if (stream_stats_enabled())
+        stream_stats_write_json(stderr);
     return 0;
 }
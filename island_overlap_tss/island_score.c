@@ -10,45 +10,89 @@
 *************************************************/
 #include "genometools.h"	
 #include "CpGI_score_stream/CpGI_score_stream_api.h"
+#include "stats_stream/stats_stream_api.h"
+#include "gff3_lite_in_stream/gff3_lite_in_stream_api.h"
+#include "gff3_fast_out_stream/gff3_fast_out_stream_api.h"
 #include <stdio.h>
+#include <unistd.h>
 
 
+// the only rows the stream looks at, see --fast
+static const char * fast_types[] = { "CpGI", NULL };
+
 void usage(const char * name)
 {
-   printf("Usage: %s <in fileName> <out fileName> <methylome db>\n", name);
+   printf("Usage: %s [--stats] [--fast] [--fast-out] [-D <min depth>] <in fileName> <out fileName> <methylome db>\n", name);
+   printf("   -D reads the methylome as a Bismark coverage file or cytosine report and scores\n");
+   printf("   methylated over covering reads, leaving out cytosines with fewer than min depth reads,\n");
+   printf("   only the CG rows of a CX report count\n");
+   printf("   --fast reads only the islands of the annotation, on several threads\n");
+   printf("   --fast-out writes through a buffered writer, scores in full precision\n");
 }
 
 
 int main(int argc, char ** argv)
 {
     GtNodeStream * in, * score, * out;
-    GtFile * out_file;
+    GtFile * out_file = NULL;
     GtError * err;
+    int fast, fast_out;
+    int counts = 0, opt;
+    unsigned int min_depth = 1;
+    const char * in_name, * out_name, * methylome_db;
+
+    // --stats reports per stage counters as JSON on stderr
+    stream_stats_parse_flag(&argc, argv);
+    fast = gff3_lite_in_stream_parse_flag(&argc, argv);
+    fast_out = gff3_fast_out_stream_parse_flag(&argc, argv);
+
+    while ((opt = getopt(argc, argv, "D:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'D': counts = 1; min_depth = strtoul(optarg, NULL, 10); break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
 
-    if (argc != 4)
+    if (argc - optind != 3)
     {
        usage(argv[0]);
        exit(1);
     }
+    in_name      = argv[optind];
+    out_name     = argv[optind + 1];
+    methylome_db = argv[optind + 2];
 
     // initilaize genometools
     gt_lib_init();
     err = gt_error_new();
 
-    if (!(in = gt_gff3_in_stream_new_sorted(argv[1])))
+    if (fast)
+        in = gff3_lite_in_stream_new(in_name, fast_types, sysconf(_SC_NPROCESSORS_ONLN));
+    else
+        in = gt_gff3_in_stream_new_sorted(in_name);
+
+    if (!in)
     {
-        fprintf(stderr, "Failed to open input stream with arg %s\n", argv[1]);
+        fprintf(stderr, "Failed to open input stream with arg %s\n", in_name);
         exit(1);
     }
 
-    if (!(out_file = gt_file_new(argv[2], "w+", err)))
+    in = stats_stream_new(in, "gff3_in", NULL);
+
+    if (!fast_out && !(out_file = gt_file_new(out_name, "w+", err)))
     {
         gt_node_stream_delete(in);
-        fprintf(stderr, "Failed to create output file %s\n", argv[2]);
+        fprintf(stderr, "Failed to create output file %s\n", out_name);
         exit(1);
     }
 
-    if (!(score = CpGI_score_stream_new(in, argv[3])))
+    score = counts ? CpGI_score_stream_new_counts(in, methylome_db, min_depth, sysconf(_SC_NPROCESSORS_ONLN))
+                   : CpGI_score_stream_new(in, methylome_db);
+    if (!score)
     {
 
         gt_file_delete(out_file);
@@ -56,9 +100,11 @@ int main(int argc, char ** argv)
         fprintf(stderr, "Failed to create CpGI score stream\n");
         exit(1);
     }
-    out = gt_gff3_out_stream_new(in, out_file);
-    
-    if (!(out = gt_gff3_out_stream_new(score, out_file)))
+    score = stats_stream_new(score, "CpGI_score", CpGI_score_stream_num_scored);
+
+    out = fast_out ? gff3_fast_out_stream_new(score, out_name, 1)
+                   : gt_gff3_out_stream_new(score, out_file);
+    if (!out)
     {
         gt_node_stream_delete(score);
         gt_file_delete(out_file);
@@ -66,6 +112,7 @@ int main(int argc, char ** argv)
         fprintf(stderr, "Failed to create output stream\n");
         exit(1);
     }
+    out = stats_stream_new(out, "gff3_out", NULL);
 
     if (gt_node_stream_pull(out, err))
     {
@@ -79,5 +126,9 @@ int main(int argc, char ** argv)
     gt_node_stream_delete(in);
     gt_error_delete(err);
     gt_lib_clean();
+
+    // the stages report their scored counts as they are deleted
+    if (stream_stats_enabled())
+        stream_stats_write_json(stderr);
     return 0;
 }
@@ -0,0 +1,312 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Sweep the sorted genes and the start ordered islands of each chromosome
+*   together, annotating promoter and body overlaps and the nearest islands
+*
+*
+*************************************************/
+#include <genometools.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "island_sweep_stream.h"
+
+
+struct island_sweep_stream {
+    const GtNodeStream parent_instance;
+    GtNodeStream * in_stream;
+    cpgi_index *   islands;
+    unsigned long  upstream;
+    unsigned long  downstream;
+
+    // sweep state for the current chromosome.  Islands before next have
+    // started by the end of some gene's window; those still reaching the
+    // current window are active, in start order, of the rest only the one
+    // ending last is kept.
+    int             have_chromosome;
+    int             chromosome;
+    const cpgi_t *  chr_islands;
+    unsigned long   chr_count;
+    unsigned long   next;
+    const cpgi_t ** active;
+    unsigned long   num_active;
+    unsigned long   active_capacity;
+    const cpgi_t *  behind;
+    long            window_start;
+
+    // per stream attribute buffers, so streams don't share any state
+    GtStr *         promoter;
+    GtStr *         body;
+    GtStr *         nearest;
+    unsigned long   num_scored;
+    unsigned long   num_rewinds;
+};
+
+static const char * feature_type_gene = "gene";
+
+
+const GtNodeStreamClass * island_sweep_stream_class(void);
+
+#define island_sweep_stream_cast(GS) gt_node_stream_cast(island_sweep_stream_class(), GS);
+
+
+static void island_sweep_stream_reset(island_sweep_stream * context, int chromosome)
+{
+    context->have_chromosome = 1;
+    context->chromosome      = chromosome;
+    context->chr_islands     = cpgi_index_chromosome(context->islands, chromosome, &context->chr_count);
+    if (!context->chr_islands)
+        context->chr_count = 0;
+    context->next         = 0;
+    context->num_active   = 0;
+    context->behind       = NULL;
+    context->window_start = 0;
+}
+
+// move the sweep to [start, end], which may only start at or after the
+// last window.  A gene sorted out of order, which the sorted stream
+// contract rules out, rewinds the chromosome rather than missing islands.
+static void island_sweep_stream_advance(island_sweep_stream * context, int chromosome, long start, long end)
+{
+    unsigned long i, kept = 0;
+
+    if (!context->have_chromosome || chromosome != context->chromosome)
+        island_sweep_stream_reset(context, chromosome);
+    else if (start < context->window_start)
+    {
+        island_sweep_stream_reset(context, chromosome);
+        context->num_rewinds++;
+    }
+    context->window_start = start;
+
+    for (; context->next < context->chr_count && (long)context->chr_islands[context->next].start <= end; context->next++)
+    {
+        if (context->num_active == context->active_capacity)
+        {
+            context->active_capacity = context->active_capacity ? context->active_capacity * 2 : 64;
+            context->active = realloc(context->active, context->active_capacity * sizeof(const cpgi_t *));
+        }
+        context->active[context->num_active++] = &context->chr_islands[context->next];
+    }
+
+    // windows only move right, an island ending before this one is done
+    for (i = 0; i < context->num_active; i++)
+    {
+        const cpgi_t * island = context->active[i];
+
+        if ((long)island->end >= start)
+            context->active[kept++] = island;
+        else if (!context->behind || island->end > context->behind->end)
+            context->behind = island;
+    }
+    context->num_active = kept;
+}
+
+static void island_sweep_stream_append_overlap(GtStr * list, const cpgi_t * island, long start, long end)
+{
+    long first = (long)island->start > start ? (long)island->start : start;
+    long last  = (long)island->end < end ? (long)island->end : end;
+
+    if (first > last)
+        return;
+    if (gt_str_length(list))
+        gt_str_append_char(list, ',');
+    gt_str_append_cstr(list, island->name);
+    gt_str_append_char(list, ':');
+    gt_str_append_ulong(list, last - first + 1);
+}
+
+static void island_sweep_stream_set_nearest(island_sweep_stream * context,
+                                            GtFeatureNode *       gene,
+                                            const char *          attribute,
+                                            const cpgi_t *        island,
+                                            unsigned long         distance,
+                                            int                   upstream
+                                           )
+{
+    if (!island)
+        return;
+    gt_str_reset(context->nearest);
+    gt_str_append_cstr(context->nearest, island->name);
+    gt_str_append_char(context->nearest, ':');
+    if (upstream)
+        gt_str_append_char(context->nearest, '-');
+    gt_str_append_ulong(context->nearest, distance);
+    gt_feature_node_set_attribute(gene, attribute, gt_str_get(context->nearest));
+}
+
+static void island_sweep_stream_join_gene(island_sweep_stream * context, GtFeatureNode * gene, int chromosome)
+{
+    long           start   = gt_genome_node_get_start((GtGenomeNode *)gene);
+    long           end     = gt_genome_node_get_end((GtGenomeNode *)gene);
+    int            reverse = gt_feature_node_get_strand(gene) != GT_STRAND_FORWARD;
+    long           tss     = reverse ? end : start;
+    long           reach   = context->upstream > context->downstream ? context->upstream : context->downstream;
+    long           promoter_start, promoter_end;
+    const cpgi_t * left, * right;
+    unsigned long  i;
+
+    // same TSS as CpGIOverlap_stream, the promoter window on the gene's strand
+    promoter_start = reverse ? tss - (long)context->downstream : tss - (long)context->upstream;
+    promoter_end   = reverse ? tss + (long)context->upstream : tss + (long)context->downstream;
+
+    island_sweep_stream_advance(context, chromosome, start - reach, end + reach);
+
+    // islands wholly left of the TSS are behind or active, wholly right of
+    // it active or the next one to be swept in
+    left  = context->behind;
+    right = context->next < context->chr_count ? &context->chr_islands[context->next] : NULL;
+
+    gt_str_reset(context->promoter);
+    gt_str_reset(context->body);
+    for (i = 0; i < context->num_active; i++)
+    {
+        const cpgi_t * island = context->active[i];
+
+        island_sweep_stream_append_overlap(context->promoter, island, promoter_start, promoter_end);
+        island_sweep_stream_append_overlap(context->body, island, start, end);
+
+        if ((long)island->end < tss && (!left || island->end > left->end))
+            left = island;
+        if ((long)island->start > tss && (!right || island->start < right->start))
+            right = island;
+    }
+
+    if (gt_str_length(context->promoter))
+        gt_feature_node_set_attribute(gene, "cpgi_promoter", gt_str_get(context->promoter));
+    if (gt_str_length(context->body))
+        gt_feature_node_set_attribute(gene, "cpgi_body", gt_str_get(context->body));
+    if (gt_str_length(context->promoter) || gt_str_length(context->body))
+        context->num_scored++;
+
+    // upstream is to the left on the forward strand, to the right on the reverse
+    island_sweep_stream_set_nearest(context, gene, reverse ? "cpgi_downstream" : "cpgi_upstream",
+                                    left, left ? tss - (long)left->end : 0, !reverse);
+    island_sweep_stream_set_nearest(context, gene, reverse ? "cpgi_upstream" : "cpgi_downstream",
+                                    right, right ? (long)right->start - tss : 0, reverse);
+}
+
+static int island_sweep_stream_next(GtNodeStream *  ns,
+                                    GtGenomeNode ** gn,
+                                    GtError *       err
+                                   )
+{
+    island_sweep_stream *   context;
+    GtGenomeNode *          cur_node;
+    GtFeatureNode *         fn;
+    GtFeatureNodeIterator * iter;
+    int                     had_err, chr_num;
+
+    context = island_sweep_stream_cast(ns);
+    *gn = NULL;
+
+    if ((had_err = gt_node_stream_next(context->in_stream, &cur_node, err)) || !cur_node)
+        return had_err;
+    *gn = cur_node;
+
+    if (!gt_genome_node_try_cast(gt_feature_node_class(), cur_node))
+        return 0;
+    fn = gt_feature_node_cast(cur_node);
+
+    // the gene may be wrapped in a pseudo node
+    if (gt_feature_node_is_pseudo(fn))
+    {
+        iter = gt_feature_node_iterator_new(fn);
+        while ((fn = gt_feature_node_iterator_next(iter)) && !gt_feature_node_has_type(fn, feature_type_gene))
+            ;
+        gt_feature_node_iterator_delete(iter);
+    }
+
+    if (!fn || !gt_feature_node_has_type(fn, feature_type_gene) ||
+        1 != sscanf(gt_str_get(gt_genome_node_get_seqid((GtGenomeNode *)fn)), "Chr%d", &chr_num))
+        return 0;
+
+    island_sweep_stream_join_gene(context, fn, chr_num);
+    return 0;
+}
+
+static void island_sweep_stream_free(GtNodeStream * ns)
+{
+    island_sweep_stream * context = island_sweep_stream_cast(ns);
+
+    if (context->num_rewinds)
+        fprintf(stderr, "island_sweep_stream: genes out of order, %lu chromosome rewinds\n", context->num_rewinds);
+    cpgi_index_delete(context->islands);
+    gt_node_stream_delete(context->in_stream);
+    free(context->active);
+    gt_str_delete(context->promoter);
+    gt_str_delete(context->body);
+    gt_str_delete(context->nearest);
+}
+
+const GtNodeStreamClass * island_sweep_stream_class(void)
+{
+    static const GtNodeStreamClass * c = NULL;
+
+    if (!c)
+    {
+        c = gt_node_stream_class_new( sizeof(island_sweep_stream),
+                                      island_sweep_stream_free,
+                                      island_sweep_stream_next
+                                    );
+    }
+
+    return c;
+}
+
+GtNodeStream * island_sweep_stream_new_with_index(GtNodeStream * in_stream,
+                                                  cpgi_index *   islands,
+                                                  unsigned long  upstream,
+                                                  unsigned long  downstream
+                                                 )
+{
+    GtNodeStream *        ns = gt_node_stream_create(island_sweep_stream_class(),
+                                                     true); // must be sorted
+    island_sweep_stream * context = island_sweep_stream_cast(ns);
+    gt_assert(in_stream && islands);
+    context->in_stream       = gt_node_stream_ref(in_stream);
+    context->islands         = cpgi_index_ref(islands);
+    context->upstream        = upstream;
+    context->downstream      = downstream;
+    context->have_chromosome = 0;
+    context->active          = NULL;
+    context->num_active      = 0;
+    context->active_capacity = 0;
+    context->promoter        = gt_str_new();
+    context->body            = gt_str_new();
+    context->nearest         = gt_str_new();
+    context->num_scored      = 0;
+    context->num_rewinds     = 0;
+
+    return ns;
+}
+
+GtNodeStream * island_sweep_stream_new(GtNodeStream * in_stream,
+                                       const char *   cpgi_db,
+                                       unsigned long  upstream,
+                                       unsigned long  downstream
+                                      )
+{
+    GtNodeStream * ns;
+    cpgi_index *   islands;
+
+    if ((islands = cpgi_index_load(cpgi_db)) == NULL)
+    {
+       fprintf(stderr, "Failed to open CpG Island db file %s\n", cpgi_db);
+       return NULL;
+    }
+
+    ns = island_sweep_stream_new_with_index(in_stream, islands, upstream, downstream);
+    cpgi_index_delete(islands);
+    return ns;
+}
+
+unsigned long island_sweep_stream_num_scored(GtNodeStream * ns)
+{
+    island_sweep_stream * context = island_sweep_stream_cast(ns);
+    return context->num_scored;
+}
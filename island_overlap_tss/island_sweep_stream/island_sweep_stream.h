@@ -0,0 +1,9 @@
+
+#ifndef ISLAND_SWEEP_STREAM_H
+#define ISLAND_SWEEP_STREAM_H
+
+#include "island_sweep_stream_api.h"
+
+const GtNodeStreamClass * island_sweep_stream_class(void);
+
+#endif
@@ -0,0 +1,44 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Join a sorted gene stream against the CpG islands in one sweep per
+ *   chromosome.  Each gene gets the islands overlapping its promoter window
+ *   (upstream bases before to downstream bases after the TSS, on the gene's
+ *   strand) and its body, with the overlap length, and the nearest island
+ *   wholly upstream and downstream of the TSS with its signed distance:
+ *
+ *     cpgi_promoter=CpGI_12:340,CpGI_13:85
+ *     cpgi_body=CpGI_13:212
+ *     cpgi_upstream=CpGI_11:-1530
+ *     cpgi_downstream=CpGI_14:4410
+ *
+ *   Islands are walked in start order alongside the genes, keeping only
+ *   those that reach into the current gene's window, so a chromosome costs
+ *   O(genes + islands) for annotations without deeply nested islands.
+ *
+ */
+
+#ifndef  ISLAND_SWEEP_STREAM_API_H
+#define  ISLAND_SWEEP_STREAM_API_H
+
+#include "../cpgi_index/cpgi_index.h"
+
+typedef struct island_sweep_stream island_sweep_stream;
+
+GtNodeStream* island_sweep_stream_new(GtNodeStream * in_stream,
+                                      const char *   cpgi_db,
+                                      unsigned long  upstream,
+                                      unsigned long  downstream
+                                     );
+
+// join against an already loaded island list, the stream takes its own reference
+GtNodeStream* island_sweep_stream_new_with_index(GtNodeStream * in_stream,
+                                                 cpgi_index *   islands,
+                                                 unsigned long  upstream,
+                                                 unsigned long  downstream
+                                                );
+
+// number of genes with an island in their promoter or body so far
+unsigned long island_sweep_stream_num_scored(GtNodeStream * ns);
+
+#endif
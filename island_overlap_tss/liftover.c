@@ -0,0 +1,360 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*  lift TAIR8 track files (chromosome position ...) and GFF3 to TAIR10
+*  coordinates, rewriting only the positions and copying the rest of each line
+*
+*************************************************/
+#include "liftover_index/liftover_index.h"
+#include "compressed_input/compressed_input.h"
+#include "stream_stats/stream_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define LIFTOVER_READ_SIZE  (1 << 20)
+#define LIFTOVER_OUT_SIZE   (1 << 20)
+
+typedef struct
+{
+    liftover_cursor *  cursor;
+    FILE *             out_file;
+    char *             out;
+    size_t             out_length;
+    int                gff3;
+    int                in_fasta;        // everything after ##FASTA is copied
+    unsigned long long num_records;
+    unsigned long long num_dropped;
+} liftover_job_t;
+
+void usage(const char * name)
+{
+   printf("Usage: %s [--stats] [-g] <updates table> <in file> <out file>\n", name);
+   printf("   lifts TAIR8 (or TAIR7) coordinates to TAIR10 using the TAIR9 assembly\n");
+   printf("   updates table.  The input is a track of chromosome position ... lines,\n");
+   printf("   or GFF3 with -g.  Records in deleted sequence are dropped\n");
+}
+
+static void liftover_flush(liftover_job_t * job)
+{
+    fwrite(job->out, 1, job->out_length, job->out_file);
+    job->out_length = 0;
+}
+
+static void liftover_write(liftover_job_t * job, const char * text, size_t length)
+{
+    if (job->out_length + length > LIFTOVER_OUT_SIZE)
+    {
+        liftover_flush(job);
+        if (length > LIFTOVER_OUT_SIZE)
+        {
+            fwrite(text, 1, length, job->out_file);
+            return;
+        }
+    }
+    memcpy(job->out + job->out_length, text, length);
+    job->out_length += length;
+}
+
+static void liftover_write_number(liftover_job_t * job, unsigned long value)
+{
+    char   digits[24];
+    char * p = digits + sizeof(digits);
+
+    do
+    {
+        *--p = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    liftover_write(job, p, digits + sizeof(digits) - p);
+}
+
+// strtoul that must stop inside the line
+static int liftover_parse_number(const char * p, const char * line_end, unsigned long * value, const char ** end)
+{
+    if (p >= line_end || *p < '0' || *p > '9')
+        return 0;
+    *value = strtoul(p, (char **)end, 10);
+    return *end <= line_end;
+}
+
+// "Chr1" or "chr1" as chromosome 1, other seqids have no updates
+static int liftover_parse_seqid(const char * seqid, const char * seqid_end, int * chromosome)
+{
+    unsigned long value;
+    const char *  end;
+
+    if (seqid_end - seqid > 3 && strncasecmp(seqid, "chr", 3) == 0)
+        seqid += 3;
+    if (!liftover_parse_number(seqid, seqid_end, &value, &end) || end != seqid_end)
+        return 0;
+    *chromosome = (int)value;
+    return 1;
+}
+
+// chromosome position ..., anything not starting with a number is a header
+static int liftover_track_line(liftover_job_t * job, const char * line, const char * line_end)
+{
+    const char *  p = line, * position_start, * end;
+    unsigned long chromosome, position, new_position;
+
+    while (p < line_end && (*p == ' ' || *p == '\t'))
+        p++;
+    if (p == line_end || *p < '0' || *p > '9')
+    {
+        liftover_write(job, line, line_end - line);
+        liftover_write(job, "\n", 1);
+        return 0;
+    }
+
+    if (!liftover_parse_number(p, line_end, &chromosome, &end))
+        return -1;
+    for (position_start = end; position_start < line_end && (*position_start == ' ' || *position_start == '\t'); position_start++)
+        ;
+    if (position_start == end || !liftover_parse_number(position_start, line_end, &position, &end))
+        return -1;
+
+    job->num_records++;
+    if (!liftover_cursor_map(job->cursor, (int)chromosome, position, &new_position))
+    {
+        job->num_dropped++;
+        return 0;
+    }
+
+    liftover_write(job, line, position_start - line);
+    liftover_write_number(job, new_position);
+    liftover_write(job, end, line_end - end);
+    liftover_write(job, "\n", 1);
+    return 0;
+}
+
+// ##sequence-region seqid start end
+static int liftover_sequence_region(liftover_job_t * job, const char * line, const char * line_end)
+{
+    const char *  seqid, * seqid_end, * p, * end;
+    unsigned long start, stop;
+    int           chromosome;
+
+    for (seqid = line + 17; seqid < line_end && (*seqid == ' ' || *seqid == '\t'); seqid++)
+        ;
+    for (seqid_end = seqid; seqid_end < line_end && *seqid_end != ' ' && *seqid_end != '\t'; seqid_end++)
+        ;
+    for (p = seqid_end; p < line_end && (*p == ' ' || *p == '\t'); p++)
+        ;
+    if (!liftover_parse_number(p, line_end, &start, &end))
+        return -1;
+    for (p = end; p < line_end && (*p == ' ' || *p == '\t'); p++)
+        ;
+    if (!liftover_parse_number(p, line_end, &stop, &end))
+        return -1;
+
+    if (liftover_parse_seqid(seqid, seqid_end, &chromosome) &&
+        !liftover_cursor_map_range(job->cursor, chromosome, &start, &stop))
+        return 0;
+
+    liftover_write(job, "##sequence-region   ", 20);
+    liftover_write(job, seqid, seqid_end - seqid);
+    liftover_write(job, " ", 1);
+    liftover_write_number(job, start);
+    liftover_write(job, " ", 1);
+    liftover_write_number(job, stop);
+    liftover_write(job, "\n", 1);
+    return 0;
+}
+
+// seqid source type start end ..., only columns 4 and 5 change
+static int liftover_gff3_line(liftover_job_t * job, const char * line, const char * line_end)
+{
+    const char *  columns[5];
+    const char *  p = line, * end;
+    unsigned long start, stop;
+    int           chromosome, i;
+
+    if (job->in_fasta || p == line_end || *p == '#')
+    {
+        if (line_end - line >= 7 && strncmp(line, "##FASTA", 7) == 0)
+            job->in_fasta = 1;
+        else if (!job->in_fasta && line_end - line > 17 && strncmp(line, "##sequence-region", 17) == 0)
+            return liftover_sequence_region(job, line, line_end);
+        liftover_write(job, line, line_end - line);
+        liftover_write(job, "\n", 1);
+        return 0;
+    }
+    if (*p == '>')
+    {
+        // FASTA without the ##FASTA directive
+        job->in_fasta = 1;
+        return liftover_gff3_line(job, line, line_end);
+    }
+
+    for (i = 0; i < 5; i++)
+    {
+        columns[i] = p;
+        if (!(p = memchr(p, '\t', line_end - p)))
+            return -1;
+        p++;
+    }
+
+    if (!liftover_parse_number(columns[3], line_end, &start, &end) || *end != '\t' ||
+        !liftover_parse_number(columns[4], line_end, &stop, &end) || *end != '\t' || start > stop)
+        return -1;
+
+    job->num_records++;
+    if (liftover_parse_seqid(columns[0], columns[1] - 1, &chromosome) &&
+        !liftover_cursor_map_range(job->cursor, chromosome, &start, &stop))
+    {
+        job->num_dropped++;
+        return 0;
+    }
+
+    liftover_write(job, line, columns[3] - line);
+    liftover_write_number(job, start);
+    liftover_write(job, "\t", 1);
+    liftover_write_number(job, stop);
+    liftover_write(job, end, line_end - end);
+    liftover_write(job, "\n", 1);
+    return 0;
+}
+
+// read whole lines in large blocks, returns the failing line number or 0
+static unsigned long liftover_run(liftover_job_t * job, FILE * in_file)
+{
+    size_t        capacity = LIFTOVER_READ_SIZE, length = 0, n;
+    char *        buffer = malloc(capacity + 1);     // NUL stops strtoul on an unterminated last line
+    unsigned long line_number = 0;
+    int           eof = 0;
+
+    while (!eof)
+    {
+        char * line = buffer, * newline;
+
+        if (length == capacity)
+        {
+            // a single line larger than the buffer
+            capacity *= 2;
+            buffer = realloc(buffer, capacity + 1);
+            line = buffer;
+        }
+        n = fread(buffer + length, 1, capacity - length, in_file);
+        length += n;
+        buffer[length] = '\0';
+        if (n == 0)
+            eof = 1;
+
+        while ((newline = memchr(line, '\n', buffer + length - line)) || (eof && line < buffer + length))
+        {
+            char * line_end = newline ? newline : buffer + length;
+            char * text_end = line_end > line && line_end[-1] == '\r' ? line_end - 1 : line_end;
+
+            line_number++;
+            if ((job->gff3 ? liftover_gff3_line(job, line, text_end) : liftover_track_line(job, line, text_end)))
+            {
+                free(buffer);
+                return line_number;
+            }
+            line = newline ? newline + 1 : buffer + length;
+        }
+
+        // keep the partial line for the next block
+        length -= line - buffer;
+        memmove(buffer, line, length);
+    }
+
+    free(buffer);
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    liftover_index *   index;
+    compressed_input * in_input;
+    liftover_job_t     job;
+    unsigned long      bad_line;
+    uint64_t           start_time;
+    int                opt, failed = 0;
+
+    // --stats reports per stage counters as JSON on stderr
+    stream_stats_parse_flag(&argc, argv);
+
+    memset(&job, 0, sizeof(job));
+    while ((opt = getopt(argc, argv, "g")) != -1)
+    {
+        switch (opt)
+        {
+        case 'g': job.gff3 = 1; break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 3)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+
+    if (!(index = liftover_index_load(argv[optind])))
+    {
+        fprintf(stderr, "Failed to load assembly updates %s\n", argv[optind]);
+        exit(1);
+    }
+
+    // gzip / BGZF text is inflated on the fly
+    if (!(in_input = compressed_input_open(argv[optind + 1])))
+    {
+        fprintf(stderr, "Failed to open input file %s\n", argv[optind + 1]);
+        exit(1);
+    }
+    if (!(job.out_file = fopen(argv[optind + 2], "w")))
+    {
+        fprintf(stderr, "Failed to create output file %s\n", argv[optind + 2]);
+        exit(1);
+    }
+
+    job.cursor = liftover_cursor_new(index);
+    job.out    = malloc(LIFTOVER_OUT_SIZE);
+    start_time = stream_stats_now();
+
+    if ((bad_line = liftover_run(&job, compressed_input_file(in_input))))
+    {
+        fprintf(stderr, "Malformed record on line %lu of %s\n", bad_line, argv[optind + 1]);
+        failed = 1;
+    }
+    stream_stats_file_parsed(argv[optind + 1], job.num_records, (stream_stats_now() - start_time) / 1e9);
+
+    if (compressed_input_close(in_input))
+    {
+        fprintf(stderr, "Input file %s is corrupt or truncated\n", argv[optind + 1]);
+        failed = 1;
+    }
+    liftover_flush(&job);
+    if (fclose(job.out_file))
+    {
+        fprintf(stderr, "Failed to write output file %s\n", argv[optind + 2]);
+        failed = 1;
+    }
+
+    if (!failed)
+    {
+        printf("%llu records lifted, %llu dropped in deleted sequence\n",
+               job.num_records - job.num_dropped, job.num_dropped);
+        if (liftover_cursor_num_searches(job.cursor))
+            printf("input is not sorted, %lu lookups fell back to binary search\n",
+                   liftover_cursor_num_searches(job.cursor));
+    }
+
+    free(job.out);
+    liftover_cursor_delete(job.cursor);
+    liftover_index_delete(index);
+
+    if (stream_stats_enabled())
+        stream_stats_write_json(stderr);
+    return failed;
+}
@@ -0,0 +1,353 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Compile the TAIR8 -> TAIR9 assembly updates into per-chromosome runs of
+*   TAIR8 positions sharing one offset, and walk them with a cursor
+*
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include "liftover_index.h"
+#include "../compressed_input/compressed_input.h"
+#include "../stream_stats/stream_stats.h"
+
+#define LIFTOVER_DELETED LONG_MIN       // offset of a run missing from TAIR9
+#define LIFTOVER_STEPS   8              // runs stepped over before searching
+
+typedef struct
+{
+    int             chromosome;
+    unsigned long * starts;             // first TAIR8 position of each run, starts[0] is 0
+    long *          offsets;            // added to positions in the run
+    unsigned long   count;
+    unsigned long   capacity;
+} chromosome_t;
+
+struct liftover_index {
+    chromosome_t * chromosomes;
+    int            num_chromosomes;
+    unsigned long  num_updates;
+};
+
+struct liftover_cursor {
+    const liftover_index * index;
+    const chromosome_t *   chromosome;  // NULL if the chromosome has no updates
+    int                    chromosome_id;
+    int                    started;
+    unsigned long          run;
+    unsigned long          num_searches;
+};
+
+// "Chr1", "chr1" and "1" all name chromosome 1
+static int liftover_parse_chromosome(const char * name, int * chromosome)
+{
+    if (strncasecmp(name, "chr", 3) == 0)
+        name += 3;
+    return sscanf(name, "%d", chromosome) == 1;
+}
+
+static chromosome_t * liftover_index_find_chromosome(const liftover_index * index, int chromosome)
+{
+    int i;
+
+    // five chromosomes, a scan beats anything clever
+    for (i = 0; i < index->num_chromosomes; i++)
+        if (index->chromosomes[i].chromosome == chromosome)
+            return &index->chromosomes[i];
+    return NULL;
+}
+
+// start a run at start, folding it into its neighbours when the offsets
+// match so adjacent runs always differ and a deleted run never touches another
+static void liftover_add_run(chromosome_t * c, unsigned long start, long offset)
+{
+    if (c->starts[c->count - 1] == start)
+    {
+        c->offsets[c->count - 1] = offset;
+        if (c->count > 1 && c->offsets[c->count - 2] == offset)
+            c->count--;
+        return;
+    }
+    if (c->offsets[c->count - 1] == offset)
+        return;
+
+    if (c->count == c->capacity)
+    {
+        c->capacity *= 2;
+        c->starts  = realloc(c->starts, c->capacity * sizeof(unsigned long));
+        c->offsets = realloc(c->offsets, c->capacity * sizeof(long));
+    }
+    c->starts[c->count]  = start;
+    c->offsets[c->count] = offset;
+    c->count++;
+}
+
+liftover_index * liftover_index_load(const char * updates_path)
+{
+    compressed_input * updates_input;
+    FILE *             updates_file;
+    liftover_index *   index;
+    long *             shifts = NULL;       // running offset of each chromosome
+    unsigned long *    covered = NULL;      // first position past the last deletion
+    char               line[1024];
+    int                failed = 0, i;
+    uint64_t           load_start = stream_stats_now();
+
+    // gzip / BGZF text is inflated on the fly
+    if ((updates_input = compressed_input_open(updates_path)) == NULL)
+        return NULL;
+    updates_file = compressed_input_file(updates_input);
+
+    index = calloc(1, sizeof(liftover_index));
+
+    while (!failed && fgets(line, sizeof(line), updates_file))
+    {
+        char           name[64], type[32];
+        unsigned long  position, length, new_position;
+        int            chromosome, fields;
+        chromosome_t * c;
+        long *         shift;
+
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[0] == '#')
+            continue;
+
+        fields = sscanf(line, "%63s %lu %31s %lu %lu", name, &position, type, &length, &new_position);
+        if (fields < 4 || !liftover_parse_chromosome(name, &chromosome))
+        {
+            failed = 1;
+            break;
+        }
+
+        if (!(c = liftover_index_find_chromosome(index, chromosome)))
+        {
+            index->chromosomes = realloc(index->chromosomes, (index->num_chromosomes + 1) * sizeof(chromosome_t));
+            shifts  = realloc(shifts, (index->num_chromosomes + 1) * sizeof(long));
+            covered = realloc(covered, (index->num_chromosomes + 1) * sizeof(unsigned long));
+            shifts[index->num_chromosomes]  = 0;
+            covered[index->num_chromosomes] = 0;
+
+            c = &index->chromosomes[index->num_chromosomes++];
+            c->chromosome = chromosome;
+            c->capacity   = 64;
+            c->count      = 1;
+            c->starts     = malloc(c->capacity * sizeof(unsigned long));
+            c->offsets    = malloc(c->capacity * sizeof(long));
+            c->starts[0]  = 0;
+            c->offsets[0] = 0;
+        }
+        shift = &shifts[c - index->chromosomes];
+
+        // rows go up the chromosome and never land in sequence already deleted,
+        // and the TAIR9 column, when given, must agree with the offsets so far
+        if (position < c->starts[c->count - 1] || position < covered[c - index->chromosomes] ||
+            (fields == 5 && (long)new_position != (long)position + *shift))
+        {
+            failed = 1;
+            break;
+        }
+
+        if (strcmp(type, "insertion") == 0)
+        {
+            // the new bases sit in front of position
+            *shift += length;
+            liftover_add_run(c, position, *shift);
+        }
+        else if (strcmp(type, "deletion") == 0)
+        {
+            liftover_add_run(c, position, LIFTOVER_DELETED);
+            *shift -= length;
+            liftover_add_run(c, position + length, *shift);
+            covered[c - index->chromosomes] = position + length;
+        }
+        else if (strcmp(type, "substitution") != 0)
+        {
+            failed = 1;
+            break;
+        }
+        index->num_updates++;
+    }
+    free(shifts);
+    free(covered);
+
+    if (compressed_input_close(updates_input) || failed)
+    {
+        liftover_index_delete(index);
+        return NULL;
+    }
+
+    // the runs are final, give back the slack
+    for (i = 0; i < index->num_chromosomes; i++)
+    {
+        chromosome_t * c = &index->chromosomes[i];
+
+        c->starts   = realloc(c->starts, c->count * sizeof(unsigned long));
+        c->offsets  = realloc(c->offsets, c->count * sizeof(long));
+        c->capacity = c->count;
+    }
+
+    stream_stats_file_parsed(updates_path, index->num_updates, (stream_stats_now() - load_start) / 1e9);
+    return index;
+}
+
+void liftover_index_delete(liftover_index * index)
+{
+    int i;
+
+    if (!index)
+        return;
+    for (i = 0; i < index->num_chromosomes; i++)
+    {
+        free(index->chromosomes[i].starts);
+        free(index->chromosomes[i].offsets);
+    }
+    free(index->chromosomes);
+    free(index);
+}
+
+unsigned long liftover_index_size(const liftover_index * index)
+{
+    return index->num_updates;
+}
+
+liftover_cursor * liftover_cursor_new(const liftover_index * index)
+{
+    liftover_cursor * cursor = calloc(1, sizeof(liftover_cursor));
+
+    cursor->index = index;
+    return cursor;
+}
+
+void liftover_cursor_delete(liftover_cursor * cursor)
+{
+    free(cursor);
+}
+
+unsigned long liftover_cursor_num_searches(const liftover_cursor * cursor)
+{
+    return cursor->num_searches;
+}
+
+// the last run in [lo, hi) starting at or before position, starts[lo] must
+// not be past position
+static unsigned long liftover_search(const chromosome_t * c,
+                                     unsigned long        position,
+                                     unsigned long        lo,
+                                     unsigned long        hi
+                                    )
+{
+    while (hi - lo > 1)
+    {
+        unsigned long mid = lo + (hi - lo) / 2;
+
+        if (c->starts[mid] <= position)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// from run, which starts at or before position, move on to the run holding
+// position.  Nearby runs are stepped to, far ones searched for
+static unsigned long liftover_step(const chromosome_t * c, unsigned long run, unsigned long position)
+{
+    int steps = 0;
+
+    while (run + 1 < c->count && c->starts[run + 1] <= position)
+    {
+        if (++steps > LIFTOVER_STEPS)
+            return liftover_search(c, position, run + 1, c->count);
+        run++;
+    }
+    return run;
+}
+
+// point the cursor at the run holding position, NULL if the chromosome
+// has no updates
+static const chromosome_t * liftover_cursor_seek(liftover_cursor * cursor, int chromosome, unsigned long position)
+{
+    const chromosome_t * c;
+
+    if (!cursor->started || chromosome != cursor->chromosome_id)
+    {
+        cursor->started       = 1;
+        cursor->chromosome_id = chromosome;
+        cursor->chromosome    = liftover_index_find_chromosome(cursor->index, chromosome);
+        cursor->run           = 0;
+    }
+    if (!(c = cursor->chromosome))
+        return NULL;
+
+    if (position < c->starts[cursor->run])
+    {
+        // the input went backwards
+        cursor->run = liftover_search(c, position, 0, cursor->run);
+        cursor->num_searches++;
+    }
+    else
+        cursor->run = liftover_step(c, cursor->run, position);
+
+    return c;
+}
+
+int liftover_cursor_map(liftover_cursor * cursor,
+                        int               chromosome,
+                        unsigned long     position,
+                        unsigned long *   new_position
+                       )
+{
+    const chromosome_t * c;
+
+    if (!(c = liftover_cursor_seek(cursor, chromosome, position)))
+    {
+        *new_position = position;
+        return 1;
+    }
+    if (c->offsets[cursor->run] == LIFTOVER_DELETED)
+        return 0;
+
+    *new_position = position + c->offsets[cursor->run];
+    return 1;
+}
+
+int liftover_cursor_map_range(liftover_cursor * cursor,
+                              int               chromosome,
+                              unsigned long *   start,
+                              unsigned long *   end
+                             )
+{
+    const chromosome_t * c;
+    unsigned long        first, last, run;
+
+    if (!(c = liftover_cursor_seek(cursor, chromosome, *start)))
+        return 1;
+
+    // a deleted run is always followed by a kept one
+    first = cursor->run;
+    if (c->offsets[first] == LIFTOVER_DELETED)
+    {
+        if (++first == c->count || c->starts[first] > *end)
+            return 0;
+        *start = c->starts[first];
+    }
+
+    // ends aren't sorted, so walk on from the start without moving the cursor
+    last = run = liftover_step(c, first, *end);
+    if (c->offsets[run] == LIFTOVER_DELETED)
+    {
+        last  = run - 1;
+        *end  = c->starts[run] - 1;
+    }
+
+    *start += c->offsets[first];
+    *end   += c->offsets[last];
+    return 1;
+}
@@ -0,0 +1,53 @@
+/*
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   TAIR8 -> TAIR10 coordinate liftover.  The TAIR8 -> TAIR9 assembly
+ *   updates (chromosome position type length [TAIR9 position]) are compiled
+ *   into per-chromosome breakpoints, each starting a run of TAIR8 positions
+ *   that share one offset or were deleted.  TAIR9 -> TAIR10 changed no
+ *   coordinates and TAIR7 shares TAIR8's, so the same index serves both.
+ *   The index is read only once loaded, give each thread its own cursor.
+ *
+ */
+
+#ifndef  LIFTOVER_INDEX_H
+#define  LIFTOVER_INDEX_H
+
+typedef struct liftover_index liftover_index;
+typedef struct liftover_cursor liftover_cursor;
+
+// load the updates table, plain or gzip / BGZF compressed.  Rows must be
+// sorted by position within each chromosome.  Returns NULL if the file can't
+// be read or is corrupt
+liftover_index * liftover_index_load(const char * updates_path);
+
+void liftover_index_delete(liftover_index * index);
+
+unsigned long liftover_index_size(const liftover_index * index);
+
+// a cursor remembers the last breakpoint it landed on, so sorted input only
+// ever steps forward.  Input that jumps back falls back to a binary search
+liftover_cursor * liftover_cursor_new(const liftover_index * index);
+
+void liftover_cursor_delete(liftover_cursor * cursor);
+
+// lift one position.  Returns 1 with the new position set, or 0 if the
+// position was deleted.  Chromosomes without updates map to themselves
+int liftover_cursor_map(liftover_cursor * cursor,
+                        int               chromosome,
+                        unsigned long     position,
+                        unsigned long *   new_position
+                       );
+
+// lift [start, end] (inclusive), trimming ends that fall in deleted
+// sequence.  Returns 0 if the whole range was deleted
+int liftover_cursor_map_range(liftover_cursor * cursor,
+                              int               chromosome,
+                              unsigned long *   start,
+                              unsigned long *   end
+                             );
+
+// number of lookups that could not step forward from the last one
+unsigned long liftover_cursor_num_searches(const liftover_cursor * cursor);
+
+#endif
@@ -0,0 +1,273 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*  metagene profiles of methylation and nucleosome signal around every
+*  gene's TSS and TES, over all genes and per expression quantile
+*
+*************************************************/
+#include "genometools.h"
+#include "gene_expression_score_stream/gene_expression_score_stream_api.h"
+#include "metagene_profile/metagene_profile.h"
+#include "stats_stream/stats_stream_api.h"
+#include "gff3_lite_in_stream/gff3_lite_in_stream_api.h"
+#include <stdio.h>
+#include <unistd.h>
+
+static const char * feature_type_gene = "gene";
+
+// the only rows the profile looks at, see --fast
+static const char * fast_types[] = { "gene", NULL };
+
+typedef struct
+{
+    metagene_gene_t gene;
+    float           expression;
+    int             has_expression;
+} metagene_entry_t;
+
+void usage(const char * name)
+{
+   printf("Usage: %s [--stats] [--fast] [-j <threads>] [-w <window>] [-b <bin size>] [-d] [-m <methylome db>]\n"
+          "       [-n <nucleosome db>] [-r <RNA-seq db> [-q <quantiles>]] <in fileName> <out profile>\n", name);
+   printf("   bins run from window bases upstream to window bases downstream of each\n");
+   printf("   TSS and TES on the gene's strand, by default 2000 bases in 50 base bins\n");
+   printf("   a bin holds the mean of the records in it, or with -d their sum per base\n");
+   printf("   -q groups the genes into expression quantiles from the RNA-seq db\n");
+   printf("   --fast reads only the genes of the annotation, on several threads\n");
+}
+
+static int metagene_expression_compare(const void * a, const void * b)
+{
+    float x = (*(const metagene_entry_t * const *)a)->expression;
+    float y = (*(const metagene_entry_t * const *)b)->expression;
+
+    return x < y ? -1 : x > y;
+}
+
+// every gene's anchors, strand and expression score if it has one
+static metagene_entry_t * read_genes(GtNodeStream * in, unsigned long * num_genes, GtError * err)
+{
+    metagene_entry_t * entries = NULL;
+    unsigned long      capacity = 0;
+    GtGenomeNode *     gn;
+    int                had_err;
+
+    *num_genes = 0;
+    while (!(had_err = gt_node_stream_next(in, &gn, err)) && gn)
+    {
+        GtFeatureNode *         fn = NULL;
+        GtFeatureNodeIterator * iter;
+        metagene_entry_t *      entry;
+        int                     chr_num;
+
+        if (gt_genome_node_try_cast(gt_feature_node_class(), gn))
+        {
+            fn = gt_feature_node_cast(gn);
+
+            // the gene may be wrapped in a pseudo node
+            if (gt_feature_node_is_pseudo(fn))
+            {
+                iter = gt_feature_node_iterator_new(fn);
+                while ((fn = gt_feature_node_iterator_next(iter)) && !gt_feature_node_has_type(fn, feature_type_gene))
+                    ;
+                gt_feature_node_iterator_delete(iter);
+            }
+        }
+
+        if (!fn || !gt_feature_node_has_type(fn, feature_type_gene) ||
+            1 != sscanf(gt_str_get(gt_genome_node_get_seqid((GtGenomeNode *)fn)), "Chr%d", &chr_num))
+        {
+            gt_genome_node_delete(gn);
+            continue;
+        }
+
+        if (*num_genes == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 32768;
+            entries = realloc(entries, capacity * sizeof(metagene_entry_t));
+        }
+        entry = &entries[(*num_genes)++];
+
+        // same TSS as CpGIOverlap_stream
+        entry->gene.chromosome = chr_num;
+        entry->gene.reverse    = gt_feature_node_get_strand(fn) != GT_STRAND_FORWARD;
+        entry->gene.tss        = entry->gene.reverse ? gt_genome_node_get_end((GtGenomeNode *)fn)
+                                                     : gt_genome_node_get_start((GtGenomeNode *)fn);
+        entry->gene.tes        = entry->gene.reverse ? gt_genome_node_get_start((GtGenomeNode *)fn)
+                                                     : gt_genome_node_get_end((GtGenomeNode *)fn);
+        entry->gene.group      = -1;
+        entry->has_expression  = gt_feature_node_score_is_defined(fn);
+        entry->expression      = entry->has_expression ? gt_feature_node_get_score(fn) : 0.0f;
+        gt_genome_node_delete(gn);
+    }
+
+    if (had_err)
+    {
+        free(entries);
+        return NULL;
+    }
+
+    // NULL is kept for failure, an annotation without genes is still read
+    if (!entries)
+        entries = malloc(sizeof(metagene_entry_t));
+    return entries;
+}
+
+// quantile q of num_quantiles by expression rank, tied genes stay together
+static void assign_quantiles(metagene_entry_t * entries, unsigned long num_genes, int num_quantiles)
+{
+    metagene_entry_t ** scored = malloc((num_genes ? num_genes : 1) * sizeof(metagene_entry_t *));
+    unsigned long       num_scored = 0, i, tie_start = 0;
+
+    for (i = 0; i < num_genes; i++)
+        if (entries[i].has_expression)
+            scored[num_scored++] = &entries[i];
+    qsort(scored, num_scored, sizeof(metagene_entry_t *), metagene_expression_compare);
+
+    for (i = 0; i < num_scored; i++)
+    {
+        if (i == 0 || scored[i]->expression != scored[i - 1]->expression)
+            tie_start = i;
+        scored[i]->gene.group = (int)(tie_start * num_quantiles / num_scored);
+    }
+    free(scored);
+}
+
+int main(int argc, char ** argv)
+{
+    GtNodeStream *     in, * expression = NULL;
+    GtError *          err;
+    FILE *             out_file;
+    metagene_entry_t * entries;
+    metagene_gene_t *  genes;
+    unsigned long      num_genes, i;
+    const char *       methylome_db = NULL, * nucleosome_db = NULL, * rnaseq_db = NULL;
+    const char *       track_dbs[2], * track_names[2] = { "methylome", "nucleosome" };
+    unsigned long      window = 2000, bin_size = 50;
+    int                num_quantiles = 0, density = 0;
+    int                num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int                fast, opt, t, failed = 0;
+
+    // --stats reports per stage counters as JSON on stderr
+    stream_stats_parse_flag(&argc, argv);
+    fast = gff3_lite_in_stream_parse_flag(&argc, argv);
+
+    while ((opt = getopt(argc, argv, "j:w:b:dm:n:r:q:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': num_threads   = atoi(optarg); break;
+        case 'w': window        = strtoul(optarg, NULL, 10); break;
+        case 'b': bin_size      = strtoul(optarg, NULL, 10); break;
+        case 'd': density       = 1; break;
+        case 'm': methylome_db  = optarg; break;
+        case 'n': nucleosome_db = optarg; break;
+        case 'r': rnaseq_db     = optarg; break;
+        case 'q': num_quantiles = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 2 || num_threads < 1 || !(methylome_db || nucleosome_db) ||
+        num_quantiles < 0 || (num_quantiles && !rnaseq_db) ||
+        bin_size == 0 || window == 0 || (2 * window) % bin_size)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+    track_dbs[0] = methylome_db;
+    track_dbs[1] = nucleosome_db;
+
+    // initilaize genometools
+    gt_lib_init();
+    err = gt_error_new();
+
+    if (fast)
+        in = gff3_lite_in_stream_new(argv[optind], fast_types, num_threads);
+    else
+        in = gt_gff3_in_stream_new_sorted(argv[optind]);
+
+    if (!in)
+    {
+        fprintf(stderr, "Failed to open input stream with arg %s\n", argv[optind]);
+        exit(1);
+    }
+    in = stats_stream_new(in, "gff3_in", NULL);
+
+    // the expression score lands in each gene's score column
+    if (rnaseq_db)
+    {
+        if (!(expression = gene_expression_score_stream_new(in, rnaseq_db)))
+        {
+            gt_node_stream_delete(in);
+            fprintf(stderr, "Failed to create gene expression score stream\n");
+            exit(1);
+        }
+        expression = stats_stream_new(expression, "gene_expression_score", gene_expression_score_stream_num_scored);
+    }
+
+    if (!(entries = read_genes(expression ? expression : in, &num_genes, err)))
+    {
+        fprintf(stderr, "Failed to read genes: %s\n", gt_error_get(err));
+        exit(1);
+    }
+    gt_node_stream_delete(expression);
+    gt_node_stream_delete(in);
+
+    if (num_quantiles)
+        assign_quantiles(entries, num_genes, num_quantiles);
+
+    genes = malloc((num_genes ? num_genes : 1) * sizeof(metagene_gene_t));
+    for (i = 0; i < num_genes; i++)
+        genes[i] = entries[i].gene;
+    free(entries);
+
+    if (!(out_file = fopen(argv[optind + 1], "w")))
+    {
+        fprintf(stderr, "Failed to create output file %s\n", argv[optind + 1]);
+        exit(1);
+    }
+    fprintf(out_file, "track\tanchor\tgroup\tbin_start\tbin_end\tgenes\tmean\tvariance\tcoverage\n");
+
+    // one track at a time, the genes are spread over the threads
+    for (t = 0; t < 2 && !failed; t++)
+    {
+        track_index *      track;
+        metagene_profile * profile;
+
+        if (!track_dbs[t])
+            continue;
+        if (!(track = track_index_load(track_dbs[t])))
+        {
+            fprintf(stderr, "Failed to open %s db file %s\n", track_names[t], track_dbs[t]);
+            failed = 1;
+            break;
+        }
+
+        profile = metagene_profile_new(window, bin_size, num_quantiles, density);
+        metagene_profile_add(profile, track, genes, num_genes, num_threads);
+        metagene_profile_write(profile, out_file, track_names[t]);
+        metagene_profile_delete(profile);
+        track_index_delete(track);
+    }
+
+    if (fclose(out_file))
+    {
+        fprintf(stderr, "Failed to write output file %s\n", argv[optind + 1]);
+        failed = 1;
+    }
+
+    free(genes);
+    gt_error_delete(err);
+    gt_lib_clean();
+
+    if (stream_stats_enabled())
+        stream_stats_write_json(stderr);
+    return failed;
+}
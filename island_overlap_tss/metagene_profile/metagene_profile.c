@@ -0,0 +1,263 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Bin a track around every gene's TSS and TES and keep running moments of
+*   each bin across genes
+*
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "metagene_profile.h"
+
+#define METAGENE_CHUNK   1024           // genes scored into one set of moments
+#define METAGENE_ANCHORS 2              // TSS, TES
+
+typedef struct
+{
+    double        n;
+    double        mean;
+    double        m2;                   // sum of squared deviations from the mean
+    unsigned long covered;              // genes with any record in the bin
+} bin_moments_t;
+
+struct metagene_profile {
+    unsigned long   window;
+    unsigned long   bin_size;
+    int             num_bins;
+    int             num_slots;          // all genes, then each group
+    int             density;
+    bin_moments_t * moments;            // [anchor][slot][bin]
+    unsigned long * num_genes;          // [slot]
+};
+
+typedef struct
+{
+    metagene_profile *      profile;
+    const track_index *     track;
+    const metagene_gene_t * genes;
+    unsigned long           num_genes;
+    bin_moments_t *         chunk_moments;
+    unsigned long           next_chunk;
+    unsigned long           num_chunks;
+    pthread_mutex_t         lock;
+} metagene_job_t;
+
+static const char * anchor_names[METAGENE_ANCHORS] = { "TSS", "TES" };
+
+static size_t metagene_profile_num_moments(const metagene_profile * profile)
+{
+    return (size_t)METAGENE_ANCHORS * profile->num_slots * profile->num_bins;
+}
+
+metagene_profile * metagene_profile_new(unsigned long window,
+                                        unsigned long bin_size,
+                                        int           num_groups,
+                                        int           density
+                                       )
+{
+    metagene_profile * profile;
+
+    if (bin_size == 0 || window == 0 || (2 * window) % bin_size || num_groups < 0)
+        return NULL;
+
+    profile = calloc(1, sizeof(metagene_profile));
+    profile->window    = window;
+    profile->bin_size  = bin_size;
+    profile->num_bins  = 2 * window / bin_size;
+    profile->num_slots = num_groups + 1;
+    profile->density   = density;
+    profile->moments   = calloc(metagene_profile_num_moments(profile), sizeof(bin_moments_t));
+    profile->num_genes = calloc(profile->num_slots, sizeof(unsigned long));
+    return profile;
+}
+
+void metagene_profile_delete(metagene_profile * profile)
+{
+    if (!profile)
+        return;
+    free(profile->moments);
+    free(profile->num_genes);
+    free(profile);
+}
+
+static void bin_moments_add(bin_moments_t * m, double value)
+{
+    double delta = value - m->mean;
+
+    m->n    += 1.0;
+    m->mean += delta / m->n;
+    m->m2   += delta * (value - m->mean);
+}
+
+// fold b into a, Chan et al's pairwise update
+static void bin_moments_merge(bin_moments_t * a, const bin_moments_t * b)
+{
+    double n, delta;
+
+    if (b->n == 0.0)
+        return;
+    n     = a->n + b->n;
+    delta = b->mean - a->mean;
+    a->mean += delta * b->n / n;
+    a->m2   += b->m2 + delta * delta * a->n * b->n / n;
+    a->n     = n;
+    a->covered += b->covered;
+}
+
+// one gene's bins around both anchors, in the direction of transcription
+static void metagene_profile_add_gene(const metagene_profile * profile,
+                                      const track_index *      track,
+                                      const metagene_gene_t *  gene,
+                                      double *                 sums,
+                                      unsigned long *          counts,
+                                      bin_moments_t *          moments
+                                     )
+{
+    int a, k;
+
+    for (a = 0; a < METAGENE_ANCHORS; a++)
+    {
+        unsigned long   anchor = a == 0 ? gene->tss : gene->tes;
+        bin_moments_t * all    = moments + (size_t)a * profile->num_slots * profile->num_bins;
+        bin_moments_t * group  = gene->group >= 0 && gene->group + 1 < profile->num_slots ?
+                                 all + (size_t)(gene->group + 1) * profile->num_bins : NULL;
+        long            start  = (long)anchor - (long)profile->window + (gene->reverse ? 1 : 0);
+
+        track_index_bin_sums(track, gene->chromosome, start, profile->bin_size, profile->num_bins, sums, counts);
+
+        for (k = 0; k < profile->num_bins; k++)
+        {
+            int    bin = gene->reverse ? profile->num_bins - 1 - k : k;
+            double value;
+
+            if (counts[bin] == 0 && !profile->density)
+                continue;
+            value = profile->density ? sums[bin] / profile->bin_size : sums[bin] / counts[bin];
+
+            bin_moments_add(&all[k], value);
+            all[k].covered += counts[bin] != 0;
+            if (group)
+            {
+                bin_moments_add(&group[k], value);
+                group[k].covered += counts[bin] != 0;
+            }
+        }
+    }
+}
+
+static void * metagene_profile_worker(void * data)
+{
+    metagene_job_t *   job = data;
+    metagene_profile * profile = job->profile;
+    double *           sums = malloc(profile->num_bins * sizeof(double));
+    unsigned long *    counts = malloc(profile->num_bins * sizeof(unsigned long));
+    size_t             chunk_size = metagene_profile_num_moments(profile);
+
+    for (;;)
+    {
+        unsigned long chunk, g, last;
+
+        pthread_mutex_lock(&job->lock);
+        chunk = job->next_chunk++;
+        pthread_mutex_unlock(&job->lock);
+        if (chunk >= job->num_chunks)
+            break;
+
+        last = (chunk + 1) * METAGENE_CHUNK < job->num_genes ? (chunk + 1) * METAGENE_CHUNK : job->num_genes;
+        for (g = chunk * METAGENE_CHUNK; g < last; g++)
+            metagene_profile_add_gene(profile, job->track, &job->genes[g], sums, counts,
+                                      job->chunk_moments + chunk * chunk_size);
+    }
+
+    free(sums);
+    free(counts);
+    return NULL;
+}
+
+void metagene_profile_add(metagene_profile *      profile,
+                          const track_index *     track,
+                          const metagene_gene_t * genes,
+                          unsigned long           num_genes,
+                          int                     num_threads
+                         )
+{
+    metagene_job_t job;
+    pthread_t *    threads;
+    size_t         chunk_size = metagene_profile_num_moments(profile), i;
+    unsigned long  g, c;
+    int            t;
+
+    if (num_genes == 0)
+        return;
+
+    job.profile       = profile;
+    job.track         = track;
+    job.genes         = genes;
+    job.num_genes     = num_genes;
+    job.next_chunk    = 0;
+    job.num_chunks    = (num_genes + METAGENE_CHUNK - 1) / METAGENE_CHUNK;
+    job.chunk_moments = calloc(job.num_chunks * chunk_size, sizeof(bin_moments_t));
+    pthread_mutex_init(&job.lock, NULL);
+
+    if (num_threads < 1)
+        num_threads = 1;
+    if ((unsigned long)num_threads > job.num_chunks)
+        num_threads = job.num_chunks;
+
+    // this thread works too
+    threads = malloc(num_threads * sizeof(pthread_t));
+    for (t = 1; t < num_threads; t++)
+        pthread_create(&threads[t], NULL, metagene_profile_worker, &job);
+    metagene_profile_worker(&job);
+    for (t = 1; t < num_threads; t++)
+        pthread_join(threads[t], NULL);
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+
+    // chunks merge in gene order, whichever thread scored them
+    for (c = 0; c < job.num_chunks; c++)
+        for (i = 0; i < chunk_size; i++)
+            bin_moments_merge(&profile->moments[i], &job.chunk_moments[c * chunk_size + i]);
+    free(job.chunk_moments);
+
+    for (g = 0; g < num_genes; g++)
+    {
+        profile->num_genes[0]++;
+        if (genes[g].group >= 0 && genes[g].group + 1 < profile->num_slots)
+            profile->num_genes[genes[g].group + 1]++;
+    }
+}
+
+void metagene_profile_write(const metagene_profile * profile, FILE * out, const char * track_name)
+{
+    int a, s, k;
+
+    for (a = 0; a < METAGENE_ANCHORS; a++)
+        for (s = 0; s < profile->num_slots; s++)
+        {
+            const bin_moments_t * m = profile->moments + ((size_t)a * profile->num_slots + s) * profile->num_bins;
+            char                  group[32];
+
+            if (s == 0)
+                strcpy(group, "all");
+            else
+                sprintf(group, "q%d", s);
+
+            for (k = 0; k < profile->num_bins; k++)
+            {
+                long bin_start = (long)k * profile->bin_size - (long)profile->window;
+
+                fprintf(out, "%s\t%s\t%s\t%ld\t%ld\t%.0f\t%g\t%g\t%g\n",
+                        track_name, anchor_names[a], group, bin_start, bin_start + (long)profile->bin_size - 1,
+                        m[k].n, m[k].mean, m[k].n > 1.0 ? m[k].m2 / (m[k].n - 1.0) : 0.0,
+                        profile->num_genes[s] ? (double)m[k].covered / profile->num_genes[s] : 0.0);
+            }
+        }
+}
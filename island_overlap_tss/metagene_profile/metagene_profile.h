@@ -0,0 +1,53 @@
+/*
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Metagene profile of a track around gene TSSs and TESs.  Each gene's
+ *   window is cut into bins read in the direction of transcription, the
+ *   bin value is the mean of the track records in it (or, for density
+ *   profiles, their sum per base) and every bin keeps the count, mean and
+ *   variance of that value across genes, for all genes and per group.
+ *   Genes are scored in fixed chunks on several threads and the chunks are
+ *   merged in order, so the result doesn't depend on the thread count.
+ *
+ */
+
+#ifndef  METAGENE_PROFILE_H
+#define  METAGENE_PROFILE_H
+
+#include <stdio.h>
+#include "../track_index/track_index.h"
+
+typedef struct
+{
+    int           chromosome;
+    unsigned long tss;
+    unsigned long tes;
+    int           reverse;          // on the minus strand
+    int           group;            // expression quantile from 0, -1 for none
+} metagene_gene_t;
+
+typedef struct metagene_profile metagene_profile;
+
+// bins of bin_size bases from window bases upstream to window bases
+// downstream of each anchor.  Returns NULL unless bin_size divides 2 * window
+metagene_profile * metagene_profile_new(unsigned long window,
+                                        unsigned long bin_size,
+                                        int           num_groups,
+                                        int           density
+                                       );
+
+void metagene_profile_delete(metagene_profile * profile);
+
+// add the genes' bins over track, genes may be in any order
+void metagene_profile_add(metagene_profile *      profile,
+                          const track_index *     track,
+                          const metagene_gene_t * genes,
+                          unsigned long           num_genes,
+                          int                     num_threads
+                         );
+
+// one row per anchor, group and bin:
+// track anchor group bin_start bin_end genes mean variance coverage
+void metagene_profile_write(const metagene_profile * profile, FILE * out, const char * track_name);
+
+#endif
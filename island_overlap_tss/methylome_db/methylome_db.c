@@ -0,0 +1,501 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Pack a text methylome into the chromosome partitioned binary format and
+*   answer interval sums on it through mmap
+*
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "methylome_db.h"
+#include "../record_reader/record_reader.h"
+
+#define METHYLOME_DB_MAGIC      "MTHYLDB1"
+#define METHYLOME_DB_BLOCK_SIZE 64
+#define METHYLOME_DB_QUANTUM    65535.0f
+
+typedef struct
+{
+    char     magic[8];
+    uint32_t block_size;
+    uint32_t num_chromosomes;
+} methylome_db_header_t;
+
+typedef struct
+{
+    int32_t  chromosome;
+    uint32_t num_blocks;
+    uint64_t num_records;
+    uint64_t index_offset;      // from start of file
+    uint64_t data_offset;       // from start of file
+    uint64_t data_length;
+} methylome_db_chromosome_t;
+
+typedef struct
+{
+    uint64_t data_offset;       // from start of the chromosome's data
+    uint64_t quantized_sum;     // of every record in earlier blocks of the chromosome
+    uint32_t first_position;
+    uint32_t num_records;
+} methylome_db_block_t;
+
+struct methylome_db {
+    int                               fd;
+    const unsigned char *             map;
+    size_t                            map_length;
+    const methylome_db_header_t *     header;
+    const methylome_db_chromosome_t * chromosomes;
+};
+
+typedef struct
+{
+    int      chromosome;
+    uint32_t position;
+    float    fraction;
+} methylome_record_t;
+
+typedef struct
+{
+    unsigned char * data;
+    size_t          length;
+    size_t          capacity;
+} byte_buffer_t;
+
+static void byte_buffer_append(byte_buffer_t * buffer, const void * bytes, size_t length)
+{
+    while (buffer->length + length > buffer->capacity)
+    {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 65536;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+static void byte_buffer_append_varint(byte_buffer_t * buffer, uint32_t value)
+{
+    unsigned char bytes[5];
+    size_t        n = 0;
+
+    while (value >= 0x80)
+    {
+        bytes[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[n++] = (unsigned char)value;
+    byte_buffer_append(buffer, bytes, n);
+}
+
+static uint16_t byte_buffer_append_fraction(byte_buffer_t * buffer, float fraction)
+{
+    uint16_t q;
+
+    // methylation is a fraction, anything outside [0, 1] is clamped
+    if (fraction < 0.0f)
+        fraction = 0.0f;
+    if (fraction > 1.0f)
+        fraction = 1.0f;
+    q = (uint16_t)(fraction * METHYLOME_DB_QUANTUM + 0.5f);
+    byte_buffer_append(buffer, &q, sizeof(q));
+    return q;
+}
+
+static int methylome_record_compare(const void * a, const void * b)
+{
+    const methylome_record_t * x = (const methylome_record_t *)a;
+    const methylome_record_t * y = (const methylome_record_t *)b;
+
+    if (x->chromosome != y->chromosome)
+        return x->chromosome < y->chromosome ? -1 : 1;
+    if (x->position != y->position)
+        return x->position < y->position ? -1 : 1;
+    return 0;
+}
+
+int methylome_db_pack(const char * text_db, const char * packed_db)
+{
+    record_reader *             reader;
+    record_view_t               record;
+    FILE *                      packed_file;
+    methylome_record_t *        records;
+    size_t                      num_records = 0, capacity = 1 << 20;
+    int                         chromosome;
+    unsigned long               position;
+    float                       fraction;
+    methylome_db_header_t       header;
+    methylome_db_chromosome_t * chromosomes = NULL;
+    byte_buffer_t *             indexes = NULL, * datas = NULL;
+    uint64_t                    offset;
+    size_t                      i, c;
+    int                         err = 0;
+    static const char           padding[8] = { 0 };
+
+    // gzip / BGZF text is inflated on the fly
+    if ((reader = record_reader_open(text_db)) == NULL)
+    {
+        fprintf(stderr, "Failed to open methylome db file %s\n", text_db);
+        return -1;
+    }
+
+    records = malloc(capacity * sizeof(methylome_record_t));
+    while (record_reader_next(reader, &record))
+    {
+        if (record_parse_track_row(&record, &chromosome, &position, &fraction))
+        {
+            record_reader_reject(reader);
+            continue;
+        }
+        if (position > UINT32_MAX)
+        {
+            fprintf(stderr, "Position %lu on chromosome %d is too large to pack\n", position, chromosome);
+            err = -1;
+            break;
+        }
+        if (num_records == capacity)
+        {
+            capacity *= 2;
+            records = realloc(records, capacity * sizeof(methylome_record_t));
+        }
+        records[num_records].chromosome = chromosome;
+        records[num_records].position   = (uint32_t)position;
+        records[num_records].fraction   = fraction;
+        num_records++;
+    }
+    if (record_reader_close(reader) && !err)
+    {
+        fprintf(stderr, "Methylome db file %s is corrupt or truncated\n", text_db);
+        err = -1;
+    }
+
+    if (err)
+    {
+        free(records);
+        return err;
+    }
+
+    qsort(records, num_records, sizeof(methylome_record_t), methylome_record_compare);
+
+    // encode each chromosome's block index and data
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, METHYLOME_DB_MAGIC, sizeof(header.magic));
+    header.block_size = METHYLOME_DB_BLOCK_SIZE;
+
+    for (i = 0; i < num_records; )
+    {
+        size_t                      first = i;
+        methylome_db_chromosome_t * chr;
+        byte_buffer_t *             index, * data;
+        uint64_t                    quantized_sum = 0;
+
+        c = header.num_chromosomes++;
+        chromosomes = realloc(chromosomes, header.num_chromosomes * sizeof(methylome_db_chromosome_t));
+        indexes     = realloc(indexes, header.num_chromosomes * sizeof(byte_buffer_t));
+        datas       = realloc(datas, header.num_chromosomes * sizeof(byte_buffer_t));
+        chr   = &chromosomes[c];
+        index = memset(&indexes[c], 0, sizeof(byte_buffer_t));
+        data  = memset(&datas[c], 0, sizeof(byte_buffer_t));
+        memset(chr, 0, sizeof(methylome_db_chromosome_t));
+        chr->chromosome = records[first].chromosome;
+
+        while (i < num_records && records[i].chromosome == chr->chromosome)
+        {
+            methylome_db_block_t block;
+            size_t               j;
+
+            block.data_offset    = data->length;
+            block.quantized_sum  = quantized_sum;
+            block.first_position = records[i].position;
+            block.num_records    = 0;
+
+            for (j = 0; j < METHYLOME_DB_BLOCK_SIZE && i < num_records && records[i].chromosome == chr->chromosome; j++, i++)
+            {
+                if (j)
+                    byte_buffer_append_varint(data, records[i].position - records[i - 1].position);
+                quantized_sum += byte_buffer_append_fraction(data, records[i].fraction);
+                block.num_records++;
+            }
+
+            byte_buffer_append(index, &block, sizeof(block));
+            chr->num_blocks++;
+            chr->num_records += block.num_records;
+        }
+        chr->data_length = data->length;
+    }
+    free(records);
+
+    // lay out: header, chromosome table, then index and data per chromosome.
+    // Data is padded so the next block index stays 8 byte aligned in the map.
+    offset = sizeof(header) + header.num_chromosomes * sizeof(methylome_db_chromosome_t);
+    for (c = 0; c < header.num_chromosomes; c++)
+    {
+        chromosomes[c].index_offset = offset;
+        offset += indexes[c].length;
+        chromosomes[c].data_offset = offset;
+        offset += (datas[c].length + 7) & ~(uint64_t)7;
+    }
+
+    if ((packed_file = fopen(packed_db, "wb")) == NULL)
+    {
+        fprintf(stderr, "Failed to create packed methylome db file %s\n", packed_db);
+        err = -1;
+    }
+    else
+    {
+        fwrite(&header, sizeof(header), 1, packed_file);
+        if (header.num_chromosomes)
+            fwrite(chromosomes, sizeof(methylome_db_chromosome_t), header.num_chromosomes, packed_file);
+        for (c = 0; c < header.num_chromosomes; c++)
+        {
+            fwrite(indexes[c].data, 1, indexes[c].length, packed_file);
+            fwrite(datas[c].data, 1, datas[c].length, packed_file);
+            fwrite(padding, 1, ((datas[c].length + 7) & ~(size_t)7) - datas[c].length, packed_file);
+        }
+        if (fclose(packed_file))
+        {
+            fprintf(stderr, "Failed to write packed methylome db file %s\n", packed_db);
+            err = -1;
+        }
+    }
+
+    for (c = 0; c < header.num_chromosomes; c++)
+    {
+        free(indexes[c].data);
+        free(datas[c].data);
+    }
+    free(indexes);
+    free(datas);
+    free(chromosomes);
+
+    return err;
+}
+
+methylome_db * methylome_db_open(const char * packed_db)
+{
+    methylome_db *                    db;
+    const methylome_db_header_t *     header;
+    const methylome_db_chromosome_t * chromosomes;
+    struct stat                       st;
+    void *                            map;
+    uint64_t                          size;
+    uint32_t                          c;
+    int                               fd, valid;
+
+    if ((fd = open(packed_db, O_RDONLY)) < 0)
+        return NULL;
+
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(methylome_db_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // every index and data range must lie in the file, the lookups trust them
+    header      = map;
+    chromosomes = (const methylome_db_chromosome_t *)((const unsigned char *)map + sizeof(methylome_db_header_t));
+    size        = st.st_size;
+    valid = !memcmp(header->magic, METHYLOME_DB_MAGIC, 8) &&
+            sizeof(methylome_db_header_t) + (uint64_t)header->num_chromosomes * sizeof(methylome_db_chromosome_t)
+                <= size;
+    for (c = 0; valid && c < header->num_chromosomes; c++)
+    {
+        const methylome_db_chromosome_t * chr = &chromosomes[c];
+
+        valid = chr->index_offset <= size &&
+                (uint64_t)chr->num_blocks * sizeof(methylome_db_block_t) <= size - chr->index_offset &&
+                chr->data_offset <= size && chr->data_length <= size - chr->data_offset;
+    }
+
+    if (!valid)
+    {
+        munmap(map, st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    db = malloc(sizeof(methylome_db));
+    db->fd          = fd;
+    db->map         = map;
+    db->map_length  = st.st_size;
+    db->header      = header;
+    db->chromosomes = chromosomes;
+
+    return db;
+}
+
+void methylome_db_close(methylome_db * db)
+{
+    if (!db)
+        return;
+    munmap((void *)db->map, db->map_length);
+    close(db->fd);
+    free(db);
+}
+
+static inline uint32_t methylome_db_read_varint(const unsigned char ** p)
+{
+    uint32_t value = 0;
+    int      shift = 0;
+
+    while (**p & 0x80)
+    {
+        value |= (uint32_t)(*(*p)++ & 0x7f) << shift;
+        shift += 7;
+    }
+    value |= (uint32_t)*(*p)++ << shift;
+    return value;
+}
+
+// quantized sum and count of the records at positions below limit, found
+// from the running sum of the last block starting below limit plus a
+// partial decode of that one block
+static uint64_t methylome_db_prefix(const methylome_db *              db,
+                                    const methylome_db_chromosome_t * chr,
+                                    unsigned long                     limit,
+                                    unsigned long *                   count
+                                   )
+{
+    const methylome_db_block_t * blocks = (const methylome_db_block_t *)(db->map + chr->index_offset);
+    const unsigned char *        p;
+    unsigned long                position;
+    uint64_t                     sum;
+    uint32_t                     lo = 0, hi = chr->num_blocks, b, i;
+
+    // strict comparison, a run of equal positions can straddle a block boundary
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (blocks[mid].first_position < limit)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *count = 0;
+    if (lo == 0)
+        return 0;
+
+    b        = lo - 1;
+    sum      = blocks[b].quantized_sum;
+    *count   = (unsigned long)b * db->header->block_size;
+    p        = db->map + chr->data_offset + blocks[b].data_offset;
+    position = blocks[b].first_position;
+
+    for (i = 0; i < blocks[b].num_records; i++)
+    {
+        uint16_t q;
+
+        if (i)
+            position += methylome_db_read_varint(&p);
+        if (position >= limit)
+            break;
+        memcpy(&q, p, sizeof(q));
+        p += sizeof(q);
+        sum += q;
+        (*count)++;
+    }
+
+    return sum;
+}
+
+double methylome_db_sum(const methylome_db * db,
+                        int                  chromosome,
+                        unsigned long        start,
+                        unsigned long        end,
+                        unsigned long *      num_records
+                       )
+{
+    const methylome_db_chromosome_t * chr = NULL;
+    unsigned long                     count_start, count_end;
+    uint64_t                          sum_start, sum_end;
+    uint32_t                          c;
+
+    for (c = 0; c < db->header->num_chromosomes; c++)
+        if (db->chromosomes[c].chromosome == chromosome)
+            chr = &db->chromosomes[c];
+
+    if (num_records)
+        *num_records = 0;
+    if (!chr || chr->num_blocks == 0 || start > end)
+        return 0.0;
+
+    sum_start = methylome_db_prefix(db, chr, start, &count_start);
+    sum_end   = methylome_db_prefix(db, chr, end + 1, &count_end);
+
+    if (num_records)
+        *num_records = count_end - count_start;
+    return (sum_end - sum_start) / (double)METHYLOME_DB_QUANTUM;
+}
+
+unsigned long methylome_db_values(const methylome_db * db,
+                                  int                  chromosome,
+                                  unsigned long        start,
+                                  unsigned long        end,
+                                  float *              values,
+                                  unsigned long        max_values
+                                 )
+{
+    const methylome_db_chromosome_t * chr = NULL;
+    const methylome_db_block_t *      blocks;
+    unsigned long                     n = 0, position;
+    uint32_t                          c, lo, hi, b, i;
+
+    for (c = 0; c < db->header->num_chromosomes; c++)
+        if (db->chromosomes[c].chromosome == chromosome)
+            chr = &db->chromosomes[c];
+    if (!chr || chr->num_blocks == 0 || start > end)
+        return 0;
+
+    // from the last block starting before start, a run of equal positions
+    // can straddle a block boundary
+    blocks = (const methylome_db_block_t *)(db->map + chr->index_offset);
+    for (lo = 0, hi = chr->num_blocks; lo < hi; )
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (blocks[mid].first_position < start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (b = lo ? lo - 1 : 0; b < chr->num_blocks && blocks[b].first_position <= end; b++)
+    {
+        const unsigned char * p = db->map + chr->data_offset + blocks[b].data_offset;
+
+        position = blocks[b].first_position;
+        for (i = 0; i < blocks[b].num_records; i++)
+        {
+            uint16_t q;
+
+            if (i)
+                position += methylome_db_read_varint(&p);
+            if (position > end)
+                return n;
+            memcpy(&q, p, sizeof(q));
+            p += sizeof(q);
+            if (position < start)
+                continue;
+            if (n < max_values)
+                values[n] = q / (float)METHYLOME_DB_QUANTUM;
+            n++;
+        }
+    }
+
+    return n;
+}
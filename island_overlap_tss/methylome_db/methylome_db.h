@@ -0,0 +1,52 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Packed binary methylome, built once from the "chromosome position
+ *   fraction" text db and then read through mmap.
+ *
+ *   header      magic, block size and the per-chromosome table (chromosome,
+ *               record count, offsets of its block index and data)
+ *   block index first position, data offset and running quantized sum
+ *               of each block, binary searched so an interval sum costs two
+ *               lookups and at most two partial block decodes
+ *   data        per block: fraction of the first record, then for each
+ *               further record the varint position delta and its fraction.
+ *               Fractions are quantized to 16 bits over [0, 1].
+ *
+ */
+
+#ifndef  METHYLOME_DB_H
+#define  METHYLOME_DB_H
+
+typedef struct methylome_db methylome_db;
+
+// convert a text methylome db to the packed format, the input doesn't have
+// to be sorted and may be gzip / BGZF compressed.  Returns 0 on success.
+int methylome_db_pack(const char * text_db, const char * packed_db);
+
+// map a packed db, returns NULL if the file can't be read or isn't packed
+methylome_db * methylome_db_open(const char * packed_db);
+
+void methylome_db_close(methylome_db * db);
+
+// sum of methylation fractions at positions in [start, end] (inclusive),
+// num_records receives the number of cytosines summed if not NULL
+double methylome_db_sum(const methylome_db * db,
+                        int                  chromosome,
+                        unsigned long        start,
+                        unsigned long        end,
+                        unsigned long *      num_records
+                       );
+
+// fractions at positions in [start, end] (inclusive) in position order, at
+// most max_values of them stored.  Returns how many there are, which may
+// be more than were stored.
+unsigned long methylome_db_values(const methylome_db * db,
+                                  int                  chromosome,
+                                  unsigned long        start,
+                                  unsigned long        end,
+                                  float *              values,
+                                  unsigned long        max_values
+                                 );
+
+#endif
@@ -0,0 +1,371 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*  score every CpGI against many methylomes in one pass, writing an
+*  island x sample matrix
+*
+*************************************************/
+#include "genometools.h"
+#include "gff3_lite_in_stream/gff3_lite_in_stream_api.h"
+#include "stats_stream/stats_stream_api.h"
+#include "methylome_merge/methylome_merge.h"
+#include "methylome_db/methylome_db.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct
+{
+    char *        name;
+    char *        seqid;
+    int           chromosome;
+    unsigned long start;
+    unsigned long end;
+    unsigned long num_cg;
+} island_t;
+
+typedef struct
+{
+    char *         path;
+    methylome_db * packed;      // packed dbs are summed per island instead of merged
+    int            column;      // into the merged rows for text dbs
+} sample_t;
+
+static const char * island_types[] = { "CpGI", NULL };
+static island_t *   sort_islands;
+
+void usage(const char * name)
+{
+   printf("Usage: %s [--stats] [-j <threads>] <in fileName> <methylome list> <out matrix>\n", name);
+   printf("   the list holds one methylome db per line, text dbs must be sorted by\n");
+   printf("   chromosome and position, packed dbs (see methylome_pack) are also read\n");
+   printf("   islands without a sumcg attribute are written as NA\n");
+}
+
+static int island_compare(const void * a, const void * b)
+{
+    const island_t * x = &sort_islands[*(const unsigned long *)a];
+    const island_t * y = &sort_islands[*(const unsigned long *)b];
+
+    if (x->chromosome != y->chromosome)
+        return x->chromosome < y->chromosome ? -1 : 1;
+    if (x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+    return 0;
+}
+
+static sample_t * read_sample_list(const char * list_path, int * num_samples)
+{
+    FILE *     list_file;
+    sample_t * samples = NULL;
+    char       line[4096];
+    int        capacity = 0;
+
+    *num_samples = 0;
+    if (!(list_file = fopen(list_path, "r")))
+        return NULL;
+
+    while (fgets(line, sizeof(line), list_file))
+    {
+        size_t length = strcspn(line, "\r\n");
+
+        line[length] = '\0';
+        if (length == 0 || line[0] == '#')
+            continue;
+        if (*num_samples == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            samples = realloc(samples, capacity * sizeof(sample_t));
+        }
+        samples[*num_samples].path   = strdup(line);
+        samples[*num_samples].packed = NULL;
+        samples[*num_samples].column = -1;
+        (*num_samples)++;
+    }
+    fclose(list_file);
+
+    return samples;
+}
+
+static island_t * read_islands(GtNodeStream * in, unsigned long * num_islands, GtError * err)
+{
+    island_t *     islands = NULL;
+    unsigned long  capacity = 0;
+    GtGenomeNode * gn;
+    int            had_err;
+
+    *num_islands = 0;
+    while (!(had_err = gt_node_stream_next(in, &gn, err)) && gn)
+    {
+        GtFeatureNode * fn;
+        island_t *      island;
+        const char *    value;
+
+        if (!gt_genome_node_try_cast(gt_feature_node_class(), gn))
+        {
+            gt_genome_node_delete(gn);
+            continue;
+        }
+        fn = gt_feature_node_cast(gn);
+
+        if (*num_islands == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16384;
+            islands = realloc(islands, capacity * sizeof(island_t));
+        }
+        island = &islands[(*num_islands)++];
+
+        // same conventions as CpGI_score_stream
+        island->chromosome = 0;
+        island->seqid = strdup(gt_str_get(gt_genome_node_get_seqid(gn)));
+        sscanf(island->seqid, "Chr%d", &island->chromosome);
+        island->start  = gt_genome_node_get_start(gn);
+        island->end    = gt_genome_node_get_end(gn);
+        island->num_cg = 0;
+        if ((value = gt_feature_node_get_attribute(fn, "sumcg")))
+            sscanf(value, "%lu", &island->num_cg);
+
+        if ((value = gt_feature_node_get_attribute(fn, "ID")))
+            island->name = strdup(value);
+        else
+        {
+            char name[256];
+
+            snprintf(name, sizeof(name), "%s:%lu-%lu", island->seqid, island->start, island->end);
+            island->name = strdup(name);
+        }
+        gt_genome_node_delete(gn);
+    }
+
+    if (had_err)
+    {
+        while (*num_islands)
+        {
+            (*num_islands)--;
+            free(islands[*num_islands].name);
+            free(islands[*num_islands].seqid);
+        }
+        free(islands);
+        return NULL;
+    }
+
+    // NULL is kept for failure, an annotation without islands is still read
+    if (!islands)
+        islands = malloc(sizeof(island_t));
+    return islands;
+}
+
+// sweep the islands along the merged methylomes, adding each position's
+// values to the rows of the islands covering it
+static int sum_islands(methylome_merge * merge,
+                       const island_t *  islands,
+                       unsigned long     num_islands,
+                       double *          sums
+                      )
+{
+    unsigned long * order = malloc((num_islands ? num_islands : 1) * sizeof(unsigned long));
+    unsigned long * active = malloc((num_islands ? num_islands : 1) * sizeof(unsigned long));
+    unsigned long   num_active = 0, next = 0, i, j;
+    int             width = methylome_merge_row_width(merge);
+    int             chromosome, status;
+    unsigned long   position;
+    const double *  values;
+
+    for (i = 0; i < num_islands; i++)
+        order[i] = i;
+    sort_islands = (island_t *)islands;
+    qsort(order, num_islands, sizeof(unsigned long), island_compare);
+
+    while ((status = methylome_merge_next(merge, &chromosome, &position, &values)) == 1)
+    {
+        // islands starting by here join, ones already passed are skipped
+        while (next < num_islands &&
+               (islands[order[next]].chromosome < chromosome ||
+                (islands[order[next]].chromosome == chromosome && islands[order[next]].start <= position)))
+        {
+            if (islands[order[next]].chromosome == chromosome && islands[order[next]].end >= position)
+                active[num_active++] = order[next];
+            next++;
+        }
+
+        for (i = j = 0; i < num_active; i++)
+            if (islands[active[i]].chromosome == chromosome && islands[active[i]].end >= position)
+                active[j++] = active[i];
+        num_active = j;
+
+        for (i = 0; i < num_active; i++)
+            methylome_merge_add_to(merge, sums + active[i] * width);
+    }
+
+    free(order);
+    free(active);
+    return status;
+}
+
+int main(int argc, char ** argv)
+{
+    GtNodeStream *    in;
+    GtError *         err;
+    FILE *            out_file;
+    island_t *        islands;
+    unsigned long     num_islands, i;
+    sample_t *        samples;
+    int               num_samples, num_text = 0, width = 0, s;
+    const char **     text_paths;
+    methylome_merge * merge = NULL;
+    double *          sums = NULL;
+    int               num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int               opt, failed = 0;
+
+    // --stats reports per stage counters as JSON on stderr
+    stream_stats_parse_flag(&argc, argv);
+
+    while ((opt = getopt(argc, argv, "j:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': num_threads = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 3 || num_threads < 1)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+
+    if (!(samples = read_sample_list(argv[optind + 1], &num_samples)) || num_samples == 0)
+    {
+        fprintf(stderr, "Failed to read methylome list %s\n", argv[optind + 1]);
+        exit(1);
+    }
+
+    // packed dbs answer range sums directly, text dbs join the merge.  A
+    // path that isn't a packed db is taken for text, and named by the merge
+    // if it can't be read as that either
+    text_paths = malloc(num_samples * sizeof(char *));
+    for (s = 0; s < num_samples; s++)
+        if (!(samples[s].packed = methylome_db_open(samples[s].path)))
+        {
+            samples[s].column = num_text;
+            text_paths[num_text++] = samples[s].path;
+        }
+
+    // initilaize genometools
+    gt_lib_init();
+    err = gt_error_new();
+
+    // only the islands are needed from the annotation
+    if (!(in = gff3_lite_in_stream_new(argv[optind], island_types, num_threads)))
+    {
+        fprintf(stderr, "Failed to open input stream with arg %s\n", argv[optind]);
+        exit(1);
+    }
+    in = stats_stream_new(in, "gff3_in", NULL);
+
+    if (!(islands = read_islands(in, &num_islands, err)))
+    {
+        fprintf(stderr, "Failed to read islands: %s\n", gt_error_get(err));
+        exit(1);
+    }
+    gt_node_stream_delete(in);
+
+    if (num_text)
+    {
+        const char * error, * error_path;
+
+        if (!(merge = methylome_merge_open(text_paths, num_text, &error_path)))
+        {
+            fprintf(stderr, "Failed to open methylome db file %s\n", error_path);
+            exit(1);
+        }
+        width = methylome_merge_row_width(merge);
+        sums  = methylome_merge_rows_new(merge, num_islands);
+
+        if (sum_islands(merge, islands, num_islands, sums) < 0)
+        {
+            error = methylome_merge_error(merge, &error_path);
+            fprintf(stderr, "Failed to read methylome db file %s: %s\n", error_path, error);
+            failed = 1;
+        }
+        if (methylome_merge_close(merge))
+        {
+            fprintf(stderr, "Methylome db files are corrupt or truncated\n");
+            failed = 1;
+        }
+    }
+
+    if (!failed && !(out_file = fopen(argv[optind + 2], "w")))
+    {
+        fprintf(stderr, "Failed to create output file %s\n", argv[optind + 2]);
+        failed = 1;
+    }
+
+    if (!failed)
+    {
+        fprintf(out_file, "ID\tseqid\tstart\tend");
+        for (s = 0; s < num_samples; s++)
+            fprintf(out_file, "\t%s", samples[s].path);
+        fprintf(out_file, "\n");
+
+        // score is sum(entries in island range) / (num_cg), in the annotation's order,
+        // NA for an island without a sumcg to divide by
+        for (i = 0; i < num_islands; i++)
+        {
+            const island_t * island = &islands[i];
+
+            fprintf(out_file, "%s\t%s\t%lu\t%lu", island->name, island->seqid, island->start, island->end);
+            for (s = 0; s < num_samples; s++)
+            {
+                double sum;
+
+                if (!island->num_cg)
+                {
+                    fprintf(out_file, "\tNA");
+                    continue;
+                }
+                if (samples[s].packed)
+                    sum = methylome_db_sum(samples[s].packed, island->chromosome,
+                                           island->start, island->end, NULL);
+                else
+                    sum = sums[i * width + samples[s].column];
+                fprintf(out_file, "\t%g", sum / (double)island->num_cg);
+            }
+            fprintf(out_file, "\n");
+        }
+
+        if (fclose(out_file))
+        {
+            fprintf(stderr, "Failed to write output file %s\n", argv[optind + 2]);
+            failed = 1;
+        }
+    }
+
+    for (i = 0; i < num_islands; i++)
+    {
+        free(islands[i].name);
+        free(islands[i].seqid);
+    }
+    free(islands);
+    free(sums);
+    for (s = 0; s < num_samples; s++)
+    {
+        methylome_db_close(samples[s].packed);
+        free(samples[s].path);
+    }
+    free(samples);
+    free(text_paths);
+    gt_error_delete(err);
+    gt_lib_clean();
+
+    if (stream_stats_enabled())
+        stream_stats_write_json(stderr);
+    return failed;
+}
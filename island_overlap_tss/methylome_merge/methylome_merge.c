@@ -0,0 +1,382 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   k-way merge of sorted methylome dbs, one cursor per file on a min heap
+*   keyed by chromosome and position
+*
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "methylome_merge.h"
+#include "../compressed_input/compressed_input.h"
+#include "../stream_stats/stream_stats.h"
+
+#define METHYLOME_MERGE_ALIGN (METHYLOME_MERGE_WIDTH * sizeof(double))
+#define MERGE_BUFFER          (1 << 16)     // per cursor, holds many whole lines
+
+typedef double merge_vector_t __attribute__ ((vector_size (METHYLOME_MERGE_ALIGN)));
+
+typedef struct
+{
+    compressed_input * input;
+    FILE *             file;
+    const char *       path;
+    int                sample;
+    int                chromosome;      // current record
+    unsigned long      position;
+    float              fraction;
+    unsigned long long num_records;
+    char *             buffer;          // NUL terminated after length
+    size_t             length;
+    size_t             offset;
+    int                eof;
+} merge_cursor_t;
+
+struct methylome_merge {
+    merge_cursor_t *  cursors;
+    int               num_samples;
+    int               width;
+    merge_cursor_t ** heap;
+    int               heap_size;
+    double *          values;
+    int *             touched;          // samples set in values by the last call
+    int               num_touched;
+    char *            is_touched;
+    const char *      error;
+    const char *      error_path;
+    uint64_t          open_time;
+};
+
+static int merge_cursor_less(const merge_cursor_t * a, const merge_cursor_t * b)
+{
+    if (a->chromosome != b->chromosome)
+        return a->chromosome < b->chromosome;
+    return a->position < b->position;
+}
+
+static void methylome_merge_sift_down(methylome_merge * merge, int i)
+{
+    merge_cursor_t * cursor = merge->heap[i];
+
+    for (;;)
+    {
+        int child = 2 * i + 1;
+
+        if (child >= merge->heap_size)
+            break;
+        if (child + 1 < merge->heap_size && merge_cursor_less(merge->heap[child + 1], merge->heap[child]))
+            child++;
+        if (!merge_cursor_less(merge->heap[child], cursor))
+            break;
+        merge->heap[i] = merge->heap[child];
+        i = child;
+    }
+    merge->heap[i] = cursor;
+}
+
+// the next whole line of the file, NULL at the end
+static char * merge_cursor_line(merge_cursor_t * cursor, char ** line_end)
+{
+    char * line;
+    char * newline;
+
+    while (!(newline = memchr(cursor->buffer + cursor->offset, '\n', cursor->length - cursor->offset)) && !cursor->eof)
+    {
+        size_t n;
+
+        // keep the partial line and top the buffer up behind it
+        memmove(cursor->buffer, cursor->buffer + cursor->offset, cursor->length - cursor->offset);
+        cursor->length -= cursor->offset;
+        cursor->offset = 0;
+        if (cursor->length == MERGE_BUFFER)
+            break;      // a line this long is garbage, let the parser reject it
+        n = fread(cursor->buffer + cursor->length, 1, MERGE_BUFFER - cursor->length, cursor->file);
+        cursor->length += n;
+        cursor->buffer[cursor->length] = '\0';
+        if (n == 0)
+            cursor->eof = 1;
+    }
+
+    if (cursor->offset == cursor->length)
+        return NULL;
+
+    line = cursor->buffer + cursor->offset;
+    *line_end = newline ? newline : cursor->buffer + cursor->length;
+    cursor->offset = *line_end - cursor->buffer + (newline != NULL);
+    return line;
+}
+
+// "chromosome position fraction", the same fields fscanf("%d %lu %f") reads,
+// without its per call overhead.  Returns -1 if the line is malformed
+static int merge_cursor_parse(merge_cursor_t * cursor, char * p, char * line_end)
+{
+    char * end;
+    double fraction = 0.0, scale = 1.0;
+    int    negative = 0;
+
+    // strtol skips newlines too, so check neither ran into the next line
+    cursor->chromosome = (int)strtol(p, &end, 10);
+    if (end == p || end > line_end)
+        return -1;
+    p = end;
+    cursor->position = strtoul(p, &end, 10);
+    if (end == p || end > line_end)
+        return -1;
+
+    // plain decimals are by far the common case
+    for (p = end; p < line_end && (*p == ' ' || *p == '\t'); p++)
+        ;
+    if (p < line_end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    end = p;
+    for (; p < line_end && *p >= '0' && *p <= '9'; p++)
+        fraction = fraction * 10.0 + (*p - '0');
+    if (p < line_end && *p == '.')
+        for (p++; p < line_end && *p >= '0' && *p <= '9'; p++)
+            fraction += (*p - '0') * (scale *= 0.1);
+
+    if (p < line_end && *p != ' ' && *p != '\t' && *p != '\r')
+    {
+        // exponents and the like
+        fraction = strtod(end, &p);
+        negative = 0;
+    }
+    if (p == end)
+        return -1;
+
+    cursor->fraction = (float)(negative ? -fraction : fraction);
+    return 0;
+}
+
+// read the cursor's next record.  Returns 1 for a record, 0 at the end of
+// the file, -1 if the file goes backwards and -2 for a malformed line
+static int merge_cursor_advance(merge_cursor_t * cursor)
+{
+    int           chromosome = cursor->chromosome;
+    unsigned long position = cursor->position;
+    char *        line, * line_end;
+
+    do
+    {
+        if (!(line = merge_cursor_line(cursor, &line_end)))
+            return 0;
+        while (line < line_end && (*line == ' ' || *line == '\t' || *line == '\r'))
+            line++;
+    } while (line == line_end);
+
+    if (merge_cursor_parse(cursor, line, line_end))
+        return -2;
+
+    cursor->num_records++;
+    if (cursor->chromosome < chromosome || (cursor->chromosome == chromosome && cursor->position < position))
+        return -1;
+    return 1;
+}
+
+// every sample can hold a file and a pipe pair open, make sure they fit
+static void methylome_merge_raise_file_limit(int num_samples)
+{
+    struct rlimit limit;
+    rlim_t        wanted = 3 * (rlim_t)num_samples + 64;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) || limit.rlim_cur >= wanted)
+        return;
+    limit.rlim_cur = limit.rlim_max == RLIM_INFINITY || limit.rlim_max > wanted ? wanted : limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+methylome_merge * methylome_merge_open(const char * const * paths, int num_samples, const char ** failed_path)
+{
+    methylome_merge * merge;
+    int               s, i;
+
+    methylome_merge_raise_file_limit(num_samples);
+
+    merge = calloc(1, sizeof(methylome_merge));
+    merge->num_samples = num_samples;
+    merge->width   = (num_samples + METHYLOME_MERGE_WIDTH - 1) / METHYLOME_MERGE_WIDTH * METHYLOME_MERGE_WIDTH;
+    merge->cursors = calloc(num_samples, sizeof(merge_cursor_t));
+    merge->heap    = malloc(num_samples * sizeof(merge_cursor_t *));
+    merge->values  = methylome_merge_rows_new(merge, 1);
+    merge->open_time = stream_stats_now();
+    merge->touched = malloc((num_samples ? num_samples : 1) * sizeof(int));
+    merge->is_touched = calloc(num_samples ? num_samples : 1, 1);
+
+    for (s = 0; s < num_samples; s++)
+    {
+        merge_cursor_t * cursor = &merge->cursors[s];
+
+        // gzip / BGZF text is inflated on the fly
+        if ((cursor->input = compressed_input_open(paths[s])) == NULL)
+        {
+            if (failed_path)
+                *failed_path = paths[s];
+            for (i = 0; i < s; i++)
+            {
+                compressed_input_close(merge->cursors[i].input);
+                free(merge->cursors[i].buffer);
+            }
+            merge->num_samples = 0;
+            methylome_merge_close(merge);
+            return NULL;
+        }
+        cursor->file       = compressed_input_file(cursor->input);
+        cursor->buffer     = malloc(MERGE_BUFFER + 1);
+        cursor->buffer[0]  = '\0';
+        cursor->path       = paths[s];
+        cursor->sample     = s;
+        cursor->chromosome = -1;
+    }
+
+    for (s = 0; s < num_samples; s++)
+    {
+        merge_cursor_t * cursor = &merge->cursors[s];
+        int              status;
+
+        // the first record can't be out of order
+        if ((status = merge_cursor_advance(cursor)) == 1)
+            merge->heap[merge->heap_size++] = cursor;
+        else if (status < 0 && !merge->error)
+        {
+            merge->error      = "malformed record, expected chromosome position fraction";
+            merge->error_path = cursor->path;
+        }
+    }
+    for (i = merge->heap_size / 2 - 1; i >= 0; i--)
+        methylome_merge_sift_down(merge, i);
+
+    return merge;
+}
+
+int methylome_merge_row_width(const methylome_merge * merge)
+{
+    return merge->width;
+}
+
+int methylome_merge_next(methylome_merge * merge,
+                         int *             chromosome,
+                         unsigned long *   position,
+                         const double **   values
+                        )
+{
+    int i;
+
+    // only clear what the last position set, the row is usually sparse
+    for (i = 0; i < merge->num_touched; i++)
+    {
+        merge->values[merge->touched[i]] = 0.0;
+        merge->is_touched[merge->touched[i]] = 0;
+    }
+    merge->num_touched = 0;
+
+    if (merge->error || merge->heap_size == 0)
+        return merge->error ? -1 : 0;
+
+    *chromosome = merge->heap[0]->chromosome;
+    *position   = merge->heap[0]->position;
+    *values     = merge->values;
+
+    // pop every cursor at this position, a file repeating a position adds up
+    while (merge->heap_size &&
+           merge->heap[0]->chromosome == *chromosome && merge->heap[0]->position == *position)
+    {
+        merge_cursor_t * cursor = merge->heap[0];
+        int              status;
+
+        if (!merge->is_touched[cursor->sample])
+        {
+            merge->is_touched[cursor->sample] = 1;
+            merge->touched[merge->num_touched++] = cursor->sample;
+        }
+        merge->values[cursor->sample] += cursor->fraction;
+
+        if ((status = merge_cursor_advance(cursor)) == 1)
+        {
+            methylome_merge_sift_down(merge, 0);
+            continue;
+        }
+        if (status < 0 && !merge->error)
+        {
+            merge->error      = status == -1 ? "positions are not sorted by chromosome and position" :
+                                               "malformed record, expected chromosome position fraction";
+            merge->error_path = cursor->path;
+        }
+        merge->heap[0] = merge->heap[--merge->heap_size];
+        if (merge->heap_size)
+            methylome_merge_sift_down(merge, 0);
+    }
+
+    return 1;
+}
+
+double * methylome_merge_rows_new(const methylome_merge * merge, unsigned long num_rows)
+{
+    void * rows;
+    size_t size = num_rows * merge->width * sizeof(double);
+
+    if (posix_memalign(&rows, METHYLOME_MERGE_ALIGN, size ? size : METHYLOME_MERGE_ALIGN))
+        return NULL;
+    memset(rows, 0, size);
+    return rows;
+}
+
+void methylome_merge_add_to(const methylome_merge * merge, double * sums)
+{
+    const merge_vector_t * values = (const merge_vector_t *)merge->values;
+    merge_vector_t *       vector_sums = (merge_vector_t *)sums;
+    int                    i;
+
+    // a few samples are cheaper to add one by one than the whole row
+    if (merge->num_touched * METHYLOME_MERGE_WIDTH < merge->width)
+    {
+        for (i = 0; i < merge->num_touched; i++)
+            sums[merge->touched[i]] += merge->values[merge->touched[i]];
+        return;
+    }
+
+    for (i = 0; i < merge->width / METHYLOME_MERGE_WIDTH; i++)
+        vector_sums[i] += values[i];
+}
+
+const char * methylome_merge_error(const methylome_merge * merge, const char ** path)
+{
+    if (path)
+        *path = merge->error_path;
+    return merge->error;
+}
+
+int methylome_merge_close(methylome_merge * merge)
+{
+    int s, failed = 0;
+
+    if (!merge)
+        return 0;
+
+    for (s = 0; s < merge->num_samples; s++)
+    {
+        // the files are read side by side, so each is charged the whole merge
+        stream_stats_file_parsed(merge->cursors[s].path, merge->cursors[s].num_records,
+                                 (stream_stats_now() - merge->open_time) / 1e9);
+        if (compressed_input_close(merge->cursors[s].input))
+        {
+            fprintf(stderr, "methylome_merge: %s is corrupt or truncated\n", merge->cursors[s].path);
+            failed = 1;
+        }
+        free(merge->cursors[s].buffer);
+    }
+
+    free(merge->cursors);
+    free(merge->heap);
+    free(merge->values);
+    free(merge->touched);
+    free(merge->is_touched);
+    free(merge);
+    return failed;
+}
@@ -0,0 +1,53 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Walk several sorted "chromosome position fraction" methylome dbs at
+ *   once.  Each file is read sequentially through its own cursor and the
+ *   cursors are merged on a heap, so every position comes out once with
+ *   the fraction of each sample side by side, ready to be added to a row
+ *   of per sample sums.  Plain and gzip / BGZF compressed files are read.
+ *
+ */
+
+#ifndef  METHYLOME_MERGE_H
+#define  METHYLOME_MERGE_H
+
+// values rows are padded to a multiple of this, so they can be added a
+// vector at a time
+#define METHYLOME_MERGE_WIDTH 4
+
+typedef struct methylome_merge methylome_merge;
+
+// returns NULL if any of the files can't be read, failed_path (if not
+// NULL) then receives the first of them
+methylome_merge * methylome_merge_open(const char * const * paths, int num_samples, const char ** failed_path);
+
+// number of doubles in a values row, num_samples rounded up to the width
+int methylome_merge_row_width(const methylome_merge * merge);
+
+// advance to the next position present in any sample.  values[s] is the
+// fraction of sample s there, or 0 if it has none; the row stays valid
+// until the next call.  Returns 1 for a position, 0 once every file is
+// done and -1 on error (see methylome_merge_error).
+int methylome_merge_next(methylome_merge * merge,
+                         int *             chromosome,
+                         unsigned long *   position,
+                         const double **   values
+                        );
+
+// zeroed rows of per sample sums, aligned for methylome_merge_add_to.
+// Release with free()
+double * methylome_merge_rows_new(const methylome_merge * merge, unsigned long num_rows);
+
+// add the values at the current position to a row of sums, a vector of
+// samples at a time
+void methylome_merge_add_to(const methylome_merge * merge, double * sums);
+
+// the path and reason of the first failure, NULL if there was none
+const char * methylome_merge_error(const methylome_merge * merge, const char ** path);
+
+// returns non-zero if a compressed file turned out to be corrupt, each
+// such file is named on stderr
+int methylome_merge_close(methylome_merge * merge);
+
+#endif
@@ -0,0 +1,37 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*  convert a text methylome db to the packed binary format read by island_score
+*
+*************************************************/
+#include "methylome_db/methylome_db.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+void usage(const char * name)
+{
+   printf("Usage: %s <methylome db> <packed methylome db>\n", name);
+}
+
+
+int main(int argc, char ** argv)
+{
+    if (argc != 3)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+
+    if (methylome_db_pack(argv[1], argv[2]))
+    {
+        fprintf(stderr, "Failed to pack methylome db %s\n", argv[1]);
+        exit(1);
+    }
+
+    return 0;
+}
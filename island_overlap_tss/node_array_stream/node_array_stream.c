@@ -0,0 +1,82 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Hand out the nodes of an array one at a time
+*
+*
+*************************************************/
+#include <genometools.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "node_array_stream.h"
+
+
+struct node_array_stream {
+    const GtNodeStream parent_instance;
+    GtGenomeNode ** nodes;
+    unsigned long   num_nodes;
+    unsigned long   next_node;
+};
+
+
+const GtNodeStreamClass * node_array_stream_class(void);
+
+#define node_array_stream_cast(GS) gt_node_stream_cast(node_array_stream_class(), GS);
+
+static int node_array_stream_next(GtNodeStream * ns,
+                                  GtGenomeNode ** gn,
+                                  GtError * err)
+{
+    node_array_stream * array_stream;
+
+    gt_error_check(err);
+    array_stream = node_array_stream_cast(ns);
+
+    // ownership of each node passes on as it is handed out
+    *gn = NULL;
+    if (array_stream->next_node < array_stream->num_nodes)
+        *gn = array_stream->nodes[array_stream->next_node++];
+
+    return 0;
+}
+
+static void node_array_stream_free(GtNodeStream * ns)
+{
+    node_array_stream * array_stream;
+    
+    array_stream = node_array_stream_cast(ns);
+    while (array_stream->next_node < array_stream->num_nodes)
+        gt_genome_node_delete(array_stream->nodes[array_stream->next_node++]);
+    return;
+}
+
+const GtNodeStreamClass * node_array_stream_class(void)
+{
+    static const GtNodeStreamClass * c = NULL;
+
+    if (!c)
+    {	
+        c = gt_node_stream_class_new( sizeof(node_array_stream),
+                                      node_array_stream_free,
+                                      node_array_stream_next
+                                    );
+    }
+    
+    return c;
+}
+
+GtNodeStream * node_array_stream_new(GtGenomeNode ** nodes, unsigned long num_nodes, bool sorted)
+{
+    GtNodeStream * ns = gt_node_stream_create(node_array_stream_class(), 
+                                              sorted);
+    node_array_stream * array_stream = node_array_stream_cast(ns);
+    array_stream->nodes     = nodes;
+    array_stream->num_nodes = num_nodes;
+    array_stream->next_node = 0;
+
+    return ns;
+}
@@ -0,0 +1,9 @@
+
+#ifndef NODE_ARRAY_STREAM_H
+#define NODE_ARRAY_STREAM_H
+
+#include "node_array_stream_api.h"
+
+const GtNodeStreamClass * node_array_stream_class(void);
+
+#endif
@@ -0,0 +1,18 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Replay an array of genome nodes as a node stream, used to feed a
+ *   buffered block of the annotation through an ordinary stream chain.
+ *
+ */
+
+#ifndef  NODE_ARRAY_STREAM_API_H
+#define  NODE_ARRAY_STREAM_API_H
+
+typedef struct node_array_stream node_array_stream;
+
+// the stream takes over the nodes it has not handed out yet, the array
+// itself stays with the caller and must outlive the stream
+GtNodeStream* node_array_stream_new(GtGenomeNode ** nodes, unsigned long num_nodes, bool sorted);
+
+#endif
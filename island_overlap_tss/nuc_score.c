@@ -0,0 +1,112 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*  score the CpGI based upon nucleosome density
+*
+*************************************************/
+#include "genometools.h"	
+#include "island_nuc_score_stream/island_nuc_score_stream_api.h"
+#include "stats_stream/stats_stream_api.h"
+#include "gff3_lite_in_stream/gff3_lite_in_stream_api.h"
+#include "gff3_fast_out_stream/gff3_fast_out_stream_api.h"
+#include <stdio.h>
+#include <unistd.h>
+
+
+// the only rows the stream looks at, see --fast
+static const char * fast_types[] = { "CpGI", NULL };
+
+void usage(const char * name)
+{
+   printf("Usage: %s [--stats] [--fast] [--fast-out] <in fileName> <out fileName> <nucleosome db>\n", name);
+   printf("   --fast reads only the islands of the annotation, on several threads\n");
+   printf("   --fast-out writes through a buffered writer, scores in full precision\n");
+}
+
+
+int main(int argc, char ** argv)
+{
+    GtNodeStream * in, * score, * out;
+    GtFile * out_file = NULL;
+    GtError * err;
+    int fast, fast_out;
+
+    // --stats reports per stage counters as JSON on stderr
+    stream_stats_parse_flag(&argc, argv);
+    fast = gff3_lite_in_stream_parse_flag(&argc, argv);
+    fast_out = gff3_fast_out_stream_parse_flag(&argc, argv);
+
+    if (argc != 4)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+
+    // initilaize genometools
+    gt_lib_init();
+    err = gt_error_new();
+
+    if (fast)
+        in = gff3_lite_in_stream_new(argv[1], fast_types, sysconf(_SC_NPROCESSORS_ONLN));
+    else
+        in = gt_gff3_in_stream_new_sorted(argv[1]);
+
+    if (!in)
+    {
+        fprintf(stderr, "Failed to open input stream with arg %s\n", argv[1]);
+        exit(1);
+    }
+
+    in = stats_stream_new(in, "gff3_in", NULL);
+
+    if (!fast_out && !(out_file = gt_file_new(argv[2], "w+", err)))
+    {
+        gt_node_stream_delete(in);
+        fprintf(stderr, "Failed to create output file %s\n", argv[2]);
+        exit(1);
+    }
+
+    if (!(score = island_nuc_score_stream_new(in, argv[3])))
+    {
+        gt_file_delete(out_file);
+        gt_node_stream_delete(in);
+        fprintf(stderr, "Failed to create nucleosome score stream\n");
+        exit(1);
+    }
+
+    score = stats_stream_new(score, "island_nuc_score", island_nuc_score_stream_num_scored);
+
+    out = fast_out ? gff3_fast_out_stream_new(score, argv[2], 1)
+                   : gt_gff3_out_stream_new(score, out_file);
+    if (!out)
+    {
+        gt_node_stream_delete(score);
+        gt_file_delete(out_file);
+        gt_node_stream_delete(in);
+        fprintf(stderr, "Failed to create output stream\n");
+        exit(1);
+    }
+    out = stats_stream_new(out, "gff3_out", NULL);
+
+    if (gt_node_stream_pull(out, err))
+    {
+        fprintf(stderr, "Failed to pull through out stream\n");
+    }
+
+    // close genome tools
+    gt_node_stream_delete(out);
+    gt_node_stream_delete(score);
+    gt_file_delete(out_file);
+    gt_node_stream_delete(in);
+    gt_error_delete(err);
+    gt_lib_clean();
+
+    // the stages report their scored counts as they are deleted
+    if (stream_stats_enabled())
+        stream_stats_write_json(stderr);
+    return 0;
+}
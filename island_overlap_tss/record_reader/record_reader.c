@@ -0,0 +1,354 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Split mapped or inflated text into records a line at a time, and parse
+*   their numeric fields by hand
+*
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "record_reader.h"
+#include "../compressed_input/compressed_input.h"
+#include "../stream_stats/stream_stats.h"
+
+#define RECORD_READER_BLOCK (4 << 20)   // bytes of inflated text read at once
+
+struct record_reader {
+    const char *       text;        // mapped file, or buffer
+    size_t             length;
+    size_t             offset;      // start of the next line
+    unsigned long      line;
+    unsigned long      num_rejected;
+    int                mapped;
+
+    compressed_input * input;       // compressed files only
+    FILE *             file;
+    char *             buffer;
+    size_t             capacity;
+    int                eof;
+
+    char *             path;
+};
+
+// exact powers of ten for floats, see record_parse_float
+static const float record_float_powers[] =
+{
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+#define RECORD_FLOAT_MAX_POWER    10
+#define RECORD_FLOAT_MAX_MANTISSA (1u << 24)
+
+
+record_reader * record_reader_open(const char * path)
+{
+    record_reader * reader;
+    unsigned char   magic[2];
+    struct stat     file_info;
+    int             fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &file_info) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    reader = calloc(1, sizeof(record_reader));
+    reader->path = strdup(path);
+
+    // plain files are read in place
+    if (S_ISREG(file_info.st_mode) &&
+        (file_info.st_size == 0 ||
+         file_info.st_size < 2 || read(fd, magic, 2) != 2 || magic[0] != 0x1f || magic[1] != 0x8b))
+    {
+        if (file_info.st_size > 0)
+        {
+            void * text = mmap(NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (text == MAP_FAILED)
+            {
+                close(fd);
+                free(reader->path);
+                free(reader);
+                return NULL;
+            }
+            madvise(text, file_info.st_size, MADV_SEQUENTIAL);
+            reader->text   = text;
+            reader->length = file_info.st_size;
+            reader->mapped = 1;
+        }
+        reader->eof = 1;
+        close(fd);
+        return reader;
+    }
+    close(fd);
+
+    // gzip / BGZF text is inflated on the fly
+    if ((reader->input = compressed_input_open(path)) == NULL)
+    {
+        free(reader->path);
+        free(reader);
+        return NULL;
+    }
+    reader->file     = compressed_input_file(reader->input);
+    reader->capacity = RECORD_READER_BLOCK;
+    reader->buffer   = malloc(reader->capacity);
+    reader->text     = reader->buffer;
+    return reader;
+}
+
+// keep the partial line at the end of the buffer and read more behind it,
+// returns 0 once there is nothing left to read
+static int record_reader_fill(record_reader * reader)
+{
+    size_t n;
+
+    if (reader->eof)
+        return 0;
+
+    reader->length -= reader->offset;
+    memmove(reader->buffer, reader->buffer + reader->offset, reader->length);
+    reader->offset = 0;
+
+    // a line longer than the buffer gets a bigger one
+    if (reader->length == reader->capacity)
+    {
+        reader->capacity *= 2;
+        reader->buffer    = realloc(reader->buffer, reader->capacity);
+        reader->text      = reader->buffer;
+    }
+
+    n = fread(reader->buffer + reader->length, 1, reader->capacity - reader->length, reader->file);
+    reader->length += n;
+    if (n == 0)
+        reader->eof = 1;
+    return n != 0;
+}
+
+// the first space or tab in [p, end), or end.  Eight bytes are tested at
+// once: a byte of x ^ blank is zero only where the text matches
+static const char * record_find_blank(const char * p, const char * end)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint64_t ones   = 0x0101010101010101ull;
+    const uint64_t highs  = 0x8080808080808080ull;
+    const uint64_t spaces = ones * ' ';
+    const uint64_t tabs   = ones * '\t';
+
+    while (end - p >= 8)
+    {
+        uint64_t word, s, t, hits;
+
+        memcpy(&word, p, sizeof(word));
+        s    = word ^ spaces;
+        t    = word ^ tabs;
+        hits = ((s - ones) & ~s & highs) | ((t - ones) & ~t & highs);
+
+        // borrows only flag bytes after a real match, so the lowest is one
+        if (hits)
+            return p + (__builtin_ctzll(hits) >> 3);
+        p += 8;
+    }
+#endif
+    while (p < end && *p != ' ' && *p != '\t')
+        p++;
+    return p;
+}
+
+int record_reader_next(record_reader * reader, record_view_t * record)
+{
+    for (;;)
+    {
+        const char * line, * line_end, * text_end, * p;
+
+        if (reader->offset == reader->length && !record_reader_fill(reader))
+            return 0;
+        line     = reader->text + reader->offset;
+        text_end = reader->text + reader->length;
+
+        if (!(line_end = memchr(line, '\n', text_end - line)))
+        {
+            // read on for the rest of the line, the last may lack its newline
+            if (record_reader_fill(reader))
+                continue;
+            line     = reader->text + reader->offset;
+            line_end = text_end = reader->text + reader->length;
+        }
+        reader->offset = line_end - reader->text + (line_end < text_end);
+        reader->line++;
+
+        if (line_end > line && line_end[-1] == '\r')
+            line_end--;
+
+        record->num_fields = 0;
+        for (p = line; record->num_fields < RECORD_READER_MAX_FIELDS; )
+        {
+            const char * field_end;
+
+            while (p < line_end && (*p == ' ' || *p == '\t'))
+                p++;
+            if (p == line_end)
+                break;
+            field_end = record_find_blank(p, line_end);
+            record->fields[record->num_fields]  = p;
+            record->lengths[record->num_fields] = field_end - p;
+            record->num_fields++;
+            p = field_end;
+        }
+
+        if (record->num_fields && record->fields[0][0] != '#')
+        {
+            record->line = reader->line;
+            return 1;
+        }
+    }
+}
+
+void record_reader_reject(record_reader * reader)
+{
+    reader->num_rejected++;
+}
+
+int record_reader_close(record_reader * reader)
+{
+    int failed = 0;
+
+    if (!reader)
+        return 0;
+
+    if (reader->num_rejected)
+        fprintf(stderr, "%s: skipped %lu malformed rows\n", reader->path, reader->num_rejected);
+
+    if (reader->input)
+    {
+        failed = ferror(reader->file) != 0;
+        failed |= compressed_input_close(reader->input);
+        free(reader->buffer);
+    }
+    else
+    {
+        stream_stats_file_read(reader->path, reader->length, reader->length);
+        if (reader->mapped)
+            munmap((void *)reader->text, reader->length);
+    }
+
+    free(reader->path);
+    free(reader);
+    return failed;
+}
+
+// digits only, -1 on anything else or overflow
+static int record_parse_digits(const char * p, const char * end, unsigned long * value)
+{
+    unsigned long n = 0;
+
+    if (p == end)
+        return -1;
+    for (; p < end; p++)
+    {
+        unsigned int digit = (unsigned char)*p - '0';
+
+        if (digit > 9 || n > (ULONG_MAX - digit) / 10)
+            return -1;
+        n = n * 10 + digit;
+    }
+    *value = n;
+    return 0;
+}
+
+int record_parse_int(const char * field, unsigned int length, int * value)
+{
+    const char *  end = field + length;
+    unsigned long n;
+    int           negative = 0;
+
+    if (field < end && (*field == '-' || *field == '+'))
+        negative = *field++ == '-';
+    if (record_parse_digits(field, end, &n) || n > (unsigned long)INT_MAX + negative)
+        return -1;
+    *value = negative ? (int)(-(long)n) : (int)n;
+    return 0;
+}
+
+int record_parse_ulong(const char * field, unsigned int length, unsigned long * value)
+{
+    const char * end = field + length;
+
+    if (field < end && *field == '+')
+        field++;
+    return record_parse_digits(field, end, value);
+}
+
+int record_parse_float(const char * field, unsigned int length, float * value)
+{
+    const char * p = field, * end = field + length;
+    char         text[64];
+    char *       text_end;
+    uint32_t     mantissa = 0;
+    int          negative = 0, num_digits = 0, decimals = 0, seen_point = 0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    // a plain decimal with few enough digits is the quotient of two floats
+    // that hold them exactly, so one division rounds it as strtof would
+    for (; p < end; p++)
+    {
+        unsigned int digit = (unsigned char)*p - '0';
+
+        if (digit <= 9)
+        {
+            if (mantissa * 10 + digit > RECORD_FLOAT_MAX_MANTISSA)
+                break;
+            mantissa = mantissa * 10 + digit;
+            num_digits++;
+            decimals += seen_point;
+        }
+        else if (*p == '.' && !seen_point)
+            seen_point = 1;
+        else
+            break;
+    }
+    if (p == end && num_digits && decimals <= RECORD_FLOAT_MAX_POWER)
+    {
+        float f = (float)mantissa / record_float_powers[decimals];
+        *value = negative ? -f : f;
+        return 0;
+    }
+
+    // exponents, long fractions, nan, inf
+    if (length == 0 || length >= sizeof(text))
+        return -1;
+    memcpy(text, field, length);
+    text[length] = '\0';
+    *value = strtof(text, &text_end);
+    return text_end == text + length ? 0 : -1;
+}
+
+int record_parse_track_row(const record_view_t * record,
+                           int *                 chromosome,
+                           unsigned long *       position,
+                           float *               value
+                          )
+{
+    if (record->num_fields < 3 ||
+        record_parse_int(record->fields[0], record->lengths[0], chromosome) ||
+        record_parse_ulong(record->fields[1], record->lengths[1], position) ||
+        record_parse_float(record->fields[2], record->lengths[2], value))
+        return -1;
+    return 0;
+}
@@ -0,0 +1,55 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Blank separated text records for the db loaders, in place of fscanf.
+ *   Plain files are mapped and read where they lie; gzip / BGZF files are
+ *   inflated into large blocks.  Each line comes back as a view of its
+ *   fields pointing into that text, which the parsers below turn into
+ *   numbers without copying, locale lookups or FILE locks.
+ *
+ */
+
+#ifndef  RECORD_READER_H
+#define  RECORD_READER_H
+
+#define RECORD_READER_MAX_FIELDS 8     // fields after these are not split off
+
+typedef struct record_reader record_reader;
+
+// one line, valid until the next call.  Fields are not NUL terminated
+typedef struct
+{
+    const char *  fields[RECORD_READER_MAX_FIELDS];
+    unsigned int  lengths[RECORD_READER_MAX_FIELDS];
+    int           num_fields;
+    unsigned long line;             // 1 based
+} record_view_t;
+
+// returns NULL if the file can't be read
+record_reader * record_reader_open(const char * path);
+
+// the next line with any fields, blank lines and lines starting with #
+// are skipped.  Returns 1 for a record and 0 at the end of the text
+int record_reader_next(record_reader * reader, record_view_t * record);
+
+// count the last record as malformed, close warns of how many there were
+void record_reader_reject(record_reader * reader);
+
+// returns non-zero if the file couldn't be read to the end or the
+// compressed data was corrupt or truncated
+int record_reader_close(record_reader * reader);
+
+// the whole field as a number, these return -1 if it is anything else
+int record_parse_int(const char * field, unsigned int length, int * value);
+int record_parse_ulong(const char * field, unsigned int length, unsigned long * value);
+int record_parse_float(const char * field, unsigned int length, float * value);
+
+// the "chromosome position value" rows of the track dbs, -1 if the first
+// three fields aren't those
+int record_parse_track_row(const record_view_t * record,
+                           int *                 chromosome,
+                           unsigned long *       position,
+                           float *               value
+                          );
+
+#endif
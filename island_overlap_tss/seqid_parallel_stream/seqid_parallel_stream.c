@@ -0,0 +1,357 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Pull a stream chain per seqid on worker threads, emitting the results
+*   in input order through a reorder buffer
+*
+*
+*************************************************/
+#include <genometools.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "seqid_parallel_stream.h"
+#include "../node_array_stream/node_array_stream_api.h"
+
+
+// every node of one seqid, the chain scoring them and what came out of it.
+// A partition is only touched by its worker until done is set, after that
+// only by the thread pulling the parallel stream.
+typedef struct
+{
+    GtGenomeNode ** nodes;
+    unsigned long   num_nodes;
+    GtNodeStream *  source;
+    GtNodeStream *  stages[SEQID_PARALLEL_MAX_STAGES];
+    int             num_stages;
+
+    GtGenomeNode ** output;
+    unsigned long   num_output;
+    unsigned long   output_capacity;
+    unsigned long   num_emitted;
+    GtError *       err;
+    int             had_err;
+    int             done;
+} seqid_partition_t;
+
+struct seqid_parallel_stream {
+    const GtNodeStream parent_instance;
+    GtNodeStream *            in_stream;
+    seqid_parallel_build_func build;
+    void *                    data;
+
+    GtGenomeNode *            lookahead;    // first node of the next partition
+    int                       input_done;
+
+    // partitions are queued in input order, [emit_partition, num_partitions)
+    // are still buffered and [next_partition, num_partitions) still waiting
+    // for a worker
+    seqid_partition_t **      partitions;
+    unsigned long             num_partitions;
+    unsigned long             partitions_capacity;
+    unsigned long             next_partition;
+    unsigned long             emit_partition;
+    unsigned long             max_buffered;
+
+    pthread_t *               threads;
+    int                       num_threads;
+    int                       threads_started;
+    int                       finished;
+    pthread_mutex_t           lock;
+    pthread_cond_t            work_available;
+    pthread_cond_t            partition_done;
+};
+
+
+const GtNodeStreamClass * seqid_parallel_stream_class(void);
+
+#define seqid_parallel_stream_cast(GS) gt_node_stream_cast(seqid_parallel_stream_class(), GS);
+
+static void seqid_parallel_stream_run_partition(seqid_partition_t * partition)
+{
+    GtNodeStream * last;
+    GtGenomeNode * gn;
+
+    last = partition->num_stages ? partition->stages[partition->num_stages - 1] : partition->source;
+
+    while (!(partition->had_err = gt_node_stream_next(last, &gn, partition->err)) && gn)
+    {
+        if (partition->num_output == partition->output_capacity)
+        {
+            partition->output_capacity = partition->output_capacity ? partition->output_capacity * 2 : 1024;
+            partition->output = realloc(partition->output, partition->output_capacity * sizeof(GtGenomeNode *));
+        }
+        partition->output[partition->num_output++] = gn;
+    }
+}
+
+static void * seqid_parallel_stream_worker(void * arg)
+{
+    seqid_parallel_stream * context = arg;
+    seqid_partition_t *     partition;
+
+    pthread_mutex_lock(&context->lock);
+    for (;;)
+    {
+        while (context->next_partition == context->num_partitions && !context->finished)
+            pthread_cond_wait(&context->work_available, &context->lock);
+        if (context->next_partition == context->num_partitions)
+            break;
+
+        partition = context->partitions[context->next_partition++];
+        pthread_mutex_unlock(&context->lock);
+
+        seqid_parallel_stream_run_partition(partition);
+
+        pthread_mutex_lock(&context->lock);
+        partition->done = 1;
+        pthread_cond_broadcast(&context->partition_done);
+    }
+    pthread_mutex_unlock(&context->lock);
+
+    return NULL;
+}
+
+static void seqid_parallel_stream_free_partition(seqid_partition_t * partition)
+{
+    int i;
+
+    // every stage drops its reference to the one before it
+    for (i = partition->num_stages - 1; i >= 0; i--)
+        gt_node_stream_delete(partition->stages[i]);
+    gt_node_stream_delete(partition->source);
+
+    while (partition->num_emitted < partition->num_output)
+        gt_genome_node_delete(partition->output[partition->num_emitted++]);
+
+    gt_error_delete(partition->err);
+    free(partition->output);
+    free(partition->nodes);
+    free(partition);
+}
+
+// read the next run of nodes sharing a seqid and queue it for the workers.
+// Nodes without a seqid (comments and such) stay with the run they are in.
+static int seqid_parallel_stream_read_partition(seqid_parallel_stream * context,
+                                                GtError * err)
+{
+    seqid_partition_t * partition;
+    GtGenomeNode **     nodes = NULL;
+    unsigned long       num_nodes = 0, capacity = 0;
+    GtStr *             seqid = NULL;
+    GtStr *             node_seqid;
+    GtGenomeNode *      gn;
+    int                 had_err = 0;
+
+    for (;;)
+    {
+        if (context->lookahead)
+        {
+            gn = context->lookahead;
+            context->lookahead = NULL;
+        }
+        else if ((had_err = gt_node_stream_next(context->in_stream, &gn, err)) || !gn)
+        {
+            context->input_done = 1;
+            break;
+        }
+
+        if ((node_seqid = gt_genome_node_get_seqid(gn)))
+        {
+            if (!seqid)
+                seqid = node_seqid;
+            else if (gt_str_cmp(seqid, node_seqid))
+            {
+                context->lookahead = gn;
+                break;
+            }
+        }
+
+        if (num_nodes == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            nodes = realloc(nodes, capacity * sizeof(GtGenomeNode *));
+        }
+        nodes[num_nodes++] = gn;
+    }
+
+    if (had_err || !num_nodes)
+    {
+        while (num_nodes)
+            gt_genome_node_delete(nodes[--num_nodes]);
+        free(nodes);
+        return had_err;
+    }
+
+    partition = calloc(1, sizeof(seqid_partition_t));
+    partition->nodes     = nodes;
+    partition->num_nodes = num_nodes;
+    partition->err       = gt_error_new();
+    partition->source    = node_array_stream_new(nodes, num_nodes,
+                                                 gt_node_stream_is_sorted(context->in_stream));
+
+    // stream classes are set up lazily, so chains are only built here
+    partition->num_stages = context->build(partition->source, partition->stages,
+                                           SEQID_PARALLEL_MAX_STAGES, context->data);
+    if (partition->num_stages < 0)
+    {
+        partition->num_stages = 0;
+        seqid_parallel_stream_free_partition(partition);
+        gt_error_set(err, "failed to build the stream chain for a sequence");
+        return -1;
+    }
+
+    pthread_mutex_lock(&context->lock);
+    if (context->num_partitions == context->partitions_capacity)
+    {
+        context->partitions_capacity = context->partitions_capacity ? context->partitions_capacity * 2 : 64;
+        context->partitions = realloc(context->partitions,
+                                      context->partitions_capacity * sizeof(seqid_partition_t *));
+    }
+    context->partitions[context->num_partitions++] = partition;
+    pthread_cond_signal(&context->work_available);
+    pthread_mutex_unlock(&context->lock);
+
+    return 0;
+}
+
+static int seqid_parallel_stream_next(GtNodeStream * ns,
+                                      GtGenomeNode ** gn,
+                                      GtError * err)
+{
+    seqid_parallel_stream * context;
+    seqid_partition_t *     partition;
+    int                     i, done, had_err;
+
+    context = seqid_parallel_stream_cast(ns);
+    *gn = NULL;
+
+    if (!context->threads_started)
+    {
+        context->threads_started = 1;
+        for (i = 0; i < context->num_threads; i++)
+            pthread_create(&context->threads[i], NULL, seqid_parallel_stream_worker, context);
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&context->lock);
+        partition = context->emit_partition < context->num_partitions
+                  ? context->partitions[context->emit_partition] : NULL;
+        done = partition && partition->done;
+        pthread_mutex_unlock(&context->lock);
+
+        if (done)
+        {
+            if (partition->had_err)
+            {
+                gt_error_set(err, "%s", gt_error_get(partition->err));
+                return partition->had_err;
+            }
+            if (partition->num_emitted < partition->num_output)
+            {
+                *gn = partition->output[partition->num_emitted++];
+                return 0;
+            }
+
+            // drained, the chain is idle so it can go now
+            seqid_parallel_stream_free_partition(partition);
+            context->partitions[context->emit_partition++] = NULL;
+            continue;
+        }
+
+        // keep the workers fed, but don't read the whole annotation ahead
+        if (!context->input_done
+            && context->num_partitions - context->emit_partition < context->max_buffered)
+        {
+            if ((had_err = seqid_parallel_stream_read_partition(context, err)))
+                return had_err;
+            continue;
+        }
+
+        if (!partition)
+            return 0;   // everything has been emitted
+
+        pthread_mutex_lock(&context->lock);
+        while (!partition->done)
+            pthread_cond_wait(&context->partition_done, &context->lock);
+        pthread_mutex_unlock(&context->lock);
+    }
+}
+
+static void seqid_parallel_stream_free(GtNodeStream * ns)
+{
+    seqid_parallel_stream * context;
+    unsigned long           p;
+    int                     i;
+    
+    context = seqid_parallel_stream_cast(ns);
+
+    // skip whatever no worker has picked up yet and wait for the rest
+    pthread_mutex_lock(&context->lock);
+    context->finished = 1;
+    context->next_partition = context->num_partitions;
+    pthread_cond_broadcast(&context->work_available);
+    pthread_mutex_unlock(&context->lock);
+
+    if (context->threads_started)
+        for (i = 0; i < context->num_threads; i++)
+            pthread_join(context->threads[i], NULL);
+
+    for (p = context->emit_partition; p < context->num_partitions; p++)
+        seqid_parallel_stream_free_partition(context->partitions[p]);
+    free(context->partitions);
+    free(context->threads);
+
+    gt_genome_node_delete(context->lookahead);
+    pthread_cond_destroy(&context->partition_done);
+    pthread_cond_destroy(&context->work_available);
+    pthread_mutex_destroy(&context->lock);
+    gt_node_stream_delete(context->in_stream);
+    return;
+}
+
+const GtNodeStreamClass * seqid_parallel_stream_class(void)
+{
+    static const GtNodeStreamClass * c = NULL;
+
+    if (!c)
+    {	
+        c = gt_node_stream_class_new( sizeof(seqid_parallel_stream),
+                                      seqid_parallel_stream_free,
+                                      seqid_parallel_stream_next
+                                    );
+    }
+    
+    return c;
+}
+
+GtNodeStream * seqid_parallel_stream_new(GtNodeStream *            in_stream,
+                                         int                       num_threads,
+                                         seqid_parallel_build_func build,
+                                         void *                    data
+                                        )
+{
+    GtNodeStream * ns = gt_node_stream_create(seqid_parallel_stream_class(), 
+                                              gt_node_stream_is_sorted(in_stream));
+    seqid_parallel_stream * context = seqid_parallel_stream_cast(ns);
+    gt_assert(in_stream && build && num_threads > 0);
+    context->in_stream   = gt_node_stream_ref(in_stream);
+    context->build       = build;
+    context->data        = data;
+    context->num_threads = num_threads;
+    context->threads     = calloc(num_threads, sizeof(pthread_t));
+
+    // two runs per thread keeps everyone busy while one is being emitted
+    context->max_buffered = 2 * (unsigned long)num_threads;
+
+    pthread_mutex_init(&context->lock, NULL);
+    pthread_cond_init(&context->work_available, NULL);
+    pthread_cond_init(&context->partition_done, NULL);
+
+    return ns;
+}
@@ -0,0 +1,9 @@
+
+#ifndef SEQID_PARALLEL_STREAM_H
+#define SEQID_PARALLEL_STREAM_H
+
+#include "seqid_parallel_stream_api.h"
+
+const GtNodeStreamClass * seqid_parallel_stream_class(void);
+
+#endif
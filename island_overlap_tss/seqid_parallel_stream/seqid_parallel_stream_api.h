@@ -0,0 +1,35 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Run a stream chain over each sequence (chromosome) of a sorted
+ *   annotation on a pool of threads.  The input is cut into runs of nodes
+ *   sharing a seqid, every run gets its own chain from the build callback
+ *   and the results come back out in the original order.
+ *
+ */
+
+#ifndef  SEQID_PARALLEL_STREAM_API_H
+#define  SEQID_PARALLEL_STREAM_API_H
+
+#define SEQID_PARALLEL_MAX_STAGES 8
+
+typedef struct seqid_parallel_stream seqid_parallel_stream;
+
+// build the chain for one run on top of in, storing the streams in
+// stages (first to last, at most max_stages).  Returns the number of
+// stages, or -1 on failure.  Called from the thread pulling the parallel
+// stream, the chains are then pulled from the worker threads, so the
+// stages must not share mutable state with each other.
+typedef int (*seqid_parallel_build_func)(GtNodeStream *  in,
+                                         GtNodeStream ** stages,
+                                         int             max_stages,
+                                         void *          data
+                                        );
+
+GtNodeStream* seqid_parallel_stream_new(GtNodeStream *            in_stream,
+                                        int                       num_threads,
+                                        seqid_parallel_build_func build,
+                                        void *                    data
+                                       );
+
+#endif
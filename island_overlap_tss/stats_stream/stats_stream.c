@@ -0,0 +1,106 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Pass nodes through unchanged, timing the wrapped stage
+*
+*
+*************************************************/
+#include <genometools.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "stats_stream.h"
+
+
+struct stats_stream {
+    const GtNodeStream parent_instance;
+    GtNodeStream * in_stream;
+    stream_stats_stage * stats;
+    stats_stream_scored_func num_scored;
+};
+
+// time spent in wrapped stages below the one currently being timed on
+// this thread, so each stage is charged only for its own work
+static __thread uint64_t nested_ns = 0;
+
+
+const GtNodeStreamClass * stats_stream_class(void);
+
+#define stats_stream_cast(GS) gt_node_stream_cast(stats_stream_class(), GS);
+
+static int stats_stream_next(GtNodeStream * ns,
+                             GtGenomeNode ** gn,
+                             GtError * err)
+{
+    stats_stream * timed_stream;
+    uint64_t       outer_nested = nested_ns;
+    uint64_t       start, elapsed;
+    int            had_err;
+
+    timed_stream = stats_stream_cast(ns);
+
+    nested_ns = 0;
+    start = stream_stats_now();
+    had_err = gt_node_stream_next(timed_stream->in_stream, gn, err);
+    elapsed = stream_stats_now() - start;
+
+    stream_stats_stage_call(timed_stream->stats,
+                            elapsed > nested_ns ? elapsed - nested_ns : 0,
+                            !had_err && *gn != NULL);
+    nested_ns = outer_nested + elapsed;
+
+    return had_err;
+}
+
+static void stats_stream_free(GtNodeStream * ns)
+{
+    stats_stream * timed_stream;
+    
+    timed_stream = stats_stream_cast(ns);
+    if (timed_stream->num_scored)
+    {
+        timed_stream->stats->nodes_scored  = timed_stream->num_scored(timed_stream->in_stream);
+        timed_stream->stats->counts_scored = 1;
+    }
+    gt_node_stream_delete(timed_stream->in_stream);
+    return;
+}
+
+const GtNodeStreamClass * stats_stream_class(void)
+{
+    static const GtNodeStreamClass * c = NULL;
+
+    if (!c)
+    {	
+        c = gt_node_stream_class_new( sizeof(stats_stream),
+                                      stats_stream_free,
+                                      stats_stream_next
+                                    );
+    }
+    
+    return c;
+}
+
+GtNodeStream * stats_stream_new(GtNodeStream *           stage,
+                                const char *             name,
+                                stats_stream_scored_func num_scored
+                               )
+{
+    GtNodeStream * ns;
+    stats_stream * timed_stream;
+
+    if (!stage || !stream_stats_enabled())
+        return stage;
+
+    ns = gt_node_stream_create(stats_stream_class(), 
+                               gt_node_stream_is_sorted(stage));
+    timed_stream = stats_stream_cast(ns);
+    timed_stream->in_stream  = stage;   // the caller's reference
+    timed_stream->stats      = stream_stats_add_stage(name);
+    timed_stream->num_scored = num_scored;
+
+    return ns;
+}
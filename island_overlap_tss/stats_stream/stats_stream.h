@@ -0,0 +1,9 @@
+
+#ifndef STATS_STREAM_H
+#define STATS_STREAM_H
+
+#include "stats_stream_api.h"
+
+const GtNodeStreamClass * stats_stream_class(void);
+
+#endif
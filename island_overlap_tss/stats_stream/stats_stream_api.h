@@ -0,0 +1,29 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Time a stream stage for --stats (see stream_stats).  The wrapper
+ *   passes every node straight through and records the calls, nodes and
+ *   the time spent in the stage itself, excluding the wrapped stages it
+ *   pulls from.
+ *
+ */
+
+#ifndef  STATS_STREAM_API_H
+#define  STATS_STREAM_API_H
+
+#include "../stream_stats/stream_stats.h"
+
+typedef struct stats_stream stats_stream;
+
+// reports how many nodes a stage scored, read just before it is deleted
+typedef unsigned long (*stats_stream_scored_func)(GtNodeStream * stage);
+
+// takes over the caller's reference to stage, which is deleted along with
+// the wrapper.  num_scored may be NULL.  With stats disabled stage itself
+// is returned, so callers can wrap unconditionally.
+GtNodeStream* stats_stream_new(GtNodeStream *           stage,
+                               const char *             name,
+                               stats_stream_scored_func num_scored
+                              );
+
+#endif
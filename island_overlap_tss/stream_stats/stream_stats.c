@@ -0,0 +1,252 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Registry of per stage and per file counters, dumped as JSON
+*
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "stream_stats.h"
+
+typedef struct
+{
+    char *             path;
+    unsigned long long disk_bytes;
+    unsigned long long text_bytes;
+    unsigned long long records;
+    double             seconds;
+} stream_stats_file_t;
+
+static int                    stats_enabled = 0;
+static uint64_t               stats_start_ns;
+static pthread_mutex_t        stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static stream_stats_stage **  stats_stages = NULL;
+static int                    stats_num_stages = 0;
+static stream_stats_file_t *  stats_files = NULL;
+static int                    stats_num_files = 0;
+
+uint64_t stream_stats_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void stream_stats_enable(void)
+{
+    stats_enabled  = 1;
+    stats_start_ns = stream_stats_now();
+}
+
+int stream_stats_enabled(void)
+{
+    return stats_enabled;
+}
+
+int stream_stats_parse_flag(int * argc, char ** argv)
+{
+    int i, j;
+
+    for (i = j = 1; i < *argc; i++)
+    {
+        if (!strcmp(argv[i], "--stats"))
+            stream_stats_enable();
+        else
+            argv[j++] = argv[i];
+    }
+    *argc = j;
+    argv[j] = NULL;
+
+    return stats_enabled;
+}
+
+stream_stats_stage * stream_stats_add_stage(const char * name)
+{
+    stream_stats_stage * stage;
+
+    if (!stats_enabled)
+        return NULL;
+
+    stage = calloc(1, sizeof(stream_stats_stage));
+    stage->name = name;
+
+    pthread_mutex_lock(&stats_lock);
+    stats_stages = realloc(stats_stages, (stats_num_stages + 1) * sizeof(stream_stats_stage *));
+    stats_stages[stats_num_stages++] = stage;
+    pthread_mutex_unlock(&stats_lock);
+
+    return stage;
+}
+
+void stream_stats_stage_call(stream_stats_stage * stage, uint64_t self_ns, int returned_node)
+{
+    int bucket = 0;
+
+    // only one thread pulls a given instance, so no locking here
+    stage->calls++;
+    stage->nodes_seen += returned_node ? 1 : 0;
+    stage->self_ns += self_ns;
+    if (self_ns > stage->max_ns)
+        stage->max_ns = self_ns;
+
+    while (bucket < STREAM_STATS_BUCKETS - 1 && (self_ns >> bucket))
+        bucket++;
+    stage->histogram[bucket]++;
+}
+
+// call with stats_lock held
+static stream_stats_file_t * stream_stats_find_file(const char * path)
+{
+    int i;
+
+    for (i = 0; i < stats_num_files; i++)
+        if (!strcmp(stats_files[i].path, path))
+            return &stats_files[i];
+
+    stats_files = realloc(stats_files, (stats_num_files + 1) * sizeof(stream_stats_file_t));
+    memset(&stats_files[stats_num_files], 0, sizeof(stream_stats_file_t));
+    stats_files[stats_num_files].path = strdup(path);
+    return &stats_files[stats_num_files++];
+}
+
+void stream_stats_file_read(const char * path, unsigned long long disk_bytes, unsigned long long text_bytes)
+{
+    stream_stats_file_t * file;
+
+    if (!stats_enabled)
+        return;
+
+    pthread_mutex_lock(&stats_lock);
+    file = stream_stats_find_file(path);
+    file->disk_bytes += disk_bytes;
+    file->text_bytes += text_bytes;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void stream_stats_file_parsed(const char * path, unsigned long long records, double seconds)
+{
+    stream_stats_file_t * file;
+
+    if (!stats_enabled)
+        return;
+
+    pthread_mutex_lock(&stats_lock);
+    file = stream_stats_find_file(path);
+    file->records += records;
+    file->seconds += seconds;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void stream_stats_write_string(FILE * out, const char * s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char)*s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+int stream_stats_write_json(FILE * out)
+{
+    struct rusage usage_info;
+    int           i, j, k, first;
+    char *        written;
+
+    getrusage(RUSAGE_SELF, &usage_info);
+
+    pthread_mutex_lock(&stats_lock);
+
+    fprintf(out, "{\n  \"wall_seconds\": %.6f,\n", (stream_stats_now() - stats_start_ns) / 1e9);
+    fprintf(out, "  \"peak_rss_kb\": %ld,\n", usage_info.ru_maxrss);
+
+    // instances of a stage (one per chain in parallel runs) are summed
+    fprintf(out, "  \"streams\": [");
+    written = calloc(stats_num_stages + 1, 1);
+    for (i = 0, first = 1; i < stats_num_stages; i++)
+    {
+        stream_stats_stage total;
+        int                instances = 0;
+
+        if (written[i])
+            continue;
+
+        memset(&total, 0, sizeof(total));
+        for (j = i; j < stats_num_stages; j++)
+        {
+            const stream_stats_stage * stage = stats_stages[j];
+
+            if (written[j] || strcmp(stage->name, stats_stages[i]->name))
+                continue;
+            written[j] = 1;
+            instances++;
+            total.calls         += stage->calls;
+            total.nodes_seen    += stage->nodes_seen;
+            total.nodes_scored  += stage->nodes_scored;
+            total.counts_scored |= stage->counts_scored;
+            total.self_ns       += stage->self_ns;
+            if (stage->max_ns > total.max_ns)
+                total.max_ns = stage->max_ns;
+            for (k = 0; k < STREAM_STATS_BUCKETS; k++)
+                total.histogram[k] += stage->histogram[k];
+        }
+
+        fprintf(out, "%s\n    {\"name\": ", first ? "" : ",");
+        stream_stats_write_string(out, stats_stages[i]->name);
+        fprintf(out, ", \"instances\": %d, \"calls\": %llu, \"nodes_seen\": %llu, \"nodes_scored\": ",
+                instances, total.calls, total.nodes_seen);
+        if (total.counts_scored)
+            fprintf(out, "%llu", total.nodes_scored);
+        else
+            fprintf(out, "null");
+        fprintf(out, ",\n     \"self_seconds\": %.6f, \"mean_ns\": %.1f, \"max_ns\": %llu,\n",
+                total.self_ns / 1e9, total.calls ? (double)total.self_ns / total.calls : 0.0,
+                (unsigned long long)total.max_ns);
+
+        // only the buckets that were hit, as [upper bound ns, calls]
+        fprintf(out, "     \"latency_ns\": [");
+        for (k = 0, j = 1; k < STREAM_STATS_BUCKETS; k++)
+        {
+            if (!total.histogram[k])
+                continue;
+            fprintf(out, "%s[%llu, %llu]", j ? "" : ", ", 1ULL << k, total.histogram[k]);
+            j = 0;
+        }
+        fprintf(out, "]}");
+        first = 0;
+    }
+    free(written);
+    fprintf(out, "%s],\n", first ? "" : "\n  ");
+
+    fprintf(out, "  \"files\": [");
+    for (i = 0; i < stats_num_files; i++)
+    {
+        const stream_stats_file_t * file = &stats_files[i];
+
+        fprintf(out, "%s\n    {\"path\": ", i ? "," : "");
+        stream_stats_write_string(out, file->path);
+        fprintf(out, ", \"disk_bytes\": %llu, \"text_bytes\": %llu, \"records\": %llu, \"seconds\": %.6f, \"text_mb_per_second\": %.1f}",
+                file->disk_bytes, file->text_bytes, file->records, file->seconds,
+                file->seconds > 0 ? file->text_bytes / file->seconds / 1048576.0 : 0.0);
+    }
+    fprintf(out, "%s]\n}\n", stats_num_files ? "\n  " : "");
+
+    pthread_mutex_unlock(&stats_lock);
+
+    return fflush(out) != 0 || ferror(out);
+}
@@ -0,0 +1,58 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Process wide performance counters behind the drivers' --stats flag:
+ *   per stream stage call counts, node counts and a latency histogram of
+ *   the time spent in the stage itself, per db file bytes and records
+ *   read, and peak memory.  Everything is a no-op until enabled, so the
+ *   loaders and streams can report unconditionally.
+ *
+ */
+
+#ifndef  STREAM_STATS_H
+#define  STREAM_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define STREAM_STATS_BUCKETS 40     // latency buckets, bucket k holds calls under 2^k ns
+
+typedef struct
+{
+    const char *       name;
+    unsigned long long calls;
+    unsigned long long nodes_seen;
+    unsigned long long nodes_scored;
+    int                counts_scored;
+    uint64_t           self_ns;
+    uint64_t           max_ns;
+    unsigned long long histogram[STREAM_STATS_BUCKETS];
+} stream_stats_stage;
+
+// removes a --stats argument from argv and enables the counters if it was
+// there.  Returns 1 if stats are on.
+int stream_stats_parse_flag(int * argc, char ** argv);
+
+void stream_stats_enable(void);
+int stream_stats_enabled(void);
+
+// a zeroed record for one instance of a stage, owned by the registry.
+// Instances sharing a name are summed in the report.  NULL when disabled.
+stream_stats_stage * stream_stats_add_stage(const char * name);
+
+// record one call that took self_ns outside of any nested stage
+void stream_stats_stage_call(stream_stats_stage * stage, uint64_t self_ns, int returned_node);
+
+// bytes taken from disk and text bytes handed to the parser for a db file
+void stream_stats_file_read(const char * path, unsigned long long disk_bytes, unsigned long long text_bytes);
+
+// records a loader parsed out of a db file and the time the load took
+void stream_stats_file_parsed(const char * path, unsigned long long records, double seconds);
+
+// monotonic clock in nanoseconds
+uint64_t stream_stats_now(void);
+
+// write the report as JSON, returns non-zero on a write error
+int stream_stats_write_json(FILE * out);
+
+#endif
@@ -0,0 +1,718 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Build the indexed binary track with its zoom levels from a text track
+*   and answer interval sums and region summaries on it through mmap
+*
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "track_file.h"
+#include "../record_reader/record_reader.h"
+#include "../stream_stats/stream_stats.h"
+
+#define TRACK_FILE_MAGIC       "TRACKDB1"
+#define TRACK_FILE_BLOCK_SIZE  256          // records per data block
+#define TRACK_FILE_FANOUT      128          // block index entries per 4kb page
+#define TRACK_FILE_ZOOM_LEVELS 3
+
+static const uint32_t track_file_zoom_bases[TRACK_FILE_ZOOM_LEVELS] = { 1000, 10000, 100000 };
+
+typedef struct
+{
+    char     magic[8];
+    uint32_t block_size;
+    uint32_t fanout;
+    uint32_t num_chromosomes;
+    uint32_t num_zoom_levels;
+    uint32_t zoom_bases[TRACK_FILE_ZOOM_LEVELS];
+    uint32_t reserved;
+} track_file_header_t;
+
+typedef struct
+{
+    uint64_t offset;            // from start of file
+    uint32_t num_bins;
+    uint32_t reserved;
+} track_file_zoom_t;
+
+typedef struct
+{
+    int32_t           chromosome;
+    uint32_t          num_blocks;
+    uint64_t          num_records;
+    uint32_t          first_position;
+    uint32_t          last_position;
+    uint64_t          top_offset;       // from start of file
+    uint64_t          index_offset;     // from start of file
+    uint64_t          data_offset;      // from start of file
+    uint64_t          data_length;
+    track_file_zoom_t zooms[TRACK_FILE_ZOOM_LEVELS];
+} track_file_chromosome_t;
+
+typedef struct
+{
+    double   sum;               // of every record in earlier blocks of the chromosome
+    uint64_t data_offset;       // from start of the chromosome's data
+    uint32_t first_position;
+    uint32_t last_position;
+    uint32_t num_records;
+    uint32_t reserved;
+} track_file_block_t;
+
+// bin b of a zoom level of width bases holds positions [b * bases, (b + 1) * bases)
+typedef struct
+{
+    double   sum;
+    float    min;
+    float    max;
+    uint32_t count;
+    uint32_t reserved;
+} track_file_bin_t;
+
+struct track_file {
+    int                             fd;
+    const unsigned char *           map;
+    size_t                          map_length;
+    const track_file_header_t *     header;
+    const track_file_chromosome_t * chromosomes;
+};
+
+typedef struct
+{
+    int      chromosome;
+    uint32_t position;
+    float    value;
+} track_file_record_t;
+
+typedef struct
+{
+    unsigned char * data;
+    size_t          length;
+    size_t          capacity;
+} byte_buffer_t;
+
+static void byte_buffer_append(byte_buffer_t * buffer, const void * bytes, size_t length)
+{
+    while (buffer->length + length > buffer->capacity)
+    {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 65536;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+static void byte_buffer_append_varint(byte_buffer_t * buffer, uint32_t value)
+{
+    unsigned char bytes[5];
+    size_t        n = 0;
+
+    while (value >= 0x80)
+    {
+        bytes[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[n++] = (unsigned char)value;
+    byte_buffer_append(buffer, bytes, n);
+}
+
+// keeps the buffer a multiple of 8 bytes so the next section stays aligned in the map
+static void byte_buffer_pad(byte_buffer_t * buffer)
+{
+    static const char padding[8] = { 0 };
+
+    byte_buffer_append(buffer, padding, ((buffer->length + 7) & ~(size_t)7) - buffer->length);
+}
+
+static int track_file_record_compare(const void * a, const void * b)
+{
+    const track_file_record_t * x = (const track_file_record_t *)a;
+    const track_file_record_t * y = (const track_file_record_t *)b;
+
+    if (x->chromosome != y->chromosome)
+        return x->chromosome < y->chromosome ? -1 : 1;
+    if (x->position != y->position)
+        return x->position < y->position ? -1 : 1;
+    return 0;
+}
+
+// the top index, block index, zoom levels and data of one chromosome's
+// records, all offsets relative to the start of the section
+static void track_file_encode_chromosome(const track_file_record_t * records,
+                                         size_t                      num_records,
+                                         track_file_chromosome_t *   chr,
+                                         byte_buffer_t *             section
+                                        )
+{
+    byte_buffer_t index = { NULL, 0, 0 }, data = { NULL, 0, 0 };
+    double        sum = 0.0;
+    size_t        i, j;
+    int           z;
+
+    memset(chr, 0, sizeof(track_file_chromosome_t));
+    chr->chromosome     = records[0].chromosome;
+    chr->num_records    = num_records;
+    chr->first_position = records[0].position;
+    chr->last_position  = records[num_records - 1].position;
+
+    for (i = 0; i < num_records; )
+    {
+        track_file_block_t block;
+
+        memset(&block, 0, sizeof(block));
+        block.data_offset    = data.length;
+        block.sum            = sum;
+        block.first_position = records[i].position;
+
+        for (j = 0; j < TRACK_FILE_BLOCK_SIZE && i < num_records; j++, i++)
+        {
+            if (j)
+                byte_buffer_append_varint(&data, records[i].position - records[i - 1].position);
+            byte_buffer_append(&data, &records[i].value, sizeof(float));
+            sum += records[i].value;
+            block.num_records++;
+        }
+        block.last_position = records[i - 1].position;
+
+        byte_buffer_append(&index, &block, sizeof(block));
+        chr->num_blocks++;
+    }
+
+    // the top index is small enough to stay in one or two pages
+    chr->top_offset = section->length;
+    for (i = 0; i < chr->num_blocks; i += TRACK_FILE_FANOUT)
+        byte_buffer_append(section, &((const track_file_block_t *)index.data)[i].first_position, sizeof(uint32_t));
+    byte_buffer_pad(section);
+
+    chr->index_offset = section->length;
+    byte_buffer_append(section, index.data, index.length);
+
+    for (z = 0; z < TRACK_FILE_ZOOM_LEVELS; z++)
+    {
+        uint32_t           bases = track_file_zoom_bases[z];
+        uint32_t           num_bins = chr->last_position / bases + 1, b;
+        track_file_bin_t * bins = calloc(num_bins, sizeof(track_file_bin_t));
+
+        for (b = 0; b < num_bins; b++)
+        {
+            bins[b].min = FLT_MAX;
+            bins[b].max = -FLT_MAX;
+        }
+        for (i = 0; i < num_records; i++)
+        {
+            track_file_bin_t * bin = &bins[records[i].position / bases];
+
+            bin->sum += records[i].value;
+            bin->count++;
+            if (records[i].value < bin->min)
+                bin->min = records[i].value;
+            if (records[i].value > bin->max)
+                bin->max = records[i].value;
+        }
+
+        chr->zooms[z].offset   = section->length;
+        chr->zooms[z].num_bins = num_bins;
+        byte_buffer_append(section, bins, num_bins * sizeof(track_file_bin_t));
+        free(bins);
+    }
+
+    chr->data_offset = section->length;
+    chr->data_length = data.length;
+    byte_buffer_append(section, data.data, data.length);
+    byte_buffer_pad(section);
+
+    free(index.data);
+    free(data.data);
+}
+
+int track_file_build(const char * text_track, const char * track_path)
+{
+    record_reader *           reader;
+    record_view_t             record;
+    FILE *                    track_out;
+    track_file_record_t *     records;
+    size_t                    num_records = 0, capacity = 1 << 20;
+    int                       chromosome;
+    unsigned long             position;
+    float                     value;
+    track_file_header_t       header;
+    track_file_chromosome_t * chromosomes = NULL;
+    byte_buffer_t *           sections = NULL;
+    uint64_t                  offset, load_start = stream_stats_now();
+    size_t                    i, c;
+    int                       z, sorted = 1, err = 0;
+
+    // gzip / BGZF text is inflated on the fly
+    if ((reader = record_reader_open(text_track)) == NULL)
+    {
+        fprintf(stderr, "Failed to open track file %s\n", text_track);
+        return -1;
+    }
+
+    records = malloc(capacity * sizeof(track_file_record_t));
+    while (record_reader_next(reader, &record))
+    {
+        if (record_parse_track_row(&record, &chromosome, &position, &value))
+        {
+            record_reader_reject(reader);
+            continue;
+        }
+        if (position > UINT32_MAX)
+        {
+            fprintf(stderr, "Position %lu on chromosome %d is too large to index\n", position, chromosome);
+            err = -1;
+            break;
+        }
+        if (num_records == capacity)
+        {
+            capacity *= 2;
+            records = realloc(records, capacity * sizeof(track_file_record_t));
+        }
+        records[num_records].chromosome = chromosome;
+        records[num_records].position   = (uint32_t)position;
+        records[num_records].value      = value;
+        if (num_records && track_file_record_compare(&records[num_records - 1], &records[num_records]) > 0)
+            sorted = 0;
+        num_records++;
+    }
+    if (record_reader_close(reader) && !err)
+    {
+        fprintf(stderr, "Track file %s is corrupt or truncated\n", text_track);
+        err = -1;
+    }
+
+    if (err)
+    {
+        free(records);
+        return err;
+    }
+    stream_stats_file_parsed(text_track, num_records, (stream_stats_now() - load_start) / 1e9);
+
+    if (!sorted)
+        qsort(records, num_records, sizeof(track_file_record_t), track_file_record_compare);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACK_FILE_MAGIC, sizeof(header.magic));
+    header.block_size      = TRACK_FILE_BLOCK_SIZE;
+    header.fanout          = TRACK_FILE_FANOUT;
+    header.num_zoom_levels = TRACK_FILE_ZOOM_LEVELS;
+    for (z = 0; z < TRACK_FILE_ZOOM_LEVELS; z++)
+        header.zoom_bases[z] = track_file_zoom_bases[z];
+
+    for (i = 0; i < num_records; )
+    {
+        size_t first = i;
+
+        while (i < num_records && records[i].chromosome == records[first].chromosome)
+            i++;
+
+        c = header.num_chromosomes++;
+        chromosomes = realloc(chromosomes, header.num_chromosomes * sizeof(track_file_chromosome_t));
+        sections    = realloc(sections, header.num_chromosomes * sizeof(byte_buffer_t));
+        memset(&sections[c], 0, sizeof(byte_buffer_t));
+        track_file_encode_chromosome(records + first, i - first, &chromosomes[c], &sections[c]);
+    }
+    free(records);
+
+    // lay out: header, chromosome table, then each chromosome's section
+    offset = sizeof(header) + header.num_chromosomes * sizeof(track_file_chromosome_t);
+    for (c = 0; c < header.num_chromosomes; c++)
+    {
+        chromosomes[c].top_offset   += offset;
+        chromosomes[c].index_offset += offset;
+        chromosomes[c].data_offset  += offset;
+        for (z = 0; z < TRACK_FILE_ZOOM_LEVELS; z++)
+            chromosomes[c].zooms[z].offset += offset;
+        offset += sections[c].length;
+    }
+
+    if ((track_out = fopen(track_path, "wb")) == NULL)
+    {
+        fprintf(stderr, "Failed to create track file %s\n", track_path);
+        err = -1;
+    }
+    else
+    {
+        fwrite(&header, sizeof(header), 1, track_out);
+        if (header.num_chromosomes)
+            fwrite(chromosomes, sizeof(track_file_chromosome_t), header.num_chromosomes, track_out);
+        for (c = 0; c < header.num_chromosomes; c++)
+            fwrite(sections[c].data, 1, sections[c].length, track_out);
+        if (fclose(track_out))
+        {
+            fprintf(stderr, "Failed to write track file %s\n", track_path);
+            err = -1;
+        }
+    }
+
+    for (c = 0; c < header.num_chromosomes; c++)
+        free(sections[c].data);
+    free(sections);
+    free(chromosomes);
+
+    return err;
+}
+
+track_file * track_file_open(const char * track_path)
+{
+    track_file *                    file;
+    const track_file_header_t *     header;
+    const track_file_chromosome_t * chromosomes;
+    struct stat                     st;
+    void *                          map;
+    uint32_t                        c;
+    int                             fd, valid;
+
+    if ((fd = open(track_path, O_RDONLY)) < 0)
+        return NULL;
+
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(track_file_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // every section has to lie inside the file
+    header      = map;
+    chromosomes = (const track_file_chromosome_t *)((const unsigned char *)map + sizeof(track_file_header_t));
+    valid = !memcmp(header->magic, TRACK_FILE_MAGIC, 8) && header->num_zoom_levels == TRACK_FILE_ZOOM_LEVELS &&
+            header->block_size > 0 && header->fanout > 0 &&
+            sizeof(track_file_header_t) + (uint64_t)header->num_chromosomes * sizeof(track_file_chromosome_t)
+                <= (uint64_t)st.st_size;
+    for (c = 0; valid && c < header->num_chromosomes; c++)
+    {
+        const track_file_chromosome_t * chr = &chromosomes[c];
+        int                             z;
+
+        valid = chr->top_offset + ((uint64_t)chr->num_blocks + header->fanout - 1) / header->fanout * sizeof(uint32_t)
+                    <= (uint64_t)st.st_size &&
+                chr->index_offset + (uint64_t)chr->num_blocks * sizeof(track_file_block_t) <= (uint64_t)st.st_size &&
+                chr->data_offset + chr->data_length <= (uint64_t)st.st_size;
+        for (z = 0; valid && z < TRACK_FILE_ZOOM_LEVELS; z++)
+            valid = chr->zooms[z].offset + (uint64_t)chr->zooms[z].num_bins * sizeof(track_file_bin_t)
+                        <= (uint64_t)st.st_size;
+    }
+
+    if (!valid)
+    {
+        munmap(map, st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    file = malloc(sizeof(track_file));
+    file->fd          = fd;
+    file->map         = map;
+    file->map_length  = st.st_size;
+    file->header      = header;
+    file->chromosomes = chromosomes;
+
+    return file;
+}
+
+void track_file_close(track_file * file)
+{
+    if (!file)
+        return;
+    munmap((void *)file->map, file->map_length);
+    close(file->fd);
+    free(file);
+}
+
+static const track_file_chromosome_t * track_file_find_chromosome(const track_file * file, int chromosome)
+{
+    uint32_t c;
+
+    for (c = 0; c < file->header->num_chromosomes; c++)
+        if (file->chromosomes[c].chromosome == chromosome)
+            return &file->chromosomes[c];
+    return NULL;
+}
+
+unsigned long track_file_chromosome_length(const track_file * file, int chromosome)
+{
+    const track_file_chromosome_t * chr = track_file_find_chromosome(file, chromosome);
+
+    return chr ? chr->last_position : 0;
+}
+
+static inline uint32_t track_file_read_varint(const unsigned char ** p)
+{
+    uint32_t value = 0;
+    int      shift = 0;
+
+    while (**p & 0x80)
+    {
+        value |= (uint32_t)(*(*p)++ & 0x7f) << shift;
+        shift += 7;
+    }
+    value |= (uint32_t)*(*p)++ << shift;
+    return value;
+}
+
+// the last block starting below limit, -1 if there is none.  The top index
+// picks the page of the block index, so only that one page is searched.
+// Comparisons are strict, a run of equal positions can straddle a block
+// boundary
+static long track_file_find_block(const track_file * file, const track_file_chromosome_t * chr, unsigned long limit)
+{
+    const uint32_t *           top = (const uint32_t *)(file->map + chr->top_offset);
+    const track_file_block_t * blocks = (const track_file_block_t *)(file->map + chr->index_offset);
+    uint32_t                   fanout = file->header->fanout;
+    uint32_t                   lo = 0, hi = (chr->num_blocks + fanout - 1) / fanout;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (top[mid] < limit)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return -1;
+
+    hi = (lo * fanout < chr->num_blocks ? lo * fanout : chr->num_blocks);
+    lo = (lo - 1) * fanout;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (blocks[mid].first_position < limit)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (long)lo - 1;
+}
+
+// sum and count of the records at positions below limit, from the running
+// sum of the last block starting below limit plus a partial decode of it
+static double track_file_prefix(const track_file *              file,
+                                const track_file_chromosome_t * chr,
+                                unsigned long                   limit,
+                                unsigned long *                 count
+                               )
+{
+    const track_file_block_t * block;
+    const unsigned char *      p;
+    unsigned long              position;
+    double                     sum;
+    long                       b = track_file_find_block(file, chr, limit);
+    uint32_t                   i;
+
+    *count = 0;
+    if (b < 0)
+        return 0.0;
+
+    block    = (const track_file_block_t *)(file->map + chr->index_offset) + b;
+    sum      = block->sum;
+    *count   = (unsigned long)b * file->header->block_size;
+    p        = file->map + chr->data_offset + block->data_offset;
+    position = block->first_position;
+
+    for (i = 0; i < block->num_records; i++)
+    {
+        float value;
+
+        if (i)
+            position += track_file_read_varint(&p);
+        if (position >= limit)
+            break;
+        memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        sum += value;
+        (*count)++;
+    }
+
+    return sum;
+}
+
+double track_file_sum(const track_file * file,
+                      int                chromosome,
+                      unsigned long      start,
+                      unsigned long      end,
+                      unsigned long *    num_records
+                     )
+{
+    const track_file_chromosome_t * chr = track_file_find_chromosome(file, chromosome);
+    unsigned long                   count_start, count_end;
+    double                          sum_start, sum_end;
+
+    if (num_records)
+        *num_records = 0;
+    if (!chr || chr->num_blocks == 0 || start > end)
+        return 0.0;
+
+    sum_start = track_file_prefix(file, chr, start, &count_start);
+    sum_end   = track_file_prefix(file, chr, end + 1, &count_end);
+
+    if (num_records)
+        *num_records = count_end - count_start;
+    return sum_end - sum_start;
+}
+
+unsigned long track_file_values(const track_file * file,
+                                int                chromosome,
+                                unsigned long      start,
+                                unsigned long      end,
+                                float *            values,
+                                unsigned long      max_values
+                               )
+{
+    const track_file_chromosome_t * chr = track_file_find_chromosome(file, chromosome);
+    const track_file_block_t *      blocks;
+    unsigned long                   n = 0, position;
+    long                            b;
+    uint32_t                        i;
+
+    if (!chr || chr->num_blocks == 0 || start > end)
+        return 0;
+
+    blocks = (const track_file_block_t *)(file->map + chr->index_offset);
+    b      = track_file_find_block(file, chr, start);
+    for (b = b < 0 ? 0 : b; b < (long)chr->num_blocks && blocks[b].first_position <= end; b++)
+    {
+        const unsigned char * p = file->map + chr->data_offset + blocks[b].data_offset;
+
+        position = blocks[b].first_position;
+        for (i = 0; i < blocks[b].num_records; i++)
+        {
+            float value;
+
+            if (i)
+                position += track_file_read_varint(&p);
+            if (position > end)
+                return n;
+            memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            if (position < start)
+                continue;
+            if (n < max_values)
+                values[n] = value;
+            n++;
+        }
+    }
+
+    return n;
+}
+
+static void track_file_summary_add(track_file_summary_t * bin, unsigned long count, double sum, double min, double max)
+{
+    if (bin->coverage == 0 || min < bin->min)
+        bin->min = min;
+    if (bin->coverage == 0 || max > bin->max)
+        bin->max = max;
+    bin->coverage += count;
+    bin->mean     += sum;       // the sum until the bins are finished
+}
+
+// the bin holding offset, the last b with b * length / num_bins <= offset,
+// so a record always lands in the bin whose printed range holds it
+static int track_file_summary_bin(unsigned long offset, int num_bins, unsigned long length)
+{
+    return (int)(((offset + 1) * num_bins - 1) / length);
+}
+
+unsigned long track_file_summarize(const track_file *     file,
+                                   int                    chromosome,
+                                   unsigned long          start,
+                                   unsigned long          end,
+                                   int                    num_bins,
+                                   track_file_summary_t * bins
+                                  )
+{
+    const track_file_chromosome_t * chr = track_file_find_chromosome(file, chromosome);
+    unsigned long                   length, bases = 0, last;
+    int                             b, z, level = -1;
+
+    if (num_bins <= 0)
+        return 0;
+    memset(bins, 0, num_bins * sizeof(track_file_summary_t));
+    if (!chr || chr->num_blocks == 0 || start > end || start > chr->last_position || end < chr->first_position)
+        return 0;
+
+    // bin b holds [start + b * length / num_bins, start + (b + 1) * length / num_bins),
+    // the quotients rounded down
+    length = end - start + 1;
+    last   = end < chr->last_position ? end : chr->last_position;
+
+    for (z = TRACK_FILE_ZOOM_LEVELS - 1; z >= 0 && level < 0; z--)
+        if (length / num_bins >= 2 * (unsigned long)file->header->zoom_bases[z])
+            level = z;
+
+    if (level >= 0)
+    {
+        const track_file_bin_t * zoom = (const track_file_bin_t *)(file->map + chr->zooms[level].offset);
+        unsigned long            j;
+
+        bases = file->header->zoom_bases[level];
+
+        // a zoom bin counts toward the bin its start falls in, the one
+        // straddling start toward the first
+        for (j = start / bases; j <= last / bases; j++)
+        {
+            unsigned long bin_start = j * bases < start ? start : j * bases;
+
+            if (zoom[j].count)
+                track_file_summary_add(&bins[track_file_summary_bin(bin_start - start, num_bins, length)],
+                                       zoom[j].count, zoom[j].sum, zoom[j].min, zoom[j].max);
+        }
+    }
+    else
+    {
+        const track_file_block_t * blocks = (const track_file_block_t *)(file->map + chr->index_offset);
+        long                       first = track_file_find_block(file, chr, start);
+        uint32_t                   k;
+
+        // records at start and beyond begin in the last block starting
+        // below start, or in the next one if it ends before start
+        for (k = first < 0 ? 0 : first; k < chr->num_blocks && blocks[k].first_position <= last; k++)
+        {
+            const unsigned char * p = file->map + chr->data_offset + blocks[k].data_offset;
+            unsigned long         position = blocks[k].first_position;
+            uint32_t              i;
+
+            if (blocks[k].last_position < start)
+                continue;
+            for (i = 0; i < blocks[k].num_records; i++)
+            {
+                float value;
+
+                if (i)
+                    position += track_file_read_varint(&p);
+                memcpy(&value, p, sizeof(value));
+                p += sizeof(value);
+                if (position < start)
+                    continue;
+                if (position > last)
+                    break;
+                track_file_summary_add(&bins[track_file_summary_bin(position - start, num_bins, length)],
+                                       1, value, value, value);
+            }
+        }
+    }
+
+    for (b = 0; b < num_bins; b++)
+        if (bins[b].coverage)
+            bins[b].mean /= bins[b].coverage;
+    return bases;
+}
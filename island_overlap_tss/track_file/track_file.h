@@ -0,0 +1,83 @@
+/*
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Indexed binary track, built once from a "chromosome position value"
+ *   text track (methylome fractions, nucleosome reads) and then read
+ *   through mmap.
+ *
+ *   header      magic, block size, index fanout, zoom level widths and the
+ *               per-chromosome table
+ *   top index   first position of every fanout-th block, a page or so per
+ *               chromosome
+ *   block index first and last position, data offset and running sum and
+ *               count of each block, fanout entries to a page
+ *   zoom levels count, sum, min and max of the records in every 1kb, 10kb
+ *               and 100kb bin of the chromosome
+ *   data        per block: value of the first record, then for each
+ *               further record the varint position delta and its value
+ *
+ *   A point or range lookup reads the top index, one page of the block
+ *   index and the one or two data blocks at the edges.  Summaries of wide
+ *   regions come from the zoom levels without touching the records.
+ *
+ */
+
+#ifndef  TRACK_FILE_H
+#define  TRACK_FILE_H
+
+typedef struct track_file track_file;
+
+typedef struct
+{
+    unsigned long coverage;     // records in the bin, the rest is 0 without any
+    double        mean;
+    double        min;
+    double        max;
+} track_file_summary_t;
+
+// convert a text track to the indexed format, the input doesn't have to be
+// sorted and may be gzip / BGZF compressed.  Returns 0 on success.
+int track_file_build(const char * text_track, const char * track_path);
+
+// map a track file, returns NULL if the file can't be read or isn't one
+track_file * track_file_open(const char * track_path);
+
+void track_file_close(track_file * file);
+
+// last position with a record, 0 if the chromosome has none
+unsigned long track_file_chromosome_length(const track_file * file, int chromosome);
+
+// sum of values at positions in [start, end] (inclusive), num_records
+// receives the number of records summed if not NULL
+double track_file_sum(const track_file * file,
+                      int                chromosome,
+                      unsigned long      start,
+                      unsigned long      end,
+                      unsigned long *    num_records
+                     );
+
+// values at positions in [start, end] (inclusive) in position order, at
+// most max_values of them stored.  Returns how many there are, which may
+// be more than were stored.
+unsigned long track_file_values(const track_file * file,
+                                int                chromosome,
+                                unsigned long      start,
+                                unsigned long      end,
+                                float *            values,
+                                unsigned long      max_values
+                               );
+
+// summarize [start, end] in num_bins bins of (near) equal width, bin b
+// starting at start + b * (end - start + 1) / num_bins rounded down.  Bins at
+// least twice as wide as a zoom level are read from the coarsest such
+// level, whose bins are counted where they start, narrower ones from the
+// records.  Returns the width of the zoom level used, 0 for the records
+unsigned long track_file_summarize(const track_file *     file,
+                                   int                    chromosome,
+                                   unsigned long          start,
+                                   unsigned long          end,
+                                   int                    num_bins,
+                                   track_file_summary_t * bins
+                                  );
+
+#endif
@@ -0,0 +1,453 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Load a text track once into per-chromosome position / prefix sum arrays
+*
+*
+*************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "track_index.h"
+#include "../methylome_db/methylome_db.h"
+#include "../track_file/track_file.h"
+#include "../cytosine_report/cytosine_report.h"
+#include "../record_reader/record_reader.h"
+#include "../stream_stats/stream_stats.h"
+
+typedef struct
+{
+    int        chromosome;
+    uint32_t * positions;       // sorted
+    float *    values;          // as read, differences of large sums lose their low bits
+    double *   sums;            // sums[i] is the total of the first i values
+    uint64_t * methylated;      // and of their reads, for count reports only
+    uint64_t * coverage;
+    unsigned long count;
+} track_chromosome_t;
+
+struct track_index {
+    track_chromosome_t * chromosomes;
+    int                  num_chromosomes;
+    methylome_db *       packed;    // answers the sums instead for packed methylomes
+    track_file *         file;      // and for indexed binary tracks
+    int                  counts;    // loaded from read counts
+    int                  reference_count;
+};
+
+typedef struct
+{
+    int      chromosome;
+    uint32_t position;
+    float    value;
+} track_record_t;
+
+static int track_record_compare(const void * a, const void * b)
+{
+    const track_record_t * x = (const track_record_t *)a;
+    const track_record_t * y = (const track_record_t *)b;
+
+    if (x->chromosome != y->chromosome)
+        return x->chromosome < y->chromosome ? -1 : 1;
+    if (x->position != y->position)
+        return x->position < y->position ? -1 : 1;
+    return 0;
+}
+
+static int cytosine_count_compare(const void * a, const void * b)
+{
+    const cytosine_count_t * x = (const cytosine_count_t *)a;
+    const cytosine_count_t * y = (const cytosine_count_t *)b;
+
+    if (x->chromosome != y->chromosome)
+        return x->chromosome < y->chromosome ? -1 : 1;
+    if (x->position != y->position)
+        return x->position < y->position ? -1 : 1;
+    return 0;
+}
+
+// a new chromosome of count records at the end of the index, sums[0] set
+static track_chromosome_t * track_index_add_chromosome(track_index * index, int chromosome, unsigned long count)
+{
+    track_chromosome_t * c;
+
+    index->chromosomes = realloc(index->chromosomes, (index->num_chromosomes + 1) * sizeof(track_chromosome_t));
+    c = &index->chromosomes[index->num_chromosomes++];
+    c->chromosome = chromosome;
+    c->count      = count;
+    c->positions  = malloc(count * sizeof(uint32_t));
+    c->values     = malloc(count * sizeof(float));
+    c->sums       = malloc((count + 1) * sizeof(double));
+    c->methylated = NULL;
+    c->coverage   = NULL;
+    c->sums[0]    = 0.0;
+    return c;
+}
+
+track_index * track_index_load(const char * track_db)
+{
+    record_reader *    reader;
+    record_view_t      record;
+    track_index *      index;
+    track_record_t *   records;
+    size_t             num_records = 0, capacity = 1 << 20, i;
+    int                chromosome;
+    unsigned long      position;
+    float              value;
+    int                sorted = 1;
+    methylome_db *     packed;
+    track_file *       file;
+    uint64_t           load_start = stream_stats_now();
+
+    // packed methylomes (see methylome_pack) carry their own index
+    if ((packed = methylome_db_open(track_db)) != NULL)
+    {
+        index = calloc(1, sizeof(track_index));
+        index->packed = packed;
+        index->reference_count = 1;
+        return index;
+    }
+
+    // so do indexed binary tracks (see track_pack)
+    if ((file = track_file_open(track_db)) != NULL)
+    {
+        index = calloc(1, sizeof(track_index));
+        index->file = file;
+        index->reference_count = 1;
+        return index;
+    }
+
+    // gzip / BGZF text is inflated on the fly
+    if ((reader = record_reader_open(track_db)) == NULL)
+        return NULL;
+
+    records = malloc(capacity * sizeof(track_record_t));
+    while (record_reader_next(reader, &record))
+    {
+        // no chromosome is longer than 2^32, such a row is garbage too
+        if (record_parse_track_row(&record, &chromosome, &position, &value) || position > UINT32_MAX)
+        {
+            record_reader_reject(reader);
+            continue;
+        }
+        if (num_records == capacity)
+        {
+            capacity *= 2;
+            records = realloc(records, capacity * sizeof(track_record_t));
+        }
+        records[num_records].chromosome = chromosome;
+        records[num_records].position   = (uint32_t)position;
+        records[num_records].value      = value;
+        if (num_records && track_record_compare(&records[num_records - 1], &records[num_records]) > 0)
+            sorted = 0;
+        num_records++;
+    }
+    if (record_reader_close(reader))
+    {
+        free(records);
+        return NULL;
+    }
+
+    // still correct, but a db too large for memory needs sorting up front
+    if (!sorted)
+    {
+        fprintf(stderr, "%s is not sorted by chromosome and position, sorting %lu records in memory "
+                        "(track_sort sorts it once on disk)\n", track_db, (unsigned long)num_records);
+        qsort(records, num_records, sizeof(track_record_t), track_record_compare);
+    }
+
+    index = calloc(1, sizeof(track_index));
+    index->reference_count = 1;
+
+    for (i = 0; i < num_records; )
+    {
+        size_t               first = i, j;
+        track_chromosome_t * c;
+
+        while (i < num_records && records[i].chromosome == records[first].chromosome)
+            i++;
+
+        c = track_index_add_chromosome(index, records[first].chromosome, i - first);
+        for (j = 0; j < c->count; j++)
+        {
+            c->positions[j] = records[first + j].position;
+            c->values[j]    = records[first + j].value;
+            c->sums[j + 1]  = c->sums[j] + records[first + j].value;
+        }
+    }
+    free(records);
+
+    stream_stats_file_parsed(track_db, num_records, (stream_stats_now() - load_start) / 1e9);
+    return index;
+}
+
+track_index * track_index_load_counts(const char * report, unsigned int min_depth, int num_threads)
+{
+    track_index *      index;
+    cytosine_count_t * counts;
+    size_t             num_counts, i, j;
+
+    if ((counts = cytosine_report_read(report, min_depth, num_threads, &num_counts)) == NULL)
+        return NULL;
+
+    // reports come in the aligner's chromosome order, often not numeric
+    for (i = 1; i < num_counts && cytosine_count_compare(&counts[i - 1], &counts[i]) <= 0; i++)
+        ;
+    if (i < num_counts)
+        qsort(counts, num_counts, sizeof(cytosine_count_t), cytosine_count_compare);
+
+    index = calloc(1, sizeof(track_index));
+    index->counts = 1;
+    index->reference_count = 1;
+
+    for (i = 0; i < num_counts; )
+    {
+        size_t               first = i;
+        track_chromosome_t * c;
+
+        while (i < num_counts && counts[i].chromosome == counts[first].chromosome)
+            i++;
+
+        c = track_index_add_chromosome(index, counts[first].chromosome, i - first);
+        c->methylated    = malloc((c->count + 1) * sizeof(uint64_t));
+        c->coverage      = malloc((c->count + 1) * sizeof(uint64_t));
+        c->methylated[0] = 0;
+        c->coverage[0]   = 0;
+        for (j = 0; j < c->count; j++)
+        {
+            const cytosine_count_t * count = &counts[first + j];
+
+            c->positions[j]      = count->position;
+            c->values[j]         = (float)((double)count->methylated / count->coverage);
+            c->sums[j + 1]       = c->sums[j] + (double)count->methylated / count->coverage;
+            c->methylated[j + 1] = c->methylated[j] + count->methylated;
+            c->coverage[j + 1]   = c->coverage[j] + count->coverage;
+        }
+    }
+    free(counts);
+
+    return index;
+}
+
+int track_index_has_counts(const track_index * index)
+{
+    return index->counts;
+}
+
+track_index * track_index_ref(track_index * index)
+{
+    index->reference_count++;
+    return index;
+}
+
+void track_index_delete(track_index * index)
+{
+    int c;
+
+    if (!index || --index->reference_count > 0)
+        return;
+    methylome_db_close(index->packed);
+    track_file_close(index->file);
+    for (c = 0; c < index->num_chromosomes; c++)
+    {
+        free(index->chromosomes[c].positions);
+        free(index->chromosomes[c].values);
+        free(index->chromosomes[c].sums);
+        free(index->chromosomes[c].methylated);
+        free(index->chromosomes[c].coverage);
+    }
+    free(index->chromosomes);
+    free(index);
+}
+
+// number of positions below limit
+static unsigned long track_index_rank(const track_chromosome_t * c, unsigned long limit)
+{
+    unsigned long lo = 0, hi = c->count;
+
+    while (lo < hi)
+    {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if (c->positions[mid] < limit)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// track_index_rank for a limit whose rank is known to be at least from,
+// galloping out from there so a near edge costs a few steps, a far one a log
+static unsigned long track_index_rank_from(const track_chromosome_t * c, unsigned long from, unsigned long limit)
+{
+    unsigned long lo = from, hi, step = 1;
+
+    while (lo + step < c->count && c->positions[lo + step - 1] < limit)
+    {
+        lo   += step;
+        step *= 2;
+    }
+    hi = lo + step < c->count ? lo + step : c->count;
+
+    while (lo < hi)
+    {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if (c->positions[mid] < limit)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static const track_chromosome_t * track_index_find_chromosome(const track_index * index, int chromosome)
+{
+    int i;
+
+    for (i = 0; i < index->num_chromosomes; i++)
+        if (index->chromosomes[i].chromosome == chromosome)
+            return &index->chromosomes[i];
+    return NULL;
+}
+
+double track_index_sum(const track_index * index,
+                       int                 chromosome,
+                       unsigned long       start,
+                       unsigned long       end,
+                       unsigned long *     num_records
+                      )
+{
+    const track_chromosome_t * c;
+    unsigned long              first, last;
+
+    if (index->packed)
+        return methylome_db_sum(index->packed, chromosome, start, end, num_records);
+    if (index->file)
+        return track_file_sum(index->file, chromosome, start, end, num_records);
+
+    c = track_index_find_chromosome(index, chromosome);
+    if (num_records)
+        *num_records = 0;
+    if (!c || start > end)
+        return 0.0;
+
+    first = track_index_rank(c, start);
+    last  = track_index_rank(c, end + 1);
+
+    if (num_records)
+        *num_records = last - first;
+    return c->sums[last] - c->sums[first];
+}
+
+double track_index_weighted_sum(const track_index * index,
+                                int                 chromosome,
+                                unsigned long       start,
+                                unsigned long       end,
+                                double *            weight
+                               )
+{
+    const track_chromosome_t * c;
+    unsigned long              first, last;
+    double                     sum;
+
+    if (!index->counts)
+    {
+        unsigned long num_records;
+
+        sum     = track_index_sum(index, chromosome, start, end, &num_records);
+        *weight = (double)num_records;
+        return sum;
+    }
+
+    *weight = 0.0;
+    if (!(c = track_index_find_chromosome(index, chromosome)) || start > end)
+        return 0.0;
+
+    first = track_index_rank(c, start);
+    last  = track_index_rank(c, end + 1);
+
+    *weight = (double)(c->coverage[last] - c->coverage[first]);
+    return (double)(c->methylated[last] - c->methylated[first]);
+}
+
+unsigned long track_index_values(const track_index * index,
+                                 int                 chromosome,
+                                 unsigned long       start,
+                                 unsigned long       end,
+                                 float *             values,
+                                 unsigned long       max_values
+                                )
+{
+    const track_chromosome_t * c;
+    unsigned long              first, last, j;
+
+    if (index->packed)
+        return methylome_db_values(index->packed, chromosome, start, end, values, max_values);
+    if (index->file)
+        return track_file_values(index->file, chromosome, start, end, values, max_values);
+
+    if (!(c = track_index_find_chromosome(index, chromosome)) || start > end)
+        return 0;
+
+    first = track_index_rank(c, start);
+    last  = track_index_rank(c, end + 1);
+
+    for (j = first; j < last && j - first < max_values; j++)
+        values[j - first] = c->values[j];
+
+    return last - first;
+}
+
+void track_index_bin_sums(const track_index * index,
+                          int                 chromosome,
+                          long                start,
+                          unsigned long       bin_size,
+                          int                 num_bins,
+                          double *            sums,
+                          unsigned long *     num_records
+                         )
+{
+    const track_chromosome_t * c;
+    unsigned long              first, last;
+    long                       edge;
+    int                        b;
+
+    if (index->packed || index->file)
+    {
+        // the block indexes answer each bin with two lookups
+        for (b = 0; b < num_bins; b++, start += bin_size)
+        {
+            long bin_end = start + (long)bin_size - 1;
+
+            sums[b] = bin_end < 1 ? 0.0 : track_index_sum(index, chromosome, start < 1 ? 1 : start,
+                                                          bin_end, num_records ? &num_records[b] : NULL);
+            if (bin_end < 1 && num_records)
+                num_records[b] = 0;
+        }
+        return;
+    }
+
+    if (!(c = track_index_find_chromosome(index, chromosome)))
+    {
+        memset(sums, 0, num_bins * sizeof(double));
+        if (num_records)
+            memset(num_records, 0, num_bins * sizeof(unsigned long));
+        return;
+    }
+
+    // positions are sorted, so each bin edge is searched for from the last one
+    first = track_index_rank(c, start < 1 ? 1 : start);
+    for (b = 0, edge = start + bin_size; b < num_bins; b++, edge += bin_size)
+    {
+        last    = edge < 1 ? first : track_index_rank_from(c, first, edge);
+        sums[b] = c->sums[last] - c->sums[first];
+        if (num_records)
+            num_records[b] = last - first;
+        first = last;
+    }
+}
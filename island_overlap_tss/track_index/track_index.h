@@ -0,0 +1,89 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Cumulative sum index over a "chromosome position value" text track
+ *   (methylome fractions, nucleosome reads).  Each chromosome keeps its
+ *   sorted positions and the running sum of values, so the sum over any
+ *   interval is two binary searches and a subtraction, in any query order.
+ *   Packed methylome dbs (see methylome_db.h) and indexed binary tracks
+ *   (see track_file.h) are opened through the same interface.
+ *
+ *   Bismark read counts (see cytosine_report.h) load into the same
+ *   index, their values being each cytosine's methylated fraction, with
+ *   running sums of methylated and covering reads kept alongside for
+ *   coverage weighted means.
+ *
+ *   Indexes are read only once loaded, so one copy can be shared by
+ *   streams on several threads.  Take a reference for each user.
+ *
+ */
+
+#ifndef  TRACK_INDEX_H
+#define  TRACK_INDEX_H
+
+typedef struct track_index track_index;
+
+// read the whole track, it is sorted here if it isn't already.  Text
+// tracks may be gzip / BGZF compressed.  Returns NULL if file can't be
+// read or is corrupt.
+track_index * track_index_load(const char * track_db);
+
+// read a Bismark coverage file or cytosine report, parsed on num_threads
+// threads, keeping the cytosines covered by at least min_depth reads.
+// Returns NULL if the file can't be read or is corrupt.
+track_index * track_index_load_counts(const char * report, unsigned int min_depth, int num_threads);
+
+// non-zero if the index was loaded from read counts
+int track_index_has_counts(const track_index * index);
+
+track_index * track_index_ref(track_index * index);
+
+// drops a reference, the index is freed with the last one
+void track_index_delete(track_index * index);
+
+// sum of values at positions in [start, end] (inclusive), num_records
+// receives the number of records summed if not NULL
+double track_index_sum(const track_index * index,
+                       int                 chromosome,
+                       unsigned long       start,
+                       unsigned long       end,
+                       unsigned long *     num_records
+                      );
+
+// methylated reads at positions in [start, end] (inclusive), *weight
+// receives the covering reads, both found by the same two searches.  For
+// tracks without counts every value weighs 1: the sum of the values and
+// the number of records.
+double track_index_weighted_sum(const track_index * index,
+                                int                 chromosome,
+                                unsigned long       start,
+                                unsigned long       end,
+                                double *            weight
+                               );
+
+// values at positions in [start, end] (inclusive) in position order, at
+// most max_values of them stored.  Returns how many there are, which may
+// be more than were stored.
+unsigned long track_index_values(const track_index * index,
+                                 int                 chromosome,
+                                 unsigned long       start,
+                                 unsigned long       end,
+                                 float *             values,
+                                 unsigned long       max_values
+                                );
+
+// sums of num_bins adjacent bins of bin_size bases, the first starting at
+// start, which may lie before position 1.  The start is searched for once
+// and each further bin edge from the one before, in steps logarithmic in
+// the records of the bin.  num_records, if not NULL, receives each bin's
+// count
+void track_index_bin_sums(const track_index * index,
+                          int                 chromosome,
+                          long                start,
+                          unsigned long       bin_size,
+                          int                 num_bins,
+                          double *            sums,
+                          unsigned long *     num_records
+                         );
+
+#endif
@@ -0,0 +1,44 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*  convert a text track to the indexed binary format with zoom levels, read
+*  by track_summary and by every tool that takes a methylome or nucleosome db
+*
+*************************************************/
+#include "track_file/track_file.h"
+#include "stream_stats/stream_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+void usage(const char * name)
+{
+   printf("Usage: %s [--stats] <track db> <indexed track>\n", name);
+}
+
+
+int main(int argc, char ** argv)
+{
+    // --stats reports the parse time as JSON on stderr
+    stream_stats_parse_flag(&argc, argv);
+
+    if (argc != 3)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+
+    if (track_file_build(argv[1], argv[2]))
+    {
+        fprintf(stderr, "Failed to index track %s\n", argv[1]);
+        exit(1);
+    }
+
+    if (stream_stats_enabled())
+        stream_stats_write_json(stderr);
+    return 0;
+}
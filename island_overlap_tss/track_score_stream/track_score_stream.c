@@ -0,0 +1,253 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Score features against a position track as a spec says: reduce the
+*   values under each feature, normalize, store as score or attribute
+*
+*
+*************************************************/
+#include <genometools.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "track_score_stream.h"
+#include "../track_index/track_index.h"
+#include "../typed_attribute/typed_attribute.h"
+
+
+struct track_score_stream {
+    const GtNodeStream parent_instance;
+    GtNodeStream * in_stream;
+    track_index * track;
+    track_score_spec_t spec;
+    typed_attribute_key score_key;
+    float * values;
+    unsigned long max_values;
+    unsigned long num_scored;
+};
+
+typedef struct track_score_stream track_score_stream;
+
+#define TRACK_SCORE_STREAM_MIN_VALUES 4096
+
+#define track_score_stream_cast(GS) gt_node_stream_cast(track_score_stream_class(), GS);
+
+
+// values of the track in [start, end] into the stream's buffer, grown
+// and fetched again if they didn't fit
+static unsigned long track_score_stream_fetch(track_score_stream * context,
+                                              int                  chromosome,
+                                              unsigned long        start,
+                                              unsigned long        end
+                                             )
+{
+    unsigned long n = track_index_values(context->track, chromosome, start, end,
+                                         context->values, context->max_values);
+
+    if (n > context->max_values)
+    {
+        free(context->values);
+        context->max_values = n + n / 2;
+        context->values     = malloc(context->max_values * sizeof(float));
+        n = track_index_values(context->track, chromosome, start, end,
+                               context->values, context->max_values);
+    }
+
+    return n;
+}
+
+static float track_score_stream_max(const float * values, unsigned long n)
+{
+    float         max = values[0];
+    unsigned long i;
+
+    // no branch in the loop so it vectorizes
+    for (i = 1; i < n; i++)
+        max = values[i] > max ? values[i] : max;
+
+    return max;
+}
+
+static double track_score_stream_variance(const float * values, unsigned long n)
+{
+    double        mean = 0, m2 = 0, delta;
+    unsigned long i;
+
+    // Welford, stable where sum of squares minus squared sum is not
+    for (i = 0; i < n; i++)
+    {
+        delta = values[i] - mean;
+        mean += delta / (double)(i + 1);
+        m2   += delta * (values[i] - mean);
+    }
+
+    return m2 / (double)n;
+}
+
+static double track_score_stream_reduce(track_score_stream * context,
+                                        int                  chromosome,
+                                        unsigned long        start,
+                                        unsigned long        end
+                                       )
+{
+    unsigned long n;
+    double        sum, weight;
+
+    // sums come straight from the index, the rest need the values
+    switch (context->spec.reducer)
+    {
+        case TRACK_REDUCE_SUM:
+            return track_index_sum(context->track, chromosome, start, end, NULL);
+
+        case TRACK_REDUCE_MEAN:
+            sum = track_index_sum(context->track, chromosome, start, end, &n);
+            return n ? sum / (double)n : 0.0;
+
+        case TRACK_REDUCE_WEIGHTED:
+            sum = track_index_weighted_sum(context->track, chromosome, start, end, &weight);
+            return weight > 0 ? sum / weight : 0.0;
+
+        case TRACK_REDUCE_COVERAGE:
+            track_index_sum(context->track, chromosome, start, end, &n);
+            return (double)n;
+
+        case TRACK_REDUCE_MAX:
+            n = track_score_stream_fetch(context, chromosome, start, end);
+            return n ? track_score_stream_max(context->values, n) : 0.0;
+
+        case TRACK_REDUCE_VARIANCE:
+            n = track_score_stream_fetch(context, chromosome, start, end);
+            return n ? track_score_stream_variance(context->values, n) : 0.0;
+    }
+
+    return 0.0;
+}
+
+static int track_score_stream_next(GtNodeStream * ns,
+                                   GtGenomeNode ** gn,
+                                   GtError * err)
+{
+    GtGenomeNode * cur_node;
+    int err_num = 0;
+    *gn = NULL;
+    track_score_stream * score_stream;
+    unsigned long start;
+    unsigned long end;
+    double value;
+    float score;
+    int chromosome_num;
+    const char * divisor_str;
+    unsigned long divisor = 1;
+
+    score_stream = track_score_stream_cast(ns);
+
+    if(!(err_num = gt_node_stream_next(score_stream->in_stream,
+                                       &cur_node,
+                                       err
+                                      )) && cur_node != NULL
+      )
+    {
+        *gn = cur_node;
+
+        // try casting as a feature node so we can test type
+        if(!gt_genome_node_try_cast(gt_feature_node_class(), cur_node))
+            return 0;
+
+        if(!gt_feature_node_has_type((GtFeatureNode *)cur_node, score_stream->spec.feature_type))
+            return 0;
+
+        if (sscanf(gt_str_get(gt_genome_node_get_seqid(cur_node)), "Chr%d", &chromosome_num) != 1)
+            return 0;
+
+        start = gt_genome_node_get_start(cur_node);
+        end   = gt_genome_node_get_end(cur_node);
+
+        switch (score_stream->spec.normalizer)
+        {
+            case TRACK_NORMALIZE_NONE:
+                break;
+
+            case TRACK_NORMALIZE_LENGTH:
+                divisor = end - start + 1;
+                break;
+
+            case TRACK_NORMALIZE_ATTRIBUTE:
+                divisor_str = gt_feature_node_get_attribute((GtFeatureNode *)cur_node,
+                                                            score_stream->spec.normalize_attribute);
+                if (!divisor_str)
+                    return 0;
+                divisor = strtoul(divisor_str, NULL, 10);
+                break;
+        }
+
+        value = divisor ? track_score_stream_reduce(score_stream, chromosome_num, start, end) / (double)divisor
+                        : 0.0;
+        score = (float)value;
+
+        // save the score into the node, attributes as floats until they
+        // are written when the output stage allows
+        if (score_stream->spec.score_attribute)
+            typed_attribute_set((GtFeatureNode *)cur_node, score_stream->score_key, score);
+        else
+            gt_feature_node_set_score((GtFeatureNode *)cur_node, score);
+        score_stream->num_scored++;
+    }
+
+    return err_num;
+}
+
+static void track_score_stream_free(GtNodeStream * ns)
+{
+    track_score_stream * score_stream;
+    
+    score_stream = track_score_stream_cast(ns);
+    free(score_stream->values);
+    track_index_delete(score_stream->track);
+    gt_node_stream_delete(score_stream->in_stream);
+    return;
+}
+
+const GtNodeStreamClass * track_score_stream_class(void)
+{
+    static const GtNodeStreamClass * c = NULL;
+
+    if (!c)
+    {	
+        c = gt_node_stream_class_new( sizeof(track_score_stream),
+                                      track_score_stream_free,
+                                      track_score_stream_next
+                                    );
+    }
+    
+    return c;
+}
+
+GtNodeStream * track_score_stream_new_with_index(GtNodeStream *             in_stream,
+                                                 track_index *              track,
+                                                 const track_score_spec_t * spec
+                                                )
+{
+    GtNodeStream * ns = gt_node_stream_create(track_score_stream_class(), 
+                                              true); // must be sorted
+    track_score_stream * score_stream = track_score_stream_cast(ns);
+    gt_assert(in_stream && track && spec);
+    gt_assert(spec->normalizer != TRACK_NORMALIZE_ATTRIBUTE || spec->normalize_attribute);
+    score_stream->in_stream  = gt_node_stream_ref(in_stream);
+    score_stream->track      = track_index_ref(track);
+    score_stream->spec       = *spec;
+    score_stream->score_key  = spec->score_attribute ? typed_attribute_intern(spec->score_attribute) : -1;
+    score_stream->max_values = TRACK_SCORE_STREAM_MIN_VALUES;
+    score_stream->values     = malloc(score_stream->max_values * sizeof(float));
+    score_stream->num_scored = 0;
+
+    return ns;
+}
+
+unsigned long track_score_stream_num_scored(GtNodeStream * ns)
+{
+    track_score_stream * score_stream = track_score_stream_cast(ns);
+    return score_stream->num_scored;
+}
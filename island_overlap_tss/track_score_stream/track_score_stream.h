@@ -0,0 +1,9 @@
+
+#ifndef TRACK_SCORE_STREAM_H
+#define TRACK_SCORE_STREAM_H
+
+#include "track_score_stream_api.h"
+
+const GtNodeStreamClass * track_score_stream_class(void);
+
+#endif
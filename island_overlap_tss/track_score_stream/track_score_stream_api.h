@@ -0,0 +1,56 @@
+/* 
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Scores features of one type from a position track.  What a score is
+ *   comes from a spec: how the track values under the feature are reduced,
+ *   what the result is divided by, and where it is stored, so a new track
+ *   type is a spec rather than another stream.
+ *
+ */
+
+#ifndef  TRACK_SCORE_STREAM_API_H
+#define  TRACK_SCORE_STREAM_API_H
+
+#include "../track_index/track_index.h"
+
+typedef enum
+{
+    TRACK_REDUCE_SUM,      // sum of the values
+    TRACK_REDUCE_MEAN,     // mean of the values, 0 without any
+    TRACK_REDUCE_MAX,      // largest value, 0 without any
+    TRACK_REDUCE_COVERAGE, // number of positions with a value
+    TRACK_REDUCE_VARIANCE, // population variance of the values (Welford)
+    TRACK_REDUCE_WEIGHTED  // methylated over covering reads of a count
+                           // track, 0 without any, the mean otherwise
+} track_reducer_t;
+
+typedef enum
+{
+    TRACK_NORMALIZE_NONE,
+    TRACK_NORMALIZE_LENGTH,   // divided by the feature length
+    TRACK_NORMALIZE_ATTRIBUTE // divided by an integer attribute, features
+                              // without it are not scored, 0 scores 0
+} track_normalizer_t;
+
+typedef struct
+{
+    const char *       feature_type;        // features scored, eg "CpGI"
+    track_reducer_t    reducer;
+    track_normalizer_t normalizer;
+    const char *       normalize_attribute; // for TRACK_NORMALIZE_ATTRIBUTE
+    const char *       score_attribute;     // typed attribute the score goes
+                                            // in, NULL for the score column
+} track_score_spec_t;
+
+// score features of spec->feature_type on Chr<n> seqids against track,
+// the stream takes its own reference and copies the spec (the strings in
+// it must outlive the stream)
+GtNodeStream* track_score_stream_new_with_index(GtNodeStream *             in_stream,
+                                                track_index *              track,
+                                                const track_score_spec_t * spec
+                                               );
+
+// number of features scored so far
+unsigned long track_score_stream_num_scored(GtNodeStream * ns);
+
+#endif
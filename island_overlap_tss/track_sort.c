@@ -0,0 +1,95 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*  sort a methylome, nucleosome or island db too large for memory by
+*  chromosome and position, or check that one already is
+*
+*************************************************/
+#include "external_sort/external_sort.h"
+#include "stream_stats/stream_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+void usage(const char * name)
+{
+   printf("Usage: %s [--stats] [-k <chromosome column>,<position column>] [-m <memory MB>] [-j <threads>]\n"
+          "       [-T <temp dir>] <in db> <out db>\n", name);
+   printf("       %s [-k <chromosome column>,<position column>] -c <in db>\n", name);
+   printf("   columns default to 1,2 for methylome and nucleosome tracks, use -k 2,3\n");
+   printf("   for island lists.  Sorting uses at most 1024 MB unless -m is given,\n");
+   printf("   runs go next to <out db> unless -T is given\n");
+   printf("   -c only checks the order, exiting 0 if sorted and 2 if not\n");
+}
+
+
+int main(int argc, char ** argv)
+{
+    external_sort_options_t options;
+    unsigned long           memory_mb = 1024, bad_line;
+    int                     check = 0, opt, sorted;
+
+    // --stats reports the parse time as JSON on stderr
+    stream_stats_parse_flag(&argc, argv);
+
+    options.chromosome_column = 1;
+    options.position_column   = 2;
+    options.num_threads       = sysconf(_SC_NPROCESSORS_ONLN);
+    options.temp_dir          = NULL;
+
+    while ((opt = getopt(argc, argv, "k:m:j:T:c")) != -1)
+    {
+        switch (opt)
+        {
+        case 'k':
+            if (2 != sscanf(optarg, "%d,%d", &options.chromosome_column, &options.position_column))
+                options.chromosome_column = 0;
+            break;
+        case 'm': memory_mb           = strtoul(optarg, NULL, 10); break;
+        case 'j': options.num_threads = atoi(optarg); break;
+        case 'T': options.temp_dir    = optarg; break;
+        case 'c': check               = 1; break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != (check ? 1 : 2) || options.num_threads < 1 || memory_mb < 16 ||
+        options.chromosome_column < 1 || options.position_column < 1 ||
+        options.chromosome_column == options.position_column)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+    options.memory_limit = (size_t)memory_mb << 20;
+
+    if (check)
+    {
+        sorted = external_sort_check(argv[optind], options.chromosome_column, options.position_column, &bad_line);
+        if (sorted < 0)
+        {
+            fprintf(stderr, "Failed to read %s\n", argv[optind]);
+            exit(1);
+        }
+        if (!sorted)
+            printf("%s is not sorted, line %lu is out of order\n", argv[optind], bad_line);
+        return sorted ? 0 : 2;
+    }
+
+    if (external_sort_file(argv[optind], argv[optind + 1], &options))
+    {
+        fprintf(stderr, "Failed to sort %s\n", argv[optind]);
+        exit(1);
+    }
+
+    if (stream_stats_enabled())
+        stream_stats_write_json(stderr);
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*  summarize a region of an indexed track in equal bins, wide bins are read
+*  from the precomputed zoom levels rather than the records
+*
+*************************************************/
+#include "track_file/track_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+void usage(const char * name)
+{
+   printf("Usage: %s <indexed track> <chromosome> [<start> <end>] [<bins>]\n", name);
+   printf("   prints start end coverage mean min max for each bin, by default\n");
+   printf("   1000 bins over the whole chromosome\n");
+}
+
+
+int main(int argc, char ** argv)
+{
+    track_file *           file;
+    track_file_summary_t * bins;
+    unsigned long          start = 1, end, length, bases;
+    int                    chromosome, num_bins = 1000, b;
+
+    if (argc != 3 && argc != 4 && argc != 5 && argc != 6)
+    {
+       usage(argv[0]);
+       exit(1);
+    }
+
+    if ((file = track_file_open(argv[1])) == NULL)
+    {
+        fprintf(stderr, "Failed to open indexed track %s\n", argv[1]);
+        exit(1);
+    }
+
+    chromosome = atoi(argv[2]);
+    end        = track_file_chromosome_length(file, chromosome);
+    if (argc >= 5)
+    {
+        start = strtoul(argv[3], NULL, 10);
+        end   = strtoul(argv[4], NULL, 10);
+    }
+    else if (end == 0)
+    {
+        fprintf(stderr, "Chromosome %d has no records in %s\n", chromosome, argv[1]);
+        track_file_close(file);
+        exit(1);
+    }
+    if (argc == 4 || argc == 6)
+        num_bins = atoi(argv[argc - 1]);
+
+    if (num_bins < 1 || start > end)
+    {
+        track_file_close(file);
+        usage(argv[0]);
+        exit(1);
+    }
+
+    bins   = malloc(num_bins * sizeof(track_file_summary_t));
+    bases  = track_file_summarize(file, chromosome, start, end, num_bins, bins);
+    length = end - start + 1;
+
+    if (bases)
+        fprintf(stderr, "read from the %lu base zoom level\n", bases);
+    for (b = 0; b < num_bins; b++)
+        printf("%lu\t%lu\t%lu\t%g\t%g\t%g\n",
+               start + b * length / num_bins, start + (b + 1) * length / num_bins - 1,
+               bins[b].coverage, bins[b].mean, bins[b].min, bins[b].max);
+
+    free(bins);
+    track_file_close(file);
+    return 0;
+}
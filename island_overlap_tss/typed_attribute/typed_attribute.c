@@ -0,0 +1,288 @@
+/*
+* @file
+* @author Brock Anderson <brock.wright.anderson@gmail.com>
+* @section LICENSE
+* Released to public domain without restriction
+*
+* @section DESCRIPTION
+*   Interned numeric attributes kept as floats on the nodes, and shortest
+*   round trip float formatting
+*
+*
+*************************************************/
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typed_attribute.h"
+
+
+typedef struct
+{
+    unsigned int      num_attributes;
+    typed_attribute_t attributes[TYPED_ATTRIBUTE_PER_NODE];
+} typed_attribute_node_t;
+
+static const char *    typed_attribute_user_data = "typed_attribute";
+static pthread_mutex_t typed_attribute_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *    typed_attribute_names[TYPED_ATTRIBUTE_MAX_KEYS];
+static size_t          typed_attribute_lengths[TYPED_ATTRIBUTE_MAX_KEYS];
+static int             typed_attribute_num_keys = 0;
+static int             typed_attribute_on = 0;
+
+// the powers a double holds exactly, so scaling by one rounds only once
+static const double typed_attribute_powers[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define TYPED_ATTRIBUTE_MAX_POWER 22
+
+
+typed_attribute_key typed_attribute_intern(const char * name)
+{
+    typed_attribute_key key;
+
+    pthread_mutex_lock(&typed_attribute_lock);
+    for (key = 0; key < typed_attribute_num_keys; key++)
+        if (!strcmp(typed_attribute_names[key], name))
+            break;
+    if (key == typed_attribute_num_keys && key < TYPED_ATTRIBUTE_MAX_KEYS)
+    {
+        typed_attribute_names[key]   = name;
+        typed_attribute_lengths[key] = strlen(name);
+        typed_attribute_num_keys++;
+    }
+    pthread_mutex_unlock(&typed_attribute_lock);
+
+    // the names are the literals of the scoring streams, a full table is a
+    // bug rather than bad input
+    gt_assert(key < TYPED_ATTRIBUTE_MAX_KEYS);
+
+    return key;
+}
+
+const char * typed_attribute_name(typed_attribute_key key, size_t * length)
+{
+    if (length)
+        *length = typed_attribute_lengths[key];
+    return typed_attribute_names[key];
+}
+
+void typed_attribute_enable(void)
+{
+    typed_attribute_on = 1;
+}
+
+int typed_attribute_enabled(void)
+{
+    return typed_attribute_on;
+}
+
+// value * 10^exponent
+static double typed_attribute_scale(double value, int exponent)
+{
+    return exponent >= 0 ? value * typed_attribute_powers[exponent] : value / typed_attribute_powers[-exponent];
+}
+
+// the decimal digits * 10^-shift stands for value if it reads back as it.
+// Rounded once to a double it does so if the double rounds to value and
+// isn't halfway to a neighbour, where the decimal itself may have been on
+// either side.  A decimal the double holds exactly is the halfway point,
+// and rounds to the even float as strtof would.
+static int typed_attribute_round_trips(double digits, int shift, float value)
+{
+    double candidate = typed_attribute_scale(digits, -shift);
+    double below     = ((double)value + nextafterf(value, 0.0f)) / 2;
+    double above     = ((double)value + nextafterf(value, INFINITY)) / 2;
+    int    exact;
+
+    exact = shift >= 0 ? fma(candidate, typed_attribute_powers[shift], -digits) == 0
+                       : fma(digits, typed_attribute_powers[-shift], -candidate) == 0;
+    return (float)candidate == value && (exact || (candidate != below && candidate != above));
+}
+
+int typed_attribute_format_float(char * buffer, float value)
+{
+    char     digits[16];
+    double   d = value;
+    uint64_t mantissa = 0;
+    int      length = 0, exponent, precision, shift = 0, num_digits, point, i;
+
+    if (isnan(value))
+    {
+        memcpy(buffer, "nan", 3);
+        return 3;
+    }
+    if (signbit(value))
+    {
+        buffer[length++] = '-';
+        value = -value;
+        d     = -d;
+    }
+    if (isinf(value))
+    {
+        memcpy(buffer + length, "inf", 3);
+        return length + 3;
+    }
+    if (value == 0)
+    {
+        buffer[length++] = '0';
+        return length;
+    }
+
+    // the fewest digits, 9 always do for a float, whose decimal reads back
+    exponent = (int)floor(log10(d));
+    for (precision = 1; precision <= 9; precision++)
+    {
+        double scaled, low, high;
+
+        shift = precision - 1 - exponent;
+        if (shift > TYPED_ATTRIBUTE_MAX_POWER || shift < -TYPED_ATTRIBUTE_MAX_POWER)
+            break;
+
+        scaled = typed_attribute_scale(d, shift);
+        low    = floor(scaled);
+        high   = low + 1;
+
+        // of two that work the nearer one
+        if (scaled - low <= high - scaled)
+        {
+            if (low > 0 && typed_attribute_round_trips(low, shift, value))
+                mantissa = (uint64_t)low;
+            else if (typed_attribute_round_trips(high, shift, value))
+                mantissa = (uint64_t)high;
+        }
+        else
+        {
+            if (typed_attribute_round_trips(high, shift, value))
+                mantissa = (uint64_t)high;
+            else if (low > 0 && typed_attribute_round_trips(low, shift, value))
+                mantissa = (uint64_t)low;
+        }
+        if (mantissa)
+            break;
+    }
+
+    // far out of range of the exact powers, which scores never are, so
+    // the slow way
+    if (!mantissa)
+    {
+        for (precision = 1; precision < 9; precision++)
+        {
+            snprintf(digits, sizeof(digits), "%.*g", precision, d);
+            if (strtof(digits, NULL) == value)
+                break;
+        }
+        return length + snprintf(buffer + length, TYPED_ATTRIBUTE_FLOAT_MAX - length, "%.*g", precision, d);
+    }
+
+    while (mantissa % 10 == 0)
+    {
+        mantissa /= 10;
+        shift--;
+    }
+    for (num_digits = 0; mantissa; mantissa /= 10)
+        digits[num_digits++] = '0' + mantissa % 10;
+    for (i = 0; i < num_digits / 2; i++)
+    {
+        char swap = digits[i];
+        digits[i] = digits[num_digits - 1 - i];
+        digits[num_digits - 1 - i] = swap;
+    }
+
+    // value is 0.digits * 10^point
+    point = num_digits - shift;
+    if (point > 0 && point <= 9)
+    {
+        if (point >= num_digits)
+        {
+            memcpy(buffer + length, digits, num_digits);
+            length += num_digits;
+            for (i = num_digits; i < point; i++)
+                buffer[length++] = '0';
+        }
+        else
+        {
+            memcpy(buffer + length, digits, point);
+            length += point;
+            buffer[length++] = '.';
+            memcpy(buffer + length, digits + point, num_digits - point);
+            length += num_digits - point;
+        }
+    }
+    else if (point <= 0 && point > -4)
+    {
+        buffer[length++] = '0';
+        buffer[length++] = '.';
+        for (i = point; i < 0; i++)
+            buffer[length++] = '0';
+        memcpy(buffer + length, digits, num_digits);
+        length += num_digits;
+    }
+    else
+    {
+        buffer[length++] = digits[0];
+        if (num_digits > 1)
+        {
+            buffer[length++] = '.';
+            memcpy(buffer + length, digits + 1, num_digits - 1);
+            length += num_digits - 1;
+        }
+        length += sprintf(buffer + length, "e%d", point - 1);
+    }
+
+    return length;
+}
+
+void typed_attribute_set(GtFeatureNode * fn, typed_attribute_key key, float value)
+{
+    typed_attribute_node_t * node;
+    char                     text[TYPED_ATTRIBUTE_FLOAT_MAX];
+    unsigned int             i;
+
+    if (typed_attribute_on)
+    {
+        node = gt_genome_node_get_user_data((GtGenomeNode *)fn, typed_attribute_user_data);
+        if (!node)
+        {
+            node = malloc(sizeof(typed_attribute_node_t));
+            node->num_attributes = 0;
+            gt_genome_node_add_user_data((GtGenomeNode *)fn, typed_attribute_user_data, node, free);
+        }
+
+        for (i = 0; i < node->num_attributes && node->attributes[i].key != key; i++)
+            ;
+        if (i < TYPED_ATTRIBUTE_PER_NODE)
+        {
+            // a text value of the same name would be written beside it
+            if (i == node->num_attributes && gt_feature_node_get_attribute(fn, typed_attribute_names[key]))
+                gt_feature_node_remove_attribute(fn, typed_attribute_names[key]);
+
+            node->attributes[i].key   = key;
+            node->attributes[i].value = value;
+            if (i == node->num_attributes)
+                node->num_attributes++;
+            return;
+        }
+    }
+
+    // no room left on the node, or typed values are off
+    text[typed_attribute_format_float(text, value)] = '\0';
+    gt_feature_node_set_attribute(fn, typed_attribute_names[key], text);
+}
+
+unsigned int typed_attribute_list(GtFeatureNode * fn, const typed_attribute_t ** list)
+{
+    typed_attribute_node_t * node;
+
+    if (!typed_attribute_on ||
+        !(node = gt_genome_node_get_user_data((GtGenomeNode *)fn, typed_attribute_user_data)))
+        return 0;
+
+    *list = node->attributes;
+    return node->num_attributes;
+}
@@ -0,0 +1,56 @@
+/*
+ * @author brock a<brock.wright.anderson@gmail.cm>
+ *
+ *   Numeric attributes the scoring streams attach to feature nodes.  Keys
+ *   are interned once when a stream is built, values are formatted in the
+ *   fewest digits that read back as the same float.
+ *
+ *   Once typed attributes are enabled (gff3_fast_out_stream does it) a
+ *   value is kept on the node as a float in its user data and only turned
+ *   into text as it is written, nothing is allocated per attribute.
+ *   Otherwise it is formatted straight into a node attribute, so any
+ *   genometools writer still sees it.
+ *
+ */
+
+#ifndef  TYPED_ATTRIBUTE_H
+#define  TYPED_ATTRIBUTE_H
+
+#include <genometools.h>
+#include <stddef.h>
+
+#define TYPED_ATTRIBUTE_MAX_KEYS   64
+#define TYPED_ATTRIBUTE_PER_NODE   8
+#define TYPED_ATTRIBUTE_FLOAT_MAX  32   // buffer size for typed_attribute_format_float
+
+typedef int typed_attribute_key;
+
+typedef struct
+{
+    typed_attribute_key key;
+    float               value;
+} typed_attribute_t;
+
+// returns the key for name, the same for every call with an equal name.
+// name must stay valid for the life of the process (a literal).  Thread
+// safe, asserts that fewer than TYPED_ATTRIBUTE_MAX_KEYS names are taken.
+typed_attribute_key typed_attribute_intern(const char * name);
+
+// the name of key, and its length if length isn't NULL
+const char * typed_attribute_name(typed_attribute_key key, size_t * length);
+
+void typed_attribute_enable(void);
+int typed_attribute_enabled(void);
+
+// set key to value on fn, replacing any value it had, typed or text
+void typed_attribute_set(GtFeatureNode * fn, typed_attribute_key key, float value);
+
+// the typed values on fn, in the order they were first set
+unsigned int typed_attribute_list(GtFeatureNode * fn, const typed_attribute_t ** list);
+
+// writes value into buffer (TYPED_ATTRIBUTE_FLOAT_MAX bytes) as the
+// shortest decimal that reads back as value, without a terminating NUL.
+// Returns the length.
+int typed_attribute_format_float(char * buffer, float value);
+
+#endif